@@ -1346,7 +1346,11 @@ static int ctdb_vacuum_and_repack_db(struct ctdb_db_context *ctdb_db,
 	DEBUG(DEBUG_INFO, ("Repacking %s with %u freelist entries\n",
 			   name, freelist_size));
 
-	ret = tdb_repack(ctdb_db->ltdb->tdb);
+	/*
+	 * Only lock one chain at a time, clients can keep
+	 * accessing the database while we repack.
+	 */
+	ret = tdb_compact(ctdb_db->ltdb->tdb, 0);
 	if (ret != 0) {
 		DEBUG(DEBUG_ERR,(__location__ " Failed to repack '%s'\n", name));
 		return -1;
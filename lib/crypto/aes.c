@@ -33,6 +33,7 @@
 
 #include "replace.h"
 #include "aes.h"
+#include "aesni.h"
 
 #ifdef SAMBA_RIJNDAEL
 #include "rijndael-alg-fst.h"
@@ -43,6 +44,8 @@ AES_set_encrypt_key(const unsigned char *userkey, const int bits, AES_KEY *key)
     key->rounds = rijndaelKeySetupEnc(key->key, userkey, bits);
     if (key->rounds == 0)
 	return -1;
+    if (samba_aesni_available())
+	samba_aesni_key_convert(key);
     return 0;
 }
 
@@ -52,18 +55,28 @@ AES_set_decrypt_key(const unsigned char *userkey, const int bits, AES_KEY *key)
     key->rounds = rijndaelKeySetupDec(key->key, userkey, bits);
     if (key->rounds == 0)
 	return -1;
+    if (samba_aesni_available())
+	samba_aesni_key_convert(key);
     return 0;
 }
 
 void
 AES_encrypt(const unsigned char *in, unsigned char *out, const AES_KEY *key)
 {
+    if (samba_aesni_available()) {
+	samba_aesni_encrypt(key, in, out);
+	return;
+    }
     rijndaelEncrypt(key->key, key->rounds, in, out);
 }
 
 void
 AES_decrypt(const unsigned char *in, unsigned char *out, const AES_KEY *key)
 {
+    if (samba_aesni_available()) {
+	samba_aesni_decrypt(key, in, out);
+	return;
+    }
     rijndaelDecrypt(key->key, key->rounds, in, out);
 }
 #endif /* SAMBA_RIJNDAEL */
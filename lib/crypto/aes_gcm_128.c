@@ -19,6 +19,7 @@
 
 #include "replace.h"
 #include "../lib/crypto/crypto.h"
+#include "../lib/crypto/aesni.h"
 #include "lib/util/byteorder.h"
 
 static inline void aes_gcm_128_inc32(uint8_t inout[AES_BLOCK_SIZE])
@@ -30,6 +31,15 @@ static inline void aes_gcm_128_inc32(uint8_t inout[AES_BLOCK_SIZE])
 	RSIVAL(inout, AES_BLOCK_SIZE - 4, v);
 }
 
+static inline void aes_gcm_128_dec32(uint8_t inout[AES_BLOCK_SIZE])
+{
+	uint32_t v;
+
+	v = RIVAL(inout, AES_BLOCK_SIZE - 4);
+	v -= 1;
+	RSIVAL(inout, AES_BLOCK_SIZE - 4, v);
+}
+
 static inline void aes_gcm_128_mul(const uint8_t x[AES_BLOCK_SIZE],
 				   const uint8_t y[AES_BLOCK_SIZE],
 				   uint8_t v[AES_BLOCK_SIZE],
@@ -67,6 +77,10 @@ static inline void aes_gcm_128_ghash_block(struct aes_gcm_128_context *ctx,
 					   const uint8_t in[AES_BLOCK_SIZE])
 {
 	aes_block_xor(ctx->Y, in, ctx->y.block);
+	if (samba_clmul_available()) {
+		samba_clmul_gcm_mul(ctx->y.block, ctx->H, ctx->Y);
+		return;
+	}
 	aes_gcm_128_mul(ctx->y.block, ctx->H, ctx->v.block, ctx->Y);
 }
 
@@ -183,6 +197,95 @@ void aes_gcm_128_crypt(struct aes_gcm_128_context *ctx,
 	aes_gcm_128_crypt_tmp(ctx, &ctx->c, m, m_len);
 }
 
+/*
+ * Counter mode and GHASH over the same data in a single pass.
+ * The cipher text is hashed, so encrypt hashes after and
+ * decrypt hashes before the xor.
+ */
+static void aes_gcm_128_crypt_update(struct aes_gcm_128_context *ctx,
+				     uint8_t *m, size_t m_len,
+				     bool encrypt)
+{
+	size_t num_blocks = m_len / AES_BLOCK_SIZE;
+	size_t len = num_blocks * AES_BLOCK_SIZE;
+
+	if (ctx->A.ofs > 0) {
+		aes_gcm_128_ghash_block(ctx, ctx->A.block);
+		ctx->A.ofs = 0;
+	}
+
+	if (ctx->C.ofs != 0 ||
+	    (ctx->c.ofs != 0 && ctx->c.ofs != AES_BLOCK_SIZE)) {
+		/*
+		 * Not on a block boundary, only happens
+		 * if the caller passed in unaligned iovecs.
+		 */
+		len = 0;
+	}
+
+	if (len > 0) {
+		if (ctx->c.ofs == 0) {
+			/*
+			 * aes_gcm_128_crypt_tmp() already generated
+			 * the key stream for the current CB,
+			 * we generate it again below.
+			 */
+			aes_gcm_128_dec32(ctx->CB);
+		}
+		ctx->c.ofs = AES_BLOCK_SIZE;
+		ctx->c.total += len;
+		ctx->C.total += len;
+
+		if (samba_aesni_available() && samba_clmul_available()) {
+			samba_aesni_gcm_crypt_blocks(&ctx->aes_key, ctx->H,
+						     ctx->CB, ctx->Y,
+						     m, num_blocks, encrypt);
+		} else {
+			uint8_t *b;
+
+			for (b = m; b < m + len; b += AES_BLOCK_SIZE) {
+				aes_gcm_128_inc32(ctx->CB);
+				AES_encrypt(ctx->CB, ctx->c.block,
+					    &ctx->aes_key);
+				if (!encrypt) {
+					aes_gcm_128_ghash_block(ctx, b);
+				}
+				aes_block_xor(b, ctx->c.block, b);
+				if (encrypt) {
+					aes_gcm_128_ghash_block(ctx, b);
+				}
+			}
+		}
+
+		m += len;
+		m_len -= len;
+	}
+
+	if (m_len == 0) {
+		return;
+	}
+
+	if (encrypt) {
+		aes_gcm_128_crypt_tmp(ctx, &ctx->c, m, m_len);
+		aes_gcm_128_update_tmp(ctx, &ctx->C, m, m_len);
+	} else {
+		aes_gcm_128_update_tmp(ctx, &ctx->C, m, m_len);
+		aes_gcm_128_crypt_tmp(ctx, &ctx->c, m, m_len);
+	}
+}
+
+void aes_gcm_128_encrypt(struct aes_gcm_128_context *ctx,
+			 uint8_t *m, size_t m_len)
+{
+	aes_gcm_128_crypt_update(ctx, m, m_len, true);
+}
+
+void aes_gcm_128_decrypt(struct aes_gcm_128_context *ctx,
+			 uint8_t *m, size_t m_len)
+{
+	aes_gcm_128_crypt_update(ctx, m, m_len, false);
+}
+
 void aes_gcm_128_digest(struct aes_gcm_128_context *ctx,
 			uint8_t T[AES_BLOCK_SIZE])
 {
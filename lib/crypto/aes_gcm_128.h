@@ -49,6 +49,15 @@ void aes_gcm_128_updateC(struct aes_gcm_128_context *ctx,
 			 const uint8_t *c, size_t c_len);
 void aes_gcm_128_crypt(struct aes_gcm_128_context *ctx,
 		       uint8_t *m, size_t m_len);
+/*
+ * Same as aes_gcm_128_crypt() followed by aes_gcm_128_updateC()
+ * (encrypt) or the other way round (decrypt), but with
+ * a single pass over m.
+ */
+void aes_gcm_128_encrypt(struct aes_gcm_128_context *ctx,
+			 uint8_t *m, size_t m_len);
+void aes_gcm_128_decrypt(struct aes_gcm_128_context *ctx,
+			 uint8_t *m, size_t m_len);
 void aes_gcm_128_digest(struct aes_gcm_128_context *ctx,
 			uint8_t T[AES_BLOCK_SIZE]);
 
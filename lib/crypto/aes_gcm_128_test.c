@@ -217,6 +217,79 @@ bool torture_local_crypto_aes_gcm_128(struct torture_context *tctx)
 		}
 	}
 
+	for (i=0; i < ARRAY_SIZE(testarray); i++) {
+		struct aes_gcm_128_context ctx;
+		uint8_t T[AES_BLOCK_SIZE];
+		DATA_BLOB _T = data_blob_const(T, sizeof(T));
+		DATA_BLOB C;
+		int e;
+		size_t j;
+
+		C = data_blob_dup_talloc(tctx, testarray[i].P);
+
+		aes_gcm_128_init(&ctx, testarray[i].K.data, testarray[i].N.data);
+		aes_gcm_128_updateA(&ctx,
+				    testarray[i].A.data,
+				    testarray[i].A.length);
+		/*
+		 * mix the single pass and the two pass functions
+		 */
+		j = MIN(C.length, AES_BLOCK_SIZE);
+		aes_gcm_128_crypt(&ctx, C.data, j);
+		aes_gcm_128_updateC(&ctx, C.data, j);
+		aes_gcm_128_encrypt(&ctx, C.data + j, C.length - j);
+		aes_gcm_128_digest(&ctx, T);
+
+		e = memcmp(testarray[i].T.data, T, sizeof(T));
+		if (e != 0) {
+			aes_mode_testvector_debug(&testarray[i], NULL, &C, &_T);
+			ret = false;
+			goto fail;
+		}
+
+		e = memcmp(testarray[i].C.data, C.data, C.length);
+		if (e != 0) {
+			aes_mode_testvector_debug(&testarray[i], NULL, &C, &_T);
+			ret = false;
+			goto fail;
+		}
+	}
+
+	for (i=0; i < ARRAY_SIZE(testarray); i++) {
+		struct aes_gcm_128_context ctx;
+		uint8_t T[AES_BLOCK_SIZE];
+		DATA_BLOB _T = data_blob_const(T, sizeof(T));
+		DATA_BLOB P;
+		int e;
+		size_t j;
+
+		P = data_blob_dup_talloc(tctx, testarray[i].C);
+
+		aes_gcm_128_init(&ctx, testarray[i].K.data, testarray[i].N.data);
+		aes_gcm_128_updateA(&ctx,
+				    testarray[i].A.data,
+				    testarray[i].A.length);
+		for (j=0; j < P.length; j += 17) {
+			aes_gcm_128_decrypt(&ctx, &P.data[j],
+					    MIN(17, P.length - j));
+		}
+		aes_gcm_128_digest(&ctx, T);
+
+		e = memcmp(testarray[i].T.data, T, sizeof(T));
+		if (e != 0) {
+			aes_mode_testvector_debug(&testarray[i], &P, NULL, &_T);
+			ret = false;
+			goto fail;
+		}
+
+		e = memcmp(testarray[i].P.data, P.data, P.length);
+		if (e != 0) {
+			aes_mode_testvector_debug(&testarray[i], &P, NULL, &_T);
+			ret = false;
+			goto fail;
+		}
+	}
+
 	for (i=0; i < ARRAY_SIZE(testarray); i++) {
 		struct aes_gcm_128_context ctx;
 		uint8_t T[AES_BLOCK_SIZE];
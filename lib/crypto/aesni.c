@@ -0,0 +1,320 @@
+/*
+   AES-NI and PCLMULQDQ accelerated AES block and GHASH primitives
+
+   Copyright (C) Samba Team 2026
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "replace.h"
+#include "../lib/crypto/aes.h"
+#include "../lib/crypto/aesni.h"
+#include "lib/util/byteorder.h"
+
+#include <cpuid.h>
+#include <wmmintrin.h>
+#include <tmmintrin.h>
+
+/*
+ * The functions using the special instructions are compiled with
+ * target attributes, so the rest of the library does not depend on
+ * -maes/-mpclmul and still runs on CPUs without them.
+ */
+#define AESNI_TARGET __attribute__((target("aes,sse2")))
+#define CLMUL_TARGET __attribute__((target("pclmul,ssse3,sse2")))
+#define GCM_TARGET __attribute__((target("aes,pclmul,ssse3,sse2")))
+
+static int aesni_cpu = -1;
+static int clmul_cpu = -1;
+static bool accel_enabled = true;
+
+static void samba_aes_cpu_detect(void)
+{
+	unsigned int eax = 0, ebx = 0, ecx = 0, edx = 0;
+
+	aesni_cpu = 0;
+	clmul_cpu = 0;
+
+	if (__get_cpuid(1, &eax, &ebx, &ecx, &edx) == 0) {
+		return;
+	}
+
+	if ((ecx & bit_AES) && (edx & bit_SSE2)) {
+		aesni_cpu = 1;
+	}
+	if ((ecx & bit_PCLMUL) && (ecx & bit_SSSE3) && (edx & bit_SSE2)) {
+		clmul_cpu = 1;
+	}
+}
+
+bool samba_aesni_available(void)
+{
+	if (unlikely(aesni_cpu == -1)) {
+		samba_aes_cpu_detect();
+	}
+	return accel_enabled && (aesni_cpu == 1);
+}
+
+bool samba_clmul_available(void)
+{
+	if (unlikely(clmul_cpu == -1)) {
+		samba_aes_cpu_detect();
+	}
+	return accel_enabled && (clmul_cpu == 1);
+}
+
+void samba_aes_accel_set_enabled(bool enabled)
+{
+	accel_enabled = enabled;
+}
+
+void samba_aesni_key_convert(AES_KEY *key)
+{
+	uint8_t *p = (uint8_t *)key->key;
+	int i;
+
+	/*
+	 * rijndael-alg-fst.c keeps the round keys as host order
+	 * 32-bit words built from big endian bytes. AESENC wants the
+	 * plain bytes, which is just the big endian representation
+	 * of those words. The decryption schedule from
+	 * rijndaelKeySetupDec() already is the "equivalent inverse
+	 * cipher" schedule AESDEC needs.
+	 */
+	for (i = 0; i < 4 * (key->rounds + 1); i++) {
+		uint32_t w = key->key[i];
+		RSIVAL(p, i * 4, w);
+	}
+}
+
+AESNI_TARGET
+void samba_aesni_encrypt(const AES_KEY *key,
+			 const uint8_t in[AES_BLOCK_SIZE],
+			 uint8_t out[AES_BLOCK_SIZE])
+{
+	const __m128i *rk = (const __m128i *)key->key;
+	__m128i m;
+	int i;
+
+	m = _mm_loadu_si128((const __m128i *)in);
+	m = _mm_xor_si128(m, _mm_loadu_si128(&rk[0]));
+	for (i = 1; i < key->rounds; i++) {
+		m = _mm_aesenc_si128(m, _mm_loadu_si128(&rk[i]));
+	}
+	m = _mm_aesenclast_si128(m, _mm_loadu_si128(&rk[i]));
+	_mm_storeu_si128((__m128i *)out, m);
+}
+
+AESNI_TARGET
+void samba_aesni_decrypt(const AES_KEY *key,
+			 const uint8_t in[AES_BLOCK_SIZE],
+			 uint8_t out[AES_BLOCK_SIZE])
+{
+	const __m128i *rk = (const __m128i *)key->key;
+	__m128i m;
+	int i;
+
+	m = _mm_loadu_si128((const __m128i *)in);
+	m = _mm_xor_si128(m, _mm_loadu_si128(&rk[0]));
+	for (i = 1; i < key->rounds; i++) {
+		m = _mm_aesdec_si128(m, _mm_loadu_si128(&rk[i]));
+	}
+	m = _mm_aesdeclast_si128(m, _mm_loadu_si128(&rk[i]));
+	_mm_storeu_si128((__m128i *)out, m);
+}
+
+/*
+ * Carry-less multiplication and reduction modulo
+ * x^128 + x^7 + x^2 + x + 1 for byte reversed GCM operands, see
+ * "Intel Carry-Less Multiplication Instruction and its Usage for
+ * Computing the GCM Mode", algorithms 1, 4 and 5.
+ */
+static inline CLMUL_TARGET __m128i clmul_gcm_mul_reflected(__m128i a,
+							  __m128i b)
+{
+	__m128i lo, mid, hi, t, t2, t3;
+
+	/* 256 bit product hi:lo */
+	lo = _mm_clmulepi64_si128(a, b, 0x00);
+	mid = _mm_xor_si128(_mm_clmulepi64_si128(a, b, 0x10),
+			    _mm_clmulepi64_si128(a, b, 0x01));
+	hi = _mm_clmulepi64_si128(a, b, 0x11);
+	lo = _mm_xor_si128(lo, _mm_slli_si128(mid, 8));
+	hi = _mm_xor_si128(hi, _mm_srli_si128(mid, 8));
+
+	/* shift hi:lo left by one bit, GCM uses reflected bit order */
+	t = _mm_srli_epi32(lo, 31);
+	t2 = _mm_srli_epi32(hi, 31);
+	lo = _mm_slli_epi32(lo, 1);
+	hi = _mm_slli_epi32(hi, 1);
+	t3 = _mm_srli_si128(t, 12);
+	t2 = _mm_slli_si128(t2, 4);
+	t = _mm_slli_si128(t, 4);
+	lo = _mm_or_si128(lo, t);
+	hi = _mm_or_si128(hi, t2);
+	hi = _mm_or_si128(hi, t3);
+
+	/* reduction, first phase */
+	t = _mm_xor_si128(_mm_slli_epi32(lo, 31), _mm_slli_epi32(lo, 30));
+	t = _mm_xor_si128(t, _mm_slli_epi32(lo, 25));
+	t2 = _mm_srli_si128(t, 4);
+	t = _mm_slli_si128(t, 12);
+	lo = _mm_xor_si128(lo, t);
+
+	/* reduction, second phase */
+	t = _mm_xor_si128(_mm_srli_epi32(lo, 1), _mm_srli_epi32(lo, 2));
+	t = _mm_xor_si128(t, _mm_srli_epi32(lo, 7));
+	t = _mm_xor_si128(t, t2);
+	lo = _mm_xor_si128(lo, t);
+
+	return _mm_xor_si128(hi, lo);
+}
+
+#define BSWAP_MASK _mm_set_epi8(0, 1, 2, 3, 4, 5, 6, 7, \
+				8, 9, 10, 11, 12, 13, 14, 15)
+
+CLMUL_TARGET
+void samba_clmul_gcm_mul(const uint8_t x[AES_BLOCK_SIZE],
+			 const uint8_t h[AES_BLOCK_SIZE],
+			 uint8_t z[AES_BLOCK_SIZE])
+{
+	const __m128i bswap = BSWAP_MASK;
+	__m128i a, b;
+
+	a = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)x), bswap);
+	b = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)h), bswap);
+
+	a = clmul_gcm_mul_reflected(a, b);
+
+	_mm_storeu_si128((__m128i *)z, _mm_shuffle_epi8(a, bswap));
+}
+
+/*
+ * Counter mode encryption and GHASH of whole blocks in a single pass,
+ * four AES blocks are kept in flight to hide the AESENC latency.
+ */
+GCM_TARGET
+void samba_aesni_gcm_crypt_blocks(const AES_KEY *key,
+				  const uint8_t H[AES_BLOCK_SIZE],
+				  uint8_t CB[AES_BLOCK_SIZE],
+				  uint8_t Y[AES_BLOCK_SIZE],
+				  uint8_t *m, size_t num_blocks,
+				  bool encrypt)
+{
+	const __m128i bswap = BSWAP_MASK;
+	const __m128i one = _mm_set_epi32(0, 0, 0, 1);
+	const __m128i *_rk = (const __m128i *)key->key;
+	__m128i rk[AES_MAXNR + 1];
+	__m128i h, y, ctr;
+	int rounds = key->rounds;
+	int r;
+
+	for (r = 0; r <= rounds; r++) {
+		rk[r] = _mm_loadu_si128(&_rk[r]);
+	}
+
+	h = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)H), bswap);
+	y = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)Y), bswap);
+	/*
+	 * The 32 bit big endian counter ends up in the lowest lane,
+	 * so _mm_add_epi32() is exactly inc32() from the GCM spec.
+	 */
+	ctr = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)CB), bswap);
+
+	for (; num_blocks >= 4; num_blocks -= 4, m += 4 * AES_BLOCK_SIZE) {
+		__m128i *p = (__m128i *)m;
+		__m128i k0, k1, k2, k3;
+		__m128i d0, d1, d2, d3;
+
+		ctr = _mm_add_epi32(ctr, one);
+		k0 = _mm_xor_si128(_mm_shuffle_epi8(ctr, bswap), rk[0]);
+		ctr = _mm_add_epi32(ctr, one);
+		k1 = _mm_xor_si128(_mm_shuffle_epi8(ctr, bswap), rk[0]);
+		ctr = _mm_add_epi32(ctr, one);
+		k2 = _mm_xor_si128(_mm_shuffle_epi8(ctr, bswap), rk[0]);
+		ctr = _mm_add_epi32(ctr, one);
+		k3 = _mm_xor_si128(_mm_shuffle_epi8(ctr, bswap), rk[0]);
+
+		for (r = 1; r < rounds; r++) {
+			k0 = _mm_aesenc_si128(k0, rk[r]);
+			k1 = _mm_aesenc_si128(k1, rk[r]);
+			k2 = _mm_aesenc_si128(k2, rk[r]);
+			k3 = _mm_aesenc_si128(k3, rk[r]);
+		}
+		k0 = _mm_aesenclast_si128(k0, rk[r]);
+		k1 = _mm_aesenclast_si128(k1, rk[r]);
+		k2 = _mm_aesenclast_si128(k2, rk[r]);
+		k3 = _mm_aesenclast_si128(k3, rk[r]);
+
+		d0 = _mm_loadu_si128(&p[0]);
+		d1 = _mm_loadu_si128(&p[1]);
+		d2 = _mm_loadu_si128(&p[2]);
+		d3 = _mm_loadu_si128(&p[3]);
+
+		k0 = _mm_xor_si128(k0, d0);
+		k1 = _mm_xor_si128(k1, d1);
+		k2 = _mm_xor_si128(k2, d2);
+		k3 = _mm_xor_si128(k3, d3);
+
+		_mm_storeu_si128(&p[0], k0);
+		_mm_storeu_si128(&p[1], k1);
+		_mm_storeu_si128(&p[2], k2);
+		_mm_storeu_si128(&p[3], k3);
+
+		/*
+		 * GHASH always runs over the cipher text
+		 */
+		if (encrypt) {
+			d0 = k0;
+			d1 = k1;
+			d2 = k2;
+			d3 = k3;
+		}
+
+		y = _mm_xor_si128(y, _mm_shuffle_epi8(d0, bswap));
+		y = clmul_gcm_mul_reflected(y, h);
+		y = _mm_xor_si128(y, _mm_shuffle_epi8(d1, bswap));
+		y = clmul_gcm_mul_reflected(y, h);
+		y = _mm_xor_si128(y, _mm_shuffle_epi8(d2, bswap));
+		y = clmul_gcm_mul_reflected(y, h);
+		y = _mm_xor_si128(y, _mm_shuffle_epi8(d3, bswap));
+		y = clmul_gcm_mul_reflected(y, h);
+	}
+
+	for (; num_blocks > 0; num_blocks -= 1, m += AES_BLOCK_SIZE) {
+		__m128i *p = (__m128i *)m;
+		__m128i k0, d0;
+
+		ctr = _mm_add_epi32(ctr, one);
+		k0 = _mm_xor_si128(_mm_shuffle_epi8(ctr, bswap), rk[0]);
+		for (r = 1; r < rounds; r++) {
+			k0 = _mm_aesenc_si128(k0, rk[r]);
+		}
+		k0 = _mm_aesenclast_si128(k0, rk[r]);
+
+		d0 = _mm_loadu_si128(p);
+		k0 = _mm_xor_si128(k0, d0);
+		_mm_storeu_si128(p, k0);
+
+		if (encrypt) {
+			d0 = k0;
+		}
+
+		y = _mm_xor_si128(y, _mm_shuffle_epi8(d0, bswap));
+		y = clmul_gcm_mul_reflected(y, h);
+	}
+
+	_mm_storeu_si128((__m128i *)CB, _mm_shuffle_epi8(ctr, bswap));
+	_mm_storeu_si128((__m128i *)Y, _mm_shuffle_epi8(y, bswap));
+}
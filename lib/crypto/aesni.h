@@ -0,0 +1,129 @@
+/*
+   AES-NI and PCLMULQDQ accelerated AES block and GHASH primitives
+
+   Copyright (C) Samba Team 2026
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef LIB_CRYPTO_AESNI_H
+#define LIB_CRYPTO_AESNI_H
+
+/*
+ * The CPU features are detected once at runtime. If they are not
+ * there, or the compiler can't generate the instructions, everything
+ * falls back to the table driven rijndael-alg-fst.c code and the
+ * generic GHASH multiplication.
+ */
+
+#ifdef HAVE_AESNI_INTRINSICS
+
+bool samba_aesni_available(void);
+bool samba_clmul_available(void);
+
+/*
+ * Only meant for tests and benchmarks: switch all AES_* and
+ * aes_gcm_128_* functions between the accelerated and the generic
+ * implementation. Keys scheduled before the switch must not be used
+ * afterwards, the key schedule layout differs.
+ */
+void samba_aes_accel_set_enabled(bool enabled);
+
+/*
+ * Convert a rijndaelKeySetupEnc/Dec() schedule in place into the
+ * byte layout the AESENC/AESDEC instructions expect.
+ */
+void samba_aesni_key_convert(AES_KEY *key);
+
+void samba_aesni_encrypt(const AES_KEY *key,
+			 const uint8_t in[AES_BLOCK_SIZE],
+			 uint8_t out[AES_BLOCK_SIZE]);
+void samba_aesni_decrypt(const AES_KEY *key,
+			 const uint8_t in[AES_BLOCK_SIZE],
+			 uint8_t out[AES_BLOCK_SIZE]);
+
+/*
+ * z = x * h in GF(2^128) with the bit order used by GCM.
+ */
+void samba_clmul_gcm_mul(const uint8_t x[AES_BLOCK_SIZE],
+			 const uint8_t h[AES_BLOCK_SIZE],
+			 uint8_t z[AES_BLOCK_SIZE]);
+
+/*
+ * AES-GCM counter mode and GHASH over num_blocks whole blocks of m
+ * in place, using the AES-NI key schedule. CB is incremented before
+ * each block, Y is the running GHASH value. Needs both AES-NI and
+ * PCLMULQDQ.
+ */
+void samba_aesni_gcm_crypt_blocks(const AES_KEY *key,
+				  const uint8_t H[AES_BLOCK_SIZE],
+				  uint8_t CB[AES_BLOCK_SIZE],
+				  uint8_t Y[AES_BLOCK_SIZE],
+				  uint8_t *m, size_t num_blocks,
+				  bool encrypt);
+
+#else /* HAVE_AESNI_INTRINSICS */
+
+static inline bool samba_aesni_available(void)
+{
+	return false;
+}
+
+static inline bool samba_clmul_available(void)
+{
+	return false;
+}
+
+static inline void samba_aes_accel_set_enabled(bool enabled)
+{
+}
+
+static inline void samba_aesni_key_convert(AES_KEY *key)
+{
+}
+
+static inline void samba_aesni_encrypt(const AES_KEY *key,
+				       const uint8_t in[AES_BLOCK_SIZE],
+				       uint8_t out[AES_BLOCK_SIZE])
+{
+	abort();
+}
+
+static inline void samba_aesni_decrypt(const AES_KEY *key,
+				       const uint8_t in[AES_BLOCK_SIZE],
+				       uint8_t out[AES_BLOCK_SIZE])
+{
+	abort();
+}
+
+static inline void samba_clmul_gcm_mul(const uint8_t x[AES_BLOCK_SIZE],
+				       const uint8_t h[AES_BLOCK_SIZE],
+				       uint8_t z[AES_BLOCK_SIZE])
+{
+	abort();
+}
+
+static inline void samba_aesni_gcm_crypt_blocks(const AES_KEY *key,
+						const uint8_t H[AES_BLOCK_SIZE],
+						uint8_t CB[AES_BLOCK_SIZE],
+						uint8_t Y[AES_BLOCK_SIZE],
+						uint8_t *m, size_t num_blocks,
+						bool encrypt)
+{
+	abort();
+}
+
+#endif /* HAVE_AESNI_INTRINSICS */
+
+#endif /* LIB_CRYPTO_AESNI_H */
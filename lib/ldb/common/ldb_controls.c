@@ -347,6 +347,28 @@ char *ldb_control_to_string(TALLOC_CTX *mem_ctx, const struct ldb_control *contr
 		return res;
 	}
 
+	if (strcmp(control->oid, LDB_CONTROL_DN_CACHE_STATS_OID) == 0) {
+		struct ldb_dn_cache_stats_control *rep_control = talloc_get_type(control->data,
+								struct ldb_dn_cache_stats_control);
+
+		if (rep_control == NULL) {
+			return talloc_asprintf(mem_ctx, "%s:%d",
+					LDB_CONTROL_DN_CACHE_STATS_NAME,
+					control->critical);
+		}
+		res = talloc_asprintf(mem_ctx, "%s:%d:%llu:%llu:%llu:%llu:%u:%u",
+					LDB_CONTROL_DN_CACHE_STATS_NAME,
+					control->critical,
+					(unsigned long long)rep_control->hits,
+					(unsigned long long)rep_control->misses,
+					(unsigned long long)rep_control->evictions,
+					(unsigned long long)rep_control->flushes,
+					rep_control->entries,
+					rep_control->max_entries);
+
+		return res;
+	}
+
 	if (strcmp(control->oid, LDB_CONTROL_DIRSYNC_OID) == 0) {
 		char *cookie;
 		struct ldb_dirsync_control *rep_control = talloc_get_type(control->data,
@@ -1026,6 +1048,29 @@ struct ldb_control *ldb_parse_control_from_string(struct ldb_context *ldb, TALLO
 		return ctrl;
 	}
 
+	if (LDB_CONTROL_CMP(control_strings, LDB_CONTROL_DN_CACHE_STATS_NAME) == 0) {
+		const char *p;
+		int crit, ret;
+
+		p = &(control_strings[sizeof(LDB_CONTROL_DN_CACHE_STATS_NAME)]);
+		ret = sscanf(p, "%d", &crit);
+		if ((ret != 1) || (crit < 0) || (crit > 1)) {
+			error_string = talloc_asprintf(mem_ctx, "invalid dn_cache_stats control syntax\n");
+			error_string = talloc_asprintf_append(error_string, " syntax: crit(b)\n");
+			error_string = talloc_asprintf_append(error_string, "   note: b = boolean");
+			ldb_set_errstring(ldb, error_string);
+			talloc_free(error_string);
+			talloc_free(ctrl);
+			return NULL;
+		}
+
+		ctrl->oid = LDB_CONTROL_DN_CACHE_STATS_OID;
+		ctrl->critical = crit;
+		ctrl->data = NULL;
+
+		return ctrl;
+	}
+
 	if (strncmp(control_strings, "local_oid:", 10) == 0) {
 		const char *p;
 		int crit = 0, ret = 0;
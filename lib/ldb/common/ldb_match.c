@@ -76,29 +76,104 @@ static int ldb_match_scope(struct ldb_context *ldb,
 }
 
 
+/*
+  a compiled search filter
+
+  The parse tree is flattened into an array of operations in prefix
+  order, each knowing where its subtree ends. The schema attribute of
+  every leaf, the values of dn=... matches and the substring chunks are
+  looked up and canonicalised once here, not once per record.
+*/
+struct ldb_match_op {
+	const struct ldb_parse_tree *tree;
+
+	/* the first operation after the subtree of this one */
+	unsigned int next;
+
+	const char *attr;
+	const struct ldb_schema_attribute *a;
+
+	/* the attribute is "dn", matched against the dn of the record */
+	bool match_dn;
+
+	/*
+	 * the dn of a dn=... match, or the parsed assertion value of
+	 * the standard DN syntax
+	 */
+	struct ldb_dn *dn;
+	bool dn_syntax;
+	bool dn_valid;
+
+	/*
+	 * the canonicalised substring chunks, num_chunks is where
+	 * canonicalising a chunk failed, if it did. Without compiled
+	 * the chunks are canonicalised while matching.
+	 */
+	bool compiled;
+	struct ldb_val *chunks;
+	unsigned int num_chunks;
+
+	const struct ldb_extended_match_rule *rule;
+
+	/* an error to return whenever this operation is evaluated */
+	int error;
+};
+
+struct ldb_match_program {
+	struct ldb_context *ldb;
+	unsigned int num_ops;
+	struct ldb_match_op *ops;
+};
+
+/*
+  compare a value of the standard DN syntax with the parsed assertion
+  value, the way ldb_comparison_dn() does
+*/
+static int ldb_match_dn_syntax(struct ldb_context *ldb,
+			       const struct ldb_match_op *op,
+			       const struct ldb_val *value)
+{
+	struct ldb_dn *dn;
+	int ret;
+
+	if (!op->dn_valid) {
+		return -1;
+	}
+
+	dn = ldb_dn_from_ldb_val(ldb, ldb, value);
+	if ( ! ldb_dn_validate(dn)) {
+		talloc_free(dn);
+		return -1;
+	}
+
+	ret = ldb_dn_compare(dn, op->dn);
+
+	talloc_free(dn);
+	return ret;
+}
+
 /*
   match if node is present
 */
 static int ldb_match_present(struct ldb_context *ldb, 
 			     const struct ldb_message *msg,
-			     const struct ldb_parse_tree *tree,
-			     enum ldb_scope scope, bool *matched)
+			     const struct ldb_match_op *op,
+			     bool *matched)
 {
-	const struct ldb_schema_attribute *a;
+	const struct ldb_schema_attribute *a = op->a;
 	struct ldb_message_element *el;
 
-	if (ldb_attr_dn(tree->u.present.attr) == 0) {
+	if (op->match_dn) {
 		*matched = true;
 		return LDB_SUCCESS;
 	}
 
-	el = ldb_msg_find_element(msg, tree->u.present.attr);
+	el = ldb_msg_find_element(msg, op->attr);
 	if (el == NULL) {
 		*matched = false;
 		return LDB_SUCCESS;
 	}
 
-	a = ldb_schema_attribute_by_name(ldb, el->name);
 	if (!a) {
 		return LDB_ERR_INVALID_ATTRIBUTE_SYNTAX;
 	}
@@ -120,26 +195,25 @@ static int ldb_match_present(struct ldb_context *ldb,
 
 static int ldb_match_comparison(struct ldb_context *ldb, 
 				const struct ldb_message *msg,
-				const struct ldb_parse_tree *tree,
-				enum ldb_scope scope,
+				const struct ldb_match_op *op,
 				enum ldb_parse_op comp_op, bool *matched)
 {
 	unsigned int i;
 	struct ldb_message_element *el;
-	const struct ldb_schema_attribute *a;
+	const struct ldb_schema_attribute *a = op->a;
+	const struct ldb_val *value = &op->tree->u.comparison.value;
 
 	/* FIXME: APPROX comparison not handled yet */
 	if (comp_op == LDB_OP_APPROX) {
 		return LDB_ERR_INAPPROPRIATE_MATCHING;
 	}
 
-	el = ldb_msg_find_element(msg, tree->u.comparison.attr);
+	el = ldb_msg_find_element(msg, op->attr);
 	if (el == NULL) {
 		*matched = false;
 		return LDB_SUCCESS;
 	}
 
-	a = ldb_schema_attribute_by_name(ldb, el->name);
 	if (!a) {
 		return LDB_ERR_INVALID_ATTRIBUTE_SYNTAX;
 	}
@@ -147,11 +221,17 @@ static int ldb_match_comparison(struct ldb_context *ldb,
 	for (i = 0; i < el->num_values; i++) {
 		if (a->syntax->operator_fn) {
 			int ret;
-			ret = a->syntax->operator_fn(ldb, comp_op, a, &el->values[i], &tree->u.comparison.value, matched);
+			ret = a->syntax->operator_fn(ldb, comp_op, a, &el->values[i], value, matched);
 			if (ret != LDB_SUCCESS) return ret;
 			if (*matched) return LDB_SUCCESS;
 		} else {
-			int ret = a->syntax->comparison_fn(ldb, ldb, &el->values[i], &tree->u.comparison.value);
+			int ret;
+
+			if (op->dn_syntax) {
+				ret = ldb_match_dn_syntax(ldb, op, &el->values[i]);
+			} else {
+				ret = a->syntax->comparison_fn(ldb, ldb, &el->values[i], value);
+			}
 
 			if (ret == 0) {
 				*matched = true;
@@ -177,25 +257,17 @@ static int ldb_match_comparison(struct ldb_context *ldb,
 */
 static int ldb_match_equality(struct ldb_context *ldb, 
 			      const struct ldb_message *msg,
-			      const struct ldb_parse_tree *tree,
-			      enum ldb_scope scope,
+			      const struct ldb_match_op *op,
 			      bool *matched)
 {
 	unsigned int i;
 	struct ldb_message_element *el;
-	const struct ldb_schema_attribute *a;
-	struct ldb_dn *valuedn;
+	const struct ldb_schema_attribute *a = op->a;
+	const struct ldb_val *value = &op->tree->u.equality.value;
 	int ret;
 
-	if (ldb_attr_dn(tree->u.equality.attr) == 0) {
-		valuedn = ldb_dn_from_ldb_val(ldb, ldb, &tree->u.equality.value);
-		if (valuedn == NULL) {
-			return LDB_ERR_INVALID_DN_SYNTAX;
-		}
-
-		ret = ldb_dn_compare(msg->dn, valuedn);
-
-		talloc_free(valuedn);
+	if (op->match_dn) {
+		ret = ldb_dn_compare(msg->dn, op->dn);
 
 		*matched = (ret == 0);
 		return LDB_SUCCESS;
@@ -203,13 +275,12 @@ static int ldb_match_equality(struct ldb_context *ldb,
 
 	/* TODO: handle the "*" case derived from an extended search
 	   operation without the attibute type defined */
-	el = ldb_msg_find_element(msg, tree->u.equality.attr);
+	el = ldb_msg_find_element(msg, op->attr);
 	if (el == NULL) {
 		*matched = false;
 		return LDB_SUCCESS;
 	}
 
-	a = ldb_schema_attribute_by_name(ldb, el->name);
 	if (a == NULL) {
 		return LDB_ERR_INVALID_ATTRIBUTE_SYNTAX;
 	}
@@ -217,11 +288,16 @@ static int ldb_match_equality(struct ldb_context *ldb,
 	for (i=0;i<el->num_values;i++) {
 		if (a->syntax->operator_fn) {
 			ret = a->syntax->operator_fn(ldb, LDB_OP_EQUALITY, a,
-						     &tree->u.equality.value, &el->values[i], matched);
+						     value, &el->values[i], matched);
 			if (ret != LDB_SUCCESS) return ret;
 			if (*matched) return LDB_SUCCESS;
+		} else if (op->dn_syntax) {
+			if (ldb_match_dn_syntax(ldb, op, &el->values[i]) == 0) {
+				*matched = true;
+				return LDB_SUCCESS;
+			}
 		} else {
-			if (a->syntax->comparison_fn(ldb, ldb, &tree->u.equality.value,
+			if (a->syntax->comparison_fn(ldb, ldb, value,
 						     &el->values[i]) == 0) {
 				*matched = true;
 				return LDB_SUCCESS;
@@ -233,18 +309,47 @@ static int ldb_match_equality(struct ldb_context *ldb,
 	return LDB_SUCCESS;
 }
 
+/*
+  get the canonicalised substring chunk c, tmp holds it if it is only
+  canonicalised now
+*/
+static bool ldb_wildcard_chunk(struct ldb_context *ldb,
+			       const struct ldb_match_op *op,
+			       unsigned int c,
+			       struct ldb_val *tmp,
+			       const struct ldb_val **cnk)
+{
+	if (op->compiled) {
+		/* the chunk could not be canonicalised */
+		if (c >= op->num_chunks) {
+			return false;
+		}
+		*cnk = &op->chunks[c];
+		return true;
+	}
+
+	TALLOC_FREE(tmp->data);
+	if (op->a->syntax->canonicalise_fn(ldb, ldb,
+					   op->tree->u.substring.chunks[c],
+					   tmp) != 0) {
+		return false;
+	}
+	*cnk = tmp;
+	return true;
+}
+
 static int ldb_wildcard_compare(struct ldb_context *ldb,
-				const struct ldb_parse_tree *tree,
+				const struct ldb_match_op *op,
 				const struct ldb_val value, bool *matched)
 {
-	const struct ldb_schema_attribute *a;
+	const struct ldb_parse_tree *tree = op->tree;
+	const struct ldb_schema_attribute *a = op->a;
 	struct ldb_val val;
-	struct ldb_val cnk;
-	struct ldb_val *chunk;
+	struct ldb_val tmp = { .data = NULL };
+	const struct ldb_val *cnk;
 	uint8_t *save_p = NULL;
 	unsigned int c = 0;
 
-	a = ldb_schema_attribute_by_name(ldb, tree->u.substring.attr);
 	if (!a) {
 		return LDB_ERR_INVALID_ATTRIBUTE_SYNTAX;
 	}
@@ -259,44 +364,39 @@ static int ldb_wildcard_compare(struct ldb_context *ldb,
 	}
 
 	save_p = val.data;
-	cnk.data = NULL;
 
 	if ( ! tree->u.substring.start_with_wildcard ) {
 
-		chunk = tree->u.substring.chunks[c];
-		if (a->syntax->canonicalise_fn(ldb, ldb, chunk, &cnk) != 0) goto mismatch;
+		if (!ldb_wildcard_chunk(ldb, op, c, &tmp, &cnk)) goto mismatch;
 
 		/* This deals with wildcard prefix searches on binary attributes (eg objectGUID) */
-		if (cnk.length > val.length) {
+		if (cnk->length > val.length) {
 			goto mismatch;
 		}
 		/*
 		 * Empty strings are returned as length 0. Ensure
 		 * we can cope with this.
 		 */
-		if (cnk.length == 0) {
+		if (cnk->length == 0) {
 			goto mismatch;
 		}
 
-		if (memcmp((char *)val.data, (char *)cnk.data, cnk.length) != 0) goto mismatch;
-		val.length -= cnk.length;
-		val.data += cnk.length;
+		if (memcmp((char *)val.data, (char *)cnk->data, cnk->length) != 0) goto mismatch;
+		val.length -= cnk->length;
+		val.data += cnk->length;
 		c++;
-		talloc_free(cnk.data);
-		cnk.data = NULL;
 	}
 
 	while (tree->u.substring.chunks[c]) {
 		uint8_t *p;
 
-		chunk = tree->u.substring.chunks[c];
-		if(a->syntax->canonicalise_fn(ldb, ldb, chunk, &cnk) != 0) goto mismatch;
+		if (!ldb_wildcard_chunk(ldb, op, c, &tmp, &cnk)) goto mismatch;
 
 		/*
 		 * Empty strings are returned as length 0. Ensure
 		 * we can cope with this.
 		 */
-		if (cnk.length == 0) {
+		if (cnk->length == 0) {
 			goto mismatch;
 		}
 		/*
@@ -304,35 +404,34 @@ static int ldb_wildcard_compare(struct ldb_context *ldb,
 		 * search, but memory search instead.
 		 */
 		p = memmem((const void *)val.data,val.length,
-			   (const void *)cnk.data, cnk.length);
+			   (const void *)cnk->data, cnk->length);
 		if (p == NULL) goto mismatch;
 		if ( (! tree->u.substring.chunks[c + 1]) && (! tree->u.substring.end_with_wildcard) ) {
 			uint8_t *g;
 			do { /* greedy */
-				g = memmem(p + cnk.length,
+				g = memmem(p + cnk->length,
 					val.length - (p - val.data),
-					(const uint8_t *)cnk.data,
-					cnk.length);
+					(const uint8_t *)cnk->data,
+					cnk->length);
 				if (g) p = g;
 			} while(g);
 		}
-		val.length = val.length - (p - (uint8_t *)(val.data)) - cnk.length;
-		val.data = (uint8_t *)(p + cnk.length);
+		val.length = val.length - (p - (uint8_t *)(val.data)) - cnk->length;
+		val.data = (uint8_t *)(p + cnk->length);
 		c++;
-		talloc_free(cnk.data);
-		cnk.data = NULL;
 	}
 
 	/* last chunk may not have reached end of string */
 	if ( (! tree->u.substring.end_with_wildcard) && (*(val.data) != 0) ) goto mismatch;
 	talloc_free(save_p);
+	talloc_free(tmp.data);
 	*matched = true;
 	return LDB_SUCCESS;
 
 mismatch:
 	*matched = false;
 	talloc_free(save_p);
-	talloc_free(cnk.data);
+	talloc_free(tmp.data);
 	return LDB_SUCCESS;
 }
 
@@ -341,13 +440,13 @@ mismatch:
 */
 static int ldb_match_substring(struct ldb_context *ldb, 
 			       const struct ldb_message *msg,
-			       const struct ldb_parse_tree *tree,
-			       enum ldb_scope scope, bool *matched)
+			       const struct ldb_match_op *op,
+			       bool *matched)
 {
 	unsigned int i;
 	struct ldb_message_element *el;
 
-	el = ldb_msg_find_element(msg, tree->u.substring.attr);
+	el = ldb_msg_find_element(msg, op->attr);
 	if (el == NULL) {
 		*matched = false;
 		return LDB_SUCCESS;
@@ -355,7 +454,7 @@ static int ldb_match_substring(struct ldb_context *ldb,
 
 	for (i = 0; i < el->num_values; i++) {
 		int ret;
-		ret = ldb_wildcard_compare(ldb, tree, el->values[i], matched);
+		ret = ldb_wildcard_compare(ldb, op, el->values[i], matched);
 		if (ret != LDB_SUCCESS) return ret;
 		if (*matched) return LDB_SUCCESS;
 	}
@@ -480,67 +579,352 @@ static const struct ldb_extended_match_rule *ldb_find_extended_match_rule(struct
 */
 static int ldb_match_extended(struct ldb_context *ldb, 
 			      const struct ldb_message *msg,
-			      const struct ldb_parse_tree *tree,
-			      enum ldb_scope scope, bool *matched)
+			      const struct ldb_match_op *op,
+			      bool *matched)
 {
-	const struct ldb_extended_match_rule *rule;
+	const struct ldb_parse_tree *tree = op->tree;
 
-	if (tree->u.extended.dnAttributes) {
-		/* FIXME: We really need to find out what this ":dn" part in
-		 * an extended match means and how to handle it. For now print
-		 * only a warning to have s3 winbind and other tools working
-		 * against us. - Matthias */
-		ldb_debug(ldb, LDB_DEBUG_WARNING, "ldb: dnAttributes extended match not supported yet");
+	if (op->rule == NULL) {
+		*matched = false;
+		return LDB_SUCCESS;
 	}
-	if (tree->u.extended.rule_id == NULL) {
-		ldb_debug(ldb, LDB_DEBUG_ERROR, "ldb: no-rule extended matches not supported yet");
-		return LDB_ERR_INAPPROPRIATE_MATCHING;
+
+	return op->rule->callback(ldb, op->rule->oid, msg,
+				  tree->u.extended.attr,
+				  &tree->u.extended.value, matched);
+}
+
+/*
+  count the operations a parse tree compiles to
+*/
+static unsigned int ldb_match_count_ops(const struct ldb_parse_tree *tree)
+{
+	unsigned int i, n = 1;
+
+	switch (tree->operation) {
+	case LDB_OP_AND:
+	case LDB_OP_OR:
+		for (i = 0; i < tree->u.list.num_elements; i++) {
+			n += ldb_match_count_ops(tree->u.list.elements[i]);
+		}
+		break;
+	case LDB_OP_NOT:
+		n += ldb_match_count_ops(tree->u.isnot.child);
+		break;
+	default:
+		break;
 	}
-	if (tree->u.extended.attr == NULL) {
-		ldb_debug(ldb, LDB_DEBUG_ERROR, "ldb: no-attribute extended matches not supported yet");
-		return LDB_ERR_INAPPROPRIATE_MATCHING;
+
+	return n;
+}
+
+/*
+  compile a leaf of the parse tree. Problems with the filter are kept
+  in op->error and only returned when a record is matched, just like
+  they were found then, only out of memory is an error here.
+
+  Without compile only what is needed to match the leaf once is done,
+  the substring chunks and the values of the DN syntax are left to
+  the match. op->dn and op->chunks are allocated on mem_ctx.
+*/
+static int ldb_match_compile_leaf(struct ldb_context *ldb,
+				  TALLOC_CTX *mem_ctx,
+				  struct ldb_match_op *op,
+				  bool compile)
+{
+	const struct ldb_parse_tree *tree = op->tree;
+	const struct ldb_schema_syntax *dn_syntax;
+	const struct ldb_val *value;
+	unsigned int c;
+
+	switch (tree->operation) {
+	case LDB_OP_EQUALITY:
+		op->attr = tree->u.equality.attr;
+		value = &tree->u.equality.value;
+		if (ldb_attr_dn(op->attr) == 0) {
+			op->match_dn = true;
+			op->dn = ldb_dn_from_ldb_val(mem_ctx, ldb, value);
+			if (op->dn == NULL) {
+				op->error = LDB_ERR_INVALID_DN_SYNTAX;
+			}
+			return LDB_SUCCESS;
+		}
+		break;
+	case LDB_OP_GREATER:
+	case LDB_OP_LESS:
+	case LDB_OP_APPROX:
+		op->attr = tree->u.comparison.attr;
+		value = &tree->u.comparison.value;
+		break;
+	case LDB_OP_PRESENT:
+		op->attr = tree->u.present.attr;
+		if (ldb_attr_dn(op->attr) == 0) {
+			op->match_dn = true;
+			return LDB_SUCCESS;
+		}
+		op->a = ldb_schema_attribute_by_name(ldb, op->attr);
+		return LDB_SUCCESS;
+	case LDB_OP_SUBSTRING:
+		op->attr = tree->u.substring.attr;
+		op->a = ldb_schema_attribute_by_name(ldb, op->attr);
+		if (!compile ||
+		    op->a == NULL || tree->u.substring.chunks == NULL) {
+			return LDB_SUCCESS;
+		}
+		op->compiled = true;
+		for (c = 0; tree->u.substring.chunks[c]; c++) ;
+		op->chunks = talloc_zero_array(mem_ctx, struct ldb_val, c);
+		if (op->chunks == NULL) {
+			return LDB_ERR_OPERATIONS_ERROR;
+		}
+		for (c = 0; tree->u.substring.chunks[c]; c++) {
+			if (op->a->syntax->canonicalise_fn(ldb, op->chunks,
+						tree->u.substring.chunks[c],
+						&op->chunks[c]) != 0) {
+				break;
+			}
+		}
+		op->num_chunks = c;
+		return LDB_SUCCESS;
+	case LDB_OP_EXTENDED:
+		op->attr = tree->u.extended.attr;
+		if (tree->u.extended.dnAttributes) {
+			/* FIXME: We really need to find out what this ":dn" part in
+			 * an extended match means and how to handle it. For now print
+			 * only a warning to have s3 winbind and other tools working
+			 * against us. - Matthias */
+			ldb_debug(ldb, LDB_DEBUG_WARNING, "ldb: dnAttributes extended match not supported yet");
+		}
+		if (tree->u.extended.rule_id == NULL) {
+			ldb_debug(ldb, LDB_DEBUG_ERROR, "ldb: no-rule extended matches not supported yet");
+			op->error = LDB_ERR_INAPPROPRIATE_MATCHING;
+			return LDB_SUCCESS;
+		}
+		if (tree->u.extended.attr == NULL) {
+			ldb_debug(ldb, LDB_DEBUG_ERROR, "ldb: no-attribute extended matches not supported yet");
+			op->error = LDB_ERR_INAPPROPRIATE_MATCHING;
+			return LDB_SUCCESS;
+		}
+		op->rule = ldb_find_extended_match_rule(ldb, tree->u.extended.rule_id);
+		if (op->rule == NULL) {
+			ldb_debug(ldb, LDB_DEBUG_ERROR, "ldb: unknown extended rule_id %s",
+				  tree->u.extended.rule_id);
+		}
+		return LDB_SUCCESS;
+	default:
+		op->error = LDB_ERR_INAPPROPRIATE_MATCHING;
+		return LDB_SUCCESS;
 	}
 
-	rule = ldb_find_extended_match_rule(ldb, tree->u.extended.rule_id);
-	if (rule == NULL) {
-		*matched = false;
-		ldb_debug(ldb, LDB_DEBUG_ERROR, "ldb: unknown extended rule_id %s",
-			  tree->u.extended.rule_id);
+	/* equality and ordering matches */
+	op->a = ldb_schema_attribute_by_name(ldb, op->attr);
+	if (!compile ||
+	    op->a == NULL || op->a->syntax->operator_fn != NULL) {
 		return LDB_SUCCESS;
 	}
 
-	return rule->callback(ldb, rule->oid, msg,
-			      tree->u.extended.attr,
-			      &tree->u.extended.value, matched);
+	/*
+	 * ldb_comparison_dn() parses both values for every compare,
+	 * parse the assertion value only once
+	 */
+	dn_syntax = ldb_standard_syntax_by_name(ldb, LDB_SYNTAX_DN);
+	if (op->a->syntax == dn_syntax) {
+		op->dn_syntax = true;
+		op->dn = ldb_dn_from_ldb_val(mem_ctx, ldb, value);
+		op->dn_valid = ldb_dn_validate(op->dn);
+	}
+
+	return LDB_SUCCESS;
+}
+
+static int ldb_match_compile_tree(struct ldb_match_program *program,
+				  const struct ldb_parse_tree *tree)
+{
+	struct ldb_match_op *op = &program->ops[program->num_ops++];
+	unsigned int i;
+	int ret;
+
+	op->tree = tree;
+
+	switch (tree->operation) {
+	case LDB_OP_AND:
+	case LDB_OP_OR:
+		for (i = 0; i < tree->u.list.num_elements; i++) {
+			ret = ldb_match_compile_tree(program,
+						     tree->u.list.elements[i]);
+			if (ret != LDB_SUCCESS) {
+				return ret;
+			}
+		}
+		break;
+	case LDB_OP_NOT:
+		ret = ldb_match_compile_tree(program, tree->u.isnot.child);
+		if (ret != LDB_SUCCESS) {
+			return ret;
+		}
+		break;
+	default:
+		ret = ldb_match_compile_leaf(program->ldb, program, op, true);
+		if (ret != LDB_SUCCESS) {
+			return ret;
+		}
+		break;
+	}
+
+	op->next = program->num_ops;
+	return LDB_SUCCESS;
 }
 
 /*
-  return 0 if the given parse tree matches the given message. Assumes
-  the message is in sorted order
+  compile a parse tree for matching many records against it with
+  ldb_match_msg_compiled(). The program refers to the tree, which has
+  to stay around as long as the program is used, and is only valid
+  while the schema doesn't change.
+*/
+int ldb_match_compile(struct ldb_context *ldb,
+		      TALLOC_CTX *mem_ctx,
+		      const struct ldb_parse_tree *tree,
+		      struct ldb_match_program **_program)
+{
+	struct ldb_match_program *program;
+	int ret;
+
+	program = talloc_zero(mem_ctx, struct ldb_match_program);
+	if (program == NULL) {
+		return LDB_ERR_OPERATIONS_ERROR;
+	}
+	program->ldb = ldb;
+
+	program->ops = talloc_zero_array(program, struct ldb_match_op,
+					 ldb_match_count_ops(tree));
+	if (program->ops == NULL) {
+		talloc_free(program);
+		return LDB_ERR_OPERATIONS_ERROR;
+	}
+
+	ret = ldb_match_compile_tree(program, tree);
+	if (ret != LDB_SUCCESS) {
+		talloc_free(program);
+		return ret;
+	}
+
+	*_program = program;
+	return LDB_SUCCESS;
+}
+
+/*
+  match a message against a compiled leaf
+ */
+static int ldb_match_leaf(struct ldb_context *ldb,
+			  const struct ldb_message *msg,
+			  const struct ldb_match_op *op,
+			  bool *matched)
+{
+	*matched = false;
+
+	if (op->error != LDB_SUCCESS) {
+		return op->error;
+	}
+
+	switch (op->tree->operation) {
+	case LDB_OP_EQUALITY:
+		return ldb_match_equality(ldb, msg, op, matched);
 
-  return 1 if it matches, and 0 if it doesn't match
+	case LDB_OP_SUBSTRING:
+		return ldb_match_substring(ldb, msg, op, matched);
+
+	case LDB_OP_GREATER:
+		return ldb_match_comparison(ldb, msg, op, LDB_OP_GREATER, matched);
+
+	case LDB_OP_LESS:
+		return ldb_match_comparison(ldb, msg, op, LDB_OP_LESS, matched);
+
+	case LDB_OP_PRESENT:
+		return ldb_match_present(ldb, msg, op, matched);
+
+	case LDB_OP_APPROX:
+		return ldb_match_comparison(ldb, msg, op, LDB_OP_APPROX, matched);
+
+	case LDB_OP_EXTENDED:
+		return ldb_match_extended(ldb, msg, op, matched);
+
+	default:
+		break;
+	}
+
+	return LDB_ERR_INAPPROPRIATE_MATCHING;
+}
+
+/*
+  run the operation at index i and its subtree against a message
 
   this is a recursive function, and does short-circuit evaluation
  */
-static int ldb_match_message(struct ldb_context *ldb, 
-			     const struct ldb_message *msg,
-			     const struct ldb_parse_tree *tree,
-			     enum ldb_scope scope, bool *matched)
+static int ldb_match_run(const struct ldb_match_program *program,
+			 unsigned int i,
+			 const struct ldb_message *msg,
+			 bool *matched)
 {
-	unsigned int i;
+	const struct ldb_match_op *op = &program->ops[i];
+	unsigned int j;
 	int ret;
 
 	*matched = false;
 
-	if (scope != LDB_SCOPE_BASE && ldb_dn_is_special(msg->dn)) {
-		/* don't match special records except on base searches */
+	switch (op->tree->operation) {
+	case LDB_OP_AND:
+		for (j = i + 1; j < op->next; j = program->ops[j].next) {
+			ret = ldb_match_run(program, j, msg, matched);
+			if (ret != LDB_SUCCESS) return ret;
+			if (!*matched) return LDB_SUCCESS;
+		}
+		*matched = true;
 		return LDB_SUCCESS;
+
+	case LDB_OP_OR:
+		for (j = i + 1; j < op->next; j = program->ops[j].next) {
+			ret = ldb_match_run(program, j, msg, matched);
+			if (ret != LDB_SUCCESS) return ret;
+			if (*matched) return LDB_SUCCESS;
+		}
+		*matched = false;
+		return LDB_SUCCESS;
+
+	case LDB_OP_NOT:
+		ret = ldb_match_run(program, i + 1, msg, matched);
+		if (ret != LDB_SUCCESS) return ret;
+		*matched = ! *matched;
+		return LDB_SUCCESS;
+
+	default:
+		break;
 	}
 
+	return ldb_match_leaf(program->ldb, msg, op, matched);
+}
+
+/*
+  match a message against a parse tree without compiling it, for
+  callers matching a single message. Only the leaves that are reached
+  are looked at, one at a time.
+
+  this is a recursive function, and does short-circuit evaluation
+ */
+static int ldb_match_message(struct ldb_context *ldb,
+			     const struct ldb_message *msg,
+			     const struct ldb_parse_tree *tree,
+			     bool *matched)
+{
+	struct ldb_match_op op = { .tree = tree };
+	unsigned int i;
+	int ret;
+
+	*matched = false;
+
 	switch (tree->operation) {
 	case LDB_OP_AND:
 		for (i=0;i<tree->u.list.num_elements;i++) {
-			ret = ldb_match_message(ldb, msg, tree->u.list.elements[i], scope, matched);
+			ret = ldb_match_message(ldb, msg, tree->u.list.elements[i], matched);
 			if (ret != LDB_SUCCESS) return ret;
 			if (!*matched) return LDB_SUCCESS;
 		}
@@ -549,7 +933,7 @@ static int ldb_match_message(struct ldb_context *ldb,
 
 	case LDB_OP_OR:
 		for (i=0;i<tree->u.list.num_elements;i++) {
-			ret = ldb_match_message(ldb, msg, tree->u.list.elements[i], scope, matched);
+			ret = ldb_match_message(ldb, msg, tree->u.list.elements[i], matched);
 			if (ret != LDB_SUCCESS) return ret;
 			if (*matched) return LDB_SUCCESS;
 		}
@@ -557,34 +941,49 @@ static int ldb_match_message(struct ldb_context *ldb,
 		return LDB_SUCCESS;
 
 	case LDB_OP_NOT:
-		ret = ldb_match_message(ldb, msg, tree->u.isnot.child, scope, matched);
+		ret = ldb_match_message(ldb, msg, tree->u.isnot.child, matched);
 		if (ret != LDB_SUCCESS) return ret;
 		*matched = ! *matched;
 		return LDB_SUCCESS;
 
-	case LDB_OP_EQUALITY:
-		return ldb_match_equality(ldb, msg, tree, scope, matched);
+	default:
+		break;
+	}
 
-	case LDB_OP_SUBSTRING:
-		return ldb_match_substring(ldb, msg, tree, scope, matched);
+	ret = ldb_match_compile_leaf(ldb, ldb, &op, false);
+	if (ret != LDB_SUCCESS) {
+		return ret;
+	}
 
-	case LDB_OP_GREATER:
-		return ldb_match_comparison(ldb, msg, tree, scope, LDB_OP_GREATER, matched);
+	ret = ldb_match_leaf(ldb, msg, &op, matched);
 
-	case LDB_OP_LESS:
-		return ldb_match_comparison(ldb, msg, tree, scope, LDB_OP_LESS, matched);
+	talloc_free(op.dn);
+	talloc_free(op.chunks);
+	return ret;
+}
 
-	case LDB_OP_PRESENT:
-		return ldb_match_present(ldb, msg, tree, scope, matched);
+/*
+  match a message against a compiled parse tree. Assumes the message
+  is in sorted order
+ */
+int ldb_match_msg_compiled(const struct ldb_match_program *program,
+			   const struct ldb_message *msg,
+			   struct ldb_dn *base,
+			   enum ldb_scope scope,
+			   bool *matched)
+{
+	*matched = false;
 
-	case LDB_OP_APPROX:
-		return ldb_match_comparison(ldb, msg, tree, scope, LDB_OP_APPROX, matched);
+	if ( ! ldb_match_scope(program->ldb, base, msg->dn, scope) ) {
+		return LDB_SUCCESS;
+	}
 
-	case LDB_OP_EXTENDED:
-		return ldb_match_extended(ldb, msg, tree, scope, matched);
+	if (scope != LDB_SCOPE_BASE && ldb_dn_is_special(msg->dn)) {
+		/* don't match special records except on base searches */
+		return LDB_SUCCESS;
 	}
 
-	return LDB_ERR_INAPPROPRIATE_MATCHING;
+	return ldb_match_run(program, 0, msg, matched);
 }
 
 int ldb_match_msg(struct ldb_context *ldb,
@@ -596,11 +995,7 @@ int ldb_match_msg(struct ldb_context *ldb,
 	bool matched;
 	int ret;
 
-	if ( ! ldb_match_scope(ldb, base, msg->dn, scope) ) {
-		return 0;
-	}
-
-	ret = ldb_match_message(ldb, msg, tree, scope, &matched);
+	ret = ldb_match_msg_error(ldb, msg, tree, base, scope, &matched);
 	if (ret != LDB_SUCCESS) {
 		/* to match the old API, we need to consider this a
 		   failure to match */
@@ -616,12 +1011,18 @@ int ldb_match_msg_error(struct ldb_context *ldb,
 			enum ldb_scope scope,
 			bool *matched)
 {
+	*matched = false;
+
 	if ( ! ldb_match_scope(ldb, base, msg->dn, scope) ) {
-		*matched = false;
 		return LDB_SUCCESS;
 	}
 
-	return ldb_match_message(ldb, msg, tree, scope, matched);
+	if (scope != LDB_SCOPE_BASE && ldb_dn_is_special(msg->dn)) {
+		/* don't match special records except on base searches */
+		return LDB_SUCCESS;
+	}
+
+	return ldb_match_message(ldb, msg, tree, matched);
 }
 
 int ldb_match_msg_objectclass(const struct ldb_message *msg,
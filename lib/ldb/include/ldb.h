@@ -528,6 +528,14 @@ typedef int (*ldb_qsort_cmp_fn_t) (void *v1, void *v2, void *opaque);
 #define LDB_CONTROL_PROVISION_OID "1.3.6.1.4.1.7165.4.3.16"
 #define LDB_CONTROL_PROVISION_NAME	"provision"
 
+/**
+   LDB_CONTROL_DN_CACHE_STATS_OID asks the tdb backend to return the
+   counters of its cache of records looked up by DN with the result of
+   a request, in a struct ldb_dn_cache_stats_control.
+*/
+#define LDB_CONTROL_DN_CACHE_STATS_OID "1.3.6.1.4.1.7165.4.3.26"
+#define LDB_CONTROL_DN_CACHE_STATS_NAME	"dn_cache_stats"
+
 /* AD controls */
 
 /**
@@ -866,6 +874,15 @@ struct ldb_verify_name_control {
 	char *gc;
 };
 
+struct ldb_dn_cache_stats_control {
+	uint64_t hits;
+	uint64_t misses;
+	uint64_t evictions;
+	uint64_t flushes;
+	unsigned int entries;
+	unsigned int max_entries;
+};
+
 struct ldb_control {
 	const char *oid;
 	int critical;
@@ -159,6 +159,19 @@ int ldb_match_msg_error(struct ldb_context *ldb,
 			enum ldb_scope scope,
 			bool *matched);
 
+struct ldb_match_program;
+
+int ldb_match_compile(struct ldb_context *ldb,
+		      TALLOC_CTX *mem_ctx,
+		      const struct ldb_parse_tree *tree,
+		      struct ldb_match_program **program);
+
+int ldb_match_msg_compiled(const struct ldb_match_program *program,
+			   const struct ldb_message *msg,
+			   struct ldb_dn *base,
+			   enum ldb_scope scope,
+			   bool *matched);
+
 int ldb_match_msg_objectclass(const struct ldb_message *msg,
 			      const char *objectclass);
 
@@ -390,6 +403,17 @@ int ldb_register_extended_match_rule(struct ldb_context *ldb,
 int ldb_pack_data(struct ldb_context *ldb,
 		  const struct ldb_message *message,
 		  struct ldb_val *data);
+
+/* the unpacked message references the packed data */
+#define LDB_UNPACK_DATA_FLAG_NO_DATA_ALLOC 0x0001
+
+int ldb_unpack_data_only_attr_list_flags(struct ldb_context *ldb,
+					 const struct ldb_val *data,
+					 struct ldb_message *message,
+					 const char * const *list,
+					 unsigned int list_size,
+					 unsigned int flags,
+					 unsigned int *nb_attributes_indb);
 int ldb_unpack_data_only_attr_list(struct ldb_context *ldb,
 				   const struct ldb_val *data,
 				   struct ldb_message *message,
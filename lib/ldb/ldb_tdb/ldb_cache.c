@@ -278,6 +278,8 @@ int ltdb_cache_load(struct ldb_module *module)
 
 	ldb = ldb_module_get_ctx(module);
 
+	ltdb_dn_cache_check(ltdb);
+
 	/* a very fast check to avoid extra database reads */
 	if (ltdb->cache != NULL && 
 	    tdb_get_seqnum(ltdb->tdb) == ltdb->tdb_seqnum) {
@@ -370,6 +372,8 @@ int ltdb_cache_load(struct ldb_module *module)
 	}
 	ltdb->cache->one_level_indexes = false;
 	ltdb->cache->attribute_indexes = false;
+	ltdb->cache->GUID_index_attribute = NULL;
+	ltdb->cache->GUID_index_prefix = NULL;
 	    
 	indexlist_dn = ldb_dn_new(module, ldb, LTDB_INDEXLIST);
 	if (indexlist_dn == NULL) goto failed;
@@ -386,6 +390,37 @@ int ltdb_cache_load(struct ldb_module *module)
 		ltdb->cache->attribute_indexes = true;
 	}
 
+	ltdb->cache->GUID_index_attribute
+		= ldb_msg_find_attr_as_string(ltdb->cache->indexlist,
+					      LTDB_IDXGUID, NULL);
+	if (ltdb->cache->GUID_index_attribute != NULL) {
+		const char *attr = ltdb->cache->GUID_index_attribute;
+		char *attr_folded;
+
+		/* the index from the GUIDs to the DNs is always kept */
+		if (!ldb_msg_check_string_attribute(ltdb->cache->indexlist,
+						    LTDB_IDXATTR, attr)) {
+			r = ldb_msg_add_string(ltdb->cache->indexlist,
+					       LTDB_IDXATTR, attr);
+			if (r != LDB_SUCCESS) {
+				goto failed;
+			}
+		}
+		ltdb->cache->attribute_indexes = true;
+
+		attr_folded = ldb_attr_casefold(ltdb->cache->indexlist, attr);
+		if (attr_folded == NULL) {
+			goto failed;
+		}
+		ltdb->cache->GUID_index_prefix =
+			talloc_asprintf(ltdb->cache->indexlist, "%s:%s:",
+					LTDB_INDEX, attr_folded);
+		talloc_free(attr_folded);
+		if (ltdb->cache->GUID_index_prefix == NULL) {
+			goto failed;
+		}
+	}
+
 	if (ltdb_attributes_load(module) == -1) {
 		goto failed;
 	}
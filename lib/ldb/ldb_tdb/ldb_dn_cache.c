@@ -0,0 +1,361 @@
+/*
+   ldb database library
+
+     ** NOTE! The following LGPL license applies to the ldb
+     ** library. This does NOT imply that all of Samba is released
+     ** under the LGPL
+
+   This library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Lesser General Public
+   License as published by the Free Software Foundation; either
+   version 3 of the License, or (at your option) any later version.
+
+   This library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Lesser General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public
+   License along with this library; if not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+ *  Name: ldb
+ *
+ *  Component: ldb tdb DN cache
+ *
+ *  Description: keep the most recently used records looked up by DN
+ *  unpacked in memory
+ *
+ *  The cache is keyed by the tdb key of a record, the casefolded DN.
+ *  Special records are never cached. Our own stores and deletes drop
+ *  the entry of the record, and a change of the tdb sequence number
+ *  outside of a transaction means somebody else changed the database,
+ *  which throws away the whole cache. Records read in a transaction
+ *  may not be committed, so cancelling a transaction does the same.
+ */
+
+#include "ldb_tdb.h"
+#include "dlinklist.h"
+
+struct ltdb_dn_cache_entry {
+	struct ltdb_dn_cache_entry *prev, *next;
+	TDB_DATA key;
+	struct ldb_message *msg;
+};
+
+struct ltdb_dn_cache {
+	/* maps keys to entries */
+	struct tdb_context *tdb;
+
+	/* most recently used first */
+	struct ltdb_dn_cache_entry *entries;
+	unsigned int num_entries;
+	unsigned int max_entries;
+
+	/* the tdb sequence number the cache is valid for */
+	int seqnum;
+
+	struct ldb_dn_cache_stats_control stats;
+};
+
+static int ltdb_dn_cache_destructor(struct ltdb_dn_cache *cache)
+{
+	tdb_close(cache->tdb);
+	return 0;
+}
+
+/*
+  set up the cache for up to max_entries records
+ */
+int ltdb_dn_cache_init(struct ltdb_private *ltdb, unsigned int max_entries)
+{
+	struct ltdb_dn_cache *cache;
+
+	if (max_entries == 0) {
+		return 0;
+	}
+
+	cache = talloc_zero(ltdb, struct ltdb_dn_cache);
+	if (cache == NULL) {
+		return -1;
+	}
+
+	cache->tdb = tdb_open(NULL, max_entries, TDB_INTERNAL, O_RDWR, 0);
+	if (cache->tdb == NULL) {
+		talloc_free(cache);
+		return -1;
+	}
+	talloc_set_destructor(cache, ltdb_dn_cache_destructor);
+
+	cache->max_entries = max_entries;
+	cache->seqnum = tdb_get_seqnum(ltdb->tdb);
+
+	ltdb->dn_cache = cache;
+	return 0;
+}
+
+static void ltdb_dn_cache_drop(struct ltdb_dn_cache *cache,
+			       struct ltdb_dn_cache_entry *entry)
+{
+	tdb_delete(cache->tdb, entry->key);
+	DLIST_REMOVE(cache->entries, entry);
+	cache->num_entries--;
+	talloc_free(entry);
+}
+
+/*
+  throw away all cached records
+ */
+void ltdb_dn_cache_flush(struct ltdb_private *ltdb)
+{
+	struct ltdb_dn_cache *cache = ltdb->dn_cache;
+
+	if (cache == NULL || cache->num_entries == 0) {
+		return;
+	}
+
+	while (cache->entries != NULL) {
+		ltdb_dn_cache_drop(cache, cache->entries);
+	}
+	cache->stats.flushes++;
+}
+
+/*
+  check that nobody else changed the database since the cached records
+  were read. Within a transaction nobody else can.
+ */
+void ltdb_dn_cache_check(struct ltdb_private *ltdb)
+{
+	struct ltdb_dn_cache *cache = ltdb->dn_cache;
+	int seqnum;
+
+	if (cache == NULL || ltdb->in_transaction != 0) {
+		return;
+	}
+
+	seqnum = tdb_get_seqnum(ltdb->tdb);
+	if (seqnum != cache->seqnum) {
+		ltdb_dn_cache_flush(ltdb);
+		cache->seqnum = seqnum;
+	}
+}
+
+/*
+  after a commit the cache reflects our own changes, which are all the
+  changes up to the given sequence number
+ */
+void ltdb_dn_cache_committed(struct ltdb_private *ltdb, int seqnum)
+{
+	if (ltdb->dn_cache != NULL) {
+		ltdb->dn_cache->seqnum = seqnum;
+	}
+}
+
+static int ltdb_dn_cache_parse(TDB_DATA key, TDB_DATA data,
+			       void *private_data)
+{
+	struct ltdb_dn_cache_entry **entry =
+		(struct ltdb_dn_cache_entry **)private_data;
+
+	if (data.dsize != sizeof(*entry)) {
+		return -1;
+	}
+	memcpy(entry, data.dptr, sizeof(*entry));
+	return 0;
+}
+
+static struct ltdb_dn_cache_entry *ltdb_dn_cache_find(
+	struct ltdb_dn_cache *cache, TDB_DATA key)
+{
+	struct ltdb_dn_cache_entry *entry = NULL;
+
+	if (tdb_parse_record(cache->tdb, key, ltdb_dn_cache_parse,
+			     &entry) != 0) {
+		return NULL;
+	}
+	return entry;
+}
+
+/*
+  find a cached record. The message stays with the cache and is only
+  good until the cache is changed.
+ */
+const struct ldb_message *ltdb_dn_cache_lookup(struct ltdb_private *ltdb,
+					       TDB_DATA key)
+{
+	struct ltdb_dn_cache *cache = ltdb->dn_cache;
+	struct ltdb_dn_cache_entry *entry;
+
+	if (cache == NULL) {
+		return NULL;
+	}
+
+	entry = ltdb_dn_cache_find(cache, key);
+	if (entry == NULL) {
+		cache->stats.misses++;
+		return NULL;
+	}
+	cache->stats.hits++;
+
+	DLIST_PROMOTE(cache->entries, entry);
+
+	return entry->msg;
+}
+
+/*
+  copy a message, only with the attributes in list if it is given. The
+  copy is allocated the way ldb_unpack_data() does it, so callers can
+  change it in the same ways.
+ */
+int ltdb_dn_cache_copy(struct ldb_message *msg,
+		       const struct ldb_message *cached,
+		       const char * const *list,
+		       unsigned int list_size)
+{
+	unsigned int i, j, h;
+
+	msg->dn = ldb_dn_copy(msg, cached->dn);
+	if (msg->dn == NULL) {
+		return -1;
+	}
+
+	msg->num_elements = 0;
+	msg->elements = talloc_array(msg, struct ldb_message_element,
+				     cached->num_elements);
+	if (msg->elements == NULL) {
+		return -1;
+	}
+
+	for (i = 0; i < cached->num_elements; i++) {
+		const struct ldb_message_element *el = &cached->elements[i];
+		struct ldb_message_element *el2;
+
+		if (list != NULL && list_size != 0) {
+			for (h = 0; h < list_size; h++) {
+				if (ldb_attr_cmp(el->name, list[h]) == 0) {
+					break;
+				}
+			}
+			if (h == list_size) {
+				continue;
+			}
+		}
+
+		el2 = &msg->elements[msg->num_elements];
+		el2->flags = 0;
+		el2->name = talloc_strdup(msg->elements, el->name);
+		if (el2->name == NULL) {
+			return -1;
+		}
+		el2->num_values = el->num_values;
+		el2->values = NULL;
+		if (el->num_values != 0) {
+			el2->values = talloc_array(msg->elements,
+						   struct ldb_val,
+						   el->num_values);
+			if (el2->values == NULL) {
+				return -1;
+			}
+		}
+		for (j = 0; j < el->num_values; j++) {
+			struct ldb_val *v = &el2->values[j];
+
+			v->length = el->values[j].length;
+			v->data = talloc_size(el2->values, v->length + 1);
+			if (v->data == NULL) {
+				return -1;
+			}
+			memcpy(v->data, el->values[j].data, v->length);
+			v->data[v->length] = 0;
+		}
+		msg->num_elements++;
+	}
+
+	return 0;
+}
+
+/*
+  add a copy of a record to the cache, making room if needed. Failing
+  to cache something is not an error.
+ */
+void ltdb_dn_cache_add(struct ltdb_private *ltdb, TDB_DATA key,
+		       const struct ldb_message *msg)
+{
+	struct ltdb_dn_cache *cache = ltdb->dn_cache;
+	struct ltdb_dn_cache_entry *entry;
+	TDB_DATA rec;
+
+	if (cache == NULL || ldb_dn_is_special(msg->dn)) {
+		return;
+	}
+
+	entry = ltdb_dn_cache_find(cache, key);
+	if (entry != NULL) {
+		ltdb_dn_cache_drop(cache, entry);
+	}
+
+	while (cache->num_entries >= cache->max_entries) {
+		ltdb_dn_cache_drop(cache, DLIST_TAIL(cache->entries));
+		cache->stats.evictions++;
+	}
+
+	entry = talloc_zero(cache, struct ltdb_dn_cache_entry);
+	if (entry == NULL) {
+		return;
+	}
+	entry->key.dptr = (uint8_t *)talloc_memdup(entry, key.dptr, key.dsize);
+	entry->key.dsize = key.dsize;
+	entry->msg = ldb_msg_new(entry);
+	if (entry->key.dptr == NULL || entry->msg == NULL ||
+	    ltdb_dn_cache_copy(entry->msg, msg, NULL, 0) != 0) {
+		talloc_free(entry);
+		return;
+	}
+
+	rec.dptr = (uint8_t *)&entry;
+	rec.dsize = sizeof(entry);
+	if (tdb_store(cache->tdb, key, rec, TDB_INSERT) != 0) {
+		talloc_free(entry);
+		return;
+	}
+
+	DLIST_ADD(cache->entries, entry);
+	cache->num_entries++;
+}
+
+/*
+  forget a record that is changed or deleted
+ */
+void ltdb_dn_cache_remove(struct ltdb_private *ltdb, TDB_DATA key)
+{
+	struct ltdb_dn_cache *cache = ltdb->dn_cache;
+	struct ltdb_dn_cache_entry *entry;
+
+	if (cache == NULL || cache->num_entries == 0) {
+		return;
+	}
+
+	entry = ltdb_dn_cache_find(cache, key);
+	if (entry != NULL) {
+		ltdb_dn_cache_drop(cache, entry);
+	}
+}
+
+/*
+  the counters for LDB_CONTROL_DN_CACHE_STATS_OID
+ */
+void ltdb_dn_cache_stats(struct ltdb_private *ltdb,
+			 struct ldb_dn_cache_stats_control *stats)
+{
+	struct ltdb_dn_cache *cache = ltdb->dn_cache;
+
+	ZERO_STRUCTP(stats);
+	if (cache == NULL) {
+		return;
+	}
+
+	*stats = cache->stats;
+	stats->entries = cache->num_entries;
+	stats->max_entries = cache->max_entries;
+}
@@ -41,14 +41,34 @@ struct dn_list {
 
 struct ltdb_idxptr {
 	struct tdb_context *itdb;
+	unsigned int itdb_hash_size;
+	unsigned int itdb_entries;
+	/* ltdb_reindex() is rebuilding all index records from scratch */
+	bool reindexing;
 	int error;
 };
 
+/* the in-memory index records start with this many hash chains and
+   get four times as many when the chains get longer than four */
+#define LTDB_IDXPTR_HASH_SIZE 1000
+
 /* we put a @IDXVERSION attribute on index entries. This
    allows us to tell if it was written by an older version
 */
 #define LTDB_INDEXING_VERSION 2
 
+/* with @IDXGUID the index entries are the fixed size GUIDs of the
+   records instead of their DNs. They are kept sorted and stored
+   together in a single @IDX value, so lists can be merged */
+#define LTDB_GUID_INDEXING_VERSION 3
+#define LTDB_GUID_SIZE 16
+
+/* the same, but each GUID is followed by the zero terminated DN of
+   its record, so a search doesn't need to look the DN up. In a
+   dn_list the entries are the GUID and the DN, the length does not
+   count the terminating zero. An empty DN means it's unknown */
+#define LTDB_GUID_DN_INDEXING_VERSION 4
+
 /* enable the idxptr mode when transactions start */
 int ltdb_index_transaction_start(struct ldb_module *module)
 {
@@ -71,6 +91,117 @@ static int dn_list_cmp(const struct ldb_val *v1, const struct ldb_val *v2)
 }
 
 
+/* compare two GUID entries in a dn_list */
+static int guid_list_cmp(const struct ldb_val *v1, const struct ldb_val *v2)
+{
+	return memcmp(v1->data, v2->data, LTDB_GUID_SIZE);
+}
+
+/*
+  find a GUID in a sorted list of GUIDs with a binary search. Returns
+  true if it is there, idx is its position or the one to insert it at
+ */
+static bool ltdb_guid_list_find(const struct dn_list *list,
+				const struct ldb_val *guid,
+				unsigned int *idx)
+{
+	unsigned int lo = 0, hi = list->count;
+
+	while (lo < hi) {
+		unsigned int mid = lo + (hi - lo) / 2;
+		int c = guid_list_cmp(&list->dn[mid], guid);
+
+		if (c == 0) {
+			*idx = mid;
+			return true;
+		}
+		if (c < 0) {
+			lo = mid + 1;
+		} else {
+			hi = mid;
+		}
+	}
+
+	*idx = lo;
+	return false;
+}
+
+/*
+  does the index record with this key hold GUIDs? That is the case for
+  all index records of a GUID indexed database, except for those of the
+  GUID attribute itself, which lead from the GUIDs back to the DNs
+ */
+static bool ltdb_dn_list_is_guid(struct ltdb_private *ltdb, struct ldb_dn *dn)
+{
+	const char *prefix = ltdb->cache->GUID_index_prefix;
+	const char *key;
+
+	if (ltdb->cache->GUID_index_attribute == NULL) {
+		return false;
+	}
+
+	key = ldb_dn_get_linearized(dn);
+	if (key == NULL) {
+		return false;
+	}
+
+	return strncmp(key, prefix, strlen(prefix)) != 0;
+}
+
+static bool ltdb_is_guid_attr(struct ltdb_private *ltdb, const char *attr)
+{
+	return ltdb->cache->GUID_index_attribute != NULL &&
+		ldb_attr_cmp(attr, ltdb->cache->GUID_index_attribute) == 0;
+}
+
+/*
+  find the GUID a record is indexed under in a GUID indexed database
+ */
+static int ltdb_index_msg_guid(struct ldb_module *module,
+			       const struct ldb_message *msg,
+			       const struct ldb_val **guid)
+{
+	struct ltdb_private *ltdb = talloc_get_type(ldb_module_get_private(module), struct ltdb_private);
+	struct ldb_message_element *el;
+
+	el = ldb_msg_find_element(msg, ltdb->cache->GUID_index_attribute);
+	if (el == NULL || el->num_values != 1 ||
+	    el->values[0].length != LTDB_GUID_SIZE) {
+		ldb_asprintf_errstring(ldb_module_get_ctx(module),
+				       __location__ ": %s needs a single %u byte %s "
+				       "value for the GUID index",
+				       ldb_dn_get_linearized(msg->dn),
+				       LTDB_GUID_SIZE,
+				       ltdb->cache->GUID_index_attribute);
+		return LDB_ERR_CONSTRAINT_VIOLATION;
+	}
+
+	*guid = &el->values[0];
+	return LDB_SUCCESS;
+}
+
+/*
+  build the entry for a record in a GUID index list: its GUID followed
+  by its DN
+ */
+static int ltdb_guid_entry(TALLOC_CTX *mem_ctx,
+			   const struct ldb_val *guid,
+			   const char *dn,
+			   struct ldb_val *v)
+{
+	size_t dn_len = strlen(dn);
+
+	v->data = talloc_size(mem_ctx, LTDB_GUID_SIZE + dn_len + 1);
+	if (v->data == NULL) {
+		return LDB_ERR_OPERATIONS_ERROR;
+	}
+	memcpy(v->data, guid->data, LTDB_GUID_SIZE);
+	memcpy(v->data + LTDB_GUID_SIZE, dn, dn_len + 1);
+	v->length = LTDB_GUID_SIZE + dn_len;
+
+	return LDB_SUCCESS;
+}
+
 /*
   find a entry in a dn_list, using a ldb_val. Uses a case sensitive
   comparison with the dn returns -1 if not found
@@ -85,25 +216,33 @@ static int ltdb_dn_list_find_val(const struct dn_list *list, const struct ldb_va
 }
 
 /*
-  find a entry in a dn_list. Uses a case sensitive comparison with the dn
-  returns -1 if not found
+  an index record changed in a transaction. Added values are appended
+  and deleted values only cleared, with a hash table of the positions
+  to find values in large records, so that changing an index record
+  costs the same whatever its size. The list is tidied up when it is
+  read by a search or stored at the end of the transaction
  */
-static int ltdb_dn_list_find_str(struct dn_list *list, const char *dn)
-{
-	struct ldb_val v;
-	v.data = discard_const_p(unsigned char, dn);
-	v.length = strlen(dn);
-	return ltdb_dn_list_find_val(list, &v);
-}
+struct ltdb_idx_batch {
+	struct dn_list list;
+	unsigned int alloc;
+	unsigned int deleted;
+	bool guid;
+	bool unsorted;
+	uint32_t *hash;
+	unsigned int hash_size;
+};
+
+/* below this many entries we don't bother with a hash table */
+#define LTDB_IDX_BATCH_HASH_MIN 32
 
 /*
   this is effectively a cast function, but with lots of paranoia
   checks and also copes with CPUs that are fussy about pointer
   alignment
  */
-static struct dn_list *ltdb_index_idxptr(struct ldb_module *module, TDB_DATA rec, bool check_parent)
+static struct ltdb_idx_batch *ltdb_index_idxptr(struct ldb_module *module, TDB_DATA rec, bool check_parent)
 {
-	struct dn_list *list;
+	struct ltdb_idx_batch *batch;
 	if (rec.dsize != sizeof(void *)) {
 		ldb_asprintf_errstring(ldb_module_get_ctx(module), 
 				       "Bad data size for idxptr %u", (unsigned)rec.dsize);
@@ -112,67 +251,324 @@ static struct dn_list *ltdb_index_idxptr(struct ldb_module *module, TDB_DATA rec
 	/* note that we can't just use a cast here, as rec.dptr may
 	   not be aligned sufficiently for a pointer. A cast would cause
 	   platforms like some ARM CPUs to crash */
-	memcpy(&list, rec.dptr, sizeof(void *));
-	list = talloc_get_type(list, struct dn_list);
-	if (list == NULL) {
+	memcpy(&batch, rec.dptr, sizeof(void *));
+	batch = talloc_get_type(batch, struct ltdb_idx_batch);
+	if (batch == NULL) {
 		ldb_asprintf_errstring(ldb_module_get_ctx(module), 
 				       "Bad type '%s' for idxptr", 
-				       talloc_get_name(list));
+				       talloc_get_name(batch));
 		return NULL;
 	}
-	if (check_parent && list->dn && talloc_parent(list->dn) != list) {
+	if (check_parent && batch->list.dn &&
+	    talloc_parent(batch->list.dn) != batch) {
 		ldb_asprintf_errstring(ldb_module_get_ctx(module), 
 				       "Bad parent '%s' for idxptr", 
-				       talloc_get_name(talloc_parent(list->dn)));
+				       talloc_get_name(talloc_parent(batch->list.dn)));
 		return NULL;
 	}
-	return list;
+	return batch;
+}
+
+static uint32_t ltdb_idx_batch_hash_val(const struct ltdb_idx_batch *batch,
+					const struct ldb_val *v)
+{
+	TDB_DATA d;
+
+	/* DNs compare equal with and without a terminating zero */
+	d.dptr = v->data;
+	d.dsize = batch->guid ? LTDB_GUID_SIZE :
+		strnlen((const char *)v->data, v->length);
+	return tdb_jenkins_hash(&d);
+}
+
+static void ltdb_idx_batch_hash_add(struct ltdb_idx_batch *batch,
+				    unsigned int i)
+{
+	uint32_t mask = batch->hash_size - 1;
+	uint32_t h = ltdb_idx_batch_hash_val(batch, &batch->list.dn[i]) & mask;
+
+	while (batch->hash[h] != 0) {
+		h = (h + 1) & mask;
+	}
+	batch->hash[h] = i + 1;
 }
 
 /*
-  return the @IDX list in an index entry for a dn as a 
-  struct dn_list
+  (re)build the hash table, with room for at least count entries
  */
-static int ltdb_dn_list_load(struct ldb_module *module,
-			     struct ldb_dn *dn, struct dn_list *list)
+static bool ltdb_idx_batch_hash_build(struct ltdb_idx_batch *batch,
+				      unsigned int count)
 {
-	struct ldb_message *msg;
-	int ret;
-	struct ldb_message_element *el;
-	struct ltdb_private *ltdb = talloc_get_type(ldb_module_get_private(module), struct ltdb_private);
-	TDB_DATA rec;
-	struct dn_list *list2;
-	TDB_DATA key;
+	unsigned int i, size = 64;
 
-	list->dn = NULL;
-	list->count = 0;
+	while (size < count * 2) {
+		size *= 2;
+	}
 
-	/* see if we have any in-memory index entries */
-	if (ltdb->idxptr == NULL ||
-	    ltdb->idxptr->itdb == NULL) {
-		goto normal_index;
+	TALLOC_FREE(batch->hash);
+	batch->hash_size = 0;
+
+	batch->hash = talloc_zero_array(batch, uint32_t, size);
+	if (batch->hash == NULL) {
+		return false;
 	}
+	batch->hash_size = size;
 
-	key.dptr = discard_const_p(unsigned char, ldb_dn_get_linearized(dn));
-	key.dsize = strlen((char *)key.dptr);
+	for (i = 0; i < batch->list.count; i++) {
+		if (batch->list.dn[i].data != NULL) {
+			ltdb_idx_batch_hash_add(batch, i);
+		}
+	}
+	return true;
+}
 
-	rec = tdb_fetch(ltdb->idxptr->itdb, key);
-	if (rec.dptr == NULL) {
-		goto normal_index;
+static bool ltdb_idx_batch_equal(const struct ltdb_idx_batch *batch,
+				 const struct ldb_val *v1,
+				 const struct ldb_val *v2)
+{
+	if (v1->data == NULL) {
+		return false;
+	}
+	if (batch->guid) {
+		return guid_list_cmp(v1, v2) == 0;
 	}
+	return dn_list_cmp(v1, v2) == 0;
+}
 
-	/* we've found an in-memory index entry */
-	list2 = ltdb_index_idxptr(module, rec, true);
-	if (list2 == NULL) {
-		free(rec.dptr);
+/*
+  find a value in an index record being changed, returns -1 if it
+  isn't there
+ */
+static int ltdb_idx_batch_find(struct ltdb_idx_batch *batch,
+			       const struct ldb_val *v)
+{
+	unsigned int i;
+	uint32_t h, mask;
+
+	if (batch->guid && !batch->unsorted && batch->deleted == 0) {
+		if (!ltdb_guid_list_find(&batch->list, v, &i)) {
+			return -1;
+		}
+		return i;
+	}
+
+	if (batch->hash == NULL &&
+	    (batch->list.count < LTDB_IDX_BATCH_HASH_MIN ||
+	     !ltdb_idx_batch_hash_build(batch, batch->list.count))) {
+		for (i = 0; i < batch->list.count; i++) {
+			if (ltdb_idx_batch_equal(batch, &batch->list.dn[i], v)) {
+				return i;
+			}
+		}
+		return -1;
+	}
+
+	mask = batch->hash_size - 1;
+	h = ltdb_idx_batch_hash_val(batch, v) & mask;
+	while (batch->hash[h] != 0) {
+		i = batch->hash[h] - 1;
+		if (ltdb_idx_batch_equal(batch, &batch->list.dn[i], v)) {
+			return i;
+		}
+		h = (h + 1) & mask;
+	}
+	return -1;
+}
+
+/*
+  add a value to an index record being changed. It must not be there
+  yet
+ */
+static int ltdb_idx_batch_append(struct ltdb_idx_batch *batch,
+				 const struct ldb_val *v)
+{
+	struct ldb_val *e;
+
+	if (batch->list.count == batch->alloc) {
+		unsigned int alloc = MAX(16, batch->alloc * 2);
+		struct ldb_val *dn;
+
+		dn = talloc_realloc(batch, batch->list.dn, struct ldb_val,
+				    alloc);
+		if (dn == NULL) {
+			return LDB_ERR_OPERATIONS_ERROR;
+		}
+		batch->list.dn = dn;
+		batch->alloc = alloc;
+	}
+
+	e = &batch->list.dn[batch->list.count];
+	if (batch->guid) {
+		if (batch->list.count > 0) {
+			const struct ldb_val *last =
+				&batch->list.dn[batch->list.count - 1];
+			if (last->data == NULL ||
+			    guid_list_cmp(last, v) > 0) {
+				batch->unsorted = true;
+			}
+		}
+		e->data = talloc_size(batch->list.dn, v->length + 1);
+		if (e->data != NULL) {
+			memcpy(e->data, v->data, v->length);
+			e->data[v->length] = 0;
+		}
+		e->length = v->length;
+	} else {
+		e->data = (uint8_t *)talloc_strndup(batch->list.dn,
+						    (const char *)v->data,
+						    v->length);
+		e->length = v->length;
+	}
+	if (e->data == NULL) {
 		return LDB_ERR_OPERATIONS_ERROR;
 	}
-	free(rec.dptr);
+	batch->list.count++;
+
+	if (batch->hash != NULL) {
+		if (batch->list.count * 2 > batch->hash_size) {
+			if (!ltdb_idx_batch_hash_build(batch,
+						       batch->list.count * 2)) {
+				return LDB_ERR_OPERATIONS_ERROR;
+			}
+		} else {
+			ltdb_idx_batch_hash_add(batch, batch->list.count - 1);
+		}
+	}
+
+	return LDB_SUCCESS;
+}
+
+/*
+  remove the value at position i from an index record being changed
+ */
+static void ltdb_idx_batch_remove(struct ltdb_idx_batch *batch,
+				  unsigned int i)
+{
+	if (i == batch->list.count - 1 && batch->hash == NULL) {
+		batch->list.count--;
+		return;
+	}
+
+	/* the entry stays in the hash table, pointing at nothing */
+	batch->list.dn[i].data = NULL;
+	batch->list.dn[i].length = 0;
+	batch->deleted++;
+}
+
+/*
+  bring an index record being changed back into the shape of a loaded
+  one: no cleared entries and GUIDs sorted
+ */
+static void ltdb_idx_batch_tidy(struct ltdb_idx_batch *batch)
+{
+	unsigned int i, j;
+
+	if (batch->deleted == 0 && !batch->unsorted) {
+		return;
+	}
+
+	if (batch->deleted != 0) {
+		for (i = j = 0; i < batch->list.count; i++) {
+			if (batch->list.dn[i].data != NULL) {
+				batch->list.dn[j++] = batch->list.dn[i];
+			}
+		}
+		batch->list.count = j;
+		batch->deleted = 0;
+	}
+
+	if (batch->unsorted) {
+		TYPESAFE_QSORT(batch->list.dn, batch->list.count,
+			       guid_list_cmp);
+		batch->unsorted = false;
+	}
+
+	/* the positions have changed */
+	TALLOC_FREE(batch->hash);
+	batch->hash_size = 0;
+}
+
+/*
+  point the entries of a dn_list at the GUIDs (and DNs) packed into
+  the @IDX value of a GUID index record
+ */
+static int ltdb_guid_list_unpack(struct ldb_module *module,
+				 struct dn_list *list,
+				 unsigned int version,
+				 struct ldb_message_element *el)
+{
+	uint8_t *guids;
+	size_t len, ofs;
+	unsigned int i, count;
+
+	if (el->num_values != 1 ||
+	    (version == LTDB_GUID_INDEXING_VERSION &&
+	     el->values[0].length % LTDB_GUID_SIZE != 0)) {
+		goto bad;
+	}
+
+	len = el->values[0].length;
+	if (version == LTDB_GUID_INDEXING_VERSION) {
+		count = len / LTDB_GUID_SIZE;
+	} else {
+		/* an upper bound, each entry takes at least this */
+		count = len / (LTDB_GUID_SIZE + 1);
+	}
+	list->dn = talloc_array(list, struct ldb_val, count);
+	if (list->dn == NULL) {
+		return ldb_module_oom(module);
+	}
+
+	/* the GUIDs stay where they are, in the packed value */
+	guids = talloc_steal(list->dn, el->values[0].data);
+	for (i = 0, ofs = 0; ofs < len; i++) {
+		uint8_t *end;
+
+		if (version == LTDB_GUID_INDEXING_VERSION) {
+			list->dn[i].data = guids + ofs;
+			list->dn[i].length = LTDB_GUID_SIZE;
+			ofs += LTDB_GUID_SIZE;
+			continue;
+		}
+
+		if (i == count || len - ofs < LTDB_GUID_SIZE + 1) {
+			goto bad;
+		}
+		end = memchr(guids + ofs + LTDB_GUID_SIZE, 0,
+			     len - ofs - LTDB_GUID_SIZE);
+		if (end == NULL) {
+			goto bad;
+		}
+		list->dn[i].data = guids + ofs;
+		list->dn[i].length = end - (guids + ofs);
+		ofs += list->dn[i].length + 1;
+	}
+	list->count = i;
 
-	*list = *list2;
 	return LDB_SUCCESS;
 
-normal_index:
+bad:
+	ldb_asprintf_errstring(ldb_module_get_ctx(module),
+			       "Bad GUID index record with %u values",
+			       el->num_values);
+	return LDB_ERR_OPERATIONS_ERROR;
+}
+
+/*
+  return the @IDX list in an index entry for a dn as a 
+  struct dn_list, as it is in the database
+ */
+static int ltdb_dn_list_load_full(struct ldb_module *module,
+				  struct ldb_dn *dn, struct dn_list *list)
+{
+	struct ldb_message *msg;
+	int ret;
+	struct ldb_message_element *el;
+	struct ltdb_private *ltdb = talloc_get_type(ldb_module_get_private(module), struct ltdb_private);
+
+	list->dn = NULL;
+	list->count = 0;
+
 	msg = ldb_msg_new(list);
 	if (msg == NULL) {
 		return LDB_ERR_OPERATIONS_ERROR;
@@ -192,6 +588,15 @@ normal_index:
 		return LDB_SUCCESS;
 	}
 
+	if (ltdb_dn_list_is_guid(ltdb, dn)) {
+		unsigned int version;
+
+		version = ldb_msg_find_attr_as_uint(msg, LTDB_IDXVERSION, 0);
+		ret = ltdb_guid_list_unpack(module, list, version, el);
+		talloc_free(msg);
+		return ret;
+	}
+
 	/* we avoid copying the strings by stealing the list */
 	list->dn = talloc_steal(list, el->values);
 	list->count = el->num_values;
@@ -199,6 +604,45 @@ normal_index:
 	return LDB_SUCCESS;
 }
 
+/*
+  return the @IDX list in an index entry for a dn as a 
+  struct dn_list
+ */
+static int ltdb_dn_list_load(struct ldb_module *module,
+			     struct ldb_dn *dn, struct dn_list *list)
+{
+	struct ltdb_private *ltdb = talloc_get_type(ldb_module_get_private(module), struct ltdb_private);
+	TDB_DATA rec;
+	struct ltdb_idx_batch *batch;
+	TDB_DATA key;
+
+	/* see if we have any in-memory index entries */
+	if (ltdb->idxptr == NULL ||
+	    ltdb->idxptr->itdb == NULL) {
+		return ltdb_dn_list_load_full(module, dn, list);
+	}
+
+	key.dptr = discard_const_p(unsigned char, ldb_dn_get_linearized(dn));
+	key.dsize = strlen((char *)key.dptr);
+
+	rec = tdb_fetch(ltdb->idxptr->itdb, key);
+	if (rec.dptr == NULL) {
+		return ltdb_dn_list_load_full(module, dn, list);
+	}
+
+	/* we've found an in-memory index entry */
+	batch = ltdb_index_idxptr(module, rec, true);
+	if (batch == NULL) {
+		free(rec.dptr);
+		return LDB_ERR_OPERATIONS_ERROR;
+	}
+	free(rec.dptr);
+
+	ltdb_idx_batch_tidy(batch);
+	*list = batch->list;
+	return LDB_SUCCESS;
+}
+
 
 /*
   save a dn_list into a full @IDX style record
@@ -206,7 +650,9 @@ normal_index:
 static int ltdb_dn_list_store_full(struct ldb_module *module, struct ldb_dn *dn, 
 				   struct dn_list *list)
 {
+	struct ltdb_private *ltdb = talloc_get_type(ldb_module_get_private(module), struct ltdb_private);
 	struct ldb_message *msg;
+	bool guid_list;
 	int ret;
 
 	if (list->count == 0) {
@@ -222,7 +668,11 @@ static int ltdb_dn_list_store_full(struct ldb_module *module, struct ldb_dn *dn,
 		return ldb_module_oom(module);
 	}
 
-	ret = ldb_msg_add_fmt(msg, LTDB_IDXVERSION, "%u", LTDB_INDEXING_VERSION);
+	guid_list = ltdb_dn_list_is_guid(ltdb, dn);
+
+	ret = ldb_msg_add_fmt(msg, LTDB_IDXVERSION, "%u",
+			      guid_list ? LTDB_GUID_DN_INDEXING_VERSION :
+			      LTDB_INDEXING_VERSION);
 	if (ret != LDB_SUCCESS) {
 		talloc_free(msg);
 		return ldb_module_oom(module);
@@ -237,8 +687,38 @@ static int ltdb_dn_list_store_full(struct ldb_module *module, struct ldb_dn *dn,
 			talloc_free(msg);
 			return ldb_module_oom(module);
 		}
-		el->values = list->dn;
-		el->num_values = list->count;
+
+		if (guid_list) {
+			struct ldb_val *v;
+			unsigned int i;
+			size_t ofs;
+
+			v = talloc(msg, struct ldb_val);
+			if (v == NULL) {
+				talloc_free(msg);
+				return ldb_module_oom(module);
+			}
+			v->length = 0;
+			for (i = 0; i < list->count; i++) {
+				v->length += list->dn[i].length + 1;
+			}
+			v->data = talloc_size(v, v->length);
+			if (v->data == NULL) {
+				talloc_free(msg);
+				return ldb_module_oom(module);
+			}
+			for (i = 0, ofs = 0; i < list->count; i++) {
+				memcpy(v->data + ofs, list->dn[i].data,
+				       list->dn[i].length);
+				ofs += list->dn[i].length;
+				v->data[ofs++] = 0;
+			}
+			el->values = v;
+			el->num_values = 1;
+		} else {
+			el->values = list->dn;
+			el->num_values = list->count;
+		}
 	}
 
 	ret = ltdb_store(module, msg, TDB_REPLACE);
@@ -246,61 +726,151 @@ static int ltdb_dn_list_store_full(struct ldb_module *module, struct ldb_dn *dn,
 	return ret;
 }
 
+static int ltdb_itdb_copy(struct tdb_context *tdb, TDB_DATA key, TDB_DATA data,
+			  void *state)
+{
+	struct tdb_context *itdb = (struct tdb_context *)state;
+
+	return tdb_store(itdb, key, data, TDB_INSERT);
+}
+
 /*
-  save a dn_list into the database, in either @IDX or internal format
+  move the in-memory index records to a larger hash table. Failing to
+  do so only costs time.
  */
-static int ltdb_dn_list_store(struct ldb_module *module, struct ldb_dn *dn, 
-			      struct dn_list *list)
+static void ltdb_itdb_grow(struct ltdb_idxptr *idxptr)
+{
+	unsigned int hash_size = idxptr->itdb_hash_size * 4;
+	struct tdb_context *itdb;
+
+	itdb = tdb_open(NULL, hash_size, TDB_INTERNAL, O_RDWR, 0);
+	if (itdb == NULL) {
+		return;
+	}
+	if (tdb_traverse_read(idxptr->itdb, ltdb_itdb_copy, itdb) < 0) {
+		tdb_close(itdb);
+		return;
+	}
+	tdb_close(idxptr->itdb);
+	idxptr->itdb = itdb;
+	idxptr->itdb_hash_size = hash_size;
+}
+
+/*
+  find the in-memory copy of an index record to change it, setting it
+  up from the database on first use in a transaction. Outside of a
+  transaction a temporary copy is set up, which
+  ltdb_idx_batch_release() stores.
+ */
+static int ltdb_idx_batch_get(struct ldb_module *module, struct ldb_dn *dn,
+			      bool load, struct ltdb_idx_batch **pbatch)
 {
 	struct ltdb_private *ltdb = talloc_get_type(ldb_module_get_private(module), struct ltdb_private);
 	TDB_DATA rec, key;
+	struct ltdb_idx_batch *batch;
+	struct dn_list *list;
 	int ret;
-	struct dn_list *list2;
 
-	if (ltdb->idxptr == NULL) {
-		return ltdb_dn_list_store_full(module, dn, list);
-	}
-
-	if (ltdb->idxptr->itdb == NULL) {
-		ltdb->idxptr->itdb = tdb_open(NULL, 1000, TDB_INTERNAL, O_RDWR, 0);
+	if (ltdb->idxptr != NULL) {
 		if (ltdb->idxptr->itdb == NULL) {
-			return LDB_ERR_OPERATIONS_ERROR;
+			ltdb->idxptr->itdb = tdb_open(NULL, LTDB_IDXPTR_HASH_SIZE,
+						      TDB_INTERNAL, O_RDWR, 0);
+			if (ltdb->idxptr->itdb == NULL) {
+				return LDB_ERR_OPERATIONS_ERROR;
+			}
+			ltdb->idxptr->itdb_hash_size = LTDB_IDXPTR_HASH_SIZE;
+			ltdb->idxptr->itdb_entries = 0;
 		}
-	}
 
-	key.dptr = discard_const_p(unsigned char, ldb_dn_get_linearized(dn));
-	key.dsize = strlen((char *)key.dptr);
+		key.dptr = discard_const_p(unsigned char, ldb_dn_get_linearized(dn));
+		key.dsize = strlen((char *)key.dptr);
 
-	rec = tdb_fetch(ltdb->idxptr->itdb, key);
-	if (rec.dptr != NULL) {
-		list2 = ltdb_index_idxptr(module, rec, false);
-		if (list2 == NULL) {
+		rec = tdb_fetch(ltdb->idxptr->itdb, key);
+		if (rec.dptr != NULL) {
+			batch = ltdb_index_idxptr(module, rec, false);
 			free(rec.dptr);
-			return LDB_ERR_OPERATIONS_ERROR;
+			if (batch == NULL) {
+				return LDB_ERR_OPERATIONS_ERROR;
+			}
+			*pbatch = batch;
+			return LDB_SUCCESS;
 		}
-		free(rec.dptr);
-		list2->dn = talloc_steal(list2, list->dn);
-		list2->count = list->count;
-		return LDB_SUCCESS;
-	}
 
-	list2 = talloc(ltdb->idxptr, struct dn_list);
-	if (list2 == NULL) {
+		batch = talloc_zero(ltdb->idxptr, struct ltdb_idx_batch);
+	} else {
+		batch = talloc_zero(module, struct ltdb_idx_batch);
+	}
+	if (batch == NULL) {
 		return LDB_ERR_OPERATIONS_ERROR;
 	}
-	list2->dn = talloc_steal(list2, list->dn);
-	list2->count = list->count;
+	batch->guid = ltdb_dn_list_is_guid(ltdb, dn);
 
-	rec.dptr = (uint8_t *)&list2;
-	rec.dsize = sizeof(void *);
+	/* a reindex starts from nothing */
+	if (ltdb->idxptr != NULL && ltdb->idxptr->reindexing) {
+		load = false;
+	}
 
-	ret = tdb_store(ltdb->idxptr->itdb, key, rec, TDB_INSERT);
-	if (ret != 0) {
-		return ltdb_err_map(tdb_error(ltdb->idxptr->itdb));
+	if (load) {
+		/* the loaded values may point into the record, which
+		   stays with the list */
+		list = talloc_zero(batch, struct dn_list);
+		if (list == NULL) {
+			talloc_free(batch);
+			return LDB_ERR_OPERATIONS_ERROR;
+		}
+		ret = ltdb_dn_list_load_full(module, dn, list);
+		if (ret != LDB_SUCCESS && ret != LDB_ERR_NO_SUCH_OBJECT) {
+			talloc_free(batch);
+			return ret;
+		}
+		batch->list.dn = talloc_steal(batch, list->dn);
+		batch->list.count = list->count;
+		batch->alloc = list->count;
 	}
+
+	if (ltdb->idxptr != NULL) {
+		rec.dptr = (uint8_t *)&batch;
+		rec.dsize = sizeof(void *);
+
+		ret = tdb_store(ltdb->idxptr->itdb, key, rec, TDB_INSERT);
+		if (ret != 0) {
+			talloc_free(batch);
+			return ltdb_err_map(tdb_error(ltdb->idxptr->itdb));
+		}
+
+		ltdb->idxptr->itdb_entries++;
+		if (ltdb->idxptr->itdb_entries >
+		    ltdb->idxptr->itdb_hash_size * 4) {
+			ltdb_itdb_grow(ltdb->idxptr);
+		}
+	}
+
+	*pbatch = batch;
 	return LDB_SUCCESS;
 }
 
+/*
+  done with changing an index record. In a transaction it stays in
+  memory until the commit, otherwise it is stored now if it changed
+ */
+static int ltdb_idx_batch_release(struct ldb_module *module, struct ldb_dn *dn,
+				  struct ltdb_idx_batch *batch, bool changed)
+{
+	struct ltdb_private *ltdb = talloc_get_type(ldb_module_get_private(module), struct ltdb_private);
+	int ret = LDB_SUCCESS;
+
+	if (ltdb->idxptr != NULL) {
+		return LDB_SUCCESS;
+	}
+
+	if (changed) {
+		ltdb_idx_batch_tidy(batch);
+		ret = ltdb_dn_list_store_full(module, dn, &batch->list);
+	}
+	talloc_free(batch);
+	return ret;
+}
+
 /*
   traverse function for storing the in-memory index entries on disk
  */
@@ -311,10 +881,10 @@ static int ltdb_index_traverse_store(struct tdb_context *tdb, TDB_DATA key, TDB_
 	struct ldb_dn *dn;
 	struct ldb_context *ldb = ldb_module_get_ctx(module);
 	struct ldb_val v;
-	struct dn_list *list;
+	struct ltdb_idx_batch *batch;
 
-	list = ltdb_index_idxptr(module, data, true);
-	if (list == NULL) {
+	batch = ltdb_index_idxptr(module, data, true);
+	if (batch == NULL) {
 		ltdb->idxptr->error = LDB_ERR_OPERATIONS_ERROR;
 		return -1;
 	}
@@ -329,7 +899,8 @@ static int ltdb_index_traverse_store(struct tdb_context *tdb, TDB_DATA key, TDB_
 		return -1;
 	}
 
-	ltdb->idxptr->error = ltdb_dn_list_store_full(module, dn, list);
+	ltdb_idx_batch_tidy(batch);
+	ltdb->idxptr->error = ltdb_dn_list_store_full(module, dn, &batch->list);
 	talloc_free(dn);
 	if (ltdb->idxptr->error != 0) {
 		return -1;
@@ -466,6 +1037,97 @@ static bool ltdb_is_indexed(const struct ldb_message *index_list, const char *at
                                we'll need a full search
  */
 
+/*
+  in a GUID indexed database a search on the GUID attribute already
+  gives the entry for the list
+ */
+static int ltdb_index_dn_guid(struct ldb_module *module,
+			      const struct ldb_parse_tree *tree,
+			      struct dn_list *list)
+{
+	struct ldb_context *ldb = ldb_module_get_ctx(module);
+	const struct ldb_schema_attribute *a;
+	struct ldb_val v;
+	int ret;
+
+	a = ldb_schema_attribute_by_name(ldb, tree->u.equality.attr);
+	ret = a->syntax->canonicalise_fn(ldb, list, &tree->u.equality.value, &v);
+	if (ret != LDB_SUCCESS) {
+		return LDB_ERR_OPERATIONS_ERROR;
+	}
+	if (v.length != LTDB_GUID_SIZE) {
+		/* not in a form we can look up */
+		return LDB_ERR_OPERATIONS_ERROR;
+	}
+
+	list->dn = talloc_array(list, struct ldb_val, 1);
+	if (list->dn == NULL) {
+		return ldb_module_oom(module);
+	}
+	list->dn[0].data = talloc_memdup(list->dn, v.data, LTDB_GUID_SIZE);
+	if (list->dn[0].data == NULL) {
+		return ldb_module_oom(module);
+	}
+	list->dn[0].length = LTDB_GUID_SIZE;
+	list->count = 1;
+
+	return LDB_SUCCESS;
+}
+
+/*
+  in a GUID indexed database a (dn=...) search needs the GUID of that
+  record
+ */
+static int ltdb_index_dn_base_guid(struct ldb_module *module,
+				   const struct ldb_val *dn_val,
+				   struct dn_list *list)
+{
+	struct ldb_context *ldb = ldb_module_get_ctx(module);
+	struct ldb_message *msg;
+	const struct ldb_val *guid;
+	struct ldb_dn *dn;
+	int ret;
+
+	msg = ldb_msg_new(list);
+	if (msg == NULL) {
+		return ldb_module_oom(module);
+	}
+
+	dn = ldb_dn_from_ldb_val(msg, ldb, dn_val);
+	if (dn == NULL) {
+		talloc_free(msg);
+		return LDB_ERR_OPERATIONS_ERROR;
+	}
+
+	ret = ltdb_search_dn1(module, dn, msg);
+	if (ret != LDB_SUCCESS) {
+		talloc_free(msg);
+		return ret;
+	}
+
+	ret = ltdb_index_msg_guid(module, msg, &guid);
+	if (ret != LDB_SUCCESS) {
+		talloc_free(msg);
+		return LDB_ERR_OPERATIONS_ERROR;
+	}
+
+	list->dn = talloc_array(list, struct ldb_val, 1);
+	if (list->dn == NULL) {
+		talloc_free(msg);
+		return ldb_module_oom(module);
+	}
+	ret = ltdb_guid_entry(list->dn, guid, ldb_dn_get_linearized(msg->dn),
+			      &list->dn[0]);
+	if (ret != LDB_SUCCESS) {
+		talloc_free(msg);
+		return ldb_module_oom(module);
+	}
+	list->count = 1;
+
+	talloc_free(msg);
+	return LDB_SUCCESS;
+}
+
 /*
   return a list of dn's that might match a simple indexed search (an
   equality search only)
@@ -475,6 +1137,7 @@ static int ltdb_index_dn_simple(struct ldb_module *module,
 				const struct ldb_message *index_list,
 				struct dn_list *list)
 {
+	struct ltdb_private *ltdb = talloc_get_type(ldb_module_get_private(module), struct ltdb_private);
 	struct ldb_context *ldb;
 	struct ldb_dn *dn;
 	int ret;
@@ -490,6 +1153,10 @@ static int ltdb_index_dn_simple(struct ldb_module *module,
 		return LDB_ERR_OPERATIONS_ERROR;
 	}
 
+	if (ltdb_is_guid_attr(ltdb, tree->u.equality.attr)) {
+		return ltdb_index_dn_guid(module, tree, list);
+	}
+
 	/* the attribute is indexed. Pull the list of DNs that match the 
 	   search criterion */
 	dn = ltdb_index_key(ldb, tree->u.equality.attr, &tree->u.equality.value, NULL);
@@ -501,7 +1168,8 @@ static int ltdb_index_dn_simple(struct ldb_module *module,
 }
 
 
-static bool list_union(struct ldb_context *, struct dn_list *, const struct dn_list *);
+static bool list_union(struct ldb_context *, struct ltdb_private *,
+		       struct dn_list *, const struct dn_list *);
 
 /*
   return a list of dn's that might match a leaf indexed search
@@ -521,6 +1189,11 @@ static int ltdb_index_dn_leaf(struct ldb_module *module,
 		return LDB_SUCCESS;
 	}
 	if (ldb_attr_dn(tree->u.equality.attr) == 0) {
+		if (ltdb->cache->GUID_index_attribute != NULL) {
+			return ltdb_index_dn_base_guid(module,
+						       &tree->u.equality.value,
+						       list);
+		}
 		list->dn = talloc_array(list, struct ldb_val, 1);
 		if (list->dn == NULL) {
 			ldb_module_oom(module);
@@ -539,10 +1212,11 @@ static int ltdb_index_dn_leaf(struct ldb_module *module,
   list = list & list2
 */
 static bool list_intersect(struct ldb_context *ldb,
+			   struct ltdb_private *ltdb,
 			   struct dn_list *list, const struct dn_list *list2)
 {
 	struct dn_list *list3;
-	unsigned int i;
+	unsigned int i, j;
 
 	if (list->count == 0) {
 		/* 0 & X == 0 */
@@ -585,10 +1259,29 @@ static bool list_intersect(struct ldb_context *ldb,
 	}
 	list3->count = 0;
 
-	for (i=0;i<list->count;i++) {
-		if (ltdb_dn_list_find_val(list2, &list->dn[i]) != -1) {
-			list3->dn[list3->count] = list->dn[i];
-			list3->count++;
+	if (ltdb->cache->GUID_index_attribute != NULL) {
+		/* sorted GUIDs, so this is a merge */
+		i = j = 0;
+		while (i < list->count && j < list2->count) {
+			int c = guid_list_cmp(&list->dn[i], &list2->dn[j]);
+
+			if (c == 0) {
+				list3->dn[list3->count] = list->dn[i];
+				list3->count++;
+				i++;
+				j++;
+			} else if (c < 0) {
+				i++;
+			} else {
+				j++;
+			}
+		}
+	} else {
+		for (i=0;i<list->count;i++) {
+			if (ltdb_dn_list_find_val(list2, &list->dn[i]) != -1) {
+				list3->dn[list3->count] = list->dn[i];
+				list3->count++;
+			}
 		}
 	}
 
@@ -605,9 +1298,11 @@ static bool list_intersect(struct ldb_context *ldb,
   list = list | list2
 */
 static bool list_union(struct ldb_context *ldb,
+		       struct ltdb_private *ltdb,
 		       struct dn_list *list, const struct dn_list *list2)
 {
 	struct ldb_val *dn3;
+	unsigned int i, j, k;
 
 	if (list2->count == 0) {
 		/* X | 0 == X */
@@ -632,6 +1327,33 @@ static bool list_union(struct ldb_context *ldb,
 		return false;
 	}
 
+	if (ltdb->cache->GUID_index_attribute != NULL) {
+		/* merge the sorted GUIDs, the result has no duplicates */
+		i = j = k = 0;
+		while (i < list->count && j < list2->count) {
+			int c = guid_list_cmp(&list->dn[i], &list2->dn[j]);
+
+			if (c <= 0) {
+				dn3[k++] = list->dn[i++];
+				if (c == 0) {
+					j++;
+				}
+			} else {
+				dn3[k++] = list2->dn[j++];
+			}
+		}
+		while (i < list->count) {
+			dn3[k++] = list->dn[i++];
+		}
+		while (j < list2->count) {
+			dn3[k++] = list2->dn[j++];
+		}
+
+		list->dn = dn3;
+		list->count = k;
+		return true;
+	}
+
 	/* we allow for duplicates here, and get rid of them later */
 	memcpy(dn3, list->dn, sizeof(list->dn[0])*list->count);
 	memcpy(dn3+list->count, list2->dn, sizeof(list2->dn[0])*list2->count);
@@ -656,6 +1378,7 @@ static int ltdb_index_dn_or(struct ldb_module *module,
 			    const struct ldb_message *index_list,
 			    struct dn_list *list)
 {
+	struct ltdb_private *ltdb = talloc_get_type(ldb_module_get_private(module), struct ltdb_private);
 	struct ldb_context *ldb;
 	unsigned int i;
 
@@ -687,7 +1410,7 @@ static int ltdb_index_dn_or(struct ldb_module *module,
 			return ret;
 		}
 
-		if (!list_union(ldb, list, list2)) {
+		if (!list_union(ldb, ltdb, list, list2)) {
 			talloc_free(list2);
 			return LDB_ERR_OPERATIONS_ERROR;
 		}
@@ -722,9 +1445,13 @@ static int ltdb_index_dn_not(struct ldb_module *module,
 
 
 static bool ltdb_index_unique(struct ldb_context *ldb,
+			      struct ltdb_private *ltdb,
 			      const char *attr)
 {
 	const struct ldb_schema_attribute *a;
+	if (ltdb_is_guid_attr(ltdb, attr)) {
+		return true;
+	}
 	a = ldb_schema_attribute_by_name(ldb, attr);
 	if (a->flags & LDB_ATTR_FLAG_UNIQUE_INDEX) {
 		return true;
@@ -740,6 +1467,7 @@ static int ltdb_index_dn_and(struct ldb_module *module,
 			     const struct ldb_message *index_list,
 			     struct dn_list *list)
 {
+	struct ltdb_private *ltdb = talloc_get_type(ldb_module_get_private(module), struct ltdb_private);
 	struct ldb_context *ldb;
 	unsigned int i;
 	bool found;
@@ -757,7 +1485,7 @@ static int ltdb_index_dn_and(struct ldb_module *module,
 		int ret;
 
 		if (subtree->operation != LDB_OP_EQUALITY ||
-		    !ltdb_index_unique(ldb, subtree->u.equality.attr)) {
+		    !ltdb_index_unique(ldb, ltdb, subtree->u.equality.attr)) {
 			continue;
 		}
 		
@@ -809,7 +1537,7 @@ static int ltdb_index_dn_and(struct ldb_module *module,
 			list->dn = list2->dn;
 			list->count = list2->count;
 			found = true;
-		} else if (!list_intersect(ldb, list, list2)) {
+		} else if (!list_intersect(ldb, ltdb, list, list2)) {
 			talloc_free(list2);
 			return LDB_ERR_OPERATIONS_ERROR;
 		}
@@ -908,82 +1636,126 @@ static int ltdb_index_dn(struct ldb_module *module,
 		break;
 	}
 
-	return ret;
+	return ret;
+}
+
+/*
+  find the DN of a record by its GUID, using the index of the GUID
+  attribute
+ */
+static int ltdb_index_guid_to_dn(struct ldb_module *module,
+				 TALLOC_CTX *mem_ctx,
+				 const struct ldb_val *guid,
+				 struct ldb_dn **dn)
+{
+	struct ltdb_private *ltdb = talloc_get_type(ldb_module_get_private(module), struct ltdb_private);
+	struct ldb_context *ldb = ldb_module_get_ctx(module);
+	struct ldb_dn *key;
+	struct dn_list *list;
+	int ret;
+
+	key = ltdb_index_key(ldb, ltdb->cache->GUID_index_attribute, guid,
+			     NULL);
+	if (key == NULL) {
+		return LDB_ERR_OPERATIONS_ERROR;
+	}
+
+	list = talloc_zero(key, struct dn_list);
+	if (list == NULL) {
+		talloc_free(key);
+		return ldb_module_oom(module);
+	}
+
+	ret = ltdb_dn_list_load(module, key, list);
+	if (ret != LDB_SUCCESS) {
+		talloc_free(key);
+		return ret;
+	}
+
+	if (list->count == 0) {
+		talloc_free(key);
+		return LDB_ERR_NO_SUCH_OBJECT;
+	}
+	if (list->count > 1) {
+		ldb_asprintf_errstring(ldb, __location__ ": %u records for a %s",
+				       list->count,
+				       ltdb->cache->GUID_index_attribute);
+		talloc_free(key);
+		return LDB_ERR_OPERATIONS_ERROR;
+	}
+
+	*dn = ldb_dn_from_ldb_val(mem_ctx, ldb, &list->dn[0]);
+	talloc_free(key);
+	if (*dn == NULL) {
+		return LDB_ERR_OPERATIONS_ERROR;
+	}
+
+	return LDB_SUCCESS;
 }
 
 /*
   filter a candidate dn_list from an indexed search into a set of results
-  extracting just the given attributes
+  extracting just the given attributes. The list holds GUIDs if
+  guid_list is set, followed by the DNs unless they come from an older
+  index record.
 */
 static int ltdb_index_filter(const struct dn_list *dn_list,
+			     bool guid_list,
 			     struct ltdb_context *ac, 
 			     uint32_t *match_count)
 {
 	struct ldb_context *ldb;
-	struct ldb_message *msg;
 	unsigned int i;
 
 	ldb = ldb_module_get_ctx(ac->module);
 
 	for (i = 0; i < dn_list->count; i++) {
-		struct ldb_dn *dn;
+		struct ldb_dn *dn = NULL;
 		int ret;
 		bool matched;
 
-		msg = ldb_msg_new(ac);
-		if (!msg) {
-			return LDB_ERR_OPERATIONS_ERROR;
-		}
-
-		dn = ldb_dn_from_ldb_val(msg, ldb, &dn_list->dn[i]);
-		if (dn == NULL) {
-			talloc_free(msg);
-			return LDB_ERR_OPERATIONS_ERROR;
+		if (guid_list &&
+		    dn_list->dn[i].length > LTDB_GUID_SIZE) {
+			struct ldb_val dn_val = {
+				.data = dn_list->dn[i].data + LTDB_GUID_SIZE,
+				.length = dn_list->dn[i].length -
+					LTDB_GUID_SIZE,
+			};
+			dn = ldb_dn_from_ldb_val(ac, ldb, &dn_val);
+			if (dn == NULL) {
+				return LDB_ERR_OPERATIONS_ERROR;
+			}
+		} else if (guid_list) {
+			ret = ltdb_index_guid_to_dn(ac->module, ac,
+						    &dn_list->dn[i], &dn);
+			if (ret == LDB_ERR_NO_SUCH_OBJECT) {
+				/* gone meanwhile, as below */
+				continue;
+			}
+			if (ret != LDB_SUCCESS) {
+				return ret;
+			}
+		} else {
+			dn = ldb_dn_from_ldb_val(ac, ldb, &dn_list->dn[i]);
+			if (dn == NULL) {
+				return LDB_ERR_OPERATIONS_ERROR;
+			}
 		}
 
-		ret = ltdb_search_dn1(ac->module, dn, msg);
+		ret = ltdb_search_dn_match(ac, dn, &matched);
 		talloc_free(dn);
 		if (ret == LDB_ERR_NO_SUCH_OBJECT) {
 			/* the record has disappeared? yes, this can happen */
-			talloc_free(msg);
 			continue;
 		}
-
-		if (ret != LDB_SUCCESS && ret != LDB_ERR_NO_SUCH_OBJECT) {
-			/* an internal error */
-			talloc_free(msg);
-			return LDB_ERR_OPERATIONS_ERROR;
-		}
-
-		ret = ldb_match_msg_error(ldb, msg,
-					  ac->tree, ac->base, ac->scope, &matched);
 		if (ret != LDB_SUCCESS) {
-			talloc_free(msg);
+			/* an internal error, or the callback failed */
 			return ret;
 		}
-		if (!matched) {
-			talloc_free(msg);
-			continue;
-		}
-
-		/* filter the attributes that the user wants */
-		ret = ltdb_filter_attrs(msg, ac->attrs);
-
-		if (ret == -1) {
-			talloc_free(msg);
-			return LDB_ERR_OPERATIONS_ERROR;
-		}
 
-		ret = ldb_module_send_entry(ac->req, msg, NULL);
-		if (ret != LDB_SUCCESS) {
-			/* Regardless of success or failure, the msg
-			 * is the callbacks responsiblity, and should
-			 * not be talloc_free()'ed */
-			ac->request_terminated = true;
-			return ret;
+		if (matched) {
+			(*match_count)++;
 		}
-
-		(*match_count)++;
 	}
 
 	return LDB_SUCCESS;
@@ -1024,6 +1796,7 @@ int ltdb_search_indexed(struct ltdb_context *ac, uint32_t *match_count)
 {
 	struct ltdb_private *ltdb = talloc_get_type(ldb_module_get_private(ac->module), struct ltdb_private);
 	struct dn_list *dn_list;
+	bool guid_list = (ltdb->cache->GUID_index_attribute != NULL);
 	int ret;
 
 	/* see if indexing is enabled */
@@ -1053,6 +1826,7 @@ int ltdb_search_indexed(struct ltdb_context *ac, uint32_t *match_count)
 		}
 		dn_list->dn[0].length = strlen((char *)dn_list->dn[0].data);
 		dn_list->count = 1;
+		guid_list = false;
 		break;		
 
 	case LDB_SCOPE_ONELEVEL:
@@ -1078,11 +1852,14 @@ int ltdb_search_indexed(struct ltdb_context *ac, uint32_t *match_count)
 			talloc_free(dn_list);
 			return ret;
 		}
-		ltdb_dn_list_remove_duplicates(dn_list);
+		if (!guid_list) {
+			/* GUID lists are kept sorted and unique */
+			ltdb_dn_list_remove_duplicates(dn_list);
+		}
 		break;
 	}
 
-	ret = ltdb_index_filter(dn_list, ac, match_count);
+	ret = ltdb_index_filter(dn_list, guid_list, ac, match_count);
 	talloc_free(dn_list);
 	return ret;
 }
@@ -1091,12 +1868,10 @@ int ltdb_search_indexed(struct ltdb_context *ac, uint32_t *match_count)
  * @brief Add a DN in the index list of a given attribute name/value pair
  *
  * This function will add the DN in the index list for the index for
- * the given attribute name and value.
+ * the given attribute name and value. In a GUID indexed database the
+ * GUID of the record is added instead.
  *
- * @param[in]  module       A ldb_module structure
- *
- * @param[in]  dn           The string representation of the DN as it
- *                          will be stored in the index entry
+ * @param[in]  msg          The record to index
  *
  * @param[in]  el           A ldb_message_element array, one of the entry
  *                          referred by the v_idx is the attribute name and
@@ -1107,64 +1882,79 @@ int ltdb_search_indexed(struct ltdb_context *ac, uint32_t *match_count)
  *
  * @return                  An ldb error code
  */
-static int ltdb_index_add1(struct ldb_module *module, const char *dn,
+static int ltdb_index_add1(struct ldb_module *module,
+			   const struct ldb_message *msg,
 			   struct ldb_message_element *el, int v_idx)
 {
+	struct ltdb_private *ltdb = talloc_get_type(ldb_module_get_private(module), struct ltdb_private);
 	struct ldb_context *ldb;
 	struct ldb_dn *dn_key;
 	int ret;
 	const struct ldb_schema_attribute *a;
-	struct dn_list *list;
-	unsigned alloc_len;
+	struct ltdb_idx_batch *batch;
+	const struct ldb_val *guid = NULL;
+	struct ldb_val v;
+	const char *dn;
 
 	ldb = ldb_module_get_ctx(module);
 
-	list = talloc_zero(module, struct dn_list);
-	if (list == NULL) {
+	dn = ldb_dn_get_linearized(msg->dn);
+	if (dn == NULL) {
 		return LDB_ERR_OPERATIONS_ERROR;
 	}
 
 	dn_key = ltdb_index_key(ldb, el->name, &el->values[v_idx], &a);
 	if (!dn_key) {
-		talloc_free(list);
 		return LDB_ERR_OPERATIONS_ERROR;
 	}
-	talloc_steal(list, dn_key);
 
-	ret = ltdb_dn_list_load(module, dn_key, list);
-	if (ret != LDB_SUCCESS && ret != LDB_ERR_NO_SUCH_OBJECT) {
-		talloc_free(list);
+	ret = ltdb_idx_batch_get(module, dn_key, true, &batch);
+	if (ret != LDB_SUCCESS) {
+		talloc_free(dn_key);
 		return ret;
 	}
 
-	if (ltdb_dn_list_find_str(list, dn) != -1) {
-		talloc_free(list);
-		return LDB_SUCCESS;
+	if (batch->guid) {
+		ret = ltdb_index_msg_guid(module, msg, &guid);
+		if (ret == LDB_SUCCESS) {
+			ret = ltdb_guid_entry(dn_key, guid, dn, &v);
+		}
+		if (ret != LDB_SUCCESS) {
+			ltdb_idx_batch_release(module, dn_key, batch, false);
+			talloc_free(dn_key);
+			return ret;
+		}
+	} else {
+		v.data = discard_const_p(uint8_t, dn);
+		v.length = strlen(dn);
+	}
+
+	if (ltdb_idx_batch_find(batch, &v) != -1) {
+		ret = ltdb_idx_batch_release(module, dn_key, batch, false);
+		talloc_free(dn_key);
+		return ret;
 	}
 
-	if (list->count > 0 &&
-	    a->flags & LDB_ATTR_FLAG_UNIQUE_INDEX) {
-		talloc_free(list);
+	if (batch->list.count > batch->deleted &&
+	    ((a->flags & LDB_ATTR_FLAG_UNIQUE_INDEX) ||
+	     ltdb_is_guid_attr(ltdb, el->name))) {
+		ltdb_idx_batch_release(module, dn_key, batch, false);
+		talloc_free(dn_key);
 		ldb_asprintf_errstring(ldb, __location__ ": unique index violation on %s in %s",
 				       el->name, dn);
 		return LDB_ERR_ENTRY_ALREADY_EXISTS;		
 	}
 
-	/* overallocate the list a bit, to reduce the number of
-	 * realloc trigered copies */	 
-	alloc_len = ((list->count+1)+7) & ~7;
-	list->dn = talloc_realloc(list, list->dn, struct ldb_val, alloc_len);
-	if (list->dn == NULL) {
-		talloc_free(list);
-		return LDB_ERR_OPERATIONS_ERROR;
+	ret = ltdb_idx_batch_append(batch, &v);
+	if (ret != LDB_SUCCESS) {
+		ltdb_idx_batch_release(module, dn_key, batch, false);
+		talloc_free(dn_key);
+		return ret;
 	}
-	list->dn[list->count].data = (uint8_t *)talloc_strdup(list->dn, dn);
-	list->dn[list->count].length = strlen(dn);
-	list->count++;
 
-	ret = ltdb_dn_list_store(module, dn_key, list);
+	ret = ltdb_idx_batch_release(module, dn_key, batch, true);
 
-	talloc_free(list);
+	talloc_free(dn_key);
 
 	return ret;
 }
@@ -1172,12 +1962,13 @@ static int ltdb_index_add1(struct ldb_module *module, const char *dn,
 /*
   add index entries for one elements in a message
  */
-static int ltdb_index_add_el(struct ldb_module *module, const char *dn,
+static int ltdb_index_add_el(struct ldb_module *module,
+			     const struct ldb_message *msg,
 			     struct ldb_message_element *el)
 {
 	unsigned int i;
 	for (i = 0; i < el->num_values; i++) {
-		int ret = ltdb_index_add1(module, dn, el, i);
+		int ret = ltdb_index_add1(module, msg, el, i);
 		if (ret != LDB_SUCCESS) {
 			return ret;
 		}
@@ -1189,12 +1980,19 @@ static int ltdb_index_add_el(struct ldb_module *module, const char *dn,
 /*
   add index entries for all elements in a message
  */
-static int ltdb_index_add_all(struct ldb_module *module, const char *dn,
-			      struct ldb_message_element *elements, int num_el)
+static int ltdb_index_add_all(struct ldb_module *module,
+			      const struct ldb_message *msg)
 {
 	struct ltdb_private *ltdb = talloc_get_type(ldb_module_get_private(module), struct ltdb_private);
+	struct ldb_message_element *elements = msg->elements;
+	const char *dn;
 	unsigned int i;
 
+	dn = ldb_dn_get_linearized(msg->dn);
+	if (dn == NULL) {
+		return LDB_ERR_OPERATIONS_ERROR;
+	}
+
 	if (dn[0] == '@') {
 		return LDB_SUCCESS;
 	}
@@ -1204,12 +2002,23 @@ static int ltdb_index_add_all(struct ldb_module *module, const char *dn,
 		return LDB_SUCCESS;
 	}
 
-	for (i = 0; i < num_el; i++) {
+	if (ltdb->cache->GUID_index_attribute != NULL) {
+		const struct ldb_val *guid;
+		int ret;
+
+		/* records without a GUID could not be indexed */
+		ret = ltdb_index_msg_guid(module, msg, &guid);
+		if (ret != LDB_SUCCESS) {
+			return ret;
+		}
+	}
+
+	for (i = 0; i < msg->num_elements; i++) {
 		int ret;
 		if (!ltdb_is_indexed(ltdb->cache->indexlist, elements[i].name)) {
 			continue;
 		}
-		ret = ltdb_index_add_el(module, dn, &elements[i]);
+		ret = ltdb_index_add_el(module, msg, &elements[i]);
 		if (ret != LDB_SUCCESS) {
 			struct ldb_context *ldb = ldb_module_get_ctx(module);
 			ldb_asprintf_errstring(ldb,
@@ -1232,7 +2041,6 @@ static int ltdb_index_onelevel(struct ldb_module *module, const struct ldb_messa
 	struct ldb_message_element el;
 	struct ldb_val val;
 	struct ldb_dn *pdn;
-	const char *dn;
 	int ret;
 
 	/* We index for ONE Level only if requested */
@@ -1245,12 +2053,6 @@ static int ltdb_index_onelevel(struct ldb_module *module, const struct ldb_messa
 		return LDB_ERR_OPERATIONS_ERROR;
 	}
 
-	dn = ldb_dn_get_linearized(msg->dn);
-	if (dn == NULL) {
-		talloc_free(pdn);
-		return LDB_ERR_OPERATIONS_ERROR;
-	}
-
 	val.data = (uint8_t *)((uintptr_t)ldb_dn_get_casefold(pdn));
 	if (val.data == NULL) {
 		talloc_free(pdn);
@@ -1263,9 +2065,9 @@ static int ltdb_index_onelevel(struct ldb_module *module, const struct ldb_messa
 	el.num_values = 1;
 
 	if (add) {
-		ret = ltdb_index_add1(module, dn, &el, 0);
+		ret = ltdb_index_add1(module, msg, &el, 0);
 	} else { /* delete */
-		ret = ltdb_index_del_value(module, msg->dn, &el, 0);
+		ret = ltdb_index_del_value(module, msg, &el, 0);
 	}
 
 	talloc_free(pdn);
@@ -1277,17 +2079,18 @@ static int ltdb_index_onelevel(struct ldb_module *module, const struct ldb_messa
   add the index entries for a new element in a record
   The caller guarantees that these element values are not yet indexed
 */
-int ltdb_index_add_element(struct ldb_module *module, struct ldb_dn *dn, 
+int ltdb_index_add_element(struct ldb_module *module,
+			   const struct ldb_message *msg,
 			   struct ldb_message_element *el)
 {
 	struct ltdb_private *ltdb = talloc_get_type(ldb_module_get_private(module), struct ltdb_private);
-	if (ldb_dn_is_special(dn)) {
+	if (ldb_dn_is_special(msg->dn)) {
 		return LDB_SUCCESS;
 	}
 	if (!ltdb_is_indexed(ltdb->cache->indexlist, el->name)) {
 		return LDB_SUCCESS;
 	}
-	return ltdb_index_add_el(module, ldb_dn_get_linearized(dn), el);
+	return ltdb_index_add_el(module, msg, el);
 }
 
 /*
@@ -1295,19 +2098,13 @@ int ltdb_index_add_element(struct ldb_module *module, struct ldb_dn *dn,
 */
 int ltdb_index_add_new(struct ldb_module *module, const struct ldb_message *msg)
 {
-	const char *dn;
 	int ret;
 
 	if (ldb_dn_is_special(msg->dn)) {
 		return LDB_SUCCESS;
 	}
 
-	dn = ldb_dn_get_linearized(msg->dn);
-	if (dn == NULL) {
-		return LDB_ERR_OPERATIONS_ERROR;
-	}
-
-	ret = ltdb_index_add_all(module, dn, msg->elements, msg->num_elements);
+	ret = ltdb_index_add_all(module, msg);
 	if (ret != LDB_SUCCESS) {
 		return ret;
 	}
@@ -1319,19 +2116,21 @@ int ltdb_index_add_new(struct ldb_module *module, const struct ldb_message *msg)
 /*
   delete an index entry for one message element
 */
-int ltdb_index_del_value(struct ldb_module *module, struct ldb_dn *dn,
+int ltdb_index_del_value(struct ldb_module *module,
+			 const struct ldb_message *msg,
 			 struct ldb_message_element *el, unsigned int v_idx)
 {
 	struct ldb_context *ldb;
 	struct ldb_dn *dn_key;
 	const char *dn_str;
 	int ret, i;
-	unsigned int j;
-	struct dn_list *list;
+	struct ltdb_idx_batch *batch;
+	const struct ldb_val *guid;
+	struct ldb_val v;
 
 	ldb = ldb_module_get_ctx(module);
 
-	dn_str = ldb_dn_get_linearized(dn);
+	dn_str = ldb_dn_get_linearized(msg->dn);
 	if (dn_str == NULL) {
 		return LDB_ERR_OPERATIONS_ERROR;
 	}
@@ -1345,40 +2144,36 @@ int ltdb_index_del_value(struct ldb_module *module, struct ldb_dn *dn,
 		return LDB_ERR_OPERATIONS_ERROR;
 	}
 
-	list = talloc_zero(dn_key, struct dn_list);
-	if (list == NULL) {
-		talloc_free(dn_key);
-		return LDB_ERR_OPERATIONS_ERROR;
-	}
-
-	ret = ltdb_dn_list_load(module, dn_key, list);
-	if (ret == LDB_ERR_NO_SUCH_OBJECT) {
-		/* it wasn't indexed. Did we have an earlier error? If we did then
-		   its gone now */
-		talloc_free(dn_key);
-		return LDB_SUCCESS;
-	}
-
+	ret = ltdb_idx_batch_get(module, dn_key, true, &batch);
 	if (ret != LDB_SUCCESS) {
 		talloc_free(dn_key);
 		return ret;
 	}
 
-	i = ltdb_dn_list_find_str(list, dn_str);
+	if (batch->guid) {
+		ret = ltdb_index_msg_guid(module, msg, &guid);
+		if (ret != LDB_SUCCESS) {
+			ltdb_idx_batch_release(module, dn_key, batch, false);
+			talloc_free(dn_key);
+			return ret;
+		}
+		v = *guid;
+	} else {
+		v.data = discard_const_p(uint8_t, dn_str);
+		v.length = strlen(dn_str);
+	}
+
+	i = ltdb_idx_batch_find(batch, &v);
 	if (i == -1) {
 		/* nothing to delete */
+		ret = ltdb_idx_batch_release(module, dn_key, batch, false);
 		talloc_free(dn_key);
-		return LDB_SUCCESS;		
+		return ret;
 	}
 
-	j = (unsigned int) i;
-	if (j != list->count - 1) {
-		memmove(&list->dn[j], &list->dn[j+1], sizeof(list->dn[0])*(list->count - (j+1)));
-	}
-	list->count--;
-	list->dn = talloc_realloc(list, list->dn, struct ldb_val, list->count);
+	ltdb_idx_batch_remove(batch, i);
 
-	ret = ltdb_dn_list_store(module, dn_key, list);
+	ret = ltdb_idx_batch_release(module, dn_key, batch, true);
 
 	talloc_free(dn_key);
 
@@ -1389,7 +2184,8 @@ int ltdb_index_del_value(struct ldb_module *module, struct ldb_dn *dn,
   delete the index entries for a element
   return -1 on failure
 */
-int ltdb_index_del_element(struct ldb_module *module, struct ldb_dn *dn,
+int ltdb_index_del_element(struct ldb_module *module,
+			   const struct ldb_message *msg,
 			   struct ldb_message_element *el)
 {
 	struct ltdb_private *ltdb = talloc_get_type(ldb_module_get_private(module), struct ltdb_private);
@@ -1402,7 +2198,7 @@ int ltdb_index_del_element(struct ldb_module *module, struct ldb_dn *dn,
 		return LDB_SUCCESS;
 	}
 
-	dn_str = ldb_dn_get_linearized(dn);
+	dn_str = ldb_dn_get_linearized(msg->dn);
 	if (dn_str == NULL) {
 		return LDB_ERR_OPERATIONS_ERROR;
 	}
@@ -1415,7 +2211,7 @@ int ltdb_index_del_element(struct ldb_module *module, struct ldb_dn *dn,
 		return LDB_SUCCESS;
 	}
 	for (i = 0; i < el->num_values; i++) {
-		ret = ltdb_index_del_value(module, dn, el, i);
+		ret = ltdb_index_del_value(module, msg, el, i);
 		if (ret != LDB_SUCCESS) {
 			return ret;
 		}
@@ -1449,7 +2245,7 @@ int ltdb_index_delete(struct ldb_module *module, const struct ldb_message *msg)
 	}
 
 	for (i = 0; i < msg->num_elements; i++) {
-		ret = ltdb_index_del_element(module, msg->dn, &msg->elements[i]);
+		ret = ltdb_index_del_element(module, msg, &msg->elements[i]);
 		if (ret != LDB_SUCCESS) {
 			return ret;
 		}
@@ -1460,68 +2256,175 @@ int ltdb_index_delete(struct ldb_module *module, const struct ldb_message *msg)
 
 
 /*
-  traversal function that deletes all @INDEX records
+  a reindex rebuilds all index records in memory. Each @INDEX record
+  in the database gets an empty one to start with, so that those no
+  longer needed are deleted at the commit.
 */
-static int delete_index(struct tdb_context *tdb, TDB_DATA key, TDB_DATA data, void *state)
+static int re_index_reset(struct ldb_module *module, TDB_DATA key)
 {
-	struct ldb_module *module = state;
-	struct ltdb_private *ltdb = talloc_get_type(ldb_module_get_private(module), struct ltdb_private);
-	const char *dnstr = "DN=" LTDB_INDEX ":";
-	struct dn_list list;
+	struct ltdb_idx_batch *batch;
 	struct ldb_dn *dn;
 	struct ldb_val v;
 	int ret;
 
-	if (strncmp((char *)key.dptr, dnstr, strlen(dnstr)) != 0) {
-		return 0;
-	}
-	/* we need to put a empty list in the internal tdb for this
-	 * index entry */
-	list.dn = NULL;
-	list.count = 0;
-
 	/* the offset of 3 is to remove the DN= prefix. */
 	v.data = key.dptr + 3;
 	v.length = strnlen((char *)key.dptr, key.dsize) - 3;
 
-	dn = ldb_dn_from_ldb_val(ltdb, ldb_module_get_ctx(module), &v);
-	ret = ltdb_dn_list_store(module, dn, &list);
+	dn = ldb_dn_from_ldb_val(module, ldb_module_get_ctx(module), &v);
+	if (dn == NULL) {
+		return LDB_ERR_OPERATIONS_ERROR;
+	}
+
+	/* if the records seen so far already added to it, that stays */
+	ret = ltdb_idx_batch_get(module, dn, false, &batch);
 	if (ret != LDB_SUCCESS) {
-		ldb_asprintf_errstring(ldb_module_get_ctx(module), 
+		ldb_asprintf_errstring(ldb_module_get_ctx(module),
 				       "Unable to store null index for %s\n",
-						ldb_dn_get_linearized(dn));
-		talloc_free(dn);
-		return -1;
+				       ldb_dn_get_linearized(dn));
 	}
 	talloc_free(dn);
-	return 0;
+	return ret;
 }
 
 struct ltdb_reindex_context {
 	struct ldb_module *module;
 	int error;
+	unsigned int count;
+#ifdef HAVE_PTHREAD
+	struct ltdb_unpack_pool *pool;
+#endif
 };
 
 /*
-  traversal function that adds @INDEX records during a re index
+  add the index entries of an unpacked record during a re index
+*/
+static int re_index_msg(struct ltdb_reindex_context *ctx,
+			TDB_DATA key, TDB_DATA data,
+			struct ldb_message *msg)
+{
+	struct ldb_module *module = ctx->module;
+	struct ltdb_private *ltdb = talloc_get_type(ldb_module_get_private(module), struct ltdb_private);
+	struct ldb_context *ldb = ldb_module_get_ctx(module);
+	int ret;
+	TDB_DATA key2;
+
+	/* check if the DN key has changed, perhaps due to the
+	   case insensitivity of an element changing */
+	key2 = ltdb_key(module, msg->dn);
+	if (key2.dptr == NULL) {
+		/* probably a corrupt record ... darn */
+		ldb_debug(ldb, LDB_DEBUG_ERROR, "Invalid DN in re_index: %s",
+						ldb_dn_get_linearized(msg->dn));
+		return LDB_SUCCESS;
+	}
+	if (strcmp((char *)key2.dptr, (char *)key.dptr) != 0) {
+		tdb_delete(ltdb->tdb, key);
+		tdb_store(ltdb->tdb, key2, data, 0);
+	}
+	talloc_free(key2.dptr);
+
+	ret = ltdb_index_onelevel(module, msg, 1);
+	if (ret != LDB_SUCCESS) {
+		ldb_debug(ldb, LDB_DEBUG_ERROR,
+			  "Adding special ONE LEVEL index failed (%s)!",
+						ldb_dn_get_linearized(msg->dn));
+		return ret;
+	}
+
+	ret = ltdb_index_add_all(module, msg);
+	if (ret != LDB_SUCCESS) {
+		return ret;
+	}
+
+	ctx->count++;
+	if (ltdb->warn_reindex && ctx->count % 10000 == 0) {
+		ldb_debug(ldb, LDB_DEBUG_WARNING,
+			  "Reindexing %s: %u records done",
+			  tdb_name(ltdb->tdb), ctx->count);
+	}
+
+	return LDB_SUCCESS;
+}
+
+#ifdef HAVE_PTHREAD
+
+/*
+  with reindex_threads set the records are unpacked by worker
+  threads. Working out the index keys needs the schema and the case
+  folding of the ldb context, so that happens in re_index_process().
+ */
+static int re_index_unpack(void *private_data, TDB_DATA key, TDB_DATA data,
+			   struct ldb_message *msg)
+{
+	struct ltdb_reindex_context *ctx =
+		(struct ltdb_reindex_context *)private_data;
+	struct ldb_context *ldb = ldb_module_get_ctx(ctx->module);
+
+	if (ldb_unpack_data(ldb, (struct ldb_val *)&data, msg) != 0) {
+		return LDB_ERR_OPERATIONS_ERROR;
+	}
+	return LDB_SUCCESS;
+}
+
+static int re_index_process(void *private_data, TDB_DATA key, TDB_DATA data,
+			    struct ldb_message *msg)
+{
+	struct ltdb_reindex_context *ctx =
+		(struct ltdb_reindex_context *)private_data;
+	int ret;
+
+	ret = re_index_msg(ctx, key, data, msg);
+	talloc_free(msg);
+	if (ret != LDB_SUCCESS && ctx->error == LDB_SUCCESS) {
+		ctx->error = ret;
+	}
+	return ret;
+}
+
+#endif /* HAVE_PTHREAD */
+
+/*
+  traversal function that rebuilds the @INDEX records during a re
+  index
 */
 static int re_index(struct tdb_context *tdb, TDB_DATA key, TDB_DATA data, void *state)
 {
 	struct ldb_context *ldb;
 	struct ltdb_reindex_context *ctx = (struct ltdb_reindex_context *)state;
 	struct ldb_module *module = ctx->module;
+	struct ltdb_private *ltdb = talloc_get_type(ldb_module_get_private(module), struct ltdb_private);
+	const char *dnstr = "DN=" LTDB_INDEX ":";
 	struct ldb_message *msg;
-	const char *dn = NULL;
 	int ret;
-	TDB_DATA key2;
 
 	ldb = ldb_module_get_ctx(module);
 
+	if (strncmp((char *)key.dptr, dnstr, strlen(dnstr)) == 0) {
+		ret = re_index_reset(module, key);
+		if (ret != LDB_SUCCESS) {
+			ctx->error = ret;
+			return -1;
+		}
+		return 0;
+	}
+
 	if (strncmp((char *)key.dptr, "DN=@", 4) == 0 ||
 	    strncmp((char *)key.dptr, "DN=", 3) != 0) {
 		return 0;
 	}
 
+	/* if we don't have indexes there is nothing to add */
+	if (ltdb->cache->indexlist->num_elements == 0) {
+		return 0;
+	}
+
+#ifdef HAVE_PTHREAD
+	if (ctx->pool != NULL) {
+		return ltdb_unpack_pool_add(ctx->pool, key, data);
+	}
+#endif
+
 	msg = ldb_msg_new(module);
 	if (msg == NULL) {
 		return -1;
@@ -1535,92 +2438,99 @@ static int re_index(struct tdb_context *tdb, TDB_DATA key, TDB_DATA data, void *
 		return -1;
 	}
 
-	/* check if the DN key has changed, perhaps due to the
-	   case insensitivity of an element changing */
-	key2 = ltdb_key(module, msg->dn);
-	if (key2.dptr == NULL) {
-		/* probably a corrupt record ... darn */
-		ldb_debug(ldb, LDB_DEBUG_ERROR, "Invalid DN in re_index: %s",
-						ldb_dn_get_linearized(msg->dn));
-		talloc_free(msg);
-		return 0;
-	}
-	if (strcmp((char *)key2.dptr, (char *)key.dptr) != 0) {
-		tdb_delete(tdb, key);
-		tdb_store(tdb, key2, data, 0);
-	}
-	talloc_free(key2.dptr);
-
-	if (msg->dn == NULL) {
-		dn = (char *)key.dptr + 3;
-	} else {
-		dn = ldb_dn_get_linearized(msg->dn);
-	}
-
-	ret = ltdb_index_onelevel(module, msg, 1);
-	if (ret != LDB_SUCCESS) {
-		ldb_debug(ldb, LDB_DEBUG_ERROR,
-			  "Adding special ONE LEVEL index failed (%s)!",
-						ldb_dn_get_linearized(msg->dn));
-		talloc_free(msg);
-		return -1;
-	}
-
-	ret = ltdb_index_add_all(module, dn, msg->elements, msg->num_elements);
-
+	ret = re_index_msg(ctx, key, data, msg);
+	talloc_free(msg);
 	if (ret != LDB_SUCCESS) {
 		ctx->error = ret;
-		talloc_free(msg);
 		return -1;
 	}
 
-	talloc_free(msg);
-
 	return 0;
 }
 
 /*
   force a complete reindex of the database
+
+  All records are read in a single traverse. The new index records
+  are only built up in memory and written once, by the commit of the
+  transaction.
 */
 int ltdb_reindex(struct ldb_module *module)
 {
 	struct ltdb_private *ltdb = talloc_get_type(ldb_module_get_private(module), struct ltdb_private);
-	int ret;
+	struct ldb_context *ldb = ldb_module_get_ctx(module);
+	struct ltdb_idxptr *idxptr;
+	int ret, error = LDB_SUCCESS;
 	struct ltdb_reindex_context ctx;
 
-	if (ltdb_cache_reload(module) != 0) {
+	if (ltdb->idxptr == NULL) {
 		return LDB_ERR_OPERATIONS_ERROR;
 	}
 
-	/* first traverse the database deleting any @INDEX records by
-	 * putting NULL entries in the in-memory tdb
-	 */
-	ret = tdb_traverse(ltdb->tdb, delete_index, module);
-	if (ret < 0) {
+	if (ltdb_cache_reload(module) != 0) {
 		return LDB_ERR_OPERATIONS_ERROR;
 	}
 
-	/* if we don't have indexes we have nothing todo */
-	if (ltdb->cache->indexlist->num_elements == 0) {
-		return LDB_SUCCESS;
+	/* records get new keys if the case folding changed */
+	ltdb_dn_cache_flush(ltdb);
+
+	/* whatever index changes this transaction made so far are
+	 * rebuilt from scratch */
+	idxptr = talloc_zero(ltdb, struct ltdb_idxptr);
+	if (idxptr == NULL) {
+		return ldb_oom(ldb);
+	}
+	if (ltdb->idxptr->itdb != NULL) {
+		tdb_close(ltdb->idxptr->itdb);
 	}
+	talloc_free(ltdb->idxptr);
+	ltdb->idxptr = idxptr;
+	ltdb->idxptr->reindexing = true;
 
 	ctx.module = module;
 	ctx.error = 0;
+	ctx.count = 0;
+#ifdef HAVE_PTHREAD
+	ctx.pool = NULL;
+	if (ltdb->reindex_threads > 1 &&
+	    ltdb->cache->indexlist->num_elements != 0) {
+		ctx.pool = ltdb_unpack_pool_init(ltdb, ltdb->reindex_threads,
+						 re_index_unpack,
+						 re_index_process, &ctx);
+		if (ctx.pool == NULL) {
+			ltdb->idxptr->reindexing = false;
+			return ldb_oom(ldb);
+		}
+	}
+#endif
 
-	/* now traverse adding any indexes for normal LDB records */
 	ret = tdb_traverse(ltdb->tdb, re_index, &ctx);
-	if (ret < 0) {
-		struct ldb_context *ldb = ldb_module_get_ctx(module);
-		ldb_asprintf_errstring(ldb, "reindexing traverse failed: %s", ldb_errstring(ldb));
-		return LDB_ERR_OPERATIONS_ERROR;
+
+#ifdef HAVE_PTHREAD
+	if (ctx.pool != NULL) {
+		error = ltdb_unpack_pool_finish(ctx.pool);
+		TALLOC_FREE(ctx.pool);
 	}
+#endif
+
+	ltdb->idxptr->reindexing = false;
 
 	if (ctx.error != LDB_SUCCESS) {
-		struct ldb_context *ldb = ldb_module_get_ctx(module);
 		ldb_asprintf_errstring(ldb, "reindexing failed: %s", ldb_errstring(ldb));
 		return ctx.error;
 	}
 
+	if (ret < 0 || error != LDB_SUCCESS) {
+		ldb_asprintf_errstring(ldb, "reindexing traverse failed: %s", ldb_errstring(ldb));
+		return LDB_ERR_OPERATIONS_ERROR;
+	}
+
+	if (ltdb->warn_reindex) {
+		ldb_debug(ldb, LDB_DEBUG_WARNING,
+			  "Reindexed %u records of %s, %u index records to write",
+			  ctx.count, tdb_name(ltdb->tdb),
+			  ltdb->idxptr->itdb_entries);
+	}
+
 	return LDB_SUCCESS;
 }
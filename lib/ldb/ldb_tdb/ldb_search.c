@@ -272,6 +272,8 @@ int ltdb_search_dn1(struct ldb_module *module, struct ldb_dn *dn, struct ldb_mes
 		.msg = msg,
 		.module = module
 	};
+	const struct ldb_message *cached = NULL;
+	bool special = ldb_dn_is_special(dn);
 
 	/* form the key */
 	tdb_key = ltdb_key(module, dn);
@@ -284,16 +286,28 @@ int ltdb_search_dn1(struct ldb_module *module, struct ldb_dn *dn, struct ldb_mes
 	msg->num_elements = 0;
 	msg->elements = NULL;
 
+	if (!special) {
+		cached = ltdb_dn_cache_lookup(ltdb, tdb_key);
+	}
+	if (cached != NULL) {
+		talloc_free(tdb_key.dptr);
+		if (ltdb_dn_cache_copy(msg, cached, NULL, 0) != 0) {
+			return LDB_ERR_OPERATIONS_ERROR;
+		}
+		return LDB_SUCCESS;
+	}
+
 	ret = tdb_parse_record(ltdb->tdb, tdb_key, 
 			       ltdb_parse_data_unpack, &ctx); 
-	talloc_free(tdb_key.dptr);
 	
 	if (ret == -1) {
+		talloc_free(tdb_key.dptr);
 		if (tdb_error(ltdb->tdb) == TDB_ERR_NOEXIST) {
 			return LDB_ERR_NO_SUCH_OBJECT;
 		}
 		return LDB_ERR_OPERATIONS_ERROR;
 	} else if (ret != LDB_SUCCESS) {
+		talloc_free(tdb_key.dptr);
 		return ret;
 	}
 	
@@ -301,9 +315,15 @@ int ltdb_search_dn1(struct ldb_module *module, struct ldb_dn *dn, struct ldb_mes
 		msg->dn = ldb_dn_copy(msg, dn);
 	}
 	if (!msg->dn) {
+		talloc_free(tdb_key.dptr);
 		return LDB_ERR_OPERATIONS_ERROR;
 	}
 
+	if (!special) {
+		ltdb_dn_cache_add(ltdb, tdb_key, msg);
+	}
+	talloc_free(tdb_key.dptr);
+
 	return LDB_SUCCESS;
 }
 
@@ -425,74 +445,362 @@ int ltdb_filter_attrs(struct ldb_message *msg, const char * const *attrs)
 }
 
 /*
-  search function for a non-indexed search
+  unpack what a search needs of a packed record to match it: only the
+  attributes the filter looks at, referencing the packed data, which
+  has to stay around while the message is used
  */
-static int search_func(struct tdb_context *tdb, TDB_DATA key, TDB_DATA data, void *state)
+static int search_unpack_filter_attrs(struct ldb_context *ldb,
+				      const struct ltdb_context *ac,
+				      TDB_DATA key, TDB_DATA data,
+				      struct ldb_message *msg)
 {
-	struct ldb_context *ldb;
-	struct ltdb_context *ac;
+	int ret;
+
+	ret = ldb_unpack_data_only_attr_list_flags(ldb,
+						   (struct ldb_val *)&data,
+						   msg,
+						   ac->filter_attrs,
+						   ac->num_filter_attrs,
+						   LDB_UNPACK_DATA_FLAG_NO_DATA_ALLOC,
+						   NULL);
+	if (ret == -1) {
+		return LDB_ERR_OPERATIONS_ERROR;
+	}
+
+	if (!msg->dn) {
+		msg->dn = ldb_dn_new(msg, ldb, (char *)key.dptr + 3);
+		if (msg->dn == NULL) {
+			return LDB_ERR_OPERATIONS_ERROR;
+		}
+	}
+
+	return LDB_SUCCESS;
+}
+
+/*
+  the attributes to unpack for a result, NULL for all of them
+ */
+static const char * const *search_result_attrs(const struct ltdb_context *ac,
+					       unsigned int *num_attrs)
+{
+	const char * const *attrs = ac->attrs;
+	unsigned int i;
+
+	*num_attrs = 0;
+	if (attrs == NULL) {
+		return NULL;
+	}
+
+	for (i = 0; attrs[i]; i++) {
+		if (strcmp(attrs[i], "*") == 0) {
+			return NULL;
+		}
+	}
+
+	*num_attrs = i;
+	return attrs;
+}
+
+/*
+  hand a result over to the caller
+ */
+static int search_send_result(struct ltdb_context *ac,
+			      struct ldb_message *result)
+{
+	int ret;
+
+	/* filter the attributes that the user wants */
+	ret = ltdb_filter_attrs(result, ac->attrs);
+	if (ret == -1) {
+		talloc_free(result);
+		return LDB_ERR_OPERATIONS_ERROR;
+	}
+
+	ret = ldb_module_send_entry(ac->req, result, NULL);
+	if (ret != LDB_SUCCESS) {
+		/* the callback failed, abort the operation */
+		ac->request_terminated = true;
+		return ret;
+	}
+
+	return LDB_SUCCESS;
+}
+
+/*
+  match a record unpacked by search_unpack_filter_attrs() against the
+  search. If it matches, the attributes the caller asked for are
+  unpacked from the packed data into a message of their own, which is
+  sent to the caller. The matching message is freed in any case.
+ */
+static int search_match_packed(struct ltdb_context *ac,
+			       struct ldb_message *msg,
+			       TDB_DATA data,
+			       bool *matched)
+{
+	struct ldb_context *ldb = ldb_module_get_ctx(ac->module);
+	const char * const *attrs;
+	unsigned int num_attrs;
+	struct ldb_message *result;
+	int ret;
+
+	/* see if it matches the given expression */
+	ret = ldb_match_msg_compiled(ac->match, msg,
+				     ac->base, ac->scope, matched);
+	if (ret != LDB_SUCCESS || !*matched) {
+		talloc_free(msg);
+		return ret;
+	}
+
+	result = ldb_msg_new(ac);
+	if (result == NULL) {
+		talloc_free(msg);
+		return LDB_ERR_OPERATIONS_ERROR;
+	}
+
+	attrs = search_result_attrs(ac, &num_attrs);
+	ret = ldb_unpack_data_only_attr_list(ldb, (struct ldb_val *)&data,
+					     result, attrs, num_attrs, NULL);
+	if (ret == -1) {
+		talloc_free(result);
+		talloc_free(msg);
+		return LDB_ERR_OPERATIONS_ERROR;
+	}
+	if (result->dn == NULL) {
+		result->dn = talloc_steal(result, msg->dn);
+	}
+	talloc_free(msg);
+
+	return search_send_result(ac, result);
+}
+
+/*
+  match a record from the DN cache against the search and send a copy
+  of the requested attributes if it matches
+ */
+static int search_match_cached(struct ltdb_context *ac,
+			       const struct ldb_message *cached,
+			       bool *matched)
+{
+	const char * const *attrs;
+	unsigned int num_attrs;
+	struct ldb_message *result;
+	int ret;
+
+	ret = ldb_match_msg_compiled(ac->match, cached,
+				     ac->base, ac->scope, matched);
+	if (ret != LDB_SUCCESS || !*matched) {
+		return ret;
+	}
+
+	result = ldb_msg_new(ac);
+	if (result == NULL) {
+		return LDB_ERR_OPERATIONS_ERROR;
+	}
+
+	attrs = search_result_attrs(ac, &num_attrs);
+	if (ltdb_dn_cache_copy(result, cached, attrs, num_attrs) != 0) {
+		talloc_free(result);
+		return LDB_ERR_OPERATIONS_ERROR;
+	}
+
+	return search_send_result(ac, result);
+}
+
+/*
+  match a packed record against the search and send it to the caller
+  if it matches
+ */
+static int search_packed(struct ltdb_context *ac, TDB_DATA key, TDB_DATA data,
+			 bool *matched)
+{
+	struct ldb_context *ldb = ldb_module_get_ctx(ac->module);
 	struct ldb_message *msg;
 	int ret;
-	bool matched;
 
-	ac = talloc_get_type(state, struct ltdb_context);
-	ldb = ldb_module_get_ctx(ac->module);
+	msg = ldb_msg_new(ac);
+	if (msg == NULL) {
+		return LDB_ERR_OPERATIONS_ERROR;
+	}
 
-	if (key.dsize < 4 || 
-	    strncmp((char *)key.dptr, "DN=", 3) != 0) {
-		return 0;
+	ret = search_unpack_filter_attrs(ldb, ac, key, data, msg);
+	if (ret != LDB_SUCCESS) {
+		talloc_free(msg);
+		return ret;
+	}
+
+	return search_match_packed(ac, msg, data, matched);
+}
+
+/*
+  look up the record of a dn found by an indexed search and send it to
+  the caller if it matches. Returns LDB_ERR_NO_SUCH_OBJECT if there is
+  no such record (any more).
+
+  Records are taken from the DN cache if they are there, and records
+  of base searches are put there, these are the lookups that tend to
+  repeat.
+ */
+int ltdb_search_dn_match(struct ltdb_context *ac, struct ldb_dn *dn,
+			 bool *matched)
+{
+	struct ldb_context *ldb = ldb_module_get_ctx(ac->module);
+	void *data = ldb_module_get_private(ac->module);
+	struct ltdb_private *ltdb = talloc_get_type(data, struct ltdb_private);
+	const struct ldb_message *cached = NULL;
+	bool cache_it;
+	struct ldb_message *msg;
+	TDB_DATA tdb_key, tdb_data;
+	int ret;
+
+	*matched = false;
+
+	tdb_key = ltdb_key(ac->module, dn);
+	if (!tdb_key.dptr) {
+		return LDB_ERR_OPERATIONS_ERROR;
+	}
+
+	cache_it = (ltdb->dn_cache != NULL && !ldb_dn_is_special(dn));
+	if (cache_it) {
+		cached = ltdb_dn_cache_lookup(ltdb, tdb_key);
+	}
+	if (cached != NULL) {
+		talloc_free(tdb_key.dptr);
+		return search_match_cached(ac, cached, matched);
+	}
+
+	tdb_data = tdb_fetch(ltdb->tdb, tdb_key);
+	if (tdb_data.dptr == NULL) {
+		talloc_free(tdb_key.dptr);
+		if (tdb_error(ltdb->tdb) == TDB_ERR_NOEXIST) {
+			return LDB_ERR_NO_SUCH_OBJECT;
+		}
+		return LDB_ERR_OPERATIONS_ERROR;
+	}
+
+	if (!cache_it || ac->scope != LDB_SCOPE_BASE) {
+		ret = search_packed(ac, tdb_key, tdb_data, matched);
+		talloc_free(tdb_key.dptr);
+		free(tdb_data.dptr);
+		return ret;
 	}
 
 	msg = ldb_msg_new(ac);
-	if (!msg) {
-		ac->error = LDB_ERR_OPERATIONS_ERROR;
-		return -1;
+	if (msg == NULL) {
+		talloc_free(tdb_key.dptr);
+		free(tdb_data.dptr);
+		return LDB_ERR_OPERATIONS_ERROR;
 	}
 
-	/* unpack the record */
-	ret = ldb_unpack_data(ldb, (struct ldb_val *)&data, msg);
+	ret = ldb_unpack_data(ldb, (struct ldb_val *)&tdb_data, msg);
+	free(tdb_data.dptr);
 	if (ret == -1) {
+		talloc_free(tdb_key.dptr);
 		talloc_free(msg);
-		ac->error = LDB_ERR_OPERATIONS_ERROR;
-		return -1;
+		return LDB_ERR_OPERATIONS_ERROR;
 	}
-
-	if (!msg->dn) {
-		msg->dn = ldb_dn_new(msg, ldb,
-				     (char *)key.dptr + 3);
+	if (msg->dn == NULL) {
+		msg->dn = ldb_dn_copy(msg, dn);
 		if (msg->dn == NULL) {
+			talloc_free(tdb_key.dptr);
 			talloc_free(msg);
-			ac->error = LDB_ERR_OPERATIONS_ERROR;
-			return -1;
+			return LDB_ERR_OPERATIONS_ERROR;
 		}
 	}
 
-	/* see if it matches the given expression */
-	ret = ldb_match_msg_error(ldb, msg,
-				  ac->tree, ac->base, ac->scope, &matched);
-	if (ret != LDB_SUCCESS) {
+	ltdb_dn_cache_add(ltdb, tdb_key, msg);
+	talloc_free(tdb_key.dptr);
+
+	ret = ldb_match_msg_compiled(ac->match, msg,
+				     ac->base, ac->scope, matched);
+	if (ret != LDB_SUCCESS || !*matched) {
 		talloc_free(msg);
-		ac->error = LDB_ERR_OPERATIONS_ERROR;
-		return -1;
+		return ret;
 	}
-	if (!matched) {
-		talloc_free(msg);
-		return 0;
+
+	return search_send_result(ac, msg);
+}
+
+/*
+  collect the attributes a filter looks at. Returns false if matching
+  it may need any attribute of a record.
+ */
+static bool search_tree_attrs(TALLOC_CTX *mem_ctx,
+			      const struct ldb_parse_tree *tree,
+			      const char ***attrs,
+			      unsigned int *num_attrs)
+{
+	const char *attr;
+	const char **list;
+	unsigned int i;
+
+	switch (tree->operation) {
+	case LDB_OP_AND:
+	case LDB_OP_OR:
+		for (i = 0; i < tree->u.list.num_elements; i++) {
+			if (!search_tree_attrs(mem_ctx,
+					       tree->u.list.elements[i],
+					       attrs, num_attrs)) {
+				return false;
+			}
+		}
+		return true;
+	case LDB_OP_NOT:
+		return search_tree_attrs(mem_ctx, tree->u.isnot.child,
+					 attrs, num_attrs);
+	case LDB_OP_EQUALITY:
+		attr = tree->u.equality.attr;
+		break;
+	case LDB_OP_SUBSTRING:
+		attr = tree->u.substring.attr;
+		break;
+	case LDB_OP_GREATER:
+	case LDB_OP_LESS:
+	case LDB_OP_APPROX:
+		attr = tree->u.comparison.attr;
+		break;
+	case LDB_OP_PRESENT:
+		attr = tree->u.present.attr;
+		break;
+	default:
+		/* extended match rules get the whole message */
+		return false;
 	}
 
-	/* filter the attributes that the user wants */
-	ret = ltdb_filter_attrs(msg, ac->attrs);
+	for (i = 0; i < *num_attrs; i++) {
+		if (ldb_attr_cmp((*attrs)[i], attr) == 0) {
+			return true;
+		}
+	}
 
-	if (ret == -1) {
-		talloc_free(msg);
-		ac->error = LDB_ERR_OPERATIONS_ERROR;
-		return -1;
+	list = talloc_realloc(mem_ctx, *attrs, const char *, *num_attrs + 1);
+	if (list == NULL) {
+		return false;
+	}
+	list[*num_attrs] = attr;
+	*attrs = list;
+	*num_attrs += 1;
+
+	return true;
+}
+
+/*
+  search function for a non-indexed search
+ */
+static int search_func(struct tdb_context *tdb, TDB_DATA key, TDB_DATA data, void *state)
+{
+	struct ltdb_context *ac;
+	bool matched;
+	int ret;
+
+	ac = talloc_get_type(state, struct ltdb_context);
+
+	if (key.dsize < 4 || 
+	    strncmp((char *)key.dptr, "DN=", 3) != 0) {
+		return 0;
 	}
 
-	ret = ldb_module_send_entry(ac->req, msg, NULL);
+	ret = search_packed(ac, key, data, &matched);
 	if (ret != LDB_SUCCESS) {
-		ac->request_terminated = true;
-		/* the callback failed, abort the operation */
 		ac->error = LDB_ERR_OPERATIONS_ERROR;
 		return -1;
 	}
@@ -500,6 +808,85 @@ static int search_func(struct tdb_context *tdb, TDB_DATA key, TDB_DATA data, voi
 	return 0;
 }
 
+#ifdef HAVE_PTHREAD
+
+/*
+  with search_threads set the records are unpacked by worker threads,
+  only with the attributes the filter needs, like search_packed()
+  does. The matching and sending happens in the thread of the search,
+  as the match functions and the callbacks use the ldb context.
+ */
+static int search_parallel_unpack(void *private_data, TDB_DATA key,
+				  TDB_DATA data, struct ldb_message *msg)
+{
+	const struct ltdb_context *ac =
+		(const struct ltdb_context *)private_data;
+
+	return search_unpack_filter_attrs(ldb_module_get_ctx(ac->module),
+					  ac, key, data, msg);
+}
+
+static int search_parallel_process(void *private_data, TDB_DATA key,
+				   TDB_DATA data, struct ldb_message *msg)
+{
+	struct ltdb_context *ac = (struct ltdb_context *)private_data;
+	bool matched;
+
+	return search_match_packed(ac, msg, data, &matched);
+}
+
+/*
+  traverse function for the parallel non-indexed search, only collects
+  the records
+ */
+static int search_parallel_func(struct tdb_context *tdb, TDB_DATA key,
+				TDB_DATA data, void *state)
+{
+	struct ltdb_unpack_pool *pool = (struct ltdb_unpack_pool *)state;
+
+	if (key.dsize < 4 ||
+	    strncmp((char *)key.dptr, "DN=", 3) != 0) {
+		return 0;
+	}
+
+	return ltdb_unpack_pool_add(pool, key, data);
+}
+
+static int ltdb_search_parallel(struct ltdb_context *ctx,
+				unsigned int num_threads)
+{
+	void *data = ldb_module_get_private(ctx->module);
+	struct ltdb_private *ltdb = talloc_get_type(data, struct ltdb_private);
+	struct ltdb_unpack_pool *pool;
+	int ret, error;
+
+	pool = ltdb_unpack_pool_init(ctx, num_threads,
+				     search_parallel_unpack,
+				     search_parallel_process, ctx);
+	if (pool == NULL) {
+		return LDB_ERR_OPERATIONS_ERROR;
+	}
+
+	ctx->error = LDB_SUCCESS;
+	if (ltdb->in_transaction != 0) {
+		ret = tdb_traverse(ltdb->tdb, search_parallel_func, pool);
+	} else {
+		ret = tdb_traverse_read(ltdb->tdb, search_parallel_func, pool);
+	}
+
+	error = ltdb_unpack_pool_finish(pool);
+	talloc_free(pool);
+
+	if (ret < 0 || error != LDB_SUCCESS) {
+		if (ctx->error == LDB_SUCCESS) {
+			ctx->error = LDB_ERR_OPERATIONS_ERROR;
+		}
+	}
+
+	return ctx->error;
+}
+
+#endif /* HAVE_PTHREAD */
 
 /*
   search the database with a LDAP-like expression.
@@ -511,6 +898,12 @@ static int ltdb_search_full(struct ltdb_context *ctx)
 	struct ltdb_private *ltdb = talloc_get_type(data, struct ltdb_private);
 	int ret;
 
+#ifdef HAVE_PTHREAD
+	if (ltdb->search_threads > 1) {
+		return ltdb_search_parallel(ctx, ltdb->search_threads);
+	}
+#endif
+
 	ctx->error = LDB_SUCCESS;
 	if (ltdb->in_transaction != 0) {
 		ret = tdb_traverse(ltdb->tdb, search_func, ctx);
@@ -603,6 +996,20 @@ int ltdb_search(struct ltdb_context *ctx)
 	ctx->base = req->op.search.base;
 	ctx->attrs = req->op.search.attrs;
 
+	/* records are only unpacked as far as the filter needs them */
+	ctx->filter_attrs = NULL;
+	ctx->num_filter_attrs = 0;
+	if (!search_tree_attrs(ctx, ctx->tree, &ctx->filter_attrs,
+			       &ctx->num_filter_attrs)) {
+		TALLOC_FREE(ctx->filter_attrs);
+		ctx->num_filter_attrs = 0;
+	}
+
+	/* the filter is compiled once for all the records it is matched against */
+	if (ret == LDB_SUCCESS) {
+		ret = ldb_match_compile(ldb, ctx, ctx->tree, &ctx->match);
+	}
+
 	if (ret == LDB_SUCCESS) {
 		uint32_t match_count = 0;
 
@@ -282,6 +282,8 @@ int ltdb_store(struct ldb_module *module, const struct ldb_message *msg, int flg
 	tdb_data.dptr = ldb_data.data;
 	tdb_data.dsize = ldb_data.length;
 
+	ltdb_dn_cache_remove(ltdb, tdb_key);
+
 	ret = tdb_store(ltdb->tdb, tdb_key, tdb_data, flgs);
 	if (ret != 0) {
 		ret = ltdb_err_map(tdb_error(ltdb->tdb));
@@ -427,6 +429,8 @@ int ltdb_delete_noindex(struct ldb_module *module, struct ldb_dn *dn)
 		return LDB_ERR_OTHER;
 	}
 
+	ltdb_dn_cache_remove(ltdb, tdb_key);
+
 	ret = tdb_delete(ltdb->tdb, tdb_key);
 	talloc_free(tdb_key.dptr);
 
@@ -580,7 +584,7 @@ static int msg_delete_attribute(struct ldb_module *module,
 	}
 	i = el - msg->elements;
 
-	ret = ltdb_index_del_element(module, msg->dn, el);
+	ret = ltdb_index_del_element(module, msg, el);
 	if (ret != LDB_SUCCESS) {
 		return ret;
 	}
@@ -637,7 +641,7 @@ static int msg_delete_element(struct ldb_module *module,
 				return msg_delete_attribute(module, ldb, msg, name);
 			}
 
-			ret = ltdb_index_del_value(module, msg->dn, el, i);
+			ret = ltdb_index_del_value(module, msg, el, i);
 			if (ret != LDB_SUCCESS) {
 				return ret;
 			}
@@ -726,6 +730,23 @@ int ltdb_modify_internal(struct ldb_module *module,
 		const struct ldb_schema_attribute *a = ldb_schema_attribute_by_name(ldb, el->name);
 		const char *dn;
 
+		/* the GUID index entries would no longer match */
+		if (ltdb->cache->GUID_index_attribute != NULL &&
+		    !ldb_dn_is_special(msg2->dn) &&
+		    ldb_attr_cmp(el->name,
+				 ltdb->cache->GUID_index_attribute) == 0) {
+			el2 = ldb_msg_find_element(msg2, el->name);
+			if ((el->flags & LDB_FLAG_MOD_MASK) != LDB_FLAG_MOD_REPLACE ||
+			    el2 == NULL ||
+			    !ldb_msg_element_equal_ordered(el, el2)) {
+				ldb_asprintf_errstring(ldb,
+						       "attribute '%s' on '%s' is used by the GUID index and cannot be modified",
+						       el->name, ldb_dn_get_linearized(msg2->dn));
+				ret = LDB_ERR_CONSTRAINT_VIOLATION;
+				goto done;
+			}
+		}
+
 		switch (msg->elements[i].flags & LDB_FLAG_MOD_MASK) {
 		case LDB_FLAG_MOD_ADD:
 
@@ -773,7 +794,7 @@ int ltdb_modify_internal(struct ldb_module *module,
 					ret = LDB_ERR_OTHER;
 					goto done;
 				}
-				ret = ltdb_index_add_element(module, msg2->dn,
+				ret = ltdb_index_add_element(module, msg2,
 							     el);
 				if (ret != LDB_SUCCESS) {
 					goto done;
@@ -841,7 +862,7 @@ int ltdb_modify_internal(struct ldb_module *module,
 				el2->values = vals;
 				el2->num_values += el->num_values;
 
-				ret = ltdb_index_add_element(module, msg2->dn, el);
+				ret = ltdb_index_add_element(module, msg2, el);
 				if (ret != LDB_SUCCESS) {
 					goto done;
 				}
@@ -900,7 +921,7 @@ int ltdb_modify_internal(struct ldb_module *module,
 				goto done;
 			}
 
-			ret = ltdb_index_add_element(module, msg2->dn, el);
+			ret = ltdb_index_add_element(module, msg2, el);
 			if (ret != LDB_SUCCESS) {
 				goto done;
 			}
@@ -1099,6 +1120,9 @@ static int ltdb_start_trans(struct ldb_module *module)
 		return ltdb_err_map(tdb_error(ltdb->tdb));
 	}
 
+	/* nobody else changes the database until we are done */
+	ltdb_dn_cache_check(ltdb);
+
 	ltdb->in_transaction++;
 
 	ltdb_index_transaction_start(module);
@@ -1135,10 +1159,12 @@ static int ltdb_end_trans(struct ldb_module *module)
 {
 	void *data = ldb_module_get_private(module);
 	struct ltdb_private *ltdb = talloc_get_type(data, struct ltdb_private);
+	int seqnum;
 
 	if (!ltdb->prepared_commit) {
 		int ret = ltdb_prepare_commit(module);
 		if (ret != LDB_SUCCESS) {
+			ltdb_dn_cache_flush(ltdb);
 			return ret;
 		}
 	}
@@ -1146,10 +1172,18 @@ static int ltdb_end_trans(struct ldb_module *module)
 	ltdb->in_transaction--;
 	ltdb->prepared_commit = false;
 
+	/* the sequence number the commit leaves behind */
+	seqnum = tdb_get_seqnum(ltdb->tdb);
+
 	if (tdb_transaction_commit(ltdb->tdb) != 0) {
+		ltdb_dn_cache_flush(ltdb);
 		return ltdb_err_map(tdb_error(ltdb->tdb));
 	}
 
+	if (ltdb->in_transaction == 0) {
+		ltdb_dn_cache_committed(ltdb, seqnum);
+	}
+
 	return LDB_SUCCESS;
 }
 
@@ -1160,6 +1194,9 @@ static int ltdb_del_trans(struct ldb_module *module)
 
 	ltdb->in_transaction--;
 
+	/* records read in the transaction may not be there any more */
+	ltdb_dn_cache_flush(ltdb);
+
 	if (ltdb_index_transaction_cancel(module) != 0) {
 		tdb_transaction_cancel(ltdb->tdb);
 		return ltdb_err_map(tdb_error(ltdb->tdb));
@@ -1262,6 +1299,44 @@ done:
 	return ret;
 }
 
+/*
+  reply with the DN cache counters if the request asked for them
+ */
+static int ltdb_dn_cache_stats_reply(struct ltdb_context *ctx,
+				     struct ldb_reply *ares)
+{
+	void *data = ldb_module_get_private(ctx->module);
+	struct ltdb_private *ltdb = talloc_get_type(data, struct ltdb_private);
+	struct ldb_dn_cache_stats_control *stats;
+	struct ldb_control **controls;
+
+	if (ldb_request_get_control(ctx->req,
+				    LDB_CONTROL_DN_CACHE_STATS_OID) == NULL) {
+		return LDB_SUCCESS;
+	}
+
+	controls = talloc_zero_array(ares, struct ldb_control *, 2);
+	if (controls == NULL) {
+		return LDB_ERR_OPERATIONS_ERROR;
+	}
+	controls[0] = talloc(controls, struct ldb_control);
+	if (controls[0] == NULL) {
+		return LDB_ERR_OPERATIONS_ERROR;
+	}
+	stats = talloc(controls[0], struct ldb_dn_cache_stats_control);
+	if (stats == NULL) {
+		return LDB_ERR_OPERATIONS_ERROR;
+	}
+	ltdb_dn_cache_stats(ltdb, stats);
+
+	controls[0]->oid = LDB_CONTROL_DN_CACHE_STATS_OID;
+	controls[0]->critical = 0;
+	controls[0]->data = stats;
+	ares->controls = controls;
+
+	return LDB_SUCCESS;
+}
+
 static void ltdb_request_done(struct ltdb_context *ctx, int error)
 {
 	struct ldb_context *ldb;
@@ -1285,6 +1360,13 @@ static void ltdb_request_done(struct ltdb_context *ctx, int error)
 	ares->type = LDB_REPLY_DONE;
 	ares->error = error;
 
+	if (ltdb_dn_cache_stats_reply(ctx, ares) != LDB_SUCCESS) {
+		ldb_oom(ldb);
+		talloc_free(ares);
+		req->callback(req, NULL);
+		return;
+	}
+
 	req->callback(req, ares);
 }
 
@@ -1424,6 +1506,7 @@ static int ltdb_handle_request(struct ldb_module *module,
 			       struct ldb_request *req)
 {
 	struct ldb_control *control_permissive;
+	struct ldb_control *control_dn_cache_stats;
 	struct ldb_context *ldb;
 	struct tevent_context *ev;
 	struct ltdb_context *ac;
@@ -1435,10 +1518,13 @@ static int ltdb_handle_request(struct ldb_module *module,
 
 	control_permissive = ldb_request_get_control(req,
 					LDB_CONTROL_PERMISSIVE_MODIFY_OID);
+	control_dn_cache_stats = ldb_request_get_control(req,
+					LDB_CONTROL_DN_CACHE_STATS_OID);
 
 	for (i = 0; req->controls && req->controls[i]; i++) {
 		if (req->controls[i]->critical &&
-		    req->controls[i] != control_permissive) {
+		    req->controls[i] != control_permissive &&
+		    req->controls[i] != control_dn_cache_stats) {
 			ldb_asprintf_errstring(ldb, "Unsupported critical extension %s",
 					       req->controls[i]->oid);
 			return LDB_ERR_UNSUPPORTED_CRITICAL_EXTENSION;
@@ -1498,6 +1584,7 @@ static int ltdb_init_rootdse(struct ldb_module *module)
 {
 	/* ignore errors on this - we expect it for non-sam databases */
 	ldb_mod_register_control(module, LDB_CONTROL_PERMISSIVE_MODIFY_OID);
+	ldb_mod_register_control(module, LDB_CONTROL_DN_CACHE_STATS_OID);
 
 	/* there can be no module beyond the backend, just return */
 	return LDB_SUCCESS;
@@ -1528,6 +1615,10 @@ static int ltdb_connect(struct ldb_context *ldb, const char *url,
 	struct ldb_module *module;
 	const char *path;
 	int tdb_flags, open_flags;
+	const char *search_threads;
+	const char *reindex_threads;
+	const char *dn_cache_size;
+	unsigned int dn_cache_entries = LTDB_DN_CACHE_DEFAULT_SIZE;
 	struct ltdb_private *ltdb;
 
 	/* parse the url */
@@ -1586,10 +1677,40 @@ static int ltdb_connect(struct ldb_context *ldb, const char *url,
 		ltdb->warn_unindexed = true;
 	}
 
-	if (getenv("LDB_WARN_REINDEX")) {
+	if (getenv("LDB_WARN_REINDEX") ||
+	    ldb_options_find(ldb, options, "warn_reindex") != NULL) {
 		ltdb->warn_reindex = true;
 	}
 
+	search_threads = ldb_options_find(ldb, options, "search_threads");
+	if (search_threads == NULL) {
+		search_threads = getenv("LDB_SEARCH_THREADS");
+	}
+	if (search_threads != NULL) {
+		ltdb->search_threads = strtoul(search_threads, NULL, 0);
+	}
+
+	reindex_threads = ldb_options_find(ldb, options, "reindex_threads");
+	if (reindex_threads == NULL) {
+		reindex_threads = getenv("LDB_REINDEX_THREADS");
+	}
+	if (reindex_threads != NULL) {
+		ltdb->reindex_threads = strtoul(reindex_threads, NULL, 0);
+	}
+
+	dn_cache_size = ldb_options_find(ldb, options, "dn_cache_size");
+	if (dn_cache_size == NULL) {
+		dn_cache_size = getenv("LDB_DN_CACHE_SIZE");
+	}
+	if (dn_cache_size != NULL) {
+		dn_cache_entries = strtoul(dn_cache_size, NULL, 0);
+	}
+	if (ltdb_dn_cache_init(ltdb, dn_cache_entries) != 0) {
+		ldb_oom(ldb);
+		talloc_free(ltdb);
+		return LDB_ERR_OPERATIONS_ERROR;
+	}
+
 	ltdb->sequence_number = 0;
 
 	module = ldb_module_new(ldb, ldb, "ldb_tdb backend", &ltdb_ops);
@@ -21,6 +21,10 @@ struct ltdb_private {
 		struct ldb_message *attributes;
 		bool one_level_indexes;
 		bool attribute_indexes;
+		/* with @IDXGUID the index entries hold this attribute */
+		const char *GUID_index_attribute;
+		/* key prefix of the index from GUIDs back to the DNs */
+		const char *GUID_index_prefix;
 	} *cache;
 
 	int in_transaction;
@@ -33,6 +37,15 @@ struct ltdb_private {
 
 	bool warn_unindexed;
 	bool warn_reindex;
+
+	/* threads unpacking records for full searches, 0 for none */
+	unsigned int search_threads;
+
+	/* threads unpacking records for a reindex, 0 for none */
+	unsigned int reindex_threads;
+
+	/* recently used records, by DN */
+	struct ltdb_dn_cache *dn_cache;
 };
 
 struct ltdb_context {
@@ -49,6 +62,11 @@ struct ltdb_context {
 	const char * const *attrs;
 	struct tevent_timer *timeout_event;
 
+	/* the attributes the filter looks at, NULL for all of them */
+	const char **filter_attrs;
+	unsigned int num_filter_attrs;
+	struct ldb_match_program *match;
+
 	/* error handling */
 	int error;
 };
@@ -60,6 +78,7 @@ struct ltdb_context {
 #define LTDB_IDXVERSION "@IDXVERSION"
 #define LTDB_IDXATTR    "@IDXATTR"
 #define LTDB_IDXONE     "@IDXONE"
+#define LTDB_IDXGUID    "@IDXGUID"
 #define LTDB_BASEINFO   "@BASEINFO"
 #define LTDB_OPTIONS    "@OPTIONS"
 #define LTDB_ATTRIBUTES "@ATTRIBUTES"
@@ -71,6 +90,9 @@ struct ltdb_context {
 #define LTDB_MOD_TIMESTAMP "whenChanged"
 #define LTDB_OBJECTCLASS "objectClass"
 
+/* records kept in the DN cache unless the dn_cache_size option says otherwise */
+#define LTDB_DN_CACHE_DEFAULT_SIZE 1000
+
 /* The following definitions come from lib/ldb/ldb_tdb/ldb_cache.c  */
 
 int ltdb_cache_reload(struct ldb_module *module);
@@ -78,6 +100,24 @@ int ltdb_cache_load(struct ldb_module *module);
 int ltdb_increase_sequence_number(struct ldb_module *module);
 int ltdb_check_at_attributes_values(const struct ldb_val *value);
 
+/* The following definitions come from lib/ldb/ldb_tdb/ldb_dn_cache.c  */
+
+int ltdb_dn_cache_init(struct ltdb_private *ltdb, unsigned int max_entries);
+void ltdb_dn_cache_flush(struct ltdb_private *ltdb);
+void ltdb_dn_cache_check(struct ltdb_private *ltdb);
+void ltdb_dn_cache_committed(struct ltdb_private *ltdb, int seqnum);
+const struct ldb_message *ltdb_dn_cache_lookup(struct ltdb_private *ltdb,
+					       TDB_DATA key);
+int ltdb_dn_cache_copy(struct ldb_message *msg,
+		       const struct ldb_message *cached,
+		       const char * const *list,
+		       unsigned int list_size);
+void ltdb_dn_cache_add(struct ltdb_private *ltdb, TDB_DATA key,
+		       const struct ldb_message *msg);
+void ltdb_dn_cache_remove(struct ltdb_private *ltdb, TDB_DATA key);
+void ltdb_dn_cache_stats(struct ltdb_private *ltdb,
+			 struct ldb_dn_cache_stats_control *stats);
+
 /* The following definitions come from lib/ldb/ldb_tdb/ldb_index.c  */
 
 struct ldb_parse_tree;
@@ -85,17 +125,41 @@ struct ldb_parse_tree;
 int ltdb_search_indexed(struct ltdb_context *ctx, uint32_t *);
 int ltdb_index_add_new(struct ldb_module *module, const struct ldb_message *msg);
 int ltdb_index_delete(struct ldb_module *module, const struct ldb_message *msg);
-int ltdb_index_del_element(struct ldb_module *module, struct ldb_dn *dn,
+int ltdb_index_del_element(struct ldb_module *module,
+			   const struct ldb_message *msg,
 			   struct ldb_message_element *el);
-int ltdb_index_add_element(struct ldb_module *module, struct ldb_dn *dn, 
+int ltdb_index_add_element(struct ldb_module *module,
+			   const struct ldb_message *msg,
 			   struct ldb_message_element *el);
-int ltdb_index_del_value(struct ldb_module *module, struct ldb_dn *dn,
+int ltdb_index_del_value(struct ldb_module *module,
+			 const struct ldb_message *msg,
 			 struct ldb_message_element *el, unsigned int v_idx);
 int ltdb_reindex(struct ldb_module *module);
 int ltdb_index_transaction_start(struct ldb_module *module);
 int ltdb_index_transaction_commit(struct ldb_module *module);
 int ltdb_index_transaction_cancel(struct ldb_module *module);
 
+/* The following definitions come from lib/ldb/ldb_tdb/ldb_unpack_pool.c  */
+
+#ifdef HAVE_PTHREAD
+typedef int (*ltdb_unpack_fn)(void *private_data, TDB_DATA key, TDB_DATA data,
+			      struct ldb_message *msg);
+typedef int (*ltdb_unpack_process_fn)(void *private_data,
+				      TDB_DATA key, TDB_DATA data,
+				      struct ldb_message *msg);
+
+struct ltdb_unpack_pool;
+
+struct ltdb_unpack_pool *ltdb_unpack_pool_init(TALLOC_CTX *mem_ctx,
+					       unsigned int num_threads,
+					       ltdb_unpack_fn unpack,
+					       ltdb_unpack_process_fn process,
+					       void *private_data);
+int ltdb_unpack_pool_add(struct ltdb_unpack_pool *pool,
+			 TDB_DATA key, TDB_DATA data);
+int ltdb_unpack_pool_finish(struct ltdb_unpack_pool *pool);
+#endif
+
 /* The following definitions come from lib/ldb/ldb_tdb/ldb_search.c  */
 
 int ltdb_has_wildcard(struct ldb_module *module, const char *attr_name, 
@@ -109,6 +173,8 @@ int ltdb_add_attr_results(struct ldb_module *module,
 			  unsigned int *count, 
 			  struct ldb_message ***res);
 int ltdb_filter_attrs(struct ldb_message *msg, const char * const *attrs);
+int ltdb_search_dn_match(struct ltdb_context *ac, struct ldb_dn *dn,
+			 bool *matched);
 int ltdb_search(struct ltdb_context *ctx);
 
 /* The following definitions come from lib/ldb/ldb_tdb/ldb_tdb.c  */
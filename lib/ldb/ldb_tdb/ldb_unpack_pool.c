@@ -0,0 +1,380 @@
+/*
+   ldb database library
+
+     ** NOTE! The following LGPL license applies to the ldb
+     ** library. This does NOT imply that all of Samba is released
+     ** under the LGPL
+
+   This library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Lesser General Public
+   License as published by the Free Software Foundation; either
+   version 3 of the License, or (at your option) any later version.
+
+   This library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Lesser General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public
+   License along with this library; if not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+ *  Name: ldb
+ *
+ *  Component: ldb tdb unpack pool
+ *
+ *  Description: unpack records in worker threads while traversing the
+ *  database
+ *
+ *  Unpacking the records is what makes traversing the whole database
+ *  slow, for unindexed searches as well as for a reindex. The tdb is
+ *  not thread safe: the caller traverses the database and hands out
+ *  batches of copied records. The workers unpack them into messages
+ *  hanging off the batch, which the caller then processes in its own
+ *  thread, as nearly everything else uses the ldb context.
+ */
+
+#include "ldb_tdb.h"
+#include "dlinklist.h"
+
+#ifdef HAVE_PTHREAD
+
+#include <pthread.h>
+
+/* records handed to a worker in one go */
+#define LTDB_UNPACK_BATCH 64
+
+struct ltdb_unpack_batch {
+	struct ltdb_unpack_batch *prev, *next;
+	unsigned int num_records;
+	TDB_DATA keys[LTDB_UNPACK_BATCH];
+	TDB_DATA data[LTDB_UNPACK_BATCH];
+	struct ldb_message *msgs[LTDB_UNPACK_BATCH];
+	bool started;
+	bool done;
+	int error;
+};
+
+struct ltdb_unpack_pool {
+	ltdb_unpack_fn unpack;
+	ltdb_unpack_process_fn process;
+	void *private_data;
+
+	pthread_mutex_t mutex;
+	pthread_cond_t todo_cond;
+	pthread_cond_t done_cond;
+	/* in the order of the traverse, which is also the order they
+	   are processed in */
+	struct ltdb_unpack_batch *batches;
+	unsigned int in_flight;
+	unsigned int max_in_flight;
+	bool shutdown;
+
+	pthread_t *threads;
+	unsigned int num_threads;
+	unsigned int max_threads;
+
+	/* the batch being filled by the traverse */
+	struct ltdb_unpack_batch *current;
+	int error;
+};
+
+/*
+  unpack the records of a batch, in a worker thread. Everything is
+  allocated below the batch, which nobody else touches meanwhile.
+ */
+static void unpack_batch(struct ltdb_unpack_pool *pool,
+			 struct ltdb_unpack_batch *batch)
+{
+	unsigned int i;
+
+	for (i = 0; i < batch->num_records; i++) {
+		struct ldb_message *msg;
+		int ret;
+
+		msg = ldb_msg_new(batch);
+		if (msg == NULL) {
+			batch->error = LDB_ERR_OPERATIONS_ERROR;
+			return;
+		}
+
+		ret = pool->unpack(pool->private_data, batch->keys[i],
+				   batch->data[i], msg);
+		if (ret != LDB_SUCCESS) {
+			batch->error = ret;
+			return;
+		}
+
+		batch->msgs[i] = msg;
+	}
+}
+
+static void *unpack_pool_worker(void *private_data)
+{
+	struct ltdb_unpack_pool *pool =
+		(struct ltdb_unpack_pool *)private_data;
+	struct ltdb_unpack_batch *batch;
+
+	pthread_mutex_lock(&pool->mutex);
+
+	while (true) {
+		for (batch = pool->batches; batch != NULL; batch = batch->next) {
+			if (!batch->started) {
+				break;
+			}
+		}
+		if (batch == NULL) {
+			if (pool->shutdown) {
+				break;
+			}
+			pthread_cond_wait(&pool->todo_cond, &pool->mutex);
+			continue;
+		}
+		batch->started = true;
+		pthread_mutex_unlock(&pool->mutex);
+
+		unpack_batch(pool, batch);
+
+		pthread_mutex_lock(&pool->mutex);
+		batch->done = true;
+		pthread_cond_signal(&pool->done_cond);
+	}
+
+	pthread_mutex_unlock(&pool->mutex);
+	return NULL;
+}
+
+/*
+  process the messages of an unpacked batch, in the thread of the
+  caller
+ */
+static int process_batch(struct ltdb_unpack_pool *pool,
+			 struct ltdb_unpack_batch *batch)
+{
+	unsigned int i;
+
+	if (batch->error != LDB_SUCCESS) {
+		return batch->error;
+	}
+
+	for (i = 0; i < batch->num_records; i++) {
+		struct ldb_message *msg = batch->msgs[i];
+		int ret;
+
+		batch->msgs[i] = NULL;
+
+		ret = pool->process(pool->private_data, batch->keys[i],
+				    batch->data[i], msg);
+		if (ret != LDB_SUCCESS) {
+			return ret;
+		}
+	}
+
+	return LDB_SUCCESS;
+}
+
+/*
+  process finished batches in order until at most max of them are
+  outstanding. After an error the rest is only thrown away.
+ */
+static void unpack_pool_reap(struct ltdb_unpack_pool *pool,
+			     unsigned int max)
+{
+	struct ltdb_unpack_batch *batch;
+
+	pthread_mutex_lock(&pool->mutex);
+
+	while (true) {
+		batch = pool->batches;
+		if (batch != NULL && batch->done) {
+			DLIST_REMOVE(pool->batches, batch);
+			pool->in_flight--;
+			pthread_mutex_unlock(&pool->mutex);
+
+			if (pool->error == LDB_SUCCESS) {
+				pool->error = process_batch(pool, batch);
+			}
+			talloc_free(batch);
+
+			pthread_mutex_lock(&pool->mutex);
+			continue;
+		}
+		if (pool->in_flight <= max) {
+			break;
+		}
+		pthread_cond_wait(&pool->done_cond, &pool->mutex);
+	}
+
+	pthread_mutex_unlock(&pool->mutex);
+}
+
+static int unpack_pool_submit(struct ltdb_unpack_pool *pool)
+{
+	struct ltdb_unpack_batch *batch = pool->current;
+
+	pool->current = NULL;
+
+	/* threads are only started once there is work for them */
+	while (pool->num_threads < pool->max_threads) {
+		int ret;
+
+		ret = pthread_create(&pool->threads[pool->num_threads], NULL,
+				     unpack_pool_worker, pool);
+		if (ret != 0) {
+			/* the others have to do, if there are others */
+			pool->max_threads = pool->num_threads;
+			break;
+		}
+		pool->num_threads++;
+	}
+
+	if (pool->num_threads == 0) {
+		unpack_batch(pool, batch);
+		batch->started = true;
+		batch->done = true;
+		pthread_mutex_lock(&pool->mutex);
+		DLIST_ADD_END(pool->batches, batch);
+		pool->in_flight++;
+		pthread_mutex_unlock(&pool->mutex);
+		unpack_pool_reap(pool, 0);
+		return pool->error;
+	}
+
+	pthread_mutex_lock(&pool->mutex);
+	DLIST_ADD_END(pool->batches, batch);
+	pool->in_flight++;
+	pthread_cond_signal(&pool->todo_cond);
+	pthread_mutex_unlock(&pool->mutex);
+
+	unpack_pool_reap(pool, pool->max_in_flight);
+	return pool->error;
+}
+
+static int unpack_pool_destructor(struct ltdb_unpack_pool *pool)
+{
+	unsigned int i;
+
+	TALLOC_FREE(pool->current);
+
+	/* wait for the workers, what they still have is thrown away */
+	if (pool->error == LDB_SUCCESS) {
+		pool->error = LDB_ERR_OPERATIONS_ERROR;
+	}
+	unpack_pool_reap(pool, 0);
+
+	pthread_mutex_lock(&pool->mutex);
+	pool->shutdown = true;
+	pthread_cond_broadcast(&pool->todo_cond);
+	pthread_mutex_unlock(&pool->mutex);
+
+	for (i = 0; i < pool->num_threads; i++) {
+		pthread_join(pool->threads[i], NULL);
+	}
+
+	pthread_cond_destroy(&pool->done_cond);
+	pthread_cond_destroy(&pool->todo_cond);
+	pthread_mutex_destroy(&pool->mutex);
+	return 0;
+}
+
+/*
+  set up a pool of up to num_threads workers. unpack is called in the
+  workers and must only use what is safe to share between threads,
+  process is called in the thread of the caller, with the messages in
+  the order the records were added in
+ */
+struct ltdb_unpack_pool *ltdb_unpack_pool_init(TALLOC_CTX *mem_ctx,
+					       unsigned int num_threads,
+					       ltdb_unpack_fn unpack,
+					       ltdb_unpack_process_fn process,
+					       void *private_data)
+{
+	struct ltdb_unpack_pool *pool;
+
+	pool = talloc_zero(mem_ctx, struct ltdb_unpack_pool);
+	if (pool == NULL) {
+		return NULL;
+	}
+	pool->unpack = unpack;
+	pool->process = process;
+	pool->private_data = private_data;
+	pool->max_threads = num_threads;
+	pool->max_in_flight = 2 * num_threads;
+
+	pool->threads = talloc_array(pool, pthread_t, num_threads);
+	if (pool->threads == NULL) {
+		talloc_free(pool);
+		return NULL;
+	}
+
+	if (pthread_mutex_init(&pool->mutex, NULL) != 0) {
+		talloc_free(pool);
+		return NULL;
+	}
+	pthread_cond_init(&pool->todo_cond, NULL);
+	pthread_cond_init(&pool->done_cond, NULL);
+	talloc_set_destructor(pool, unpack_pool_destructor);
+
+	return pool;
+}
+
+/*
+  hand a copy of a record to the pool, from a traverse function.
+  Returns 0 or -1 to stop the traverse after an error.
+ */
+int ltdb_unpack_pool_add(struct ltdb_unpack_pool *pool,
+			 TDB_DATA key, TDB_DATA data)
+{
+	struct ltdb_unpack_batch *batch;
+	unsigned int i;
+
+	if (pool->current == NULL) {
+		pool->current = talloc_zero(NULL, struct ltdb_unpack_batch);
+		if (pool->current == NULL) {
+			pool->error = LDB_ERR_OPERATIONS_ERROR;
+			return -1;
+		}
+	}
+	batch = pool->current;
+	i = batch->num_records;
+
+	batch->keys[i].dptr = (uint8_t *)talloc_memdup(batch, key.dptr,
+						       key.dsize);
+	batch->keys[i].dsize = key.dsize;
+	batch->data[i].dptr = (uint8_t *)talloc_memdup(batch, data.dptr,
+						       data.dsize);
+	batch->data[i].dsize = data.dsize;
+	if (batch->keys[i].dptr == NULL ||
+	    (batch->data[i].dptr == NULL && data.dsize != 0)) {
+		pool->error = LDB_ERR_OPERATIONS_ERROR;
+		return -1;
+	}
+	batch->num_records++;
+
+	if (batch->num_records < LTDB_UNPACK_BATCH) {
+		return 0;
+	}
+	if (unpack_pool_submit(pool) != LDB_SUCCESS) {
+		return -1;
+	}
+	return 0;
+}
+
+/*
+  process the rest after the traverse, returns the first error of the
+  workers or of process
+ */
+int ltdb_unpack_pool_finish(struct ltdb_unpack_pool *pool)
+{
+	if (pool->current != NULL && pool->error == LDB_SUCCESS) {
+		unpack_pool_submit(pool);
+	}
+	TALLOC_FREE(pool->current);
+
+	unpack_pool_reap(pool, 0);
+
+	return pool->error;
+}
+
+#endif /* HAVE_PTHREAD */
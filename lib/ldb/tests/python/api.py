@@ -1275,6 +1275,188 @@ class LdbResultTests(TestCase):
         self.assertTrue(found)
 
 
+class DnCacheTests(TestCase):
+
+    def setUp(self):
+        super(DnCacheTests, self).setUp()
+        self.name = filename()
+        self.l = ldb.Ldb(self.name, options=["dn_cache_size=2"])
+        for i in range(3):
+            self.l.add({"dn": "OU=OU%d,DC=SAMBA,DC=ORG" % i,
+                        "name": b"OU #%d" % i,
+                        "description": b"OU number %d" % i})
+
+    def tearDown(self):
+        super(DnCacheTests, self).tearDown()
+        if os.path.exists(self.name):
+            os.unlink(self.name)
+
+    def stats(self, res):
+        # dn_cache_stats:crit:hits:misses:evictions:flushes:entries:max
+        self.assertEqual(len(res.controls), 1)
+        fields = str(res.controls[0]).split(":")
+        self.assertEqual(fields[0], "dn_cache_stats")
+        return [int(f) for f in fields[2:]]
+
+    def search(self, i, attrs=None, expression=None, l=None):
+        if l is None:
+            l = self.l
+        return l.search("OU=OU%d,DC=SAMBA,DC=ORG" % i, ldb.SCOPE_BASE,
+                        expression=expression, attrs=attrs,
+                        controls=["dn_cache_stats:0"])
+
+    def test_hits(self):
+        res = self.search(0)
+        self.assertEqual(self.stats(res)[:2], [0, 1])
+        res = self.search(0, attrs=["name"])
+        self.assertEqual(self.stats(res)[:2], [1, 1])
+        self.assertEqual(list(res[0]["name"]), [b"OU #0"])
+        self.assertFalse("description" in res[0])
+        res = self.search(0, expression="(name=OU #1)")
+        self.assertEqual(len(res), 0)
+        self.assertEqual(self.stats(res)[:2], [2, 1])
+
+    def test_results_are_copies(self):
+        res = self.search(0)
+        res[0]["name"] = b"changed"
+        res = self.search(0)
+        self.assertEqual(list(res[0]["name"]), [b"OU #0"])
+
+    def test_eviction(self):
+        for i in range(3):
+            self.search(i)
+        res = self.search(0)
+        hits, misses, evictions, flushes, entries, max_entries = \
+            self.stats(res)
+        self.assertEqual(hits, 0)
+        self.assertEqual(misses, 4)
+        self.assertEqual(evictions, 2)
+        self.assertEqual((entries, max_entries), (2, 2))
+        res = self.search(2)
+        self.assertEqual(self.stats(res)[:2], [1, 4])
+
+    def test_own_changes(self):
+        self.search(0)
+        m = ldb.Message()
+        m.dn = ldb.Dn(self.l, "OU=OU0,DC=SAMBA,DC=ORG")
+        m["name"] = ldb.MessageElement(b"changed", ldb.FLAG_MOD_REPLACE,
+                                       "name")
+        self.l.modify(m)
+        res = self.search(0)
+        self.assertEqual(list(res[0]["name"]), [b"changed"])
+        self.l.delete("OU=OU0,DC=SAMBA,DC=ORG")
+        self.assertEqual(len(self.search(0)), 0)
+
+    def test_other_changes(self):
+        other = ldb.Ldb(self.name)
+        self.search(0)
+        m = ldb.Message()
+        m.dn = ldb.Dn(other, "OU=OU0,DC=SAMBA,DC=ORG")
+        m["name"] = ldb.MessageElement(b"changed", ldb.FLAG_MOD_REPLACE,
+                                       "name")
+        other.modify(m)
+        res = self.search(0)
+        self.assertEqual(list(res[0]["name"]), [b"changed"])
+        self.assertEqual(self.stats(res)[3], 1)
+
+    def test_disabled(self):
+        l = ldb.Ldb(self.name, options=["dn_cache_size=0"])
+        self.search(0, l=l)
+        res = self.search(0, l=l)
+        self.assertEqual(self.stats(res), [0, 0, 0, 0, 0, 0])
+
+
+class IndexTransactionTests(TestCase):
+
+    def setUp(self):
+        super(IndexTransactionTests, self).setUp()
+        self.name = filename()
+        self.l = ldb.Ldb(self.name)
+        self.l.add({"dn": "@INDEXLIST",
+                    "@IDXATTR": [b"x", b"y"],
+                    "@IDXONE": [b"1"]})
+        self.l.add({"dn": "DC=SAMBA,DC=ORG", "x": b"base"})
+
+    def tearDown(self):
+        super(IndexTransactionTests, self).tearDown()
+        if os.path.exists(self.name):
+            os.unlink(self.name)
+
+    def add(self, i, x=b"all"):
+        self.l.add({"dn": "CN=U%d,DC=SAMBA,DC=ORG" % i,
+                    "x": x, "y": b"%d" % (i % 3)})
+
+    def names(self, expression):
+        res = self.l.search("DC=SAMBA,DC=ORG", ldb.SCOPE_SUBTREE,
+                            expression)
+        return sorted(str(m.dn) for m in res)
+
+    def expected(self, numbers):
+        return sorted("CN=U%d,DC=SAMBA,DC=ORG" % i for i in numbers)
+
+    def test_changes_in_transaction(self):
+        self.l.transaction_start()
+        for i in range(200):
+            self.add(i)
+        self.assertEqual(self.names("(x=all)"), self.expected(range(200)))
+        for i in range(0, 200, 2):
+            self.l.delete("CN=U%d,DC=SAMBA,DC=ORG" % i)
+        self.assertEqual(self.names("(x=all)"),
+                         self.expected(range(1, 200, 2)))
+        for i in range(0, 200, 4):
+            self.add(i)
+        self.add(200, x=b"other")
+        remaining = [i for i in range(200) if i % 4 != 2]
+        self.assertEqual(self.names("(&(x=all)(y=1))"),
+                         self.expected(i for i in remaining if i % 3 == 1))
+        self.l.transaction_commit()
+        self.assertEqual(self.names("(x=all)"), self.expected(remaining))
+        res = self.l.search("DC=SAMBA,DC=ORG", ldb.SCOPE_ONELEVEL)
+        self.assertEqual(len(res), len(remaining) + 1)
+
+    def test_cancel(self):
+        for i in range(50):
+            self.add(i)
+        self.l.transaction_start()
+        for i in range(50, 100):
+            self.add(i)
+        for i in range(25):
+            self.l.delete("CN=U%d,DC=SAMBA,DC=ORG" % i)
+        self.l.transaction_cancel()
+        self.assertEqual(self.names("(x=all)"), self.expected(range(50)))
+
+    def reindex(self, l):
+        for i in range(300):
+            self.add(i)
+        l.transaction_start()
+        for i in range(300, 400):
+            self.add(i, x=b"other")
+        m = ldb.Message()
+        m.dn = ldb.Dn(l, "@INDEXLIST")
+        m["@IDXATTR"] = ldb.MessageElement([b"x"], ldb.FLAG_MOD_REPLACE,
+                                           "@IDXATTR")
+        l.modify(m)
+        self.add(400, x=b"other")
+        l.transaction_commit()
+        self.assertEqual(self.names("(x=all)"), self.expected(range(300)))
+        self.assertEqual(self.names("(x=other)"),
+                         self.expected(range(300, 401)))
+        self.assertEqual(self.names("(&(x=all)(y=1))"),
+                         self.expected(i for i in range(300) if i % 3 == 1))
+        # the index records of y are gone
+        res = l.search("@INDEX:Y:1", ldb.SCOPE_BASE)
+        self.assertEqual(len(res), 0)
+        res = l.search("@INDEX:X:all", ldb.SCOPE_BASE)
+        self.assertEqual(len(res[0]["@IDX"]), 300)
+
+    def test_reindex(self):
+        self.reindex(self.l)
+
+    def test_reindex_threads(self):
+        self.l = ldb.Ldb(self.name, options=["reindex_threads:3"])
+        self.reindex(self.l)
+
+
 class BadTypeTests(TestCase):
     def test_control(self):
         l = ldb.Ldb()
@@ -163,3 +163,126 @@ EOF
 checkone 3 "cn=t1,cn=TEST" '(test=one)'
 checkone 1 "cn=t1,cn=TEST" '(cn=two)'
 
+
+echo "Testing parallel unindexed search"
+awk 'BEGIN { for (i = 0; i < 300; i++) {
+	printf("dn: cn=p%d,cn=TEST\nobjectClass: parclass\ncn: p%d\npt: p%d\n\n", i, i, i % 3) } }' | \
+	$VALGRIND ldbadd || exit 1
+for threads in 0 4; do
+    n=`$VALGRIND ldbsearch --search-threads=$threads '(pt=p1)' | grep '^dn' | wc -l`
+    if [ $n != 100 ]; then
+	echo "Got $n but expected 100 with $threads search threads"
+	exit 1
+    fi
+    echo "OK: 100 (pt=p1) with $threads search threads"
+done
+n=`LDB_SEARCH_THREADS=3 $VALGRIND ldbsearch '(&(objectClass=parclass)(!(pt=p2)))' | grep '^dn' | wc -l`
+if [ $n != 200 ]; then
+    echo "Got $n but expected 200 with LDB_SEARCH_THREADS"
+    exit 1
+fi
+echo "OK: 200 with LDB_SEARCH_THREADS"
+
+echo "Testing GUID indexes"
+(
+LDB_URL="$LDB_URL.guid"
+export LDB_URL
+rm -f $LDB_URL
+
+checkindexed() {
+    count=$1
+    expression="$2"
+    out=`LDB_WARN_UNINDEXED=1 $VALGRIND ldbsearch "$expression" 2>&1`
+    if echo "$out" | grep -q 'FULL SEARCH'; then
+	printf 'Unindexed search for %s\n' "$expression"
+	exit 1
+    fi
+    n=`echo "$out" | grep '^dn' | wc -l`
+    if [ $n != $count ]; then
+	printf 'Got %s but expected %s for %s\n' $n $count "$expression"
+	echo "$out"
+	exit 1
+    fi
+    printf 'OK: %s %s\n' $count "$expression"
+}
+
+cat <<EOF | $VALGRIND ldbadd || exit 1
+dn: @INDEXLIST
+@IDXATTR: test
+@IDXATTR: cn
+@IDXONE: 1
+@IDXGUID: objectGUID
+
+dn: cn=TEST
+objectClass: container
+cn: TEST
+objectGUID:: AQIDBAUGBwgJCgsMDQ4PEA==
+
+dn: cn=g1,cn=TEST
+objectClass: guidclass
+cn: g1
+test: foo
+objectGUID:: ERITFBUWFxgZGhscHR4fIA==
+
+dn: cn=g2,cn=TEST
+objectClass: guidclass
+cn: g2
+test: foo
+objectGUID:: ISIjJCUmJygpKissLS4vMA==
+EOF
+
+checkindexed 2 '(test=foo)'
+checkindexed 1 '(&(test=foo)(cn=g2))'
+checkindexed 3 '(|(test=foo)(cn=TEST))'
+checkindexed 1 '(objectGUID=\11\12\13\14\15\16\17\18\19\1a\1b\1c\1d\1e\1f\20)'
+n=`$VALGRIND ldbsearch -s one -b cn=TEST '(test=foo)' | grep '^dn' | wc -l`
+if [ $n != 2 ]; then
+    echo "Got $n but expected 2 for the one level search"
+    exit 1
+fi
+echo "OK: 2 one level (test=foo)"
+
+echo "Refusing duplicate and missing GUIDs"
+cat <<EOF | $VALGRIND ldbadd 2>/dev/null && exit 1
+dn: cn=g3,cn=TEST
+objectClass: guidclass
+test: foo
+objectGUID:: ERITFBUWFxgZGhscHR4fIA==
+EOF
+cat <<EOF | $VALGRIND ldbadd 2>/dev/null && exit 1
+dn: cn=g3,cn=TEST
+objectClass: guidclass
+test: foo
+EOF
+cat <<EOF | $VALGRIND ldbmodify 2>/dev/null && exit 1
+dn: cn=g2,cn=TEST
+changetype: modify
+replace: objectGUID
+objectGUID:: MTIzNDU2Nzg5Ojs8PT4/QA==
+EOF
+checkindexed 2 '(test=foo)'
+
+echo "Modifying, renaming and deleting with GUID indexes"
+cat <<EOF | $VALGRIND ldbmodify || exit 1
+dn: cn=g2,cn=TEST
+changetype: modify
+replace: test
+test: bar
+EOF
+checkindexed 1 '(test=foo)'
+checkindexed 1 '(test=bar)'
+$VALGRIND ldbrename cn=g2,cn=TEST cn=g4,cn=TEST || exit 1
+checkindexed 1 '(&(test=bar)(cn=g2))'
+n=`$VALGRIND ldbsearch -b cn=g4,cn=TEST -s base '(test=bar)' | grep '^dn' | wc -l`
+if [ $n != 1 ]; then
+    echo "Got $n but expected 1 for the renamed record"
+    exit 1
+fi
+$VALGRIND ldbdel cn=g1,cn=TEST || exit 1
+checkindexed 0 '(test=foo)'
+checkindexed 1 '(|(test=foo)(test=bar))'
+
+rm -f $LDB_URL
+$VALGRIND ldbtest --index-bench=guid --num-records 100 --num-searches 10 || exit 1
+rm -f $LDB_URL
+) || exit 1
@@ -45,6 +45,9 @@ static struct poptOption builtin_popt_options[] = {
 	{ "modules-path", 0, POPT_ARG_STRING, &options.modules_path, 0, "modules path", "PATH" },
 	{ "num-searches", 0, POPT_ARG_INT, &options.num_searches, 0, "number of test searches", NULL },
 	{ "num-records", 0, POPT_ARG_INT, &options.num_records, 0, "number of test records", NULL },
+	{ "search-threads", 0, POPT_ARG_INT, &options.search_threads, 0, "threads for unindexed searches", "NUM" },
+	{ "reindex-threads", 0, POPT_ARG_INT, &options.reindex_threads, 0, "threads for reindexing", "NUM" },
+	{ "index-bench", 0, POPT_ARG_STRING, &options.index_bench, 0, "index benchmark in ldbtest", "dn|guid" },
 	{ "all", 'a',    POPT_ARG_NONE, &options.all_records, 0, "(|(objectClass=*)(distinguishedName=*))", NULL },
 	{ "nosync", 0,   POPT_ARG_NONE, &options.nosync, 0, "non-synchronous transactions", NULL },
 	{ "sorted", 'S', POPT_ARG_NONE, &options.sorted, 0, "sort attributes", NULL },
@@ -90,6 +93,29 @@ static bool add_control(TALLOC_CTX *mem_ctx, const char *control)
 	return true;
 }
 
+/*
+  add a connect option to the options structure
+ */
+static bool add_option(TALLOC_CTX *mem_ctx, const char *option)
+{
+	unsigned int i;
+
+	if (option == NULL) {
+		return false;
+	}
+
+	/* count how many options we already have */
+	for (i=0; options.options && options.options[i]; i++) ;
+
+	options.options = talloc_realloc(mem_ctx, options.options, const char *, i + 2);
+	if (options.options == NULL) {
+		return false;
+	}
+	options.options[i] = option;
+	options.options[i+1] = NULL;
+	return true;
+}
+
 /**
   process command line options
 */
@@ -290,6 +316,29 @@ struct ldb_cmdline *ldb_cmdline_process(struct ldb_context *ldb,
 		ldb_set_modules_dir(ldb, options.modules_path);
 	}
 
+	if (options.search_threads != 0 &&
+	    !add_option(ret, talloc_asprintf(ret, "search_threads:%d",
+					      options.search_threads))) {
+		fprintf(stderr, "Out of memory!\n");
+		goto failed;
+	}
+
+	if (options.reindex_threads != 0 &&
+	    !add_option(ret, talloc_asprintf(ret, "reindex_threads:%d",
+					      options.reindex_threads))) {
+		fprintf(stderr, "Out of memory!\n");
+		goto failed;
+	}
+
+	/* with -v show how a reindex is getting on */
+	if (options.verbose != 0 &&
+	    !add_option(ret, "warn_reindex:1")) {
+		fprintf(stderr, "Out of memory!\n");
+		goto failed;
+	}
+
+	ret->options = options.options;
+
 	rc = ldb_modules_hook(ldb, LDB_MODULE_HOOK_CMDLINE_PRECONNECT);
 	if (rc != LDB_SUCCESS) {
 		fprintf(stderr, "ldb: failed to run preconnect hooks : %s\n", ldb_strerror(rc));
@@ -493,6 +542,22 @@ int handle_controls_reply(struct ldb_control **reply, struct ldb_control **reque
 			continue;
 		}
 
+		if (strcmp(LDB_CONTROL_DN_CACHE_STATS_OID, reply[i]->oid) == 0) {
+			struct ldb_dn_cache_stats_control *rep_control;
+
+			rep_control = talloc_get_type(reply[i]->data, struct ldb_dn_cache_stats_control);
+
+			printf("# DN cache: %llu hits, %llu misses, %llu evictions, %llu flushes, %u/%u entries\n",
+			       (unsigned long long)rep_control->hits,
+			       (unsigned long long)rep_control->misses,
+			       (unsigned long long)rep_control->evictions,
+			       (unsigned long long)rep_control->flushes,
+			       rep_control->entries,
+			       rep_control->max_entries);
+
+			continue;
+		}
+
 		/* no controls matched, throw a warning */
 		fprintf(stderr, "Unknown reply control oid: %s\n", reply[i]->oid);
 	}
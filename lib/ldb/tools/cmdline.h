@@ -44,6 +44,9 @@ struct ldb_cmdline {
 	const char **controls;
 	int show_binary;
 	int tracing;
+	int search_threads;
+	int reindex_threads;
+	const char *index_bench;
 };
 
 struct ldb_cmdline *ldb_cmdline_process(struct ldb_context *ldb, int argc,
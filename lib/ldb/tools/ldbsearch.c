@@ -189,6 +189,7 @@ static int do_search(struct ldb_context *ldb,
 {
 	struct ldb_request *req;
 	struct search_context *sctx;
+	struct timeval start, end;
 	int ret;
 
 	req = NULL;
@@ -204,6 +205,8 @@ static int do_search(struct ldb_context *ldb,
 		return LDB_ERR_OPERATIONS_ERROR;
 	}
 
+	gettimeofday(&start, NULL);
+
 again:
 	/* free any previous requests */
 	if (req) talloc_free(req);
@@ -261,6 +264,8 @@ again:
 	if (sctx->pending)
 		goto again;
 
+	gettimeofday(&end, NULL);
+
 	if (sctx->sort && (sctx->num_stored != 0 || sctx->refs != 0)) {
 		unsigned int i;
 
@@ -279,6 +284,12 @@ again:
 	printf("# returned %u records\n# %u entries\n# %u referrals\n",
 		sctx->entries + sctx->refs, sctx->entries, sctx->refs);
 
+	if (options->verbose) {
+		printf("# search took %.3f seconds\n",
+		       (end.tv_sec - start.tv_sec) +
+		       (end.tv_usec - start.tv_usec) / 1.0e6);
+	}
+
 	talloc_free(sctx);
 	talloc_free(req);
 
@@ -284,6 +284,200 @@ static void start_test(struct ldb_context *ldb, unsigned int nrecords,
 }
 
 
+/*
+  index benchmark: users spread over units and sites, searched with
+  equality, AND and OR filters. With guid the index records hold the
+  objectGUIDs instead of the DNs.
+*/
+#define BENCH_UNITS 100
+#define BENCH_SITES 16
+
+static void bench_add_users(struct ldb_context *ldb, struct ldb_dn *basedn,
+			    bool guid_index, unsigned int count)
+{
+	struct ldb_message *msg;
+	unsigned int i;
+
+	if (ldb_transaction_start(ldb) != LDB_SUCCESS) {
+		printf("transaction start failed - %s\n", ldb_errstring(ldb));
+		exit(LDB_ERR_OPERATIONS_ERROR);
+	}
+
+	msg = ldb_msg_new(ldb);
+	if (msg == NULL) {
+		printf("ldb_msg_new failed\n");
+		exit(LDB_ERR_OPERATIONS_ERROR);
+	}
+	msg->dn = ldb_dn_new(msg, ldb, "@INDEXLIST");
+	ldb_msg_add_string(msg, "@IDXATTR", "uid");
+	ldb_msg_add_string(msg, "@IDXATTR", "ou");
+	ldb_msg_add_string(msg, "@IDXATTR", "l");
+	if (guid_index) {
+		ldb_msg_add_string(msg, "@IDXGUID", "objectGUID");
+	}
+	if (ldb_add(ldb, msg) != LDB_SUCCESS) {
+		printf("Add of @INDEXLIST failed - %s\n", ldb_errstring(ldb));
+		exit(LDB_ERR_OPERATIONS_ERROR);
+	}
+	talloc_free(msg);
+
+	for (i=0;i<count;i++) {
+		TALLOC_CTX *tmp_ctx = talloc_new(ldb);
+		uint8_t guid[16];
+		struct ldb_val v;
+		int ret;
+
+		/* GUIDs in the order of creation */
+		memset(guid, 0x42, sizeof(guid));
+		guid[12] = (i >> 24) & 0xff;
+		guid[13] = (i >> 16) & 0xff;
+		guid[14] = (i >> 8) & 0xff;
+		guid[15] = i & 0xff;
+		v.data = guid;
+		v.length = sizeof(guid);
+
+		msg = ldb_msg_new(tmp_ctx);
+		msg->dn = ldb_dn_copy(msg, basedn);
+		ldb_dn_add_child_fmt(msg->dn, "cn=User%u", i);
+
+		ret = ldb_msg_add_fmt(msg, "cn", "User%u", i);
+		ret |= ldb_msg_add_fmt(msg, "uid", "user%u", i);
+		ret |= ldb_msg_add_fmt(msg, "ou", "unit%u", i % BENCH_UNITS);
+		ret |= ldb_msg_add_fmt(msg, "l", "site%u", i % BENCH_SITES);
+		ret |= ldb_msg_add_string(msg, "objectClass", "person");
+		ret |= ldb_msg_add_value(msg, "objectGUID", &v, NULL);
+		if (ret != LDB_SUCCESS) {
+			printf("building User%u failed\n", i);
+			exit(LDB_ERR_OPERATIONS_ERROR);
+		}
+
+		if (ldb_add(ldb, msg) != LDB_SUCCESS) {
+			printf("Add of User%u failed - %s\n", i, ldb_errstring(ldb));
+			exit(LDB_ERR_OPERATIONS_ERROR);
+		}
+
+		talloc_free(tmp_ctx);
+	}
+
+	if (ldb_transaction_commit(ldb) != LDB_SUCCESS) {
+		printf("transaction commit failed - %s\n", ldb_errstring(ldb));
+		exit(LDB_ERR_OPERATIONS_ERROR);
+	}
+}
+
+/* number of users below nrecords with i % step == first */
+static unsigned int bench_count(unsigned int nrecords, unsigned int first,
+				unsigned int step)
+{
+	if (first >= nrecords) {
+		return 0;
+	}
+	return (nrecords - 1 - first) / step + 1;
+}
+
+static void bench_search(struct ldb_context *ldb, struct ldb_dn *basedn,
+			 const char *expr, unsigned int expected)
+{
+	struct ldb_result *res = NULL;
+	int ret;
+
+	ret = ldb_search(ldb, ldb, &res, basedn, LDB_SCOPE_SUBTREE, NULL,
+			 "%s", expr);
+	if (ret != LDB_SUCCESS || res->count != expected) {
+		printf("Search %s failed - %u results, %u expected - %s\n",
+		       expr, ret == LDB_SUCCESS ? res->count : 0, expected,
+		       ldb_errstring(ldb));
+		exit(LDB_ERR_OPERATIONS_ERROR);
+	}
+	talloc_free(res);
+}
+
+static void start_index_bench(struct ldb_context *ldb, const char *mode,
+			      unsigned int nrecords, unsigned int nsearches)
+{
+	struct ldb_dn *basedn;
+	bool guid_index;
+	unsigned int i;
+
+	if (strcmp(mode, "guid") == 0) {
+		guid_index = true;
+	} else if (strcmp(mode, "dn") == 0) {
+		guid_index = false;
+	} else {
+		printf("Invalid index benchmark '%s', use dn or guid\n", mode);
+		exit(LDB_ERR_OPERATIONS_ERROR);
+	}
+
+	if (nrecords == 0) {
+		printf("The index benchmark needs records\n");
+		exit(LDB_ERR_OPERATIONS_ERROR);
+	}
+
+	basedn = ldb_dn_new(ldb, ldb, options->basedn);
+	if ( ! ldb_dn_validate(basedn)) {
+		printf("Invalid base DN format\n");
+		exit(LDB_ERR_INVALID_DN_SYNTAX);
+	}
+
+	printf("Adding %u users with %s index\n", nrecords, mode);
+	_start_timer();
+	bench_add_users(ldb, basedn, guid_index, nrecords);
+	printf("add took %.2f seconds\n", _end_timer());
+
+	_start_timer();
+	for (i=0;i<nsearches;i++) {
+		unsigned int u = (i * 7919) % nrecords;
+		char *expr = talloc_asprintf(ldb, "(uid=user%u)", u);
+
+		bench_search(ldb, basedn, expr, 1);
+		talloc_free(expr);
+	}
+	printf("equality search took %.2f seconds\n", _end_timer());
+
+	_start_timer();
+	for (i=0;i<nsearches;i++) {
+		unsigned int unit = i % BENCH_UNITS;
+		unsigned int site = (i * 3) % BENCH_SITES;
+		unsigned int expected = 0, first;
+		char *expr;
+
+		/* both hold for i % 400 == first, if there is one */
+		for (first = unit; first < BENCH_UNITS * 4; first += BENCH_UNITS) {
+			if (first % BENCH_SITES == site) {
+				expected = bench_count(nrecords, first,
+						       BENCH_UNITS * 4);
+				break;
+			}
+		}
+
+		expr = talloc_asprintf(ldb, "(&(ou=unit%u)(l=site%u))",
+				       unit, site);
+		bench_search(ldb, basedn, expr, expected);
+		talloc_free(expr);
+	}
+	printf("AND search took %.2f seconds\n", _end_timer());
+
+	_start_timer();
+	for (i=0;i<nsearches;i++) {
+		unsigned int unit = i % BENCH_UNITS;
+		unsigned int u = (i * 7919) % nrecords;
+		unsigned int expected;
+		char *expr;
+
+		expected = bench_count(nrecords, unit, BENCH_UNITS);
+		if (u % BENCH_UNITS != unit) {
+			expected++;
+		}
+
+		expr = talloc_asprintf(ldb, "(|(uid=user%u)(ou=unit%u))",
+				       u, unit);
+		bench_search(ldb, basedn, expr, expected);
+		talloc_free(expr);
+	}
+	printf("OR search took %.2f seconds\n", _end_timer());
+}
+
+
 /*
       2) Store an @indexlist record
 
@@ -398,6 +592,7 @@ static void usage(struct ldb_context *ldb)
 	printf("  -H ldb_url       choose the database (or $LDB_URL)\n");
 	printf("  --num-records  nrecords      database size to use\n");
 	printf("  --num-searches nsearches     number of searches to do\n");
+	printf("  --index-bench dn|guid        only run the index benchmark\n");
 	printf("\n");
 	printf("tests ldb API\n\n");
 	exit(LDB_ERR_OPERATIONS_ERROR);
@@ -426,6 +621,14 @@ int main(int argc, const char **argv)
 	printf("Testing with num-records=%d and num-searches=%d\n", 
 	       options->num_records, options->num_searches);
 
+	if (options->index_bench != NULL) {
+		start_index_bench(ldb, options->index_bench,
+				  (unsigned int) options->num_records,
+				  (unsigned int) options->num_searches);
+		talloc_free(mem_ctx);
+		return LDB_SUCCESS;
+	}
+
 	start_test(ldb,
 		   (unsigned int) options->num_records,
 		   (unsigned int) options->num_searches);
@@ -281,8 +281,15 @@ struct talloc_chunk {
 	 * is a pointer to the struct talloc_chunk of the pool that it was
 	 * allocated from. This way children can quickly find the pool to chew
 	 * from.
+	 *
+	 * Otherwise "cache" is set for chunks allocated from a
+	 * talloc_cache, they are given back to it instead of being
+	 * free(3)'ed.
 	 */
-	struct talloc_pool_hdr *pool;
+	union {
+		struct talloc_pool_hdr *pool;
+		struct talloc_cache *cache;
+	} u;
 };
 
 /* 16 byte alignment seems to keep everyone happy */
@@ -588,7 +595,7 @@ static inline struct talloc_chunk *talloc_alloc_pool(struct talloc_chunk *parent
 		pool_hdr = talloc_pool_from_chunk(parent);
 	}
 	else if (parent->flags & TALLOC_FLAG_POOLMEM) {
-		pool_hdr = parent->pool;
+		pool_hdr = parent->u.pool;
 	}
 
 	if (pool_hdr == NULL) {
@@ -615,13 +622,17 @@ static inline struct talloc_chunk *talloc_alloc_pool(struct talloc_chunk *parent
 	pool_hdr->end = (void *)((char *)pool_hdr->end + chunk_size);
 
 	result->flags = talloc_magic | TALLOC_FLAG_POOLMEM;
-	result->pool = pool_hdr;
+	result->u.pool = pool_hdr;
 
 	pool_hdr->object_count++;
 
 	return result;
 }
 
+static inline void *tc_link_new_chunk(struct talloc_chunk *tc,
+				      const void *context, size_t size,
+				      struct talloc_memlimit *limit);
+
 /*
    Allocate a bit of memory as a child of an existing pointer
 */
@@ -671,11 +682,21 @@ static inline void *__talloc_with_prefix(const void *context, size_t size,
 		}
 		tc = (struct talloc_chunk *)(ptr + prefix_len);
 		tc->flags = talloc_magic;
-		tc->pool  = NULL;
+		tc->u.pool = NULL;
 
 		talloc_memlimit_grow(limit, total_len);
 	}
 
+	return tc_link_new_chunk(tc, context, size, limit);
+}
+
+/*
+   Initialise a new chunk and link it to its parent
+*/
+static inline void *tc_link_new_chunk(struct talloc_chunk *tc,
+				      const void *context, size_t size,
+				      struct talloc_memlimit *limit)
+{
 	tc->limit = limit;
 	tc->size = size;
 	tc->destructor = NULL;
@@ -810,6 +831,199 @@ overflow:
 	return NULL;
 }
 
+/*
+  A talloc_cache hands out chunks of a fixed size. Freed ones are kept
+  on a freelist of the thread freeing them and reused by the next
+  allocation in that thread, instead of going through free(3) and
+  malloc(3). The caches live as long as the process, each one has a
+  slot in the per thread freelists.
+*/
+
+#define TALLOC_MAX_CACHES 64
+
+struct talloc_cache {
+	const char *name;
+	size_t size;
+	unsigned max_free;
+	unsigned idx;
+};
+
+#ifdef HAVE___THREAD
+
+struct talloc_cache_freelist {
+	struct talloc_chunk *chunks;
+	unsigned num_chunks;
+};
+
+static struct talloc_cache talloc_caches[TALLOC_MAX_CACHES];
+static unsigned talloc_num_caches;
+static __thread struct talloc_cache_freelist
+	talloc_cache_freelists[TALLOC_MAX_CACHES];
+
+static void talloc_cache_put(struct talloc_chunk *tc)
+{
+	struct talloc_cache *cache = tc->u.cache;
+	struct talloc_cache_freelist *fl = &talloc_cache_freelists[cache->idx];
+
+	if (fl->num_chunks >= cache->max_free) {
+		free(tc);
+		return;
+	}
+
+	/* still marked as free, so double frees are caught */
+	tc->next = fl->chunks;
+	fl->chunks = tc;
+	fl->num_chunks++;
+}
+
+static inline void *__talloc_cache_alloc(const void *context,
+					 struct talloc_cache *cache,
+					 size_t size)
+{
+	struct talloc_cache_freelist *fl = &talloc_cache_freelists[cache->idx];
+	struct talloc_memlimit *limit = NULL;
+	struct talloc_chunk *tc;
+
+	if (unlikely(context == NULL)) {
+		context = null_context;
+	}
+
+	if (context != NULL) {
+		limit = talloc_chunk_from_ptr(context)->limit;
+	}
+
+	if (!talloc_memlimit_check(limit, TC_HDR_SIZE + size)) {
+		errno = ENOMEM;
+		return NULL;
+	}
+
+	tc = fl->chunks;
+	if (likely(tc != NULL)) {
+		fl->chunks = tc->next;
+		fl->num_chunks--;
+	} else {
+		tc = (struct talloc_chunk *)malloc(TC_HDR_SIZE + cache->size);
+		if (unlikely(tc == NULL)) {
+			return NULL;
+		}
+	}
+	tc->flags = talloc_magic;
+	tc->u.cache = cache;
+
+	talloc_memlimit_grow(limit, TC_HDR_SIZE + size);
+
+	return tc_link_new_chunk(tc, context, size, limit);
+}
+
+_PUBLIC_ struct talloc_cache *talloc_cache_create(const char *name,
+						  size_t size,
+						  unsigned max_free)
+{
+	struct talloc_cache *cache;
+	unsigned idx;
+
+	if (size >= MAX_TALLOC_SIZE) {
+		errno = EINVAL;
+		return NULL;
+	}
+
+#if defined(HAVE___SYNC_FETCH_AND_ADD)
+	idx = __sync_fetch_and_add(&talloc_num_caches, 1);
+#else
+	idx = talloc_num_caches++;
+#endif
+	if (idx >= TALLOC_MAX_CACHES) {
+		errno = ENOSPC;
+		return NULL;
+	}
+
+	cache = &talloc_caches[idx];
+	cache->name = name;
+	cache->size = size;
+	cache->max_free = max_free;
+	cache->idx = idx;
+
+	return cache;
+}
+
+_PUBLIC_ void talloc_cache_flush(struct talloc_cache *cache)
+{
+	unsigned i;
+
+	for (i = 0; i < TALLOC_MAX_CACHES; i++) {
+		struct talloc_cache_freelist *fl = &talloc_cache_freelists[i];
+
+		if ((cache != NULL) && (cache->idx != i)) {
+			continue;
+		}
+
+		while (fl->chunks != NULL) {
+			struct talloc_chunk *tc = fl->chunks;
+
+			fl->chunks = tc->next;
+			free(tc);
+		}
+		fl->num_chunks = 0;
+	}
+}
+
+#else
+
+_PUBLIC_ struct talloc_cache *talloc_cache_create(const char *name,
+						  size_t size,
+						  unsigned max_free)
+{
+	errno = ENOSYS;
+	return NULL;
+}
+
+_PUBLIC_ void talloc_cache_flush(struct talloc_cache *cache)
+{
+	return;
+}
+
+#endif
+
+/*
+  Allocate from a cache, anything not fitting into it is a normal
+  allocation.
+*/
+_PUBLIC_ void *_talloc_cache_alloc(const void *context,
+				   struct talloc_cache *cache,
+				   size_t size, const char *name)
+{
+	void *ptr;
+
+#ifdef HAVE___THREAD
+	if (likely((cache != NULL) && (size <= cache->size))) {
+		ptr = __talloc_cache_alloc(context, cache, size);
+		if (likely(ptr != NULL)) {
+			_talloc_set_name_const(ptr, name);
+		}
+		return ptr;
+	}
+#endif
+	ptr = __talloc(context, size);
+	if (unlikely(ptr == NULL)) {
+		return NULL;
+	}
+	_talloc_set_name_const(ptr, name);
+	return ptr;
+}
+
+_PUBLIC_ void *_talloc_cache_zero(const void *context,
+				  struct talloc_cache *cache,
+				  size_t size, const char *name)
+{
+	void *p = _talloc_cache_alloc(context, cache, size, name);
+
+	if (p) {
+		memset(p, '\0', size);
+	}
+
+	return p;
+}
+
 /*
   setup a destructor to be called on free of a pointer
   the destructor should return 0 on success, or -1 on failure.
@@ -912,7 +1126,7 @@ static inline void _talloc_free_poolmem(struct talloc_chunk *tc,
 	struct talloc_chunk *pool_tc;
 	void *next_tc;
 
-	pool = tc->pool;
+	pool = tc->u.pool;
 	pool_tc = talloc_chunk_from_pool(pool);
 	next_tc = tc_next_chunk(tc);
 
@@ -1112,6 +1326,14 @@ static inline int _talloc_free_internal(void *ptr, const char *location)
 
 	talloc_memlimit_update_on_free(tc);
 
+#ifdef HAVE___THREAD
+	if (unlikely(tc->u.cache != NULL)) {
+		TC_INVALIDATE_FULL_FILL_CHUNK(tc);
+		talloc_cache_put(tc);
+		return 0;
+	}
+#endif
+
 	TC_INVALIDATE_FULL_CHUNK(tc);
 	free(ptr_to_free);
 	return 0;
@@ -1698,7 +1920,7 @@ _PUBLIC_ void *_talloc_realloc(const void *context, void *ptr, size_t size, cons
 
 	/* handle realloc inside a talloc_pool */
 	if (unlikely(tc->flags & TALLOC_FLAG_POOLMEM)) {
-		pool_hdr = tc->pool;
+		pool_hdr = tc->u.pool;
 	}
 
 #if (ALWAYS_REALLOC == 0)
@@ -1891,6 +2113,10 @@ got_new_ptr:
 	if (malloced) {
 		tc->flags &= ~TALLOC_FLAG_POOLMEM;
 	}
+	if (!(tc->flags & TALLOC_FLAG_POOLMEM)) {
+		/* this doesn't fit into a talloc_cache anymore */
+		tc->u.cache = NULL;
+	}
 	if (tc->parent) {
 		tc->parent->child = tc;
 	}
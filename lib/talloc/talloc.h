@@ -890,6 +890,99 @@ void *_talloc_pooled_object(const void *ctx,
 			    size_t total_subobjects_size);
 #endif
 
+struct talloc_cache;
+
+/**
+ * @brief Create a cache for talloc objects of a fixed size.
+ *
+ * Objects allocated with talloc_cache_alloc() are not free(3)'ed when they
+ * are released with talloc_free(). Up to max_free of them are kept by the
+ * thread releasing them and reused for its next talloc_cache_alloc(), which
+ * saves the malloc(3) and free(3) for frequently allocated types. Apart
+ * from that they are normal talloc objects.
+ *
+ * Caches can't be freed, they are meant to be created once for a type.
+ * Threads should call talloc_cache_flush() before they exit, otherwise the
+ * objects they keep are lost.
+ *
+ * @param[in]  name     The name of the cache, for debugging.
+ *
+ * @param[in]  size     The size of the objects.
+ *
+ * @param[in]  max_free The number of released objects to keep per thread.
+ *
+ * @return              The cache, NULL on error. This also happens if there
+ *                      are too many caches or the platform lacks thread
+ *                      local storage, allocations with a NULL cache are
+ *                      normal allocations.
+ *
+ * @see talloc_cache_alloc()
+ */
+struct talloc_cache *talloc_cache_create(const char *name,
+					 size_t size,
+					 unsigned max_free);
+
+#ifdef DOXYGEN
+/**
+ * @brief Allocate a talloc object from a cache.
+ *
+ * This is like talloc(), objects bigger than the size of the cache are
+ * allocated as usual.
+ *
+ * @code
+ *      static struct talloc_cache *foo_cache;
+ *
+ *      if (foo_cache == NULL) {
+ *              foo_cache = talloc_cache_create("struct foo",
+ *                                              sizeof(struct foo), 100);
+ *      }
+ *      foo = talloc_cache_alloc(mem_ctx, foo_cache, struct foo);
+ * @endcode
+ *
+ * @param[in]  ctx      The talloc context to hang the result off.
+ *
+ * @param[in]  cache    The cache to use, can be NULL.
+ *
+ * @param[in]  type     The type that we want to allocate.
+ *
+ * @return              The allocated talloc object, NULL on error.
+ *
+ * @see talloc_cache_create()
+ */
+void *talloc_cache_alloc(const void *ctx, struct talloc_cache *cache, #type);
+
+/**
+ * @brief Allocate a zero-initialized talloc object from a cache.
+ *
+ * @param[in]  ctx      The talloc context to hang the result off.
+ *
+ * @param[in]  cache    The cache to use, can be NULL.
+ *
+ * @param[in]  type     The type that we want to allocate.
+ *
+ * @return              The allocated talloc object, NULL on error.
+ *
+ * @see talloc_cache_alloc()
+ */
+void *talloc_cache_zero(const void *ctx, struct talloc_cache *cache, #type);
+#else
+#define talloc_cache_alloc(ctx, cache, type) \
+	(type *)_talloc_cache_alloc(ctx, cache, sizeof(type), #type)
+#define talloc_cache_zero(ctx, cache, type) \
+	(type *)_talloc_cache_zero(ctx, cache, sizeof(type), #type)
+void *_talloc_cache_alloc(const void *ctx, struct talloc_cache *cache,
+			  size_t size, const char *name);
+void *_talloc_cache_zero(const void *ctx, struct talloc_cache *cache,
+			 size_t size, const char *name);
+#endif
+
+/**
+ * @brief Release the objects a cache keeps for the calling thread.
+ *
+ * @param[in]  cache    The cache to flush, NULL for all of them.
+ */
+void talloc_cache_flush(struct talloc_cache *cache);
+
 /**
  * @brief Free a talloc chunk and NULL out the pointer.
  *
@@ -828,6 +828,7 @@ static bool test_unref_reparent(void)
 static bool test_speed(void)
 {
 	void *ctx = talloc_new(NULL);
+	struct talloc_cache *cache;
 	unsigned count;
 	const int loop = 1000;
 	int i;
@@ -875,6 +876,29 @@ static bool test_speed(void)
 
 	fprintf(stderr, "talloc_pool: %.0f ops/sec\n", count/timeval_elapsed(&tv));
 
+	cache = talloc_cache_create("speed", 300, 100);
+	ctx = talloc_new(NULL);
+
+	tv = timeval_current();
+	count = 0;
+	do {
+		void *p1, *p2, *p3;
+		for (i=0;i<loop;i++) {
+			p1 = _talloc_cache_alloc(ctx, cache, loop % 100, "p1");
+			p2 = _talloc_cache_alloc(p1, cache, 8, "p2");
+			strcpy(p2, "foo bar");
+			p3 = _talloc_cache_alloc(p1, cache, 300, "p3");
+			(void)p3;
+			talloc_free(p1);
+		}
+		count += 3 * loop;
+	} while (timeval_elapsed(&tv) < 5.0);
+
+	talloc_free(ctx);
+	talloc_cache_flush(cache);
+
+	fprintf(stderr, "talloc_cache: %.0f ops/sec\n", count/timeval_elapsed(&tv));
+
 	tv = timeval_current();
 	count = 0;
 	do {
@@ -896,6 +920,98 @@ static bool test_speed(void)
 	return true;
 }
 
+struct cache_obj {
+	uint64_t a, b;
+	char name[48];
+};
+
+static bool test_cache(void)
+{
+	static struct talloc_cache *cache;
+	void *root, *l;
+	struct cache_obj *o1, *o2;
+	char *s, *p[16];
+	unsigned i, n;
+
+	printf("test: cache\n# TALLOC CACHE\n");
+
+	/* caches can't be freed, test_reset() must not create new ones */
+	if (cache == NULL) {
+		cache = talloc_cache_create("struct cache_obj",
+					    sizeof(struct cache_obj), 2);
+	}
+
+	root = talloc_new(NULL);
+
+	o1 = talloc_cache_zero(root, cache, struct cache_obj);
+	torture_assert("cache", o1 != NULL, "failed: alloc\n");
+	torture_assert("cache", o1->a == 0 && o1->name[47] == 0,
+		"failed: not zeroed\n");
+	torture_assert_str_equal("cache", talloc_get_name(o1),
+				 "struct cache_obj", "wrong name");
+	CHECK_SIZE("cache", o1, sizeof(struct cache_obj));
+
+	s = talloc_strdup(o1, "child");
+	torture_assert("cache", s != NULL, "failed: alloc child\n");
+	CHECK_BLOCKS("cache", root, 3);
+	talloc_free(o1);
+	CHECK_BLOCKS("cache", root, 1);
+
+	o2 = talloc_cache_alloc(root, cache, struct cache_obj);
+	torture_assert("cache", o2 != NULL, "failed: alloc\n");
+	if (cache != NULL) {
+		torture_assert("cache", o2 == o1,
+			"failed: released object not reused\n");
+	}
+	CHECK_PARENT("cache", o2, root);
+
+	/* smaller objects are taken from the cache as well */
+	s = _talloc_cache_alloc(root, cache, 10, "small");
+	torture_assert("cache", s != NULL, "failed: alloc small\n");
+	CHECK_SIZE("cache", s, 10);
+
+	/* and can grow out of it */
+	s = talloc_realloc_size(root, s, 1000);
+	torture_assert("cache", s != NULL, "failed: realloc\n");
+	memset(s, 0x11, 1000);
+	CHECK_SIZE("cache", s, 1000);
+	talloc_free(s);
+
+	/* bigger ones are normal allocations */
+	s = _talloc_cache_alloc(root, cache, 1000, "big");
+	torture_assert("cache", s != NULL, "failed: alloc big\n");
+	memset(s, 0x11, 1000);
+	talloc_free(s);
+
+	/* memory limits count cached objects */
+	l = talloc_new(root);
+	torture_assert("cache", talloc_set_memlimit(l, 1024) == 0,
+		"failed: setting memlimit should never fail\n");
+	for (n = 0; n < 16; n++) {
+		p[n] = (char *)talloc_cache_alloc(l, cache, struct cache_obj);
+		if (p[n] == NULL) {
+			break;
+		}
+	}
+	torture_assert("cache", n > 0 && n < 16,
+		"failed: memlimit not applied\n");
+	for (i = 0; i < n; i++) {
+		talloc_free(p[i]);
+	}
+	for (i = 0; i < n; i++) {
+		p[i] = (char *)talloc_cache_alloc(l, cache, struct cache_obj);
+		torture_assert("cache", p[i] != NULL,
+			"failed: memlimit not updated on free\n");
+	}
+	talloc_free(l);
+
+	talloc_free(root);
+	talloc_cache_flush(cache);
+
+	printf("success: cache\n");
+	return true;
+}
+
 static bool test_lifeless(void)
 {
 	void *top = talloc_new(NULL);
@@ -1989,6 +2105,8 @@ bool torture_local_talloc(struct torture_context *tctx)
 	ret &= test_free_children();
 	test_reset();
 	ret &= test_memlimit();
+	test_reset();
+	ret &= test_cache();
 #ifdef HAVE_PTHREAD
 	test_reset();
 	ret &= test_pthread_talloc_passing();
@@ -61,28 +61,104 @@ int tdb_rec_free_read(struct tdb_context *tdb, tdb_off_t off, struct tdb_record
 	return 0;
 }
 
+/* number of free lists, see TDB_FEATURE_FLAG_FREELISTS */
+unsigned int tdb_freelist_count(struct tdb_context *tdb)
+{
+	if (tdb->feature_flags & TDB_FEATURE_FLAG_FREELISTS) {
+		return TDB_NUM_FREELISTS;
+	}
+	return 1;
+}
+
+/* offset of the head pointer of a free list */
+tdb_off_t tdb_freelist_top(struct tdb_context *tdb, unsigned int list)
+{
+	if (list == 0) {
+		return FREELIST_TOP;
+	}
+	return offsetof(struct tdb_header, freelist_tops) +
+		(list - 1) * sizeof(tdb_off_t);
+}
+
+/* the free list a record of rec_len bytes belongs on */
+unsigned int tdb_freelist_class(struct tdb_context *tdb, tdb_len_t rec_len)
+{
+	unsigned int list = 0;
+
+	if (!(tdb->feature_flags & TDB_FEATURE_FLAG_FREELISTS)) {
+		return 0;
+	}
+
+	rec_len >>= TDB_FREELIST_SHIFT;
+	while (rec_len != 0 && list < TDB_NUM_FREELISTS - 1) {
+		rec_len >>= 1;
+		list++;
+	}
+	return list;
+}
+
+/*
+ * Move a free record to the list of its size class if it is on the
+ * wrong one: left merges make records grow out of their class,
+ * allocations shrink them. last_ptr points to the record.
+ *
+ * Returns -1 on error, 1 if the record was moved, 0 otherwise.
+ */
+static int tdb_freelist_refile(struct tdb_context *tdb, unsigned int list,
+			       tdb_off_t last_ptr, tdb_off_t rec_ptr)
+{
+	struct tdb_record rec;
+	unsigned int new_list;
+	tdb_off_t top;
+
+	if (tdb_rec_free_read(tdb, rec_ptr, &rec) == -1) {
+		return -1;
+	}
+
+	new_list = tdb_freelist_class(tdb, rec.rec_len);
+	if (new_list == list) {
+		return 0;
+	}
+
+	top = tdb_freelist_top(tdb, new_list);
+
+	if (tdb_ofs_write(tdb, last_ptr, &rec.next) == -1 ||
+	    tdb_ofs_read(tdb, top, &rec.next) == -1 ||
+	    tdb_rec_write(tdb, rec_ptr, &rec) == -1 ||
+	    tdb_ofs_write(tdb, top, &rec_ptr) == -1) {
+		TDB_LOG((tdb, TDB_DEBUG_FATAL, "tdb_freelist_refile: "
+			 "failed to move %u from list %u to %u\n",
+			 rec_ptr, list, new_list));
+		return -1;
+	}
+
+	return 1;
+}
+
 
-#if USE_RIGHT_MERGES
 /* Remove an element from the freelist.  Must have alloc lock. */
-static int remove_from_freelist(struct tdb_context *tdb, tdb_off_t off, tdb_off_t next)
+int tdb_remove_from_freelist(struct tdb_context *tdb, tdb_off_t off,
+			     tdb_off_t next)
 {
 	tdb_off_t last_ptr, i;
-
-	/* read in the freelist top */
-	last_ptr = FREELIST_TOP;
-	while (tdb_ofs_read(tdb, last_ptr, &i) != -1 && i != 0) {
-		if (i == off) {
-			/* We've found it! */
-			return tdb_ofs_write(tdb, last_ptr, &next);
+	unsigned int list;
+
+	for (list = 0; list < tdb_freelist_count(tdb); list++) {
+		/* read in the freelist top */
+		last_ptr = tdb_freelist_top(tdb, list);
+		while (tdb_ofs_read(tdb, last_ptr, &i) != -1 && i != 0) {
+			if (i == off) {
+				/* We've found it! */
+				return tdb_ofs_write(tdb, last_ptr, &next);
+			}
+			/* Follow chain (next offset is at start of record) */
+			last_ptr = i;
 		}
-		/* Follow chain (next offset is at start of record) */
-		last_ptr = i;
 	}
 	tdb->ecode = TDB_ERR_CORRUPT;
-	TDB_LOG((tdb, TDB_DEBUG_FATAL,"remove_from_freelist: not on list at off=%u\n", off));
+	TDB_LOG((tdb, TDB_DEBUG_FATAL,"tdb_remove_from_freelist: not on list at off=%u\n", off));
 	return -1;
 }
-#endif
 
 
 /* update a record tailer (must hold allocation lock) */
@@ -306,6 +382,7 @@ static int check_merge_ptr_with_left_record(struct tdb_context *tdb,
  */
 int tdb_free(struct tdb_context *tdb, tdb_off_t offset, struct tdb_record *rec)
 {
+	tdb_off_t top;
 	int ret;
 
 	/* Allocation and tailer lock */
@@ -331,7 +408,7 @@ int tdb_free(struct tdb_context *tdb, tdb_off_t offset, struct tdb_record *rec)
 
 		/* If it's free, expand to include it. */
 		if (r.magic == TDB_FREE_MAGIC) {
-			if (remove_from_freelist(tdb, right, r.next) == -1) {
+			if (tdb_remove_from_freelist(tdb, right, r.next) == -1) {
 				TDB_LOG((tdb, TDB_DEBUG_FATAL, "tdb_free: right free failed at %u\n", right));
 				goto left;
 			}
@@ -354,13 +431,14 @@ left:
 		goto done;
 	}
 
-	/* Nothing to merge, prepend to free list */
+	/* Nothing to merge, prepend to the free list of its size */
 
 	rec->magic = TDB_FREE_MAGIC;
+	top = tdb_freelist_top(tdb, tdb_freelist_class(tdb, rec->rec_len));
 
-	if (tdb_ofs_read(tdb, FREELIST_TOP, &rec->next) == -1 ||
+	if (tdb_ofs_read(tdb, top, &rec->next) == -1 ||
 	    tdb_rec_write(tdb, offset, rec) == -1 ||
-	    tdb_ofs_write(tdb, FREELIST_TOP, &offset) == -1) {
+	    tdb_ofs_write(tdb, top, &offset) == -1) {
 		TDB_LOG((tdb, TDB_DEBUG_FATAL, "tdb_free record write failed at offset=%u\n", offset));
 		goto fail;
 	}
@@ -386,8 +464,9 @@ done:
    able to free up the record without fragmentation
  */
 static tdb_off_t tdb_allocate_ofs(struct tdb_context *tdb,
-				  tdb_len_t length, tdb_off_t rec_ptr,
-				  struct tdb_record *rec, tdb_off_t last_ptr)
+				  tdb_len_t length, unsigned int list,
+				  tdb_off_t rec_ptr, struct tdb_record *rec,
+				  tdb_off_t last_ptr)
 {
 #define MIN_REC_SIZE (sizeof(struct tdb_record) + sizeof(tdb_off_t) + 8)
 
@@ -416,6 +495,11 @@ static tdb_off_t tdb_allocate_ofs(struct tdb_context *tdb,
 		return 0;
 	}
 
+	/* the rest may now belong to a smaller size class */
+	if (tdb_freelist_refile(tdb, list, last_ptr, rec_ptr) == -1) {
+		return 0;
+	}
+
 	/* and setup the new record */
 	rec_ptr += sizeof(*rec) + rec->rec_len;
 
@@ -434,41 +518,33 @@ static tdb_off_t tdb_allocate_ofs(struct tdb_context *tdb,
 	return rec_ptr;
 }
 
-/* allocate some space from the free list. The offset returned points
-   to a unconnected tdb_record within the database with room for at
-   least length bytes of total data
+struct tdb_freelist_fit {
+	unsigned int list;
+	tdb_off_t rec_ptr, last_ptr;
+	tdb_len_t rec_len;
+};
 
-   0 is returned if the space could not be allocated
+/*
+  look for the best fit for length bytes on one free list, merging
+  free records into their left neighbours on the way. Stop after
+  max_scan records, 0 means walk the whole list. With a limit, only
+  records ending below it are taken.
  */
-static tdb_off_t tdb_allocate_from_freelist(
-	struct tdb_context *tdb, tdb_len_t length, struct tdb_record *rec)
+static int tdb_freelist_find(struct tdb_context *tdb, unsigned int list,
+			     tdb_len_t length, unsigned int max_scan,
+			     tdb_off_t limit, struct tdb_record *rec,
+			     struct tdb_freelist_fit *bestfit,
+			     bool *merge_created_candidate)
 {
-	tdb_off_t rec_ptr, last_ptr, newrec_ptr;
-	struct {
-		tdb_off_t rec_ptr, last_ptr;
-		tdb_len_t rec_len;
-	} bestfit;
+	tdb_off_t rec_ptr, last_ptr;
 	float multiplier = 1.0;
-	bool merge_created_candidate;
-
-	/* over-allocate to reduce fragmentation */
-	length *= 1.25;
-
-	/* Extra bytes required for tailer */
-	length += sizeof(tdb_off_t);
-	length = TDB_ALIGN(length, TDB_ALIGNMENT);
+	unsigned int scanned = 0;
 
- again:
-	merge_created_candidate = false;
-	last_ptr = FREELIST_TOP;
+	last_ptr = tdb_freelist_top(tdb, list);
 
 	/* read in the freelist top */
-	if (tdb_ofs_read(tdb, FREELIST_TOP, &rec_ptr) == -1)
-		return 0;
-
-	bestfit.rec_ptr = 0;
-	bestfit.last_ptr = 0;
-	bestfit.rec_len = 0;
+	if (tdb_ofs_read(tdb, last_ptr, &rec_ptr) == -1)
+		return -1;
 
 	/*
 	   this is a best fit allocation strategy. Originally we used
@@ -481,20 +557,20 @@ static tdb_off_t tdb_allocate_from_freelist(
 		struct tdb_record left_rec;
 
 		if (tdb_rec_free_read(tdb, rec_ptr, rec) == -1) {
-			return 0;
+			return -1;
 		}
 
 		ret = check_merge_with_left_record(tdb, rec_ptr, rec,
 						   &left_ptr, &left_rec);
 		if (ret == -1) {
-			return 0;
+			return -1;
 		}
 		if (ret == 1) {
 			/* merged */
 			rec_ptr = rec->next;
 			ret = tdb_ofs_write(tdb, last_ptr, &rec->next);
 			if (ret == -1) {
-				return 0;
+				return -1;
 			}
 
 			/*
@@ -518,23 +594,42 @@ static tdb_off_t tdb_allocate_from_freelist(
 			 * This way we can avoid expanding the database.
 			 */
 
-			if (bestfit.rec_ptr == left_ptr) {
-				bestfit.rec_len = left_rec.rec_len;
+			if (bestfit->rec_ptr == left_ptr) {
+				bestfit->rec_len = left_rec.rec_len;
 			}
 
 			if (left_rec.rec_len > length) {
-				merge_created_candidate = true;
+				*merge_created_candidate = true;
 			}
 
 			continue;
 		}
 
-		if (rec->rec_len >= length) {
-			if (bestfit.rec_ptr == 0 ||
-			    rec->rec_len < bestfit.rec_len) {
-				bestfit.rec_len = rec->rec_len;
-				bestfit.rec_ptr = rec_ptr;
-				bestfit.last_ptr = last_ptr;
+		if (tdb_freelist_class(tdb, rec->rec_len) != list) {
+			/*
+			 * Grown by earlier merges, move it to where
+			 * the bigger allocations look for it.
+			 */
+			tdb_off_t next = rec->next;
+
+			ret = tdb_freelist_refile(tdb, list, last_ptr,
+						  rec_ptr);
+			if (ret == -1) {
+				return -1;
+			}
+			rec_ptr = next;
+			continue;
+		}
+
+		if (rec->rec_len >= length &&
+		    (limit == 0 ||
+		     rec_ptr + sizeof(*rec) + rec->rec_len <= limit)) {
+			if (bestfit->rec_ptr == 0 ||
+			    rec->rec_len < bestfit->rec_len) {
+				bestfit->list = list;
+				bestfit->rec_len = rec->rec_len;
+				bestfit->rec_ptr = rec_ptr;
+				bestfit->last_ptr = last_ptr;
 			}
 		}
 
@@ -546,8 +641,12 @@ static tdb_off_t tdb_allocate_from_freelist(
 		   stop searching if its also not too big. The
 		   definition of 'too big' changes as we scan
 		   through */
-		if (bestfit.rec_len > 0 &&
-		    bestfit.rec_len < length * multiplier) {
+		if (bestfit->rec_len > 0 &&
+		    bestfit->rec_len < length * multiplier) {
+			break;
+		}
+
+		if (max_scan != 0 && ++scanned >= max_scan) {
 			break;
 		}
 
@@ -558,20 +657,103 @@ static tdb_off_t tdb_allocate_from_freelist(
 		multiplier *= 1.05;
 	}
 
+	return 0;
+}
+
+/* allocate some space from the free list. The offset returned points
+   to a unconnected tdb_record within the database with room for at
+   least length bytes of total data
+
+   With a limit, the space has to end below it and the file is not
+   expanded.
+
+   0 is returned if the space could not be allocated
+ */
+static tdb_off_t tdb_allocate_from_freelist(
+	struct tdb_context *tdb, tdb_len_t length, tdb_off_t limit,
+	struct tdb_record *rec)
+{
+	struct tdb_freelist_fit bestfit;
+	unsigned int num_lists = tdb_freelist_count(tdb);
+	unsigned int list, i;
+	bool merge_created_candidate;
+	int ret;
+
+	if (limit == 0) {
+		/* over-allocate to reduce fragmentation */
+		length *= 1.25;
+	}
+
+	/* Extra bytes required for tailer */
+	length += sizeof(tdb_off_t);
+	length = TDB_ALIGN(length, TDB_ALIGNMENT);
+
+	list = tdb_freelist_class(tdb, length);
+
+ again:
+	merge_created_candidate = false;
+	ZERO_STRUCT(bestfit);
+
+	if (num_lists == 1) {
+		ret = tdb_freelist_find(tdb, 0, length, 0, limit, rec,
+					&bestfit, &merge_created_candidate);
+	} else {
+		/*
+		 * Look at a few records of our own size class, every
+		 * record in the bigger classes fits.
+		 */
+		ret = tdb_freelist_find(tdb, list, length, TDB_FREELIST_SCAN,
+					limit, rec, &bestfit,
+					&merge_created_candidate);
+		for (i = list + 1;
+		     (ret == 0) && (bestfit.rec_ptr == 0) && (i < num_lists);
+		     i++) {
+			ret = tdb_freelist_find(tdb, i, length,
+						TDB_FREELIST_SCAN, limit, rec,
+						&bestfit,
+						&merge_created_candidate);
+		}
+		/*
+		 * Left merges grow records on the smaller lists. Before
+		 * expanding the file walk all lists completely, this
+		 * moves the grown records up to where we find them.
+		 */
+		for (i = 0;
+		     (ret == 0) && (bestfit.rec_ptr == 0) && (i < num_lists);
+		     i++) {
+			ret = tdb_freelist_find(tdb, i, length, 0, limit, rec,
+						&bestfit,
+						&merge_created_candidate);
+		}
+	}
+	if (ret == -1) {
+		return 0;
+	}
+
 	if (bestfit.rec_ptr != 0) {
 		if (tdb_rec_free_read(tdb, bestfit.rec_ptr, rec) == -1) {
 			return 0;
 		}
 
-		newrec_ptr = tdb_allocate_ofs(tdb, length, bestfit.rec_ptr,
-					      rec, bestfit.last_ptr);
-		return newrec_ptr;
+		if (limit != 0 &&
+		    bestfit.rec_ptr + sizeof(*rec) + rec->rec_len > limit) {
+			/* a later merge made it grow beyond the limit */
+			goto again;
+		}
+
+		return tdb_allocate_ofs(tdb, length, bestfit.list,
+					bestfit.rec_ptr, rec,
+					bestfit.last_ptr);
 	}
 
 	if (merge_created_candidate) {
 		goto again;
 	}
 
+	if (limit != 0) {
+		return 0;
+	}
+
 	/* we didn't find enough space. See if we can expand the
 	   database and if we can then try again */
 	if (tdb_expand(tdb, length + sizeof(*rec)) == 0)
@@ -650,7 +832,7 @@ tdb_off_t tdb_allocate(struct tdb_context *tdb, int hash, tdb_len_t length,
 			 */
 			tdb_purge_dead(tdb, hash);
 
-			ret = tdb_allocate_from_freelist(tdb, length, rec);
+			ret = tdb_allocate_from_freelist(tdb, length, 0, rec);
 			tdb_unlock(tdb, -1, F_WRLCK);
 			return ret;
 		}
@@ -661,17 +843,40 @@ blocking_freelist_allocate:
 	if (tdb_lock(tdb, -1, F_WRLCK) == -1) {
 		return 0;
 	}
-	ret = tdb_allocate_from_freelist(tdb, length, rec);
+	ret = tdb_allocate_from_freelist(tdb, length, 0, rec);
+	tdb_unlock(tdb, -1, F_WRLCK);
+	return ret;
+}
+
+/*
+ * Allocate space that ends below limit, used by tdb_compact() to
+ * move records towards the start of the file. Never expands the
+ * file, 0 means there is no such space.
+ */
+tdb_off_t tdb_allocate_below(struct tdb_context *tdb, tdb_len_t length,
+			     tdb_off_t limit, struct tdb_record *rec)
+{
+	tdb_off_t ret;
+
+	if (tdb_lock(tdb, -1, F_WRLCK) == -1) {
+		return 0;
+	}
+	ret = tdb_allocate_from_freelist(tdb, length, limit, rec);
 	tdb_unlock(tdb, -1, F_WRLCK);
 	return ret;
 }
 
 /**
  * Merge adjacent records in the freelist.
+ *
+ * With several free lists the merges make records grow out of their
+ * size class, a second pass moves them to the right list.
  */
 static int tdb_freelist_merge_adjacent(struct tdb_context *tdb,
 				       int *count_records, int *count_merged)
 {
+	unsigned int num_lists = tdb_freelist_count(tdb);
+	unsigned int list;
 	tdb_off_t cur, next;
 	int count = 0;
 	int merged = 0;
@@ -682,32 +887,51 @@ static int tdb_freelist_merge_adjacent(struct tdb_context *tdb,
 		return -1;
 	}
 
-	cur = FREELIST_TOP;
-	while (tdb_ofs_read(tdb, cur, &next) == 0 && next != 0) {
-		tdb_off_t next2;
+	for (list = 0; list < num_lists; list++) {
+		cur = tdb_freelist_top(tdb, list);
 
-		count++;
+		while (tdb_ofs_read(tdb, cur, &next) == 0 && next != 0) {
+			tdb_off_t next2;
 
-		ret = check_merge_ptr_with_left_record(tdb, next, &next2);
-		if (ret == -1) {
-			goto done;
-		}
-		if (ret == 1) {
-			/*
-			 * merged:
-			 * now let cur->next point to next2 instead of next
-			 */
+			count++;
 
-			ret = tdb_ofs_write(tdb, cur, &next2);
-			if (ret != 0) {
+			ret = check_merge_ptr_with_left_record(tdb, next,
+							       &next2);
+			if (ret == -1) {
 				goto done;
 			}
+			if (ret == 1) {
+				/*
+				 * merged:
+				 * now let cur->next point to next2 instead
+				 * of next and look at next2
+				 */
+
+				ret = tdb_ofs_write(tdb, cur, &next2);
+				if (ret != 0) {
+					goto done;
+				}
+
+				merged++;
+				continue;
+			}
 
-			next = next2;
-			merged++;
+			cur = next;
 		}
+	}
+
+	for (list = 0; (num_lists > 1) && (list < num_lists); list++) {
+		cur = tdb_freelist_top(tdb, list);
 
-		cur = next;
+		while (tdb_ofs_read(tdb, cur, &next) == 0 && next != 0) {
+			ret = tdb_freelist_refile(tdb, list, cur, next);
+			if (ret == -1) {
+				goto done;
+			}
+			if (ret == 0) {
+				cur = next;
+			}
+		}
 	}
 
 	if (count_records != NULL) {
@@ -731,15 +955,18 @@ done:
 static int tdb_freelist_size_no_merge(struct tdb_context *tdb)
 {
 	tdb_off_t ptr;
+	unsigned int list;
 	int count=0;
 
 	if (tdb_lock(tdb, -1, F_RDLCK) == -1) {
 		return -1;
 	}
 
-	ptr = FREELIST_TOP;
-	while (tdb_ofs_read(tdb, ptr, &ptr) == 0 && ptr != 0) {
-		count++;
+	for (list = 0; list < tdb_freelist_count(tdb); list++) {
+		ptr = tdb_freelist_top(tdb, list);
+		while (tdb_ofs_read(tdb, ptr, &ptr) == 0 && ptr != 0) {
+			count++;
+		}
 	}
 
 	tdb_unlock(tdb, -1, F_RDLCK);
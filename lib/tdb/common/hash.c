@@ -343,3 +343,76 @@ _PUBLIC_ unsigned int tdb_jenkins_hash(TDB_DATA *key)
 {
 	return hashlittle(key->dptr, key->dsize);
 }
+
+/*
+ * MurmurHash3, x86_32 variant, by Austin Appleby, who placed it in
+ * the public domain. It needs far fewer instructions per key byte than
+ * hashlittle(). The key is read as little endian 32-bit words, so the
+ * hash is the same on all platforms, like it is for hashlittle().
+ */
+static inline uint32_t murmur_rotl32(uint32_t x, int r)
+{
+	return (x << r) | (x >> (32 - r));
+}
+
+static inline uint32_t murmur_fmix32(uint32_t h)
+{
+	h ^= h >> 16;
+	h *= 0x85ebca6b;
+	h ^= h >> 13;
+	h *= 0xc2b2ae35;
+	h ^= h >> 16;
+	return h;
+}
+
+static uint32_t murmur3_32(const uint8_t *data, size_t len, uint32_t seed)
+{
+	const uint32_t c1 = 0xcc9e2d51;
+	const uint32_t c2 = 0x1b873593;
+	size_t nblocks = len / 4;
+	const uint8_t *tail = data + nblocks * 4;
+	uint32_t h1 = seed;
+	uint32_t k1;
+	size_t i;
+
+	for (i = 0; i < nblocks; i++) {
+		const uint8_t *p = data + i * 4;
+
+		k1 = (uint32_t)p[0] |
+			((uint32_t)p[1] << 8) |
+			((uint32_t)p[2] << 16) |
+			((uint32_t)p[3] << 24);
+
+		k1 *= c1;
+		k1 = murmur_rotl32(k1, 15);
+		k1 *= c2;
+
+		h1 ^= k1;
+		h1 = murmur_rotl32(h1, 13);
+		h1 = h1 * 5 + 0xe6546b64;
+	}
+
+	k1 = 0;
+	switch (len & 3) {
+	case 3:
+		k1 ^= (uint32_t)tail[2] << 16;
+		/* fall through */
+	case 2:
+		k1 ^= (uint32_t)tail[1] << 8;
+		/* fall through */
+	case 1:
+		k1 ^= tail[0];
+		k1 *= c1;
+		k1 = murmur_rotl32(k1, 15);
+		k1 *= c2;
+		h1 ^= k1;
+	}
+
+	h1 ^= (uint32_t)len;
+	return murmur_fmix32(h1);
+}
+
+_PUBLIC_ unsigned int tdb_murmur_hash(TDB_DATA *key)
+{
+	return murmur3_32(key->dptr, key->dsize, 0);
+}
@@ -284,6 +284,9 @@ int tdb_allrecord_upgrade(struct tdb_context *tdb)
 	if (ret == 0) {
 		tdb->allrecord_lock.ltype = F_WRLCK;
 		tdb->allrecord_lock.off = 0;
+		if (tdb_have_seqlocks(tdb)) {
+			tdb_seqlock_write_begin(tdb, 0);
+		}
 		return 0;
 	}
 fail:
@@ -304,11 +307,32 @@ static struct tdb_lock_type *find_nestlock(struct tdb_context *tdb,
 	return NULL;
 }
 
+/*
+ * With TDB_FEATURE_FLAG_SEQLOCK every write locked period of a hash
+ * chain is announced to the lockless readers in tdb_parse_record()
+ * via the chain's sequence counter. The freelist is of no interest to
+ * them.
+ */
+static bool tdb_seqlock_chain_index(struct tdb_context *tdb, uint32_t offset,
+				    unsigned *idx)
+{
+	if (!tdb_have_seqlocks(tdb)) {
+		return false;
+	}
+	if (offset < lock_offset(0)) {
+		return false;
+	}
+	*idx = (offset - lock_offset(0)) / sizeof(tdb_off_t) + 1;
+	return true;
+}
+
 /* lock an offset in the database. */
 int tdb_nest_lock(struct tdb_context *tdb, uint32_t offset, int ltype,
 		  enum tdb_lock_flags flags)
 {
 	struct tdb_lock_type *new_lck;
+	bool seqlock_write = false;
+	unsigned seqlock_idx;
 
 	if (offset >= lock_offset(tdb->hash_size)) {
 		tdb->ecode = TDB_ERR_LOCK;
@@ -319,8 +343,22 @@ int tdb_nest_lock(struct tdb_context *tdb, uint32_t offset, int ltype,
 	if (tdb->flags & TDB_NOLOCK)
 		return 0;
 
+	if ((ltype == F_WRLCK) && !(flags & TDB_LOCK_MARK_ONLY)) {
+		seqlock_write = tdb_seqlock_chain_index(tdb, offset,
+							&seqlock_idx);
+	}
+
 	new_lck = find_nestlock(tdb, offset);
 	if (new_lck) {
+		if (seqlock_write && (new_lck->ltype == F_RDLCK)) {
+			/*
+			 * The chain mutex is exclusive, so we can
+			 * write under a nested write lock. Readers
+			 * have to notice that from now on.
+			 */
+			tdb_seqlock_write_begin(tdb, seqlock_idx);
+			new_lck->ltype = F_WRLCK;
+		}
 		/*
 		 * Just increment the in-memory struct, posix locks
 		 * don't stack.
@@ -347,6 +385,10 @@ int tdb_nest_lock(struct tdb_context *tdb, uint32_t offset, int ltype,
 		return -1;
 	}
 
+	if (seqlock_write) {
+		tdb_seqlock_write_begin(tdb, seqlock_idx);
+	}
+
 	new_lck = &tdb->lockrecs[tdb->num_lockrecs];
 
 	new_lck->off = offset;
@@ -371,8 +413,20 @@ static int tdb_lock_and_recover(struct tdb_context *tdb)
 		return -1;
 	}
 
+	/*
+	 * Recovery rewrites arbitrary parts of the file without chain
+	 * locks, lockless readers have to back off.
+	 */
+	if (tdb_have_seqlocks(tdb)) {
+		tdb_seqlock_write_begin(tdb, 0);
+	}
+
 	ret = tdb_transaction_recover(tdb);
 
+	if (tdb_have_seqlocks(tdb)) {
+		tdb_seqlock_write_end(tdb, 0);
+	}
+
 	tdb_brunlock(tdb, F_WRLCK, OPEN_LOCK, 1);
 	tdb_brunlock(tdb, F_WRLCK, FREELIST_TOP, 0);
 
@@ -467,12 +521,112 @@ _PUBLIC_ int tdb_lock_nonblock(struct tdb_context *tdb, int list, int ltype)
 	return tdb_lock_list(tdb, list, ltype, TDB_LOCK_NOWAIT);
 }
 
+/*
+ * tdb_rehash() in another process might have grown the hash table
+ * since we last looked at the header. It holds the allrecord lock and
+ * the transaction lock while doing so, so once we hold any lock the
+ * header is stable. Mutex databases can't be rehashed.
+ */
+static bool tdb_hash_size_may_change(struct tdb_context *tdb)
+{
+	if (tdb->feature_flags & TDB_FEATURE_FLAG_MUTEX) {
+		return false;
+	}
+	if (tdb->allrecord_lock.count != 0) {
+		return false;
+	}
+	return !have_data_locks(tdb);
+}
+
+static uint32_t tdb_header_hash_size(struct tdb_context *tdb)
+{
+	uint32_t hash_size;
+
+	if (tdb->methods->tdb_read(tdb, offsetof(struct tdb_header, hash_size),
+				   &hash_size, sizeof(hash_size),
+				   DOCONV()) == -1) {
+		return tdb->hash_size;
+	}
+	if (hash_size == 0) {
+		return tdb->hash_size;
+	}
+	return hash_size;
+}
+
+static void tdb_refresh_hash_size(struct tdb_context *tdb)
+{
+	uint32_t hash_size = tdb_header_hash_size(tdb);
+
+	if (hash_size != tdb->hash_size) {
+		TDB_LOG((tdb, TDB_DEBUG_TRACE, "tdb_refresh_hash_size: "
+			 "hash size changed from %u to %u\n",
+			 tdb->hash_size, hash_size));
+		tdb->hash_size = hash_size;
+	}
+}
+
+/*
+ * Lock the hash chain of "hash". If this is the first data lock we
+ * take, make sure we look at the right chain. With TDB_LOCK_MARK_ONLY
+ * the caller promises that someone else holds the real chain lock,
+ * which keeps tdb_rehash() away just the same.
+ */
+static int tdb_lock_hash_list(struct tdb_context *tdb, uint32_t hash,
+			      int ltype, enum tdb_lock_flags waitflag)
+{
+	bool check = tdb_hash_size_may_change(tdb);
+	bool mark = waitflag & TDB_LOCK_MARK_ONLY;
+	int list = BUCKET(hash);
+	uint32_t hash_size;
+	int ret;
+
+	if (mark) {
+		ret = tdb_nest_lock(tdb, lock_offset(list), ltype, waitflag);
+	} else {
+		ret = tdb_lock_list(tdb, list, ltype, waitflag);
+	}
+	if ((ret != 0) || !check) {
+		return ret;
+	}
+
+	hash_size = tdb_header_hash_size(tdb);
+	if (hash_size == tdb->hash_size) {
+		return 0;
+	}
+
+	tdb_nest_unlock(tdb, lock_offset(list), ltype, mark);
+	tdb_refresh_hash_size(tdb);
+
+	return tdb_lock_hash_list(tdb, hash, ltype, waitflag);
+}
+
+/* lock the hash chain of a key hash */
+int tdb_lock_hash(struct tdb_context *tdb, uint32_t hash, int ltype)
+{
+	int ret;
+
+	ret = tdb_lock_hash_list(tdb, hash, ltype, TDB_LOCK_WAIT);
+	if (ret) {
+		TDB_LOG((tdb, TDB_DEBUG_ERROR, "tdb_lock_hash failed on hash "
+			 "0x%08x ltype=%d (%s)\n", hash, ltype,
+			 strerror(errno)));
+	}
+	return ret;
+}
+
+/* lock the hash chain of a key hash. non-blocking lock */
+int tdb_lock_hash_nonblock(struct tdb_context *tdb, uint32_t hash, int ltype)
+{
+	return tdb_lock_hash_list(tdb, hash, ltype, TDB_LOCK_NOWAIT);
+}
+
 
 int tdb_nest_unlock(struct tdb_context *tdb, uint32_t offset, int ltype,
 		    bool mark_lock)
 {
 	int ret = -1;
 	struct tdb_lock_type *lck;
+	unsigned seqlock_idx;
 
 	if (tdb->flags & TDB_NOLOCK)
 		return 0;
@@ -504,6 +658,10 @@ int tdb_nest_unlock(struct tdb_context *tdb, uint32_t offset, int ltype,
 	if (mark_lock) {
 		ret = 0;
 	} else {
+		if ((lck->ltype == F_WRLCK) &&
+		    tdb_seqlock_chain_index(tdb, offset, &seqlock_idx)) {
+			tdb_seqlock_write_end(tdb, seqlock_idx);
+		}
 		ret = tdb_brunlock(tdb, ltype, offset, 1);
 	}
 
@@ -539,7 +697,23 @@ _PUBLIC_ int tdb_unlock(struct tdb_context *tdb, int list, int ltype)
 int tdb_transaction_lock(struct tdb_context *tdb, int ltype,
 			 enum tdb_lock_flags lockflags)
 {
-	return tdb_nest_lock(tdb, TRANSACTION_LOCK, ltype, lockflags);
+	bool check;
+	int ret;
+
+	/*
+	 * Traverses walk the hash chains under the transaction lock,
+	 * which excludes tdb_rehash().
+	 */
+	check = (tdb->transaction == NULL) &&
+		!(lockflags & TDB_LOCK_MARK_ONLY) &&
+		(find_nestlock(tdb, TRANSACTION_LOCK) == NULL) &&
+		tdb_hash_size_may_change(tdb);
+
+	ret = tdb_nest_lock(tdb, TRANSACTION_LOCK, ltype, lockflags);
+	if ((ret == 0) && check) {
+		tdb_refresh_hash_size(tdb);
+	}
+	return ret;
 }
 
 /*
@@ -671,6 +845,15 @@ int tdb_allrecord_lock(struct tdb_context *tdb, int ltype,
 	tdb->allrecord_lock.ltype = upgradable ? F_WRLCK : ltype;
 	tdb->allrecord_lock.off = upgradable;
 
+	/*
+	 * An upgradable lock is only used to write once it is
+	 * upgraded, see tdb_allrecord_upgrade().
+	 */
+	if ((ltype == F_WRLCK) && !upgradable &&
+	    !(flags & TDB_LOCK_MARK_ONLY) && tdb_have_seqlocks(tdb)) {
+		tdb_seqlock_write_begin(tdb, 0);
+	}
+
 	if (tdb_needs_recovery(tdb)) {
 		bool mark = flags & TDB_LOCK_MARK_ONLY;
 		tdb_allrecord_unlock(tdb, ltype, mark);
@@ -686,6 +869,10 @@ int tdb_allrecord_lock(struct tdb_context *tdb, int ltype,
 		return tdb_allrecord_lock(tdb, ltype, flags, upgradable);
 	}
 
+	if (!(tdb->feature_flags & TDB_FEATURE_FLAG_MUTEX)) {
+		tdb_refresh_hash_size(tdb);
+	}
+
 	return 0;
 }
 
@@ -720,6 +907,12 @@ int tdb_allrecord_unlock(struct tdb_context *tdb, int ltype, bool mark_lock)
 	if (!mark_lock) {
 		int ret;
 
+		if ((tdb->allrecord_lock.ltype == F_WRLCK) &&
+		    (tdb->allrecord_lock.off == 0) &&
+		    tdb_have_seqlocks(tdb)) {
+			tdb_seqlock_write_end(tdb, 0);
+		}
+
 		if (tdb_have_mutexes(tdb)) {
 			ret = tdb_mutex_allrecord_unlock(tdb);
 			if (ret == 0) {
@@ -806,7 +999,7 @@ _PUBLIC_ int tdb_unlockall_read(struct tdb_context *tdb)
    contention - it cannot guarantee how many records will be locked */
 _PUBLIC_ int tdb_chainlock(struct tdb_context *tdb, TDB_DATA key)
 {
-	int ret = tdb_lock(tdb, BUCKET(tdb->hash_fn(&key)), F_WRLCK);
+	int ret = tdb_lock_hash(tdb, tdb->hash_fn(&key), F_WRLCK);
 	tdb_trace_1rec(tdb, "tdb_chainlock", key);
 	return ret;
 }
@@ -816,7 +1009,7 @@ _PUBLIC_ int tdb_chainlock(struct tdb_context *tdb, TDB_DATA key)
    locked */
 _PUBLIC_ int tdb_chainlock_nonblock(struct tdb_context *tdb, TDB_DATA key)
 {
-	int ret = tdb_lock_nonblock(tdb, BUCKET(tdb->hash_fn(&key)), F_WRLCK);
+	int ret = tdb_lock_hash_nonblock(tdb, tdb->hash_fn(&key), F_WRLCK);
 	tdb_trace_1rec_ret(tdb, "tdb_chainlock_nonblock", key, ret);
 	return ret;
 }
@@ -824,8 +1017,8 @@ _PUBLIC_ int tdb_chainlock_nonblock(struct tdb_context *tdb, TDB_DATA key)
 /* mark a chain as locked without actually locking it. Warning! use with great caution! */
 _PUBLIC_ int tdb_chainlock_mark(struct tdb_context *tdb, TDB_DATA key)
 {
-	int ret = tdb_nest_lock(tdb, lock_offset(BUCKET(tdb->hash_fn(&key))),
-				F_WRLCK, TDB_LOCK_MARK_ONLY);
+	int ret = tdb_lock_hash_list(tdb, tdb->hash_fn(&key), F_WRLCK,
+				     TDB_LOCK_MARK_ONLY);
 	tdb_trace_1rec(tdb, "tdb_chainlock_mark", key);
 	return ret;
 }
@@ -834,6 +1027,7 @@ _PUBLIC_ int tdb_chainlock_mark(struct tdb_context *tdb, TDB_DATA key)
 _PUBLIC_ int tdb_chainlock_unmark(struct tdb_context *tdb, TDB_DATA key)
 {
 	tdb_trace_1rec(tdb, "tdb_chainlock_unmark", key);
+	/* The mark pins hash_size, BUCKET() finds the marked chain */
 	return tdb_nest_unlock(tdb, lock_offset(BUCKET(tdb->hash_fn(&key))),
 			       F_WRLCK, true);
 }
@@ -847,7 +1041,7 @@ _PUBLIC_ int tdb_chainunlock(struct tdb_context *tdb, TDB_DATA key)
 _PUBLIC_ int tdb_chainlock_read(struct tdb_context *tdb, TDB_DATA key)
 {
 	int ret;
-	ret = tdb_lock(tdb, BUCKET(tdb->hash_fn(&key)), F_RDLCK);
+	ret = tdb_lock_hash(tdb, tdb->hash_fn(&key), F_RDLCK);
 	tdb_trace_1rec(tdb, "tdb_chainlock_read", key);
 	return ret;
 }
@@ -860,7 +1054,7 @@ _PUBLIC_ int tdb_chainunlock_read(struct tdb_context *tdb, TDB_DATA key)
 
 _PUBLIC_ int tdb_chainlock_read_nonblock(struct tdb_context *tdb, TDB_DATA key)
 {
-	int ret = tdb_lock_nonblock(tdb, BUCKET(tdb->hash_fn(&key)), F_RDLCK);
+	int ret = tdb_lock_hash_nonblock(tdb, tdb->hash_fn(&key), F_RDLCK);
 	tdb_trace_1rec_ret(tdb, "tdb_chainlock_read_nonblock", key, ret);
 	return ret;
 }
@@ -955,10 +1149,17 @@ void tdb_release_transaction_locks(struct tdb_context *tdb)
 	for (i=0;i<tdb->num_lockrecs;i++) {
 		struct tdb_lock_type *lck = &tdb->lockrecs[i];
 
+		unsigned seqlock_idx;
+
 		/* Don't release the active lock!  Copy it to first entry. */
 		if (lck->off == ACTIVE_LOCK) {
 			tdb->lockrecs[active++] = *lck;
 		} else {
+			if ((lck->ltype == F_WRLCK) &&
+			    tdb_seqlock_chain_index(tdb, lck->off,
+						    &seqlock_idx)) {
+				tdb_seqlock_write_end(tdb, seqlock_idx);
+			}
 			tdb_brunlock(tdb, lck->ltype, lck->off, 1);
 		}
 	}
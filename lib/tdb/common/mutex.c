@@ -73,6 +73,12 @@ struct tdb_mutexes {
 	 * one mutex per hashchain.
 	 */
 	pthread_mutex_t hashchains[1];
+
+	/*
+	 * With TDB_FEATURE_FLAG_SEQLOCK the hashchains[] array is
+	 * followed by hash_size+1 uint32_t sequence counters, see
+	 * tdb_seqlock_counter().
+	 */
 };
 
 bool tdb_have_mutexes(struct tdb_context *tdb)
@@ -91,6 +97,10 @@ size_t tdb_mutex_size(struct tdb_context *tdb)
 	mutex_size = sizeof(struct tdb_mutexes);
 	mutex_size += tdb->hash_size * sizeof(pthread_mutex_t);
 
+	if (tdb->feature_flags & TDB_FEATURE_FLAG_SEQLOCK) {
+		mutex_size += (tdb->hash_size + 1) * sizeof(uint32_t);
+	}
+
 	return TDB_ALIGN(mutex_size, tdb->page_size);
 }
 
@@ -645,6 +655,136 @@ int tdb_mutex_munmap(struct tdb_context *tdb)
 	return munmap(tdb->mutexes, len);
 }
 
+#ifdef USE_TDB_SEQLOCK_READ
+
+/*
+ * TDB_SEQLOCK_READ: Every modification of a hash chain is bracketed by
+ * tdb_seqlock_write_begin() and tdb_seqlock_write_end() on the chain's
+ * sequence counter while the chain mutex is held. The counter is odd
+ * while a modification is in progress. Readers note the counter, walk
+ * the chain through their mmap without locking and only trust what
+ * they found if the counter did not change meanwhile.
+ *
+ * Index 0 is not used for the freelist (readers never look at it), it
+ * is bumped by allrecord lock holders that write and by transaction
+ * recovery. Readers check it together with the chain counter.
+ *
+ * If a writer dies with the chain mutex held, its counter stays odd
+ * until the next writer of the chain comes along. Until then readers
+ * of that chain just use the locked path.
+ */
+
+static uint32_t *tdb_seqlock_counter(struct tdb_context *tdb, unsigned idx)
+{
+	struct tdb_mutexes *m = tdb->mutexes;
+	uint32_t *seqlocks = (uint32_t *)&m->hashchains[tdb->hash_size+1];
+
+	return &seqlocks[idx];
+}
+
+bool tdb_seqlock_supported(void)
+{
+	return true;
+}
+
+bool tdb_have_seqlocks(struct tdb_context *tdb)
+{
+	if (!(tdb->feature_flags & TDB_FEATURE_FLAG_SEQLOCK)) {
+		return false;
+	}
+	/* not mapped with TDB_NOLOCK */
+	return (tdb->mutexes != NULL);
+}
+
+void tdb_seqlock_write_begin(struct tdb_context *tdb, unsigned idx)
+{
+	uint32_t *counter = tdb_seqlock_counter(tdb, idx);
+	uint32_t seq = __atomic_load_n(counter, __ATOMIC_RELAXED);
+
+	/*
+	 * Odd already if a previous writer died in the middle, make
+	 * sure it changes anyway.
+	 */
+	__atomic_store_n(counter, (seq + 1) | 1, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+}
+
+void tdb_seqlock_write_end(struct tdb_context *tdb, unsigned idx)
+{
+	uint32_t *counter = tdb_seqlock_counter(tdb, idx);
+	uint32_t seq = __atomic_load_n(counter, __ATOMIC_RELAXED);
+
+	__atomic_store_n(counter, (seq | 1) + 1, __ATOMIC_RELEASE);
+}
+
+/*
+ * Returns false if a writer is active, either on the chain or on the
+ * whole database.
+ */
+bool tdb_seqlock_read_begin(struct tdb_context *tdb, unsigned idx,
+			    uint32_t seq[2])
+{
+	seq[0] = __atomic_load_n(tdb_seqlock_counter(tdb, 0),
+				 __ATOMIC_ACQUIRE);
+	seq[1] = __atomic_load_n(tdb_seqlock_counter(tdb, idx),
+				 __ATOMIC_ACQUIRE);
+
+	return (((seq[0] | seq[1]) & 1) == 0);
+}
+
+/*
+ * Returns true if what was read since tdb_seqlock_read_begin() can't
+ * be trusted.
+ */
+bool tdb_seqlock_read_retry(struct tdb_context *tdb, unsigned idx,
+			    const uint32_t seq[2])
+{
+	__atomic_thread_fence(__ATOMIC_ACQUIRE);
+
+	if (__atomic_load_n(tdb_seqlock_counter(tdb, idx),
+			    __ATOMIC_RELAXED) != seq[1]) {
+		return true;
+	}
+	return (__atomic_load_n(tdb_seqlock_counter(tdb, 0),
+				__ATOMIC_RELAXED) != seq[0]);
+}
+
+#else /* USE_TDB_SEQLOCK_READ */
+
+bool tdb_seqlock_supported(void)
+{
+	return false;
+}
+
+bool tdb_have_seqlocks(struct tdb_context *tdb)
+{
+	return false;
+}
+
+void tdb_seqlock_write_begin(struct tdb_context *tdb, unsigned idx)
+{
+	return;
+}
+
+void tdb_seqlock_write_end(struct tdb_context *tdb, unsigned idx)
+{
+	return;
+}
+
+bool tdb_seqlock_read_begin(struct tdb_context *tdb, unsigned idx,
+			    uint32_t seq[2])
+{
+	return false;
+}
+
+bool tdb_seqlock_read_retry(struct tdb_context *tdb, unsigned idx,
+			    const uint32_t seq[2])
+{
+	return true;
+}
+
+#endif /* USE_TDB_SEQLOCK_READ */
+
 static bool tdb_mutex_locking_cached;
 
 static bool tdb_mutex_locking_supported(void)
@@ -1024,4 +1164,36 @@ _PUBLIC_ bool tdb_runtime_check_for_robust_mutexes(void)
 	return false;
 }
 
+bool tdb_seqlock_supported(void)
+{
+	return false;
+}
+
+bool tdb_have_seqlocks(struct tdb_context *tdb)
+{
+	return false;
+}
+
+void tdb_seqlock_write_begin(struct tdb_context *tdb, unsigned idx)
+{
+	return;
+}
+
+void tdb_seqlock_write_end(struct tdb_context *tdb, unsigned idx)
+{
+	return;
+}
+
+bool tdb_seqlock_read_begin(struct tdb_context *tdb, unsigned idx,
+			    uint32_t seq[2])
+{
+	return false;
+}
+
+bool tdb_seqlock_read_retry(struct tdb_context *tdb, unsigned idx,
+			    const uint32_t seq[2])
+{
+	return true;
+}
+
 #endif
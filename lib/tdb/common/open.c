@@ -84,6 +84,12 @@ static int tdb_new_database(struct tdb_context *tdb, struct tdb_header *header,
 	if (tdb->flags & TDB_MUTEX_LOCKING) {
 		newdb->feature_flags |= TDB_FEATURE_FLAG_MUTEX;
 	}
+	if (tdb->flags & TDB_SEQLOCK_READ) {
+		newdb->feature_flags |= TDB_FEATURE_FLAG_SEQLOCK;
+	}
+	if (tdb->flags & TDB_FREELIST_CLASSES) {
+		newdb->feature_flags |= TDB_FEATURE_FLAG_FREELISTS;
+	}
 
 	/*
 	 * If we have any features we add the FEATURE_FLAG_MAGIC, overwriting the
@@ -209,6 +215,12 @@ static bool check_header_hash(struct tdb_context *tdb,
 			      struct tdb_header *header,
 			      bool default_hash, uint32_t *m1, uint32_t *m2)
 {
+	tdb_hash_func inbuilt[] = {
+		tdb_murmur_hash, tdb_jenkins_hash, tdb_old_hash
+	};
+	tdb_hash_func preferred = tdb->hash_fn;
+	size_t i;
+
 	tdb_header_hash(tdb, m1, m2);
 	if (header->magic1_hash == *m1 &&
 	    header->magic2_hash == *m2) {
@@ -219,12 +231,23 @@ static bool check_header_hash(struct tdb_context *tdb,
 	if (!default_hash)
 		return false;
 
-	/* Otherwise, try the other inbuilt hash. */
-	if (tdb->hash_fn == tdb_old_hash)
-		tdb->hash_fn = tdb_jenkins_hash;
-	else
-		tdb->hash_fn = tdb_old_hash;
-	return check_header_hash(tdb, header, false, m1, m2);
+	/* Otherwise, try the other inbuilt hashes. */
+	for (i = 0; i < ARRAY_SIZE(inbuilt); i++) {
+		uint32_t o1, o2;
+
+		if (inbuilt[i] == preferred) {
+			continue;
+		}
+		tdb->hash_fn = inbuilt[i];
+		tdb_header_hash(tdb, &o1, &o2);
+		if (header->magic1_hash == o1 &&
+		    header->magic2_hash == o2) {
+			return true;
+		}
+	}
+
+	tdb->hash_fn = preferred;
+	return false;
 }
 
 static bool tdb_mutex_open_ok(struct tdb_context *tdb,
@@ -279,6 +302,14 @@ check_local_settings:
 		return false;
 	}
 
+	if ((header->feature_flags & TDB_FEATURE_FLAG_SEQLOCK) &&
+	    !tdb_seqlock_supported()) {
+		TDB_LOG((tdb, TDB_DEBUG_ERROR, "tdb_mutex_open_ok[%s]: "
+			 "Can't maintain the TDB_SEQLOCK_READ counters\n",
+			 tdb->name));
+		return false;
+	}
+
 	if (tdb_mutex_size(tdb) != header->mutex_size) {
 		TDB_LOG((tdb, TDB_DEBUG_ERROR, "tdb_mutex_open_ok[%s]: "
 			 "Mutex size changed from %u to %u\n.",
@@ -323,6 +354,9 @@ _PUBLIC_ struct tdb_context *tdb_open_ex(const char *name, int hash_size, int td
 	if (tdb_flags & TDB_MUTEX_LOCKING) {
 		tdb_flags |= TDB_INCOMPATIBLE_HASH;
 	}
+	if (tdb_flags & TDB_MURMUR_HASH) {
+		tdb_flags |= TDB_INCOMPATIBLE_HASH;
+	}
 
 	tdb->fd = -1;
 #ifdef TDB_TRACE
@@ -370,12 +404,14 @@ _PUBLIC_ struct tdb_context *tdb_open_ex(const char *name, int hash_size, int td
 		hash_alg = "the user defined";
 	} else {
 		/* This controls what we use when creating a tdb. */
-		if (tdb->flags & TDB_INCOMPATIBLE_HASH) {
+		if (tdb->flags & TDB_MURMUR_HASH) {
+			tdb->hash_fn = tdb_murmur_hash;
+		} else if (tdb->flags & TDB_INCOMPATIBLE_HASH) {
 			tdb->hash_fn = tdb_jenkins_hash;
 		} else {
 			tdb->hash_fn = tdb_old_hash;
 		}
-		hash_alg = "either default";
+		hash_alg = "any default";
 	}
 
 	/* cache the page size */
@@ -399,7 +435,8 @@ _PUBLIC_ struct tdb_context *tdb_open_ex(const char *name, int hash_size, int td
 		tdb->read_only = 1;
 		/* read only databases don't do locking or clear if first */
 		tdb->flags |= TDB_NOLOCK;
-		tdb->flags &= ~(TDB_CLEAR_IF_FIRST|TDB_MUTEX_LOCKING);
+		tdb->flags &= ~(TDB_CLEAR_IF_FIRST|TDB_MUTEX_LOCKING|
+				TDB_SEQLOCK_READ);
 	}
 
 	if ((tdb->flags & TDB_ALLOW_NESTING) &&
@@ -469,6 +506,27 @@ _PUBLIC_ struct tdb_context *tdb_open_ex(const char *name, int hash_size, int td
 		}
 	}
 
+	if (tdb->flags & TDB_SEQLOCK_READ) {
+		if (!(tdb->flags & TDB_MUTEX_LOCKING)) {
+			TDB_LOG((tdb, TDB_DEBUG_ERROR, "tdb_open_ex: "
+				"invalid flags for %s - TDB_SEQLOCK_READ "
+				"requires TDB_MUTEX_LOCKING\n", name));
+			errno = EINVAL;
+			goto fail;
+		}
+
+		/*
+		 * Only an optimization, create a database without
+		 * the sequence counters if we can't maintain them.
+		 */
+		if (!tdb_seqlock_supported()) {
+			TDB_LOG((tdb, TDB_DEBUG_TRACE, "tdb_open_ex: "
+				"TDB_SEQLOCK_READ not supported, "
+				"ignoring it for %s\n", name));
+			tdb->flags &= ~TDB_SEQLOCK_READ;
+		}
+	}
+
 	if (getenv("TDB_NO_FSYNC")) {
 		tdb->flags |= TDB_NOSYNC;
 	}
@@ -615,6 +673,16 @@ _PUBLIC_ struct tdb_context *tdb_open_ex(const char *name, int hash_size, int td
 		goto fail;
 	}
 
+	if ((tdb->feature_flags & TDB_FEATURE_FLAG_SEQLOCK) &&
+	    !(tdb->feature_flags & TDB_FEATURE_FLAG_MUTEX)) {
+		TDB_LOG((tdb, TDB_DEBUG_ERROR, "tdb_open_ex: invalid "
+			 "features in tdb %s: 0x%08x (seqlock without "
+			 "mutexes)\n",
+			 name, (unsigned)tdb->feature_flags));
+		errno = EINVAL;
+		goto fail;
+	}
+
 	if (tdb->feature_flags & TDB_FEATURE_FLAG_MUTEX) {
 		if (!tdb_mutex_open_ok(tdb, &header)) {
 			errno = EINVAL;
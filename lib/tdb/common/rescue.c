@@ -249,12 +249,19 @@ _PUBLIC_ int tdb_rescue(struct tdb_context *tdb,
 	}
 
 	/* Walk hash chains to positive vet. */
-	for (h = 0; h < 1+tdb->hash_size; h++) {
+	for (h = 0; h < tdb_freelist_count(tdb) + tdb->hash_size; h++) {
 		bool slow_chase = false;
-		tdb_off_t slow_off = FREELIST_TOP + h*sizeof(tdb_off_t);
+		bool free_list = (h == 0) || (h > tdb->hash_size);
+		tdb_off_t slow_off;
 
-		if (tdb_ofs_read(tdb, FREELIST_TOP + h*sizeof(tdb_off_t),
-				 &off) == -1)
+		/* The other free lists come after the hash chains. */
+		if (h > tdb->hash_size) {
+			slow_off = tdb_freelist_top(tdb, h - tdb->hash_size);
+		} else {
+			slow_off = FREELIST_TOP + h*sizeof(tdb_off_t);
+		}
+
+		if (tdb_ofs_read(tdb, slow_off, &off) == -1)
 			continue;
 
 		while (off && off != slow_off) {
@@ -263,8 +270,7 @@ _PUBLIC_ int tdb_rescue(struct tdb_context *tdb,
 				break;
 			}
 
-			/* 0 is the free list, rest are hash chains. */
-			if (h == 0) {
+			if (free_list) {
 				/* Don't mark garbage as free. */
 				if (rec.magic != TDB_FREE_MAGIC) {
 					break;
@@ -22,6 +22,7 @@
 	"Header offset/logical size: %zu/%zu\n" \
 	"Number of records: %zu\n" \
 	"Incompatible hash: %s\n" \
+	"Hash function: %s\n" \
 	"Active/supported feature flags: 0x%08x/0x%08x\n" \
 	"Robust mutexes locking: %s\n" \
 	"Smallest/average/largest keys: %zu/%zu/%zu\n" \
@@ -31,11 +32,16 @@
 	"Smallest/average/largest dead records: %zu/%zu/%zu\n" \
 	"Number of free records: %zu\n" \
 	"Smallest/average/largest free records: %zu/%zu/%zu\n" \
+	"Number of free lists: %u\n" \
 	"Number of hash chains: %zu\n" \
 	"Smallest/average/largest hash chains: %zu/%zu/%zu\n" \
 	"Number of uncoalesced records: %zu\n" \
 	"Smallest/average/largest uncoalesced runs: %zu/%zu/%zu\n" \
-	"Percentage keys/data/padding/free/dead/rechdrs&tailers/hashes: %.0f/%.0f/%.0f/%.0f/%.0f/%.0f/%.0f\n"
+	"Percentage keys/data/padding/free/dead/rechdrs&tailers/hashes: %.0f/%.0f/%.0f/%.0f/%.0f/%.0f/%.0f\n" \
+	"Hash chain length histogram:\n%s"
+
+/* Chains of length 0, 1, 2-3, 4-7, ... */
+#define HISTOGRAM_SLOTS 33
 
 /* We don't use tally module, to keep upstream happy. */
 struct tally {
@@ -69,6 +75,64 @@ static size_t tally_mean(const struct tally *tally)
 	return tally->total / tally->num;
 }
 
+static unsigned int histogram_slot(size_t len)
+{
+	unsigned int slot = 0;
+
+	while (len != 0 && slot < HISTOGRAM_SLOTS - 1) {
+		len >>= 1;
+		slot++;
+	}
+	return slot;
+}
+
+static void histogram_print(const size_t *histogram, char *buf, size_t buflen)
+{
+	unsigned int slot, last = 0;
+	size_t used = 0;
+
+	buf[0] = '\0';
+
+	for (slot = 0; slot < HISTOGRAM_SLOTS; slot++) {
+		if (histogram[slot] != 0) {
+			last = slot;
+		}
+	}
+
+	for (slot = 0; slot <= last && used < buflen; slot++) {
+		int len;
+
+		if (slot < 2) {
+			len = snprintf(buf + used, buflen - used,
+				       "  %u: %zu\n", slot, histogram[slot]);
+		} else {
+			len = snprintf(buf + used, buflen - used,
+				       "  %llu-%llu: %zu\n",
+				       1ULL << (slot - 1),
+				       (1ULL << slot) - 1,
+				       histogram[slot]);
+		}
+		if (len < 0) {
+			break;
+		}
+		used += len;
+	}
+}
+
+static const char *hash_fn_name(struct tdb_context *tdb)
+{
+	if (tdb->hash_fn == tdb_old_hash) {
+		return "default";
+	}
+	if (tdb->hash_fn == tdb_jenkins_hash) {
+		return "jenkins";
+	}
+	if (tdb->hash_fn == tdb_murmur_hash) {
+		return "murmur3";
+	}
+	return "user defined";
+}
+
 static size_t get_hash_length(struct tdb_context *tdb, unsigned int i)
 {
 	tdb_off_t rec_ptr;
@@ -99,6 +163,8 @@ _PUBLIC_ char *tdb_summary(struct tdb_context *tdb)
 	size_t unc = 0;
 	int len;
 	struct tdb_record recovery;
+	size_t histogram[HISTOGRAM_SLOTS] = { 0 };
+	char histogram_buf[HISTOGRAM_SLOTS * 48];
 
 	/* Read-only databases use no locking at all: it's best-effort.
 	 * We may have a write lock already, so skip that case too. */
@@ -108,6 +174,8 @@ _PUBLIC_ char *tdb_summary(struct tdb_context *tdb)
 		if (tdb_lockall_read(tdb) == -1)
 			return NULL;
 		locked = true;
+		/* the file may have been shrunk by tdb_compact() */
+		tdb->methods->tdb_oob(tdb, tdb->map_size, 1, 1);
 	}
 
 	if (tdb_recovery_area(tdb, tdb->methods, &rec_off, &recovery) != 0) {
@@ -165,8 +233,12 @@ _PUBLIC_ char *tdb_summary(struct tdb_context *tdb)
 	if (unc > 1)
 		tally_add(&uncoal, unc - 1);
 
-	for (off = 0; off < tdb->hash_size; off++)
-		tally_add(&hashval, get_hash_length(tdb, off));
+	for (off = 0; off < tdb->hash_size; off++) {
+		size_t chain_len = get_hash_length(tdb, off);
+		tally_add(&hashval, chain_len);
+		histogram[histogram_slot(chain_len)]++;
+	}
+	histogram_print(histogram, histogram_buf, sizeof(histogram_buf));
 
 	file_size = tdb->hdr_ofs + tdb->map_size;
 
@@ -174,7 +246,9 @@ _PUBLIC_ char *tdb_summary(struct tdb_context *tdb)
 		 (unsigned long long)file_size, keys.total+data.total,
 		 (size_t)tdb->hdr_ofs, (size_t)tdb->map_size,
 		 keys.num,
-		 (tdb->hash_fn == tdb_jenkins_hash)?"yes":"no",
+		 ((tdb->hash_fn == tdb_jenkins_hash) ||
+		  (tdb->hash_fn == tdb_murmur_hash))?"yes":"no",
+		 hash_fn_name(tdb),
 		 (unsigned)tdb->feature_flags, TDB_SUPPORTED_FEATURE_FLAGS,
 		 (tdb->feature_flags & TDB_FEATURE_FLAG_MUTEX)?"yes":"no",
 		 keys.min, tally_mean(&keys), keys.max,
@@ -184,6 +258,7 @@ _PUBLIC_ char *tdb_summary(struct tdb_context *tdb)
 		 dead.min, tally_mean(&dead), dead.max,
 		 freet.num,
 		 freet.min, tally_mean(&freet), freet.max,
+		 tdb_freelist_count(tdb),
 		 hashval.num,
 		 hashval.min, tally_mean(&hashval), hashval.max,
 		 uncoal.total,
@@ -197,7 +272,8 @@ _PUBLIC_ char *tdb_summary(struct tdb_context *tdb)
 		 * (sizeof(struct tdb_record) + sizeof(uint32_t))
 		 * 100.0 / file_size,
 		 tdb->hash_size * sizeof(tdb_off_t)
-		 * 100.0 / file_size);
+		 * 100.0 / file_size,
+		 histogram_buf);
 	if (len == -1) {
 		goto unlock;
 	}
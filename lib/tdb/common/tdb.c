@@ -115,13 +115,149 @@ tdb_off_t tdb_find_lock_hash(struct tdb_context *tdb, TDB_DATA key, uint32_t has
 {
 	uint32_t rec_ptr;
 
-	if (tdb_lock(tdb, BUCKET(hash), locktype) == -1)
+	if (tdb_lock_hash(tdb, hash, locktype) == -1)
 		return 0;
 	if (!(rec_ptr = tdb_find(tdb, key, hash, rec)))
 		tdb_unlock(tdb, BUCKET(hash), locktype);
 	return rec_ptr;
 }
 
+/*
+ * TDB_SEQLOCK_READ: Look up a record without taking the chain lock.
+ *
+ * Writers might modify the chain while we walk it, so everything we
+ * read from the map can be garbage until tdb_seqlock_read_retry() says
+ * otherwise: All offsets are checked against our map before they are
+ * followed, and the data is copied out before it is handed to anyone.
+ *
+ * Returns false if the caller has to look up the record under the
+ * chain lock instead. Otherwise *pfound says whether the key exists
+ * and if so, data->dsize is its length. If copy_data is set,
+ * data->dptr points at a copy of it: at buf if it fits into buflen
+ * bytes, else at a malloc'ed buffer.
+ */
+
+#define TDB_SEQLOCK_READ_RETRIES 3
+
+static bool tdb_find_seqlock(struct tdb_context *tdb, TDB_DATA key,
+			     uint32_t hash, bool copy_data,
+			     uint8_t *buf, size_t buflen,
+			     bool *pfound, TDB_DATA *data)
+{
+	const unsigned char *map = (const unsigned char *)tdb->map_ptr;
+	unsigned idx = BUCKET(hash) + 1;
+	int retries;
+
+	if (!tdb_have_seqlocks(tdb)) {
+		return false;
+	}
+	if ((tdb->transaction != NULL) || (map == NULL)) {
+		return false;
+	}
+
+	for (retries = 0; retries < TDB_SEQLOCK_READ_RETRIES; retries++) {
+		uint32_t seq[2];
+		struct tdb_record rec;
+		tdb_off_t rec_ptr;
+		uint8_t *dptr = NULL;
+		bool found = false;
+		bool torn = false;
+
+		if (!tdb_seqlock_read_begin(tdb, idx, seq)) {
+			/*
+			 * A writer is active, possibly ourselves. Don't
+			 * spin, wait for it in the chain lock.
+			 */
+			return false;
+		}
+
+		memcpy(&rec_ptr, map + TDB_HASH_TOP(hash), sizeof(rec_ptr));
+		if (DOCONV()) {
+			tdb_convert(&rec_ptr, sizeof(rec_ptr));
+		}
+
+		while (rec_ptr != 0) {
+			tdb_off_t key_ofs, data_ofs, end;
+
+			if (tdb_seqlock_read_retry(tdb, idx, seq)) {
+				/* Also ends loops in a torn chain */
+				torn = true;
+				break;
+			}
+
+			if (!tdb_add_off_t(rec_ptr, sizeof(rec), &key_ofs) ||
+			    (key_ofs > tdb->map_size)) {
+				/*
+				 * Either garbage, or the file has grown
+				 * behind our mmap. tdb_oob() in the
+				 * locked path remaps.
+				 */
+				return false;
+			}
+			memcpy(&rec, map + rec_ptr, sizeof(rec));
+			if (DOCONV()) {
+				tdb_convert(&rec, sizeof(rec));
+			}
+
+			if (TDB_BAD_MAGIC(&rec) || (rec.next == rec_ptr)) {
+				torn = true;
+				break;
+			}
+			if (!tdb_add_off_t(key_ofs, rec.key_len, &data_ofs) ||
+			    !tdb_add_off_t(data_ofs, rec.data_len, &end) ||
+			    (end > tdb->map_size)) {
+				torn = true;
+				break;
+			}
+
+			if (!TDB_DEAD(&rec) && (hash == rec.full_hash) &&
+			    (key.dsize == rec.key_len) &&
+			    (memcmp(map + key_ofs, key.dptr,
+				    key.dsize) == 0)) {
+				found = true;
+				break;
+			}
+			rec_ptr = rec.next;
+		}
+
+		if (found && copy_data) {
+			dptr = buf;
+			if ((buf == NULL) || (rec.data_len > buflen)) {
+				dptr = (uint8_t *)malloc(
+					rec.data_len ? rec.data_len : 1);
+				if (dptr == NULL) {
+					return false;
+				}
+			}
+			memcpy(dptr, map + rec_ptr + sizeof(rec) + rec.key_len,
+			       rec.data_len);
+		}
+
+		if (tdb_seqlock_read_retry(tdb, idx, seq)) {
+			if (dptr != buf) {
+				free(dptr);
+			}
+			continue;
+		}
+		if (torn) {
+			/*
+			 * Nobody wrote, so it's real corruption. Let
+			 * the locked path report it.
+			 */
+			return false;
+		}
+
+		*pfound = found;
+		if (found) {
+			data->dptr = dptr;
+			data->dsize = rec.data_len;
+		}
+		return true;
+	}
+
+	return false;
+}
+
 static TDB_DATA _tdb_fetch(struct tdb_context *tdb, TDB_DATA key);
 
 static int tdb_update_hash_cmp(TDB_DATA key, TDB_DATA data, void *private_data)
@@ -191,8 +327,19 @@ static TDB_DATA _tdb_fetch(struct tdb_context *tdb, TDB_DATA key)
 	TDB_DATA ret;
 	uint32_t hash;
 
+	bool found;
+
 	/* find which hash bucket it is in */
 	hash = tdb->hash_fn(&key);
+
+	if (tdb_find_seqlock(tdb, key, hash, true, NULL, 0, &found, &ret)) {
+		if (!found) {
+			tdb->ecode = TDB_ERR_NOEXIST;
+			return tdb_null;
+		}
+		return ret;
+	}
+
 	if (!(rec_ptr = tdb_find_lock_hash(tdb,key,hash,F_RDLCK,&rec)))
 		return tdb_null;
 
@@ -226,6 +373,10 @@ _PUBLIC_ TDB_DATA tdb_fetch(struct tdb_context *tdb, TDB_DATA key)
  * This is interesting for all readers of potentially large data structures in
  * the tdb records, ldb indexes being one example.
  *
+ * With TDB_SEQLOCK_READ the record is usually looked up without the chain
+ * lock, the parser then sees a private copy of the data and runs without any
+ * lock held.
+ *
  * Return -1 if the record was not found.
  */
 
@@ -238,10 +389,30 @@ _PUBLIC_ int tdb_parse_record(struct tdb_context *tdb, TDB_DATA key,
 	struct tdb_record rec;
 	int ret;
 	uint32_t hash;
+	uint8_t buf[256];
+	TDB_DATA data;
+	bool found;
 
 	/* find which hash bucket it is in */
 	hash = tdb->hash_fn(&key);
 
+	if (tdb_find_seqlock(tdb, key, hash, true, buf, sizeof(buf),
+			     &found, &data)) {
+		if (!found) {
+			tdb_trace_1rec_ret(tdb, "tdb_parse_record", key, -1);
+			tdb->ecode = TDB_ERR_NOEXIST;
+			return -1;
+		}
+		tdb_trace_1rec_ret(tdb, "tdb_parse_record", key, 0);
+
+		ret = parser(key, data, private_data);
+
+		if (data.dptr != buf) {
+			free(data.dptr);
+		}
+		return ret;
+	}
+
 	if (!(rec_ptr = tdb_find_lock_hash(tdb,key,hash,F_RDLCK,&rec))) {
 		/* record not found */
 		tdb_trace_1rec_ret(tdb, "tdb_parse_record", key, -1);
@@ -267,6 +438,12 @@ _PUBLIC_ int tdb_parse_record(struct tdb_context *tdb, TDB_DATA key,
 static int tdb_exists_hash(struct tdb_context *tdb, TDB_DATA key, uint32_t hash)
 {
 	struct tdb_record rec;
+	TDB_DATA data;
+	bool found;
+
+	if (tdb_find_seqlock(tdb, key, hash, false, NULL, 0, &found, &data)) {
+		return found ? 1 : 0;
+	}
 
 	if (tdb_find_lock_hash(tdb, key, hash, F_RDLCK, &rec) == 0)
 		return 0;
@@ -574,7 +751,7 @@ _PUBLIC_ int tdb_store(struct tdb_context *tdb, TDB_DATA key, TDB_DATA dbuf, int
 
 	/* find which hash bucket it is in */
 	hash = tdb->hash_fn(&key);
-	if (tdb_lock(tdb, BUCKET(hash), F_WRLCK) == -1)
+	if (tdb_lock_hash(tdb, hash, F_WRLCK) == -1)
 		return -1;
 
 	ret = _tdb_store(tdb, key, dbuf, flag, hash);
@@ -592,7 +769,7 @@ _PUBLIC_ int tdb_append(struct tdb_context *tdb, TDB_DATA key, TDB_DATA new_dbuf
 
 	/* find which hash bucket it is in */
 	hash = tdb->hash_fn(&key);
-	if (tdb_lock(tdb, BUCKET(hash), F_WRLCK) == -1)
+	if (tdb_lock_hash(tdb, hash, F_WRLCK) == -1)
 		return -1;
 
 	dbuf = _tdb_fetch(tdb, key);
@@ -797,6 +974,11 @@ _PUBLIC_ int tdb_wipe_all(struct tdb_context *tdb)
 
 	tdb_trace(tdb, "tdb_wipe_all");
 
+	if (tdb->transaction == NULL) {
+		/* tdb_compact() in another process may have shrunk the file */
+		tdb->methods->tdb_oob(tdb, tdb->map_size, 1, 1);
+	}
+
 	/* see if the tdb has a recovery area, and remember its size
 	   if so. We don't want to lose this as otherwise each
 	   tdb_wipe_all() in a transaction will increase the size of
@@ -823,10 +1005,12 @@ _PUBLIC_ int tdb_wipe_all(struct tdb_context *tdb)
 		}
 	}
 
-	/* wipe the freelist */
-	if (tdb_ofs_write(tdb, FREELIST_TOP, &offset) == -1) {
-		TDB_LOG((tdb, TDB_DEBUG_FATAL,"tdb_wipe_all: failed to write freelist\n"));
-		goto failed;
+	/* wipe the freelists */
+	for (i=0;i<tdb_freelist_count(tdb);i++) {
+		if (tdb_ofs_write(tdb, tdb_freelist_top(tdb, i), &offset) == -1) {
+			TDB_LOG((tdb, TDB_DEBUG_FATAL,"tdb_wipe_all: failed to write freelist %d\n", i));
+			goto failed;
+		}
 	}
 
 	/* add all the rest of the file to the freelist, possibly leaving a gap
@@ -962,6 +1146,530 @@ _PUBLIC_ int tdb_repack(struct tdb_context *tdb)
 	return 0;
 }
 
+/*
+  smallest prime >= n, hash sizes are traditionally prime
+ */
+static uint32_t tdb_next_prime(uint32_t n)
+{
+	uint32_t i;
+
+	if (n <= 2) {
+		return 2;
+	}
+	n |= 1;
+
+	while (true) {
+		for (i = 3; i <= n / i; i += 2) {
+			if (n % i == 0) {
+				break;
+			}
+		}
+		if (i > n / i) {
+			return n;
+		}
+		n += 2;
+	}
+}
+
+/*
+  look at up to 1024 evenly spread hash chains to decide whether the
+  hash table has become too small, without traversing everything
+ */
+static bool tdb_rehash_wanted(struct tdb_context *tdb)
+{
+	uint32_t step = MAX(tdb->hash_size / 1024, 1);
+	uint32_t max_len = tdb->map_size / sizeof(struct tdb_record);
+	uint64_t records = 0;
+	uint32_t chains = 0;
+	uint32_t i;
+
+	for (i = 0; i < tdb->hash_size; i += step) {
+		tdb_off_t rec_ptr;
+		uint32_t len = 0;
+
+		if (tdb_ofs_read(tdb, TDB_HASH_TOP(i), &rec_ptr) == -1) {
+			return false;
+		}
+		while ((rec_ptr != 0) && (len < max_len)) {
+			struct tdb_record rec;
+
+			if (tdb_rec_read(tdb, rec_ptr, &rec) == -1) {
+				return false;
+			}
+			rec_ptr = rec.next;
+			len++;
+		}
+		records += len;
+		chains++;
+	}
+
+	return records > (uint64_t)chains * TDB_REHASH_CHAIN_LENGTH;
+}
+
+/*
+  grow the hash table. Every record is moved, so this works like
+  tdb_repack(), but the hash table gets its new size in between.
+ */
+_PUBLIC_ int tdb_rehash(struct tdb_context *tdb, int hash_size)
+{
+	struct tdb_context *tmp_db;
+	struct traverse_state state;
+	uint32_t old_hash_size;
+	tdb_off_t data_start, recovery_head;
+	int count;
+
+	tdb_trace(tdb, "tdb_rehash");
+
+	if (hash_size < 0 ||
+	    (uint32_t)hash_size >= (UINT32_MAX - FREELIST_TOP) / sizeof(tdb_off_t) - 1) {
+		tdb->ecode = TDB_ERR_EINVAL;
+		TDB_LOG((tdb, TDB_DEBUG_ERROR, "tdb_rehash: invalid hash size "
+			 "%d\n", hash_size));
+		return -1;
+	}
+
+	if (tdb->feature_flags & TDB_FEATURE_FLAG_MUTEX) {
+		/* the mutex area is sized for the hash table */
+		tdb->ecode = TDB_ERR_EINVAL;
+		TDB_LOG((tdb, TDB_DEBUG_ERROR, "tdb_rehash: can't rehash "
+			 "a database with mutexes\n"));
+		return -1;
+	}
+
+	if (tdb_transaction_start(tdb) != 0) {
+		TDB_LOG((tdb, TDB_DEBUG_FATAL, __location__ " Failed to start transaction\n"));
+		return -1;
+	}
+
+	old_hash_size = tdb->hash_size;
+
+	if (hash_size == 0 && !tdb_rehash_wanted(tdb)) {
+		tdb_transaction_cancel(tdb);
+		return 0;
+	}
+	if (hash_size != 0 && (uint32_t)hash_size <= old_hash_size) {
+		/* we only ever grow */
+		tdb_transaction_cancel(tdb);
+		return 0;
+	}
+
+	tmp_db = tdb_open("tmpdb", old_hash_size, TDB_INTERNAL, O_RDWR|O_CREAT, 0);
+	if (tmp_db == NULL) {
+		TDB_LOG((tdb, TDB_DEBUG_FATAL, __location__ " Failed to create tmp_db\n"));
+		tdb_transaction_cancel(tdb);
+		return -1;
+	}
+
+	state.error = false;
+	state.dest_db = tmp_db;
+
+	count = tdb_traverse_read(tdb, repack_traverse, &state);
+	if (count == -1 || state.error) {
+		TDB_LOG((tdb, TDB_DEBUG_FATAL, __location__ " Failed to traverse copying out\n"));
+		goto fail;
+	}
+
+	if (hash_size == 0) {
+		hash_size = tdb_next_prime(count);
+		if ((uint32_t)hash_size <= old_hash_size) {
+			/* it was dead records, tdb_repack() is for those */
+			tdb_transaction_cancel(tdb);
+			tdb_close(tmp_db);
+			return 0;
+		}
+	}
+
+	/* the new hash table overlays the first records */
+	data_start = FREELIST_TOP + (hash_size + 1) * sizeof(tdb_off_t);
+	if (tdb->map_size < data_start) {
+		if (tdb_expand(tdb, data_start - tdb->map_size) != 0) {
+			TDB_LOG((tdb, TDB_DEBUG_FATAL, __location__ " Failed to expand\n"));
+			goto fail;
+		}
+	}
+
+	/*
+	 * A recovery area that is now in the way gets replaced by a
+	 * new one at the end of the file at commit time.
+	 */
+	if (tdb_ofs_read(tdb, TDB_RECOVERY_HEAD, &recovery_head) == -1) {
+		TDB_LOG((tdb, TDB_DEBUG_FATAL, __location__ " Failed to read recovery head\n"));
+		goto fail;
+	}
+	if (recovery_head != 0 && recovery_head < data_start) {
+		recovery_head = 0;
+		if (tdb_ofs_write(tdb, TDB_RECOVERY_HEAD, &recovery_head) == -1) {
+			TDB_LOG((tdb, TDB_DEBUG_FATAL, __location__ " Failed to write recovery head\n"));
+			goto fail;
+		}
+	}
+
+	if (tdb_transaction_set_hash_size(tdb, hash_size) != 0) {
+		TDB_LOG((tdb, TDB_DEBUG_FATAL, __location__ " Failed to set hash size\n"));
+		goto fail;
+	}
+
+	if (tdb_wipe_all(tdb) != 0) {
+		TDB_LOG((tdb, TDB_DEBUG_FATAL, __location__ " Failed to wipe database\n"));
+		goto fail;
+	}
+
+	state.error = false;
+	state.dest_db = tdb;
+
+	if (tdb_traverse_read(tmp_db, repack_traverse, &state) == -1 ||
+	    state.error) {
+		TDB_LOG((tdb, TDB_DEBUG_FATAL, __location__ " Failed to traverse copying back\n"));
+		goto fail;
+	}
+
+	tdb_close(tmp_db);
+
+	if (tdb_transaction_commit(tdb) != 0) {
+		TDB_LOG((tdb, TDB_DEBUG_FATAL, __location__ " Failed to commit\n"));
+		tdb->hash_size = old_hash_size;
+		return -1;
+	}
+
+	TDB_LOG((tdb, TDB_DEBUG_TRACE, "tdb_rehash: %d records, hash size "
+		 "%u -> %u\n", count, old_hash_size, tdb->hash_size));
+	return 0;
+
+fail:
+	tdb->hash_size = old_hash_size;
+	tdb_transaction_cancel(tdb);
+	tdb_close(tmp_db);
+	return -1;
+}
+
+/*
+  move the records of one hash chain that live beyond the limit into
+  free space below it. The chain is locked, so we can relink the
+  records under readers and writers of other chains.
+ */
+static int tdb_compact_chain(struct tdb_context *tdb, uint32_t chain,
+			     tdb_off_t limit, uint32_t *moved)
+{
+	struct tdb_record rec, new_rec;
+	tdb_off_t last_ptr, rec_ptr, new_ptr;
+	unsigned char *buf;
+	tdb_len_t len;
+	int ret = -1;
+
+	if (tdb_lock(tdb, chain, F_WRLCK) == -1) {
+		return -1;
+	}
+
+	last_ptr = TDB_HASH_TOP(chain);
+	if (tdb_ofs_read(tdb, last_ptr, &rec_ptr) == -1) {
+		goto fail;
+	}
+
+	while (rec_ptr != 0) {
+		if (tdb_rec_read(tdb, rec_ptr, &rec) == -1) {
+			goto fail;
+		}
+
+		/*
+		 * Dead records go away on their own, and records
+		 * someone is traversing have to stay where they are.
+		 */
+		if (rec_ptr < limit || rec.magic != TDB_MAGIC ||
+		    tdb_write_lock_record(tdb, rec_ptr) == -1) {
+			last_ptr = rec_ptr;
+			rec_ptr = rec.next;
+			continue;
+		}
+
+		len = rec.key_len + rec.data_len;
+
+		new_ptr = tdb_allocate_below(tdb, len, limit, &new_rec);
+		if (new_ptr == 0) {
+			/* no hole that fits, maybe a smaller record does */
+			tdb_write_unlock_record(tdb, rec_ptr);
+			last_ptr = rec_ptr;
+			rec_ptr = rec.next;
+			continue;
+		}
+
+		buf = tdb_alloc_read(tdb, rec_ptr + sizeof(rec), len);
+		if (buf == NULL) {
+			tdb_free(tdb, new_ptr, &new_rec);
+			tdb_write_unlock_record(tdb, rec_ptr);
+			goto fail;
+		}
+
+		new_rec.next = rec.next;
+		new_rec.key_len = rec.key_len;
+		new_rec.data_len = rec.data_len;
+		new_rec.full_hash = rec.full_hash;
+		new_rec.magic = TDB_MAGIC;
+
+		/* the copy has to be complete before we link it in */
+		if (tdb_rec_write(tdb, new_ptr, &new_rec) == -1 ||
+		    tdb->methods->tdb_write(tdb, new_ptr + sizeof(new_rec),
+					    buf, len) == -1 ||
+		    tdb_ofs_write(tdb, last_ptr, &new_ptr) == -1) {
+			SAFE_FREE(buf);
+			tdb_free(tdb, new_ptr, &new_rec);
+			tdb_write_unlock_record(tdb, rec_ptr);
+			goto fail;
+		}
+		SAFE_FREE(buf);
+
+		if (tdb_free(tdb, rec_ptr, &rec) == -1) {
+			tdb_write_unlock_record(tdb, rec_ptr);
+			goto fail;
+		}
+		tdb_write_unlock_record(tdb, rec_ptr);
+
+		*moved += 1;
+		last_ptr = new_ptr;
+		rec_ptr = new_rec.next;
+	}
+
+	ret = 0;
+fail:
+	tdb_unlock(tdb, chain, F_WRLCK);
+	return ret;
+}
+
+/*
+  where the records would end if all free space was at the end of the
+  file. A recovery area at the end goes away in tdb_compact_truncate().
+  If that would not gain us a page, everything stays where it is.
+ */
+static tdb_off_t tdb_compact_limit(struct tdb_context *tdb)
+{
+	struct tdb_record rec;
+	tdb_off_t limit, rec_ptr, recovery_head, tail;
+	unsigned int list;
+
+	if (tdb_lock(tdb, -1, F_RDLCK) == -1) {
+		return 0;
+	}
+
+	tdb->methods->tdb_oob(tdb, tdb->map_size, 1, 1);
+	limit = tdb->map_size;
+	tail = tdb->map_size;
+
+	if (tdb_ofs_read(tdb, TDB_RECOVERY_HEAD, &recovery_head) == -1) {
+		goto fail;
+	}
+	if (recovery_head != 0 &&
+	    tdb->methods->tdb_read(tdb, recovery_head, &rec, sizeof(rec),
+				   DOCONV()) == 0 &&
+	    recovery_head + sizeof(rec) + rec.rec_len == tdb->map_size) {
+		limit -= MIN(limit, sizeof(rec) + rec.rec_len);
+		tail = recovery_head;
+	}
+
+	/* the free record at the end, tdb_freelist_size() merged them */
+	for (list = 0; list < tdb_freelist_count(tdb); list++) {
+		if (tdb_ofs_read(tdb, tdb_freelist_top(tdb, list),
+				 &rec_ptr) == -1) {
+			goto fail;
+		}
+		while (rec_ptr != 0) {
+			if (tdb_rec_free_read(tdb, rec_ptr, &rec) == -1) {
+				goto fail;
+			}
+			limit -= MIN(limit, sizeof(rec) + rec.rec_len);
+			if (rec_ptr + sizeof(rec) + rec.rec_len == tail) {
+				tail = rec_ptr;
+			}
+			rec_ptr = rec.next;
+		}
+	}
+
+	tdb_unlock(tdb, -1, F_RDLCK);
+
+	if (limit + tdb->page_size > tail) {
+		return tdb->map_size;
+	}
+	return MAX(limit, TDB_DATA_START(tdb->hash_size));
+
+fail:
+	tdb_unlock(tdb, -1, F_RDLCK);
+	return 0;
+}
+
+/*
+  give the free space at the end of the file back to the file system.
+  Transactions and walkers of the whole file like tdb_check() have to
+  be out of the way for a moment, if they are busy we do it next time.
+ */
+static int tdb_compact_truncate(struct tdb_context *tdb)
+{
+	struct tdb_record rec;
+	tdb_off_t recovery_head, off, tailer, new_size;
+	int ret = -1;
+
+	if (tdb->flags & TDB_INTERNAL) {
+		return 0;
+	}
+	if (tdb->feature_flags & TDB_FEATURE_FLAG_SEQLOCK) {
+		/* lockless readers would fault on the removed pages */
+		return 0;
+	}
+
+	if (tdb_allrecord_lock(tdb, F_WRLCK, TDB_LOCK_NOWAIT, false) == -1) {
+		return 0;
+	}
+	/* tdb_lock() does nothing for the freelist under the allrecord lock */
+	if (tdb_nest_lock(tdb, FREELIST_TOP - sizeof(tdb_off_t), F_WRLCK,
+			  TDB_LOCK_WAIT) == -1) {
+		tdb_allrecord_unlock(tdb, F_WRLCK, false);
+		return -1;
+	}
+
+	tdb->methods->tdb_oob(tdb, tdb->map_size, 1, 1);
+
+	/* an unused recovery area at the end is given back as well */
+	if (tdb_ofs_read(tdb, TDB_RECOVERY_HEAD, &recovery_head) == -1) {
+		goto unlock;
+	}
+	if (recovery_head != 0 && !tdb_needs_recovery(tdb)) {
+		if (tdb->methods->tdb_read(tdb, recovery_head, &rec,
+					   sizeof(rec), DOCONV()) == -1) {
+			goto unlock;
+		}
+		if (recovery_head + sizeof(rec) + rec.rec_len ==
+		    tdb->map_size) {
+			tdb_off_t zero = 0;
+
+			if (tdb_ofs_write(tdb, TDB_RECOVERY_HEAD,
+					  &zero) == -1 ||
+			    tdb_free_region(tdb, recovery_head,
+					    sizeof(rec) + rec.rec_len) == -1) {
+				goto unlock;
+			}
+		}
+	}
+
+	/* the last record's tailer tells where it starts */
+	if (tdb_ofs_read(tdb, tdb->map_size - sizeof(tailer), &tailer) == -1) {
+		goto unlock;
+	}
+	off = tdb->map_size - tailer;
+	if (tailer < sizeof(rec) || tailer > tdb->map_size ||
+	    off < TDB_DATA_START(tdb->hash_size) ||
+	    tdb->methods->tdb_read(tdb, off, &rec, sizeof(rec),
+				   DOCONV()) == -1 ||
+	    rec.magic != TDB_FREE_MAGIC ||
+	    sizeof(rec) + rec.rec_len != tailer) {
+		/* in use */
+		ret = 0;
+		goto unlock;
+	}
+
+	/* keep a small free record and the file size at page granularity */
+	new_size = TDB_ALIGN(off + sizeof(rec) + 2 * sizeof(tdb_off_t),
+			     tdb->page_size);
+	if (new_size >= tdb->map_size) {
+		ret = 0;
+		goto unlock;
+	}
+
+	if (tdb_remove_from_freelist(tdb, off, rec.next) == -1) {
+		goto unlock;
+	}
+
+	if (ftruncate(tdb->fd, tdb->hdr_ofs + new_size) == -1) {
+		tdb->ecode = TDB_ERR_IO;
+		TDB_LOG((tdb, TDB_DEBUG_FATAL, "tdb_compact: ftruncate to "
+			 "%u failed (%s)\n", new_size, strerror(errno)));
+		/* the record is still intact, put it back */
+		tdb_free(tdb, off, &rec);
+		goto unlock;
+	}
+	tdb->methods->tdb_oob(tdb, tdb->map_size, 1, 1);
+
+	memset(&rec, '\0', sizeof(rec));
+	rec.rec_len = new_size - off - sizeof(rec);
+	if (tdb_free(tdb, off, &rec) == -1) {
+		goto unlock;
+	}
+
+	ret = 0;
+unlock:
+	tdb_nest_unlock(tdb, FREELIST_TOP - sizeof(tdb_off_t), F_WRLCK, false);
+	tdb_allrecord_unlock(tdb, F_WRLCK, false);
+	return ret;
+}
+
+/*
+  move records from the end of the file into the free space further up
+  and shrink the file, without the global lock tdb_repack() needs.
+ */
+_PUBLIC_ int tdb_compact(struct tdb_context *tdb, unsigned int max_chains)
+{
+	uint32_t end, moved = 0;
+	tdb_off_t old_size;
+
+	tdb_trace(tdb, "tdb_compact");
+
+	if (tdb->read_only || tdb->traverse_read) {
+		tdb->ecode = TDB_ERR_RDONLY;
+		return -1;
+	}
+	if (tdb->transaction != NULL) {
+		tdb->ecode = TDB_ERR_EINVAL;
+		TDB_LOG((tdb, TDB_DEBUG_ERROR, "tdb_compact: not allowed "
+			 "inside a transaction\n"));
+		return -1;
+	}
+
+	if (tdb->compact_chain >= tdb->hash_size) {
+		/* tdb_rehash() may have shrunk our view */
+		tdb->compact_chain = 0;
+	}
+
+	if (tdb->compact_chain == 0) {
+		/* bigger holes for the records we are going to move */
+		if (tdb_freelist_size(tdb) == -1) {
+			return -1;
+		}
+		tdb->compact_limit = tdb_compact_limit(tdb);
+		if (tdb->compact_limit == 0) {
+			return -1;
+		}
+	}
+
+	end = tdb->hash_size;
+	if (max_chains != 0 && max_chains < end - tdb->compact_chain) {
+		end = tdb->compact_chain + max_chains;
+	}
+
+	while (tdb->compact_chain < end) {
+		if (tdb_compact_chain(tdb, tdb->compact_chain,
+				      tdb->compact_limit, &moved) == -1) {
+			return -1;
+		}
+		tdb->compact_chain++;
+	}
+
+	if (tdb->compact_chain < tdb->hash_size) {
+		return 1;
+	}
+
+	tdb->compact_chain = 0;
+	old_size = tdb->map_size;
+
+	/* the holes we left behind are next to each other now */
+	if (tdb_freelist_size(tdb) == -1) {
+		return -1;
+	}
+	if (tdb_compact_truncate(tdb) == -1) {
+		return -1;
+	}
+
+	TDB_LOG((tdb, TDB_DEBUG_TRACE, "tdb_compact: moved %u records, "
+		 "size %u -> %u\n", moved, old_size,
+		 tdb->map_size));
+	return 0;
+}
+
 /* Even on files, we can get partial writes due to signals. */
 bool tdb_write_all(int fd, const void *buf, size_t count)
 {
@@ -56,6 +56,7 @@ typedef uint32_t tdb_off_t;
 #define TDB_FEATURE_FLAG_MAGIC (0xbad1a52U)
 #define TDB_ALIGNMENT 4
 #define DEFAULT_HASH_SIZE 131
+#define TDB_REHASH_CHAIN_LENGTH 4
 #define FREELIST_TOP (sizeof(struct tdb_header))
 #define TDB_ALIGN(x,a) (((x) + (a)-1) & ~((a)-1))
 #define TDB_BYTEREV(x) (((((x)&0xff)<<24)|((x)&0xFF00)<<8)|(((x)>>8)&0xFF00)|((x)>>24))
@@ -69,10 +70,25 @@ typedef uint32_t tdb_off_t;
 #define TDB_PAD_BYTE 0x42
 #define TDB_PAD_U32  0x42424242
 
+/*
+ * With TDB_FEATURE_FLAG_FREELISTS free records are kept on one list
+ * per power of two size class. List 0 is the classic freelist at
+ * FREELIST_TOP and holds records below 64 bytes, the others live in
+ * the header. The last list takes everything from 1MB upwards.
+ */
+#define TDB_NUM_FREELISTS 16
+#define TDB_FREELIST_SHIFT 6
+/* records looked at in one size class before trying the bigger ones */
+#define TDB_FREELIST_SCAN 16
+
 #define TDB_FEATURE_FLAG_MUTEX 0x00000001
+#define TDB_FEATURE_FLAG_SEQLOCK 0x00000002
+#define TDB_FEATURE_FLAG_FREELISTS 0x00000004
 
 #define TDB_SUPPORTED_FEATURE_FLAGS ( \
 	TDB_FEATURE_FLAG_MUTEX | \
+	TDB_FEATURE_FLAG_SEQLOCK | \
+	TDB_FEATURE_FLAG_FREELISTS | \
 	0)
 
 /* NB assumes there is a local variable called "tdb" that is the
@@ -161,7 +177,9 @@ struct tdb_header {
 	uint32_t magic2_hash; /* hash of TDB_MAGIC. */
 	uint32_t feature_flags;
 	tdb_len_t mutex_size; /* set if TDB_FEATURE_FLAG_MUTEX is set */
-	tdb_off_t reserved[25];
+	/* set if TDB_FEATURE_FLAG_FREELISTS is set */
+	tdb_off_t freelist_tops[TDB_NUM_FREELISTS-1];
+	tdb_off_t reserved[10];
 };
 
 struct tdb_lock_type {
@@ -228,6 +246,8 @@ struct tdb_context {
 	struct tdb_transaction *transaction;
 	int page_size;
 	int max_dead_records;
+	uint32_t compact_chain; /* next chain for tdb_compact() */
+	tdb_off_t compact_limit; /* records beyond this get moved */
 #ifdef TDB_TRACE
 	int tracefd;
 #endif
@@ -242,6 +262,8 @@ int tdb_munmap(struct tdb_context *tdb);
 int tdb_mmap(struct tdb_context *tdb);
 int tdb_lock(struct tdb_context *tdb, int list, int ltype);
 int tdb_lock_nonblock(struct tdb_context *tdb, int list, int ltype);
+int tdb_lock_hash(struct tdb_context *tdb, uint32_t hash, int ltype);
+int tdb_lock_hash_nonblock(struct tdb_context *tdb, uint32_t hash, int ltype);
 int tdb_nest_lock(struct tdb_context *tdb, uint32_t offset, int ltype,
 		  enum tdb_lock_flags flags);
 int tdb_nest_unlock(struct tdb_context *tdb, uint32_t offset, int ltype,
@@ -271,6 +293,13 @@ int tdb_ofs_read(struct tdb_context *tdb, tdb_off_t offset, tdb_off_t *d);
 int tdb_ofs_write(struct tdb_context *tdb, tdb_off_t offset, tdb_off_t *d);
 void *tdb_convert(void *buf, uint32_t size);
 int tdb_free(struct tdb_context *tdb, tdb_off_t offset, struct tdb_record *rec);
+unsigned int tdb_freelist_count(struct tdb_context *tdb);
+tdb_off_t tdb_freelist_top(struct tdb_context *tdb, unsigned int list);
+unsigned int tdb_freelist_class(struct tdb_context *tdb, tdb_len_t rec_len);
+tdb_off_t tdb_allocate_below(struct tdb_context *tdb, tdb_len_t length,
+			     tdb_off_t limit, struct tdb_record *rec);
+int tdb_remove_from_freelist(struct tdb_context *tdb, tdb_off_t off,
+			     tdb_off_t next);
 tdb_off_t tdb_allocate(struct tdb_context *tdb, int hash, tdb_len_t length,
 		       struct tdb_record *rec);
 int tdb_ofs_read(struct tdb_context *tdb, tdb_off_t offset, tdb_off_t *d);
@@ -300,6 +329,7 @@ int tdb_rec_free_read(struct tdb_context *tdb, tdb_off_t off,
 		      struct tdb_record *rec);
 bool tdb_write_all(int fd, const void *buf, size_t count);
 int tdb_transaction_recover(struct tdb_context *tdb);
+int tdb_transaction_set_hash_size(struct tdb_context *tdb, uint32_t hash_size);
 void tdb_header_hash(struct tdb_context *tdb,
 		     uint32_t *magic1_hash, uint32_t *magic2_hash);
 unsigned int tdb_old_hash(TDB_DATA *key);
@@ -324,4 +354,13 @@ int tdb_mutex_allrecord_unlock(struct tdb_context *tdb);
 int tdb_mutex_allrecord_upgrade(struct tdb_context *tdb);
 void tdb_mutex_allrecord_downgrade(struct tdb_context *tdb);
 
+bool tdb_seqlock_supported(void);
+bool tdb_have_seqlocks(struct tdb_context *tdb);
+void tdb_seqlock_write_begin(struct tdb_context *tdb, unsigned idx);
+void tdb_seqlock_write_end(struct tdb_context *tdb, unsigned idx);
+bool tdb_seqlock_read_begin(struct tdb_context *tdb, unsigned idx,
+			    uint32_t seq[2]);
+bool tdb_seqlock_read_retry(struct tdb_context *tdb, unsigned idx,
+			    const uint32_t seq[2]);
+
 #endif /* TDB_PRIVATE_H */
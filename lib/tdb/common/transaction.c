@@ -374,6 +374,51 @@ static void transaction_next_hash_chain(struct tdb_context *tdb, uint32_t *chain
 	(*chain) = h;
 }
 
+/*
+  change the number of hash chains within a transaction, for
+  tdb_rehash(). The caller has to make sure the file is large enough
+  for the new hash table and has to rebuild all hash chains.
+*/
+int tdb_transaction_set_hash_size(struct tdb_context *tdb, uint32_t hash_size)
+{
+	uint32_t *hash_heads;
+	tdb_off_t ofs = hash_size;
+
+	if (tdb->transaction == NULL) {
+		tdb->ecode = TDB_ERR_EINVAL;
+		TDB_LOG((tdb, TDB_DEBUG_ERROR, "tdb_transaction_set_hash_size: "
+			 "no transaction\n"));
+		return -1;
+	}
+
+	hash_heads = (uint32_t *)realloc(tdb->transaction->hash_heads,
+					 (hash_size+1) * sizeof(uint32_t));
+	if (hash_heads == NULL) {
+		tdb->ecode = TDB_ERR_OOM;
+		return -1;
+	}
+	tdb->transaction->hash_heads = hash_heads;
+
+	if (tdb_ofs_write(tdb, offsetof(struct tdb_header, hash_size),
+			  &ofs) == -1) {
+		TDB_LOG((tdb, TDB_DEBUG_FATAL, "tdb_transaction_set_hash_size: "
+			 "failed to write hash size\n"));
+		return -1;
+	}
+	tdb->hash_size = hash_size;
+
+	/* the new hash heads cover what used to be record data */
+	if (tdb->methods->tdb_read(tdb, FREELIST_TOP, hash_heads,
+				   TDB_HASHTABLE_SIZE(tdb), 0) != 0) {
+		TDB_LOG((tdb, TDB_DEBUG_FATAL, "tdb_transaction_set_hash_size: "
+			 "failed to read hash heads\n"));
+		tdb->ecode = TDB_ERR_IO;
+		return -1;
+	}
+
+	return 0;
+}
+
 /*
   out of bounds check during a transaction
 */
@@ -1038,17 +1083,21 @@ static bool repack_worthwhile(struct tdb_context *tdb)
 	tdb_off_t ptr;
 	struct tdb_record rec;
 	tdb_len_t total = 0, largest = 0;
+	unsigned int list;
 
-	if (tdb_ofs_read(tdb, FREELIST_TOP, &ptr) == -1) {
-		return false;
-	}
+	for (list = 0; list < tdb_freelist_count(tdb); list++) {
+		if (tdb_ofs_read(tdb, tdb_freelist_top(tdb, list),
+				 &ptr) == -1) {
+			return false;
+		}
 
-	while (ptr != 0 && tdb_rec_free_read(tdb, ptr, &rec) == 0) {
-		total += rec.rec_len;
-		if (rec.rec_len > largest) {
-			largest = rec.rec_len;
+		while (ptr != 0 && tdb_rec_free_read(tdb, ptr, &rec) == 0) {
+			total += rec.rec_len;
+			if (rec.rec_len > largest) {
+				largest = rec.rec_len;
+			}
+			ptr = rec.next;
 		}
-		ptr = rec.next;
 	}
 
 	return total > largest * 2;
@@ -73,7 +73,16 @@ static tdb_off_t tdb_next_lock(struct tdb_context *tdb, struct tdb_traverse_lock
 			}
 		}
 
-		if (tdb_lock(tdb, tlock->hash, tlock->lock_rw) == -1)
+		if (tlock->hash == 0 && !tlock->off) {
+			/*
+			 * Starting a walk: chain 0 is chain 0 for any
+			 * hash size, and locking it this way picks up a
+			 * tdb_rehash() by another process before we use
+			 * tdb->hash_size as our upper bound.
+			 */
+			if (tdb_lock_hash(tdb, 0, tlock->lock_rw) == -1)
+				return TDB_NEXT_LOCK_ERR;
+		} else if (tdb_lock(tdb, tlock->hash, tlock->lock_rw) == -1)
 			return TDB_NEXT_LOCK_ERR;
 
 		/* No previous record?  Start at top of chain. */
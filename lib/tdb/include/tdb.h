@@ -84,6 +84,13 @@ extern "C" {
 #define TDB_MUTEX_LOCKING 4096 /** optimized locking using robust mutexes if supported,
                                    only with tdb >= 1.3.0 and TDB_CLEAR_IF_FIRST
                                    after checking tdb_runtime_check_for_robust_mutexes() */
+#define TDB_SEQLOCK_READ 8192 /** let tdb_fetch(), tdb_parse_record() and tdb_exists()
+                                  read hash chains without locking, only together with
+                                  TDB_MUTEX_LOCKING, only with tdb >= 1.3.9 */
+#define TDB_MURMUR_HASH 16384 /** Faster hashing: can't be opened by tdb < 1.3.10,
+                                  implies TDB_INCOMPATIBLE_HASH */
+#define TDB_FREELIST_CLASSES 32768 /** Keep free records on one list per size class,
+                                       can't be opened by tdb < 1.3.10 */
 
 /** The tdb error codes */
 enum TDB_ERROR {TDB_SUCCESS=0, TDB_ERR_CORRUPT, TDB_ERR_IO, TDB_ERR_LOCK, 
@@ -152,6 +159,10 @@ struct tdb_logging_context {
  *                                             can't be opened by tdb < 1.3.0.
  *                                             Only valid in combination with TDB_CLEAR_IF_FIRST
  *                                             after checking tdb_runtime_check_for_robust_mutexes()\n
+ *                         TDB_MURMUR_HASH - Faster hashing: can't be opened by tdb < 1.3.10.\n
+ *                         TDB_FREELIST_CLASSES - Size class free lists, faster allocation
+ *                                                on fragmented databases: can't be opened
+ *                                                by tdb < 1.3.10.\n
  *
  * @param[in]  open_flags Flags for the open(2) function.
  *
@@ -193,6 +204,10 @@ struct tdb_context *tdb_open(const char *name, int hash_size, int tdb_flags,
  *                                             can't be opened by tdb < 1.3.0.
  *                                             Only valid in combination with TDB_CLEAR_IF_FIRST
  *                                             after checking tdb_runtime_check_for_robust_mutexes()\n
+ *                         TDB_MURMUR_HASH - Faster hashing: can't be opened by tdb < 1.3.10.\n
+ *                         TDB_FREELIST_CLASSES - Size class free lists, faster allocation
+ *                                                on fragmented databases: can't be opened
+ *                                                by tdb < 1.3.10.\n
  *
  * @param[in]  open_flags Flags for the open(2) function.
  *
@@ -809,6 +824,18 @@ void tdb_increment_seqnum_nonblock(struct tdb_context *tdb);
  */
 unsigned int tdb_jenkins_hash(TDB_DATA *key);
 
+/**
+ * @brief Create a hash of the key with MurmurHash3.
+ *
+ * This is the hash function used for databases created with
+ * TDB_MURMUR_HASH.
+ *
+ * @param[in]  key      The key to hash
+ *
+ * @return              The hash.
+ */
+unsigned int tdb_murmur_hash(TDB_DATA *key);
+
 /**
  * @brief Check the consistency of the database.
  *
@@ -895,6 +922,27 @@ void tdb_setalarm_sigptr(struct tdb_context *tdb, volatile sig_atomic_t *sigptr)
 int tdb_wipe_all(struct tdb_context *tdb);
 int tdb_repack(struct tdb_context *tdb);
 
+/*
+ * Grow the hash table to hash_size chains, or with hash_size == 0 to
+ * about one chain per record if the chains hold more than four records
+ * on average. Runs as a transaction, other users of the database pick
+ * up the new size on their next access. Not for TDB_MUTEX_LOCKING.
+ */
+int tdb_rehash(struct tdb_context *tdb, int hash_size);
+
+/*
+ * Move records from the end of the file into free space further up,
+ * one hash chain at a time under its chain lock, and give the free
+ * space at the end back to the file system. Other users of the
+ * database only have to wait for the chain being worked on.
+ *
+ * With max_chains != 0 at most that many chains are done per call, so
+ * that a scavenger can spread the work. Returns 1 if there are chains
+ * left for the next call, 0 when done and -1 on error. Databases with
+ * TDB_SEQLOCK_READ are compacted but not shrunk.
+ */
+int tdb_compact(struct tdb_context *tdb, unsigned int max_chains);
+
 /* Debug functions. Not used in production. */
 void tdb_dump_all(struct tdb_context *tdb);
 int tdb_printfreelist(struct tdb_context *tdb);
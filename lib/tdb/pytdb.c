@@ -770,6 +770,8 @@ PyObject* module_init(void)
 	PyModule_AddIntConstant(m, "ALLOW_NESTING", TDB_ALLOW_NESTING);
 	PyModule_AddIntConstant(m, "DISALLOW_NESTING", TDB_DISALLOW_NESTING);
 	PyModule_AddIntConstant(m, "INCOMPATIBLE_HASH", TDB_INCOMPATIBLE_HASH);
+	PyModule_AddIntConstant(m, "MURMUR_HASH", TDB_MURMUR_HASH);
+	PyModule_AddIntConstant(m, "FREELIST_CLASSES", TDB_FREELIST_CLASSES);
 
 	PyModule_AddStringConstant(m, "__docformat__", "restructuredText");
 
@@ -0,0 +1,201 @@
+#include "../common/tdb_private.h"
+#include "../common/io.c"
+#include "../common/tdb.c"
+#include "../common/lock.c"
+#include "../common/freelist.c"
+#include "../common/traverse.c"
+#include "../common/transaction.c"
+#include "../common/error.c"
+#include "../common/open.c"
+#include "../common/check.c"
+#include "../common/hash.c"
+#include "../common/mutex.c"
+#include "tap-interface.h"
+#include <stdlib.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include "logging.h"
+
+#define NUM_RECORDS 2000
+
+static TDB_DATA make_key(unsigned i)
+{
+	static char buf[16];
+	TDB_DATA key;
+
+	snprintf(buf, sizeof(buf), "key%u", i);
+	key.dptr = (uint8_t *)buf;
+	key.dsize = strlen(buf);
+	return key;
+}
+
+static bool store(struct tdb_context *tdb, unsigned i)
+{
+	static uint8_t buf[1000];
+	TDB_DATA data;
+
+	data.dptr = buf;
+	data.dsize = (i % 7 + 1) * 100 + i % 13;
+	memset(buf, i, data.dsize);
+
+	return tdb_store(tdb, make_key(i), data, TDB_REPLACE) == 0;
+}
+
+static bool fill(struct tdb_context *tdb, unsigned step)
+{
+	unsigned i;
+
+	for (i = 0; i < NUM_RECORDS; i += step) {
+		if (!store(tdb, i)) {
+			return false;
+		}
+	}
+	return true;
+}
+
+/* Keep every fourth record, mostly the later ones sit at the end */
+static bool thin_out(struct tdb_context *tdb)
+{
+	unsigned i;
+
+	for (i = 0; i < NUM_RECORDS; i++) {
+		if ((i % 4 != 0) && tdb_delete(tdb, make_key(i)) != 0) {
+			return false;
+		}
+	}
+	return true;
+}
+
+static bool all_there(struct tdb_context *tdb, unsigned step)
+{
+	unsigned i;
+
+	for (i = 0; i < NUM_RECORDS; i++) {
+		TDB_DATA data = tdb_fetch(tdb, make_key(i));
+		bool ok;
+
+		if (i % step != 0) {
+			ok = (data.dptr == NULL);
+		} else {
+			ok = (data.dsize == (i % 7 + 1) * 100 + i % 13) &&
+				(data.dptr[0] == (uint8_t)i) &&
+				(data.dptr[data.dsize - 1] == (uint8_t)i);
+		}
+		free(data.dptr);
+		if (!ok) {
+			diag("record %u wrong", i);
+			return false;
+		}
+	}
+	return true;
+}
+
+static bool file_size_ok(struct tdb_context *tdb)
+{
+	struct stat st;
+
+	return fstat(tdb_fd(tdb), &st) == 0 &&
+		st.st_size == tdb_map_size(tdb);
+}
+
+static int traverse_fn(struct tdb_context *tdb, TDB_DATA key, TDB_DATA data,
+		       void *private_data)
+{
+	int *fds = (int *)private_data;
+	char c = 0;
+
+	if (fds[0] != -1) {
+		/* let the parent compact while we hold this record */
+		if (write(fds[1], &c, 1) != 1 || read(fds[0], &c, 1) != 1) {
+			return -1;
+		}
+		fds[0] = -1;
+	}
+	return 0;
+}
+
+int main(int argc, char *argv[])
+{
+	struct tdb_context *tdb;
+	int flags[] = { TDB_DEFAULT, TDB_NOMMAP, TDB_CONVERT,
+			TDB_FREELIST_CLASSES };
+	int to_child[2], to_parent[2], fds[2];
+	size_t size;
+	unsigned i, calls;
+	int ret, status;
+	pid_t child;
+	char c = 0;
+
+	plan_tests(sizeof(flags) / sizeof(flags[0]) * 11 + 8);
+
+	for (i = 0; i < sizeof(flags) / sizeof(flags[0]); i++) {
+		tdb = tdb_open_ex("run-compact.tdb", 131, flags[i],
+				  O_CREAT|O_TRUNC|O_RDWR, 0600, &taplogctx,
+				  NULL);
+		ok1(tdb);
+		ok1(fill(tdb, 1) && thin_out(tdb));
+		size = tdb_map_size(tdb);
+
+		/* In steps of 10 chains */
+		calls = 0;
+		do {
+			ret = tdb_compact(tdb, 10);
+			calls++;
+		} while (ret == 1);
+		ok1(ret == 0);
+		ok1(calls == 14);
+
+		ok1(tdb_map_size(tdb) < size / 2);
+		ok1(file_size_ok(tdb));
+		ok1(all_there(tdb, 4));
+		ok1(tdb_check(tdb, NULL, NULL) == 0);
+
+		/* Another round gains nothing */
+		size = tdb_map_size(tdb);
+		ok1(tdb_compact(tdb, 0) == 0 && tdb_map_size(tdb) == size);
+
+		/* And it grows again as usual */
+		ok1(fill(tdb, 1) && all_there(tdb, 1));
+		ok1(tdb_check(tdb, NULL, NULL) == 0);
+		tdb_close(tdb);
+	}
+
+	/* Another process traverses while we compact */
+	tdb = tdb_open_ex("run-compact.tdb", 131, TDB_DEFAULT,
+			  O_CREAT|O_TRUNC|O_RDWR, 0600, &taplogctx, NULL);
+	ok1(fill(tdb, 1) && thin_out(tdb));
+	size = tdb_map_size(tdb);
+
+	if (pipe(to_child) != 0 || pipe(to_parent) != 0) {
+		abort();
+	}
+
+	child = fork();
+	if (child == 0) {
+		if (tdb_reopen(tdb) != 0) {
+			exit(1);
+		}
+		fds[0] = to_child[0];
+		fds[1] = to_parent[1];
+		ret = tdb_traverse_read(tdb, traverse_fn, fds);
+		exit(ret == NUM_RECORDS / 4 ? 0 : 2);
+	}
+
+	ok1(read(to_parent[0], &c, 1) == 1);
+
+	/* Records are moved, but the traverse keeps the file as it is */
+	ok1(tdb_compact(tdb, 0) == 0);
+	ok1(tdb_map_size(tdb) == size && file_size_ok(tdb));
+	ok1(all_there(tdb, 4) && tdb_check(tdb, NULL, NULL) == 0);
+
+	ok1(write(to_child[1], &c, 1) == 1);
+	waitpid(child, &status, 0);
+	ok1(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+
+	ok1(tdb_compact(tdb, 0) == 0 && tdb_map_size(tdb) < size / 2);
+	ok1(file_size_ok(tdb) && all_there(tdb, 4) &&
+	    tdb_check(tdb, NULL, NULL) == 0);
+	tdb_close(tdb);
+
+	return exit_status();
+}
@@ -0,0 +1,144 @@
+#include "../common/tdb_private.h"
+#include "../common/io.c"
+#include "../common/tdb.c"
+#include "../common/lock.c"
+#include "../common/freelist.c"
+#include "../common/freelistcheck.c"
+#include "../common/traverse.c"
+#include "../common/transaction.c"
+#include "../common/error.c"
+#include "../common/open.c"
+#include "../common/check.c"
+#include "../common/hash.c"
+#include "../common/mutex.c"
+#include "tap-interface.h"
+#include <stdlib.h>
+#include "logging.h"
+
+#define NUM_RECORDS 500
+
+static TDB_DATA make_key(unsigned i)
+{
+	static char buf[16];
+	TDB_DATA key;
+
+	snprintf(buf, sizeof(buf), "key%u", i);
+	key.dptr = (uint8_t *)buf;
+	key.dsize = strlen(buf);
+	return key;
+}
+
+/* Sizes from a few bytes to some 100k, so that all classes get used */
+static bool store(struct tdb_context *tdb, unsigned i, unsigned round)
+{
+	static uint8_t buf[200000];
+	TDB_DATA data;
+
+	data.dptr = buf;
+	data.dsize = ((i * 7919 + round * 104729) % 17) << (i % 14);
+	memset(buf, i, data.dsize);
+
+	return tdb_store(tdb, make_key(i), data, TDB_REPLACE) == 0;
+}
+
+static bool churn(struct tdb_context *tdb, unsigned rounds)
+{
+	unsigned i, r;
+
+	for (r = 0; r < rounds; r++) {
+		for (i = 0; i < NUM_RECORDS; i++) {
+			if ((i + r) % 3 == 0) {
+				tdb_delete(tdb, make_key(i));
+			} else if (!store(tdb, i, r)) {
+				return false;
+			}
+		}
+	}
+	return true;
+}
+
+/*
+ * No record may be smaller than its list's class. With exact, every
+ * record must be on the list of its class.
+ */
+static bool lists_ok(struct tdb_context *tdb, bool exact)
+{
+	unsigned int list, class;
+	struct tdb_record rec;
+	tdb_off_t off;
+
+	for (list = 0; list < tdb_freelist_count(tdb); list++) {
+		if (tdb_ofs_read(tdb, tdb_freelist_top(tdb, list), &off)) {
+			return false;
+		}
+		while (off != 0) {
+			if (tdb_rec_free_read(tdb, off, &rec) != 0) {
+				return false;
+			}
+			class = tdb_freelist_class(tdb, rec.rec_len);
+			if (class < list || (exact && class != list)) {
+				diag("%u bytes on list %u", rec.rec_len, list);
+				return false;
+			}
+			off = rec.next;
+		}
+	}
+	return true;
+}
+
+int main(int argc, char *argv[])
+{
+	struct tdb_context *tdb;
+	int flags[] = { TDB_FREELIST_CLASSES,
+			TDB_FREELIST_CLASSES|TDB_NOMMAP,
+			TDB_FREELIST_CLASSES|TDB_CONVERT,
+			TDB_FREELIST_CLASSES|TDB_NOMMAP|TDB_CONVERT };
+	unsigned i;
+	int num;
+
+	plan_tests(sizeof(flags) / sizeof(flags[0]) * 12 + 6);
+
+	for (i = 0; i < sizeof(flags) / sizeof(flags[0]); i++) {
+		tdb = tdb_open_ex("run-freelists.tdb", 131, flags[i],
+				  O_CREAT|O_TRUNC|O_RDWR, 0600, &taplogctx,
+				  NULL);
+		ok1(tdb);
+		ok1(tdb_freelist_count(tdb) == TDB_NUM_FREELISTS);
+
+		ok1(churn(tdb, 10));
+		ok1(tdb_check(tdb, NULL, NULL) == 0);
+		ok1(tdb_validate_freelist(tdb, &num) == 0 && num > 0);
+		ok1(lists_ok(tdb, false));
+
+		/* Merging moves the grown records to their class */
+		ok1(tdb_freelist_size(tdb) > 0);
+		ok1(lists_ok(tdb, true));
+
+		ok1(tdb_transaction_start(tdb) == 0);
+		ok1(churn(tdb, 2));
+		ok1(tdb_transaction_commit(tdb) == 0);
+		ok1(tdb_check(tdb, NULL, NULL) == 0 && lists_ok(tdb, false));
+		tdb_close(tdb);
+	}
+
+	/* The feature is a property of the file, not of the open flags */
+	tdb = tdb_open_ex("run-freelists.tdb", 0, TDB_DEFAULT, O_RDWR, 0,
+			  &taplogctx, NULL);
+	ok1(tdb && tdb_freelist_count(tdb) == TDB_NUM_FREELISTS);
+	ok1(churn(tdb, 2) && tdb_check(tdb, NULL, NULL) == 0);
+	tdb_close(tdb);
+
+	tdb = tdb_open_ex("run-freelists.tdb", 131, TDB_DEFAULT,
+			  O_CREAT|O_TRUNC|O_RDWR, 0600, &taplogctx, NULL);
+	ok1(tdb && tdb_freelist_count(tdb) == 1);
+	tdb_close(tdb);
+
+	tdb = tdb_open_ex("run-freelists.tdb", 0, TDB_FREELIST_CLASSES,
+			  O_RDWR, 0, &taplogctx, NULL);
+	ok1(tdb && tdb_freelist_count(tdb) == 1);
+	ok1(churn(tdb, 2) && tdb_check(tdb, NULL, NULL) == 0);
+	ok1(lists_ok(tdb, true));
+	tdb_close(tdb);
+
+	return exit_status();
+}
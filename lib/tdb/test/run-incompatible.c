@@ -49,7 +49,7 @@ int main(int argc, char *argv[])
 	TDB_DATA d, r;
 	struct tdb_logging_context log_ctx = { log_fn, &log_count };
 
-	plan_tests(38 * 2);
+	plan_tests(52 * 2);
 
 	for (flags = 0; flags <= TDB_CONVERT; flags += TDB_CONVERT) {
 		unsigned int rwmagic = TDB_HASH_RWLOCK_MAGIC;
@@ -148,6 +148,54 @@ int main(int argc, char *argv[])
 		ok1(tdb_check(tdb, NULL, NULL) == 0);
 		tdb_close(tdb);
 
+		/* Now create with the murmur hash. */
+		log_count = 0;
+		tdb = tdb_open_ex("run-incompatible.tdb", 0,
+				  flags|TDB_MURMUR_HASH,
+				  O_CREAT|O_RDWR|O_TRUNC, 0600, &log_ctx,
+				  NULL);
+		ok1(tdb);
+		ok1(log_count == 0);
+		d.dptr = discard_const_p(uint8_t, "Hello");
+		d.dsize = 5;
+		ok1(tdb_store(tdb, d, d, TDB_INSERT) == 0);
+		tdb_close(tdb);
+
+		/* Older tdbs must not open it either. */
+		ok1(hdr_rwlocks("run-incompatible.tdb") == rwmagic);
+
+		/* Cannot open with jenkins hash. */
+		log_count = 0;
+		tdb = tdb_open_ex("run-incompatible.tdb", 0, 0,
+				  O_RDWR, 0600, &log_ctx, tdb_jenkins_hash);
+		ok1(!tdb);
+		ok1(log_count == 1);
+
+		/* Can open with murmur hash. */
+		log_count = 0;
+		tdb = tdb_open_ex("run-incompatible.tdb", 0, 0,
+				  O_RDWR, 0600, &log_ctx, tdb_murmur_hash);
+		ok1(tdb);
+		ok1(log_count == 0);
+		r = tdb_fetch(tdb, d);
+		ok1(r.dsize == 5);
+		free(r.dptr);
+		tdb_close(tdb);
+
+		/* Can open by letting it figure it out itself. */
+		log_count = 0;
+		tdb = tdb_open_ex("run-incompatible.tdb", 0,
+				  TDB_INCOMPATIBLE_HASH,
+				  O_RDWR, 0600, &log_ctx, NULL);
+		ok1(tdb);
+		ok1(log_count == 0);
+		ok1(tdb->hash_fn == tdb_murmur_hash);
+		r = tdb_fetch(tdb, d);
+		ok1(r.dsize == 5);
+		free(r.dptr);
+		ok1(tdb_check(tdb, NULL, NULL) == 0);
+		tdb_close(tdb);
+
 		/* We can also use incompatible hash with other hashes. */
 		log_count = 0;
 		tdb = tdb_open_ex("run-incompatible.tdb", 0,
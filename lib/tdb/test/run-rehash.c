@@ -0,0 +1,190 @@
+#include "../common/tdb_private.h"
+#include "../common/io.c"
+#include "../common/tdb.c"
+#include "../common/lock.c"
+#include "../common/freelist.c"
+#include "../common/traverse.c"
+#include "../common/transaction.c"
+#include "../common/error.c"
+#include "../common/open.c"
+#include "../common/check.c"
+#include "../common/hash.c"
+#include "../common/summary.c"
+#include "../common/mutex.c"
+#include "tap-interface.h"
+#include <stdlib.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include "logging.h"
+
+#define NUM_RECORDS 1000
+
+static TDB_DATA make_key(unsigned i)
+{
+	static char buf[16];
+	TDB_DATA key;
+
+	snprintf(buf, sizeof(buf), "key%u", i);
+	key.dptr = (uint8_t *)buf;
+	key.dsize = strlen(buf);
+	return key;
+}
+
+static bool all_there(struct tdb_context *tdb, unsigned num)
+{
+	unsigned i;
+
+	for (i = 0; i < num; i++) {
+		TDB_DATA key = make_key(i);
+		TDB_DATA data = tdb_fetch(tdb, key);
+		bool ok;
+
+		ok = (data.dsize == sizeof(i)) &&
+			(memcmp(data.dptr, &i, sizeof(i)) == 0);
+		free(data.dptr);
+		if (!ok) {
+			diag("record %u missing", i);
+			return false;
+		}
+	}
+	return true;
+}
+
+static bool fill(struct tdb_context *tdb, unsigned from, unsigned to)
+{
+	unsigned i;
+
+	for (i = from; i < to; i++) {
+		TDB_DATA data = { (uint8_t *)&i, sizeof(i) };
+
+		if (tdb_store(tdb, make_key(i), data, TDB_INSERT) != 0) {
+			return false;
+		}
+	}
+	return true;
+}
+
+/* Another process grows the hash table from 7 to 1009 chains */
+static bool rehash_in_child(struct tdb_context *tdb)
+{
+	int status;
+	pid_t child;
+
+	child = fork();
+	if (child == 0) {
+		if (tdb_reopen(tdb) != 0) {
+			exit(1);
+		}
+		if (tdb_rehash(tdb, 0) != 0) {
+			exit(2);
+		}
+		exit(tdb_hash_size(tdb) == 1009 ? 0 : 3);
+	}
+	waitpid(child, &status, 0);
+	return WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+static unsigned count_keys(struct tdb_context *tdb)
+{
+	TDB_DATA key, next;
+	unsigned num = 0;
+
+	for (key = tdb_firstkey(tdb); key.dptr != NULL; key = next) {
+		next = tdb_nextkey(tdb, key);
+		free(key.dptr);
+		num++;
+	}
+	return num;
+}
+
+int main(int argc, char *argv[])
+{
+	struct tdb_context *tdb;
+	int flags[] = { TDB_DEFAULT, TDB_NOMMAP, TDB_CONVERT,
+			TDB_INCOMPATIBLE_HASH };
+	char *summary;
+	unsigned i;
+	TDB_DATA key;
+	uint32_t hash;
+
+	plan_tests(sizeof(flags) / sizeof(flags[0]) * 18 + 11);
+
+	for (i = 0; i < sizeof(flags) / sizeof(flags[0]); i++) {
+		tdb = tdb_open_ex("run-rehash.tdb", 7, flags[i],
+				  O_CREAT|O_TRUNC|O_RDWR, 0600, &taplogctx,
+				  NULL);
+		ok1(tdb);
+		ok1(fill(tdb, 0, NUM_RECORDS));
+
+		/* Nothing to do when asked to shrink */
+		ok1(tdb_rehash(tdb, 5) == 0);
+		ok1(tdb_hash_size(tdb) == 7);
+
+		/* About one record per chain */
+		ok1(tdb_rehash(tdb, 0) == 0);
+		ok1(tdb_hash_size(tdb) == 1009);
+		ok1(all_there(tdb, NUM_RECORDS));
+		ok1(tdb_check(tdb, NULL, NULL) == 0);
+
+		summary = tdb_summary(tdb);
+		ok1(summary && strstr(summary, "Number of hash chains: 1009\n"));
+		free(summary);
+
+		/* Short chains: nothing to do */
+		ok1(tdb_rehash(tdb, 0) == 0);
+		ok1(tdb_hash_size(tdb) == 1009);
+
+		/* Explicit size, the new hash table covers the recovery area */
+		ok1(tdb_rehash(tdb, 16411) == 0);
+		ok1(tdb_hash_size(tdb) == 16411);
+		ok1(all_there(tdb, NUM_RECORDS));
+		tdb_close(tdb);
+
+		/* The new size is what everyone sees */
+		tdb = tdb_open_ex("run-rehash.tdb", 0, flags[i], O_RDWR, 0,
+				  &taplogctx, NULL);
+		ok1(tdb);
+		ok1(tdb_hash_size(tdb) == 16411);
+		ok1(all_there(tdb, NUM_RECORDS));
+		ok1(tdb_check(tdb, NULL, NULL) == 0);
+		tdb_close(tdb);
+	}
+
+	/* Another process rehashes while we have the database open */
+	tdb = tdb_open_ex("run-rehash.tdb", 7, TDB_DEFAULT,
+			  O_CREAT|O_TRUNC|O_RDWR, 0600, &taplogctx, NULL);
+	fill(tdb, 0, NUM_RECORDS);
+	ok1(rehash_in_child(tdb));
+
+	/* We only notice on the next access */
+	ok1(all_there(tdb, NUM_RECORDS) && tdb_hash_size(tdb) == 1009);
+	ok1(fill(tdb, NUM_RECORDS, 2 * NUM_RECORDS) &&
+	    all_there(tdb, 2 * NUM_RECORDS) &&
+	    (tdb_check(tdb, NULL, NULL) == 0));
+	tdb_close(tdb);
+
+	/* tdb_firstkey() walks all of the new chains */
+	tdb = tdb_open_ex("run-rehash.tdb", 7, TDB_DEFAULT,
+			  O_CREAT|O_TRUNC|O_RDWR, 0600, &taplogctx, NULL);
+	fill(tdb, 0, NUM_RECORDS);
+	ok1(rehash_in_child(tdb));
+	ok1(count_keys(tdb) == NUM_RECORDS);
+	ok1(tdb_hash_size(tdb) == 1009);
+	tdb_close(tdb);
+
+	/* tdb_chainlock_mark() marks the chain under the new hash size */
+	tdb = tdb_open_ex("run-rehash.tdb", 7, TDB_DEFAULT,
+			  O_CREAT|O_TRUNC|O_RDWR, 0600, &taplogctx, NULL);
+	fill(tdb, 0, NUM_RECORDS);
+	ok1(rehash_in_child(tdb));
+	key = make_key(0);
+	hash = tdb->hash_fn(&key);
+	ok1(tdb_chainlock_mark(tdb, key) == 0);
+	ok1(tdb->num_lockrecs == 1 &&
+	    tdb->lockrecs[0].off == lock_offset(hash % 1009));
+	ok1(tdb_chainlock_unmark(tdb, key) == 0);
+	ok1(tdb->num_lockrecs == 0 && all_there(tdb, NUM_RECORDS));
+	tdb_close(tdb);
+
+	return exit_status();
+}
@@ -0,0 +1,265 @@
+#include "../common/tdb_private.h"
+#include "../common/io.c"
+#include "../common/tdb.c"
+#include "../common/lock.c"
+#include "../common/freelist.c"
+#include "../common/traverse.c"
+#include "../common/transaction.c"
+#include "../common/error.c"
+#include "../common/open.c"
+#include "../common/check.c"
+#include "../common/hash.c"
+#include "../common/mutex.c"
+#include "tap-interface.h"
+#include <stdlib.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <stdarg.h>
+
+#ifdef USE_TDB_SEQLOCK_READ
+
+/*
+ * Readers must only ever see one of these two values, although the
+ * child keeps replacing one by the other.
+ */
+static const char short_value[] = "short";
+static const char long_value[] =
+	"a value that is long enough not to fit into the old record "
+	"so that tdb_store has to move it to a new place in the chain";
+
+#define NUM_KEYS 8
+#define NUM_WRITES 20000
+
+static void log_fn(struct tdb_context *tdb, enum tdb_debug_level level,
+		   const char *fmt, ...)
+{
+	va_list ap;
+	va_start(ap, fmt);
+	vfprintf(stderr, fmt, ap);
+	va_end(ap);
+}
+
+static TDB_DATA make_key(unsigned i)
+{
+	static char buf[NUM_KEYS][16];
+	TDB_DATA key;
+
+	snprintf(buf[i], sizeof(buf[i]), "key%u", i);
+	key.dptr = (uint8_t *)buf[i];
+	key.dsize = strlen(buf[i]);
+	return key;
+}
+
+static TDB_DATA make_value(unsigned n)
+{
+	TDB_DATA data;
+
+	if (n % 2 == 0) {
+		data.dptr = discard_const_p(uint8_t, short_value);
+		data.dsize = sizeof(short_value);
+	} else {
+		data.dptr = discard_const_p(uint8_t, long_value);
+		data.dsize = sizeof(long_value);
+	}
+	return data;
+}
+
+static bool value_ok(TDB_DATA data)
+{
+	if ((data.dsize == sizeof(short_value)) &&
+	    (memcmp(data.dptr, short_value, data.dsize) == 0)) {
+		return true;
+	}
+	if ((data.dsize == sizeof(long_value)) &&
+	    (memcmp(data.dptr, long_value, data.dsize) == 0)) {
+		return true;
+	}
+	return false;
+}
+
+static int parse_fn(TDB_DATA key, TDB_DATA data, void *private_data)
+{
+	bool *ok = (bool *)private_data;
+
+	*ok = value_ok(data);
+	return 0;
+}
+
+static uint32_t chain_seq(struct tdb_context *tdb, TDB_DATA key)
+{
+	uint32_t hash = tdb->hash_fn(&key);
+
+	return *tdb_seqlock_counter(tdb, BUCKET(hash) + 1);
+}
+
+static int do_child(struct tdb_context *tdb, int to, int from)
+{
+	unsigned n;
+	int ret;
+	char c = 0;
+
+	ret = tdb_reopen(tdb);
+	ok(ret == 0, "tdb_reopen should succeed");
+
+	write(to, &c, sizeof(c));
+	read(from, &c, sizeof(c));
+
+	for (n = 0; n < NUM_WRITES; n++) {
+		TDB_DATA key = make_key(n % NUM_KEYS);
+
+		if (n % 100 == 0) {
+			ret = tdb_delete(tdb, key);
+		} else {
+			ret = tdb_store(tdb, key, make_value(n), TDB_REPLACE);
+		}
+		if (ret != 0) {
+			ok(false, "tdb_store/tdb_delete should succeed");
+			break;
+		}
+	}
+
+	tdb_close(tdb);
+	return 0;
+}
+
+int main(int argc, char *argv[])
+{
+	struct tdb_context *tdb;
+	unsigned int log_count;
+	struct tdb_logging_context log_ctx = { log_fn, &log_count };
+	TDB_DATA key, data;
+	int ret, status;
+	pid_t child;
+	int fromchild[2];
+	int tochild[2];
+	char c;
+	int tdb_flags;
+	uint32_t seq;
+	unsigned bad_fetch = 0, bad_parse = 0;
+	unsigned i;
+	bool parsed_ok;
+
+	if (!tdb_runtime_check_for_robust_mutexes()) {
+		skip(1, "No robust mutex support");
+		return exit_status();
+	}
+
+	tdb_flags = TDB_INCOMPATIBLE_HASH|
+		TDB_CLEAR_IF_FIRST|
+		TDB_SEQLOCK_READ;
+
+	tdb = tdb_open_ex("seqlock-read.tdb", 3, tdb_flags,
+			  O_RDWR|O_CREAT|O_TRUNC, 0755, &log_ctx, NULL);
+	ok(tdb == NULL, "TDB_SEQLOCK_READ without TDB_MUTEX_LOCKING fails");
+	ok(errno == EINVAL, "errno should be EINVAL");
+
+	tdb_flags |= TDB_MUTEX_LOCKING;
+
+	tdb = tdb_open_ex("seqlock-read.tdb", 3, tdb_flags,
+			  O_RDWR|O_CREAT|O_TRUNC, 0755, &log_ctx, NULL);
+	ok(tdb, "tdb_open_ex should succeed");
+	ok(tdb_have_seqlocks(tdb), "the database should have seqlocks");
+
+	key = make_key(0);
+	seq = chain_seq(tdb, key);
+	ok((seq % 2) == 0, "the chain should be idle");
+
+	ret = tdb_store(tdb, key, make_value(0), TDB_INSERT);
+	ok(ret == 0, "tdb_store should succeed");
+	ok(chain_seq(tdb, key) == seq + 2, "tdb_store should bump the chain");
+
+	data = tdb_fetch(tdb, key);
+	ok(value_ok(data), "tdb_fetch should find the value");
+	free(data.dptr);
+	ok(tdb_exists(tdb, key), "tdb_exists should find the key");
+
+	ret = tdb_chainlock(tdb, key);
+	ok(ret == 0, "tdb_chainlock should succeed");
+	ok((chain_seq(tdb, key) % 2) == 1, "the chain should be written");
+	data = tdb_fetch(tdb, key);
+	ok(value_ok(data), "tdb_fetch under the chainlock should work");
+	free(data.dptr);
+	ret = tdb_chainunlock(tdb, key);
+	ok(ret == 0, "tdb_chainunlock should succeed");
+	ok((chain_seq(tdb, key) % 2) == 0, "the chain should be idle");
+
+	ret = tdb_lockall(tdb);
+	ok(ret == 0, "tdb_lockall should succeed");
+	ok((*tdb_seqlock_counter(tdb, 0) % 2) == 1,
+	   "the database should be written");
+	ret = tdb_unlockall(tdb);
+	ok(ret == 0, "tdb_unlockall should succeed");
+	ok((*tdb_seqlock_counter(tdb, 0) % 2) == 0,
+	   "the database should be idle");
+
+	ret = tdb_transaction_start(tdb);
+	ok(ret == 0, "tdb_transaction_start should succeed");
+	ret = tdb_store(tdb, key, make_value(1), TDB_REPLACE);
+	ok(ret == 0, "tdb_store should succeed");
+	ret = tdb_transaction_commit(tdb);
+	ok(ret == 0, "tdb_transaction_commit should succeed");
+	ok((*tdb_seqlock_counter(tdb, 0) % 2) == 0,
+	   "the database should be idle");
+
+	data = tdb_fetch(tdb, key);
+	ok((data.dsize == sizeof(long_value)),
+	   "tdb_fetch should see the committed value");
+	free(data.dptr);
+
+	pipe(fromchild);
+	pipe(tochild);
+
+	child = fork();
+	if (child == 0) {
+		close(fromchild[0]);
+		close(tochild[1]);
+		return do_child(tdb, fromchild[1], tochild[0]);
+	}
+	close(fromchild[1]);
+	close(tochild[0]);
+
+	read(fromchild[0], &c, sizeof(c));
+	write(tochild[1], &c, sizeof(c));
+
+	/*
+	 * Read while the child keeps rewriting the keys. Records
+	 * change size and move around in their chain.
+	 */
+	for (i = 0; waitpid(child, &status, WNOHANG) == 0; i++) {
+		key = make_key(i % NUM_KEYS);
+
+		data = tdb_fetch(tdb, key);
+		if ((data.dptr != NULL) && !value_ok(data)) {
+			bad_fetch++;
+		}
+		free(data.dptr);
+
+		parsed_ok = true;
+		ret = tdb_parse_record(tdb, key, parse_fn, &parsed_ok);
+		if ((ret == 0) && !parsed_ok) {
+			bad_parse++;
+		}
+	}
+
+	ok(bad_fetch == 0, "tdb_fetch should never see a torn value");
+	ok(bad_parse == 0, "tdb_parse_record should never see a torn value");
+	ok(WIFEXITED(status) && WEXITSTATUS(status) == 0,
+	   "child should have exited correctly");
+
+	ok(tdb_check(tdb, NULL, NULL) == 0, "tdb_check should succeed");
+
+	tdb_close(tdb);
+
+	diag("done after %u reads", i);
+	return exit_status();
+}
+
+#else /* USE_TDB_SEQLOCK_READ */
+
+int main(int argc, char *argv[])
+{
+	skip(1, "No TDB_SEQLOCK_READ support");
+	return exit_status();
+}
+
+#endif /* USE_TDB_SEQLOCK_READ */
@@ -20,12 +20,14 @@ int main(int argc, char *argv[])
 	struct tdb_context *tdb;
 	int flags[] = { TDB_INTERNAL, TDB_DEFAULT, TDB_NOMMAP,
 			TDB_INTERNAL|TDB_CONVERT, TDB_CONVERT,
-			TDB_NOMMAP|TDB_CONVERT };
+			TDB_NOMMAP|TDB_CONVERT,
+			TDB_INTERNAL|TDB_FREELIST_CLASSES,
+			TDB_FREELIST_CLASSES };
 	TDB_DATA key = { (unsigned char *)&j, sizeof(j) };
 	TDB_DATA data = { (unsigned char *)&j, sizeof(j) };
 	char *summary;
 
-	plan_tests(sizeof(flags) / sizeof(flags[0]) * 14);
+	plan_tests(sizeof(flags) / sizeof(flags[0]) * 17);
 	for (i = 0; i < sizeof(flags) / sizeof(flags[0]); i++) {
 		tdb = tdb_open("run-summary.tdb", 131, flags[i],
 			       O_RDWR|O_CREAT|O_TRUNC, 0600);
@@ -51,11 +53,16 @@ int main(int argc, char *argv[])
 		ok1(strstr(summary, "Number of dead records: 0\n"));
 		ok1(strstr(summary, "Number of free records: 1\n"));
 		ok1(strstr(summary, "Smallest/average/largest free records: "));
+		ok1(strstr(summary, (flags[i] & TDB_FREELIST_CLASSES) ?
+			   "Number of free lists: 16\n" :
+			   "Number of free lists: 1\n"));
 		ok1(strstr(summary, "Number of hash chains: 131\n"));
 		ok1(strstr(summary, "Smallest/average/largest hash chains: "));
 		ok1(strstr(summary, "Number of uncoalesced records: 0\n"));
 		ok1(strstr(summary, "Smallest/average/largest uncoalesced runs: 0/0/0\n"));
 		ok1(strstr(summary, "Percentage keys/data/padding/free/dead/rechdrs&tailers/hashes: "));
+		ok1(strstr(summary, "Hash chain length histogram:\n"));
+		ok1(strstr(summary, "  0: "));
 
 		free(summary);
 		tdb_close(tdb);
@@ -0,0 +1,297 @@
+/* tdbchurn: keep a tdb busy with stores, appends and deletes of
+   varying sizes for a long time and show how the write latency
+   develops while the free space gets fragmented.
+*/
+
+#include "replace.h"
+#include "system/time.h"
+#include "system/filesys.h"
+#include "tdb.h"
+
+#ifdef HAVE_GETOPT_H
+#include <getopt.h>
+#endif
+
+#define KEYLEN 24
+#define MAX_DATALEN 8192
+
+/* write latencies in powers of two microseconds */
+#define LATENCY_SLOTS 32
+
+struct churn_stats {
+	unsigned long ops;
+	double total_us;
+	double max_us;
+	unsigned long latency[LATENCY_SLOTS];
+};
+
+static struct tdb_logging_context log_ctx;
+static int error_count;
+
+#ifdef PRINTF_ATTRIBUTE
+static void tdb_log(struct tdb_context *tdb, enum tdb_debug_level level, const char *format, ...) PRINTF_ATTRIBUTE(3,4);
+#endif
+static void tdb_log(struct tdb_context *tdb, enum tdb_debug_level level, const char *format, ...)
+{
+	va_list ap;
+
+	/* trace level messages do not indicate an error */
+	if (level != TDB_DEBUG_TRACE) {
+		error_count++;
+	}
+
+	va_start(ap, format);
+	vfprintf(stdout, format, ap);
+	va_end(ap);
+	fflush(stdout);
+}
+
+static double timeval_us(const struct timeval *tv)
+{
+	return tv->tv_sec * 1000000.0 + tv->tv_usec;
+}
+
+static double now_us(void)
+{
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+	return timeval_us(&tv);
+}
+
+static void stats_add(struct churn_stats *stats, double us)
+{
+	unsigned slot = 0;
+	unsigned long v = (unsigned long)us;
+
+	while (v != 0 && slot < LATENCY_SLOTS - 1) {
+		v >>= 1;
+		slot++;
+	}
+
+	stats->ops++;
+	stats->total_us += us;
+	if (us > stats->max_us) {
+		stats->max_us = us;
+	}
+	stats->latency[slot]++;
+}
+
+/* upper bound of the slot holding the given per mille */
+static unsigned long stats_permille(const struct churn_stats *stats,
+				    unsigned permille)
+{
+	unsigned long wanted = (stats->ops * permille + 999) / 1000;
+	unsigned long seen = 0;
+	unsigned slot;
+
+	for (slot = 0; slot < LATENCY_SLOTS; slot++) {
+		seen += stats->latency[slot];
+		if (seen >= wanted) {
+			break;
+		}
+	}
+	return 1UL << slot;
+}
+
+static TDB_DATA make_key(unsigned i)
+{
+	static char buf[KEYLEN + 1];
+	TDB_DATA key;
+
+	snprintf(buf, sizeof(buf), "fileid:%016x", i);
+	key.dptr = (unsigned char *)buf;
+	key.dsize = strlen(buf);
+	return key;
+}
+
+/* Mostly small records, some big ones, like share mode entries */
+static TDB_DATA make_data(void)
+{
+	static unsigned char buf[MAX_DATALEN];
+	TDB_DATA data;
+	unsigned r = random() % 100;
+
+	if (r < 70) {
+		data.dsize = 64 + random() % 256;
+	} else if (r < 95) {
+		data.dsize = 320 + random() % 1024;
+	} else {
+		data.dsize = 1344 + random() % (MAX_DATALEN - 1344);
+	}
+	memset(buf, r, data.dsize);
+	data.dptr = buf;
+	return data;
+}
+
+static int churn_op(struct tdb_context *tdb, unsigned num_records)
+{
+	TDB_DATA key = make_key(random() % num_records);
+	TDB_DATA data;
+	unsigned r = random() % 100;
+
+	if (r < 40) {
+		if (tdb_delete(tdb, key) != 0 &&
+		    tdb_error(tdb) != TDB_ERR_NOEXIST) {
+			return -1;
+		}
+		return 0;
+	}
+
+	data = make_data();
+	if (r < 55) {
+		/* an entry gets added to an existing record */
+		data.dsize = data.dsize % 128 + 1;
+		return tdb_append(tdb, key, data);
+	}
+	return tdb_store(tdb, key, data, TDB_REPLACE);
+}
+
+static void usage(void)
+{
+	printf("Usage: tdbchurn [-n NUM_RECORDS] [-t SECONDS] [-i INTERVAL] [-H HASH_SIZE] [-s SEED] [-b SECONDS] [-c] [-m] [FILE]\n");
+	printf("  -c  use TDB_FREELIST_CLASSES (implied by -m)\n");
+	printf("  -m  use TDB_MUTEX_LOCKING\n");
+	printf("  -b  run tdb_freelist_size() every SECONDS to coalesce free records\n");
+	exit(0);
+}
+
+int main(int argc, char * const *argv)
+{
+	const char *name = "churn.tdb";
+	unsigned num_records = 100000;
+	unsigned seconds = 600;
+	unsigned interval = 10;
+	unsigned coalesce = 0;
+	int hash_size = 10007;
+	int tdb_flags = TDB_CLEAR_IF_FIRST|TDB_NOSYNC;
+	unsigned seed = 0;
+	struct tdb_context *tdb;
+	struct churn_stats stats;
+	double start, interval_start, next_report, next_coalesce, t;
+	struct stat st;
+	int c;
+
+	while ((c = getopt(argc, argv, "n:t:i:H:s:b:cmh")) != -1) {
+		switch (c) {
+		case 'n':
+			num_records = strtoul(optarg, NULL, 0);
+			break;
+		case 't':
+			seconds = strtoul(optarg, NULL, 0);
+			break;
+		case 'i':
+			interval = strtoul(optarg, NULL, 0);
+			break;
+		case 'H':
+			hash_size = strtol(optarg, NULL, 0);
+			break;
+		case 's':
+			seed = strtoul(optarg, NULL, 0);
+			break;
+		case 'b':
+			coalesce = strtoul(optarg, NULL, 0);
+			break;
+		case 'c':
+			tdb_flags |= TDB_FREELIST_CLASSES;
+			break;
+		case 'm':
+			if (!tdb_runtime_check_for_robust_mutexes()) {
+				printf("tdb_runtime_check_for_robust_mutexes() returned false\n");
+				exit(1);
+			}
+			tdb_flags |= TDB_MUTEX_LOCKING;
+			break;
+		default:
+			usage();
+		}
+	}
+
+	argc -= optind;
+	argv += optind;
+
+	if (argc > 0) {
+		name = argv[0];
+	}
+	if (num_records == 0 || interval == 0) {
+		usage();
+	}
+
+	log_ctx.log_fn = tdb_log;
+
+	unlink(name);
+	tdb = tdb_open_ex(name, hash_size, tdb_flags, O_RDWR | O_CREAT,
+			  0600, &log_ctx, NULL);
+	if (tdb == NULL) {
+		perror("tdb_open_ex");
+		exit(1);
+	}
+
+	srandom(seed);
+
+	printf("%8s %10s %10s %8s %8s %10s %10s\n", "seconds", "ops/s",
+	       "avg_us", "p99_us", "p999_us", "max_us", "size_kB");
+
+	ZERO_STRUCT(stats);
+	start = interval_start = now_us();
+	next_report = start + interval * 1000000.0;
+	next_coalesce = start + coalesce * 1000000.0;
+
+	while (true) {
+		double before = now_us();
+
+		if (churn_op(tdb, num_records) != 0) {
+			printf("operation failed: %s\n", tdb_errorstr(tdb));
+			error_count++;
+			break;
+		}
+
+		t = now_us();
+		stats_add(&stats, t - before);
+
+		if (coalesce != 0 && t >= next_coalesce) {
+			tdb_freelist_size(tdb);
+			next_coalesce = t + coalesce * 1000000.0;
+		}
+
+		if (t < next_report) {
+			continue;
+		}
+
+		if (fstat(tdb_fd(tdb), &st) != 0) {
+			st.st_size = 0;
+		}
+
+		printf("%8.0f %10.0f %10.1f %8lu %8lu %10.0f %10lu\n",
+		       (t - start) / 1000000.0,
+		       stats.ops * 1000000.0 / (t - interval_start),
+		       stats.total_us / stats.ops,
+		       stats_permille(&stats, 990),
+		       stats_permille(&stats, 999),
+		       stats.max_us,
+		       (unsigned long)(st.st_size / 1024));
+		fflush(stdout);
+
+		ZERO_STRUCT(stats);
+		interval_start = t;
+		next_report = t + interval * 1000000.0;
+
+		if (t - start >= seconds * 1000000.0) {
+			break;
+		}
+	}
+
+	if (tdb_check(tdb, NULL, NULL) != 0) {
+		printf("tdb_check failed\n");
+		error_count++;
+	}
+
+	tdb_close(tdb);
+	unlink(name);
+
+	if (error_count != 0) {
+		printf("churn failed\n");
+		exit(1);
+	}
+	return 0;
+}
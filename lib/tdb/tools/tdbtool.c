@@ -64,6 +64,9 @@ enum commands {
 	CMD_SYSTEM,
 	CMD_CHECK,
 	CMD_REPACK,
+	CMD_REHASH,
+	CMD_COMPACT,
+	CMD_CHAINS,
 	CMD_QUIT,
 	CMD_HELP
 };
@@ -103,6 +106,9 @@ COMMAND_TABLE cmd_table[] = {
 	{"q",		CMD_QUIT},
 	{"!",		CMD_SYSTEM},
 	{"repack",	CMD_REPACK},
+	{"rehash",	CMD_REHASH},
+	{"compact",	CMD_COMPACT},
+	{"chains",	CMD_CHAINS},
 	{NULL,		CMD_HELP}
 };
 
@@ -237,6 +243,10 @@ static void help(void)
 "  freelist_size        : print the number of records in the freelist\n"
 "  check                : check the integrity of an opened database\n"
 "  repack               : repack the database\n"
+"  rehash    [size]     : grow the hash table, by default if the chains are long\n"
+"  compact   [chains]   : move records to the front and shrink the file,\n"
+"                         locking [chains] hash chains at a time\n"
+"  chains               : print the hash chain length histogram\n"
 "  speed                : perform speed tests on the database\n"
 "  ! command            : execute system command\n"
 "  1 | first            : print the first record\n"
@@ -476,6 +486,91 @@ static void info_tdb(void)
 	}
 }
 
+static void print_summary_line(const char *summary, const char *prefix)
+{
+	const char *p = strstr(summary, prefix);
+	const char *end;
+
+	if (p == NULL) {
+		return;
+	}
+	end = strchr(p, '\n');
+	if (end == NULL) {
+		end = p + strlen(p);
+	}
+	printf("%.*s\n", (int)(end - p), p);
+}
+
+static void chains_tdb(void)
+{
+	char *summary = tdb_summary(tdb);
+	const char *histogram;
+
+	if (!summary) {
+		printf("Error = %s\n", tdb_errorstr(tdb));
+		return;
+	}
+
+	print_summary_line(summary, "Number of records:");
+	print_summary_line(summary, "Hash function:");
+	print_summary_line(summary, "Number of hash chains:");
+	print_summary_line(summary, "Smallest/average/largest hash chains:");
+
+	histogram = strstr(summary, "Hash chain length histogram:");
+	if (histogram != NULL) {
+		printf("%s", histogram);
+	}
+	free(summary);
+}
+
+static void rehash_tdb(const char *size)
+{
+	int hash_size = size ? atoi(size) : 0;
+	int old_hash_size = tdb_hash_size(tdb);
+
+	printf("Before:\n");
+	chains_tdb();
+
+	if (tdb_rehash(tdb, hash_size) != 0) {
+		printf("Error = %s\n", tdb_errorstr(tdb));
+		return;
+	}
+
+	if (tdb_hash_size(tdb) == old_hash_size) {
+		printf("Hash table not grown\n");
+		return;
+	}
+
+	printf("After:\n");
+	chains_tdb();
+}
+
+static void compact_tdb(const char *chains)
+{
+	unsigned int max_chains = chains ? atoi(chains) : 0;
+	size_t old_size = tdb_map_size(tdb);
+	size_t round_size;
+	unsigned int rounds = 0;
+	int ret;
+
+	/* holes get filled up better with each round */
+	do {
+		round_size = tdb_map_size(tdb);
+		do {
+			ret = tdb_compact(tdb, max_chains);
+		} while (ret == 1);
+		rounds++;
+	} while (ret == 0 && tdb_map_size(tdb) < round_size);
+
+	if (ret != 0) {
+		printf("Error = %s\n", tdb_errorstr(tdb));
+		return;
+	}
+
+	printf("Size %zu -> %zu bytes in %u rounds\n", old_size,
+	       tdb_map_size(tdb), rounds);
+}
+
 static void speed_tdb(const char *tlimit)
 {
 	const char *str = "store test", *str2 = "transaction test";
@@ -669,6 +764,17 @@ static int do_command(void)
 			bIterate = 0;
 			tdb_repack(tdb);
 			return 0;
+		case CMD_REHASH:
+			bIterate = 0;
+			rehash_tdb(arg1);
+			return 0;
+		case CMD_COMPACT:
+			bIterate = 0;
+			compact_tdb(arg1);
+			return 0;
+		case CMD_CHAINS:
+			chains_tdb();
+			return 0;
 		case CMD_TRANSACTION_CANCEL:
 			bIterate = 0;
 			tdb_transaction_cancel(tdb);
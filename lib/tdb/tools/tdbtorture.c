@@ -25,6 +25,8 @@
 #define CULL_PROB 100
 #define KEYLEN 3
 #define DATALEN 100
+#define READ_BENCH_RECORDS 10000
+#define READ_BENCH_HASH_SIZE 10007
 
 static struct tdb_context *db;
 static int in_transaction;
@@ -34,6 +36,7 @@ static int hash_size = 2;
 static int loopnum;
 static int count_pipe;
 static bool mutex = false;
+static bool seqlock = false;
 static struct tdb_logging_context log_ctx;
 
 #ifdef PRINTF_ATTRIBUTE
@@ -217,7 +220,13 @@ static int traverse_fn(struct tdb_context *tdb, TDB_DATA key, TDB_DATA dbuf,
 
 static void usage(void)
 {
-	printf("Usage: tdbtorture [-t] [-k] [-m] [-n NUM_PROCS] [-l NUM_LOOPS] [-s SEED] [-H HASH_SIZE]\n");
+	printf("Usage: tdbtorture [-t] [-k] [-m] [-S] [-n NUM_PROCS] [-l NUM_LOOPS] [-s SEED] [-H HASH_SIZE]\n");
+	printf("       tdbtorture -R SECONDS [-W] [-m] [-S] [-n MAX_PROCS] [-H HASH_SIZE]\n");
+	printf("\n");
+	printf("  -S  use TDB_SEQLOCK_READ, implies -m\n");
+	printf("  -R  measure tdb_fetch() throughput with 1, 2, 4 ... MAX_PROCS\n"
+	       "      readers (default 64), SECONDS for each step\n");
+	printf("  -W  run a writer process in parallel to the readers\n");
 	exit(0);
 }
 
@@ -236,6 +245,9 @@ static int run_child(const char *filename, int i, int seed, unsigned num_loops,
 	if (mutex) {
 		tdb_flags |= TDB_MUTEX_LOCKING;
 	}
+	if (seqlock) {
+		tdb_flags |= TDB_SEQLOCK_READ;
+	}
 
 	db = tdb_open_ex(filename, hash_size, tdb_flags,
 			 O_RDWR | O_CREAT, 0600, &log_ctx, NULL);
@@ -277,6 +289,237 @@ static int run_child(const char *filename, int i, int seed, unsigned num_loops,
 	return (error_count < 100 ? error_count : 100);
 }
 
+/*
+ * Read scaling benchmark: all children share the db opened by the
+ * parent, which keeps it open so that TDB_CLEAR_IF_FIRST does not wipe
+ * it in between.
+ */
+
+struct read_bench_result {
+	bool writer;
+	uint64_t ops;
+};
+
+static double elapsed_since(const struct timeval *start)
+{
+	struct timeval now;
+
+	gettimeofday(&now, NULL);
+	return (now.tv_sec - start->tv_sec) +
+		(now.tv_usec - start->tv_usec) * 1e-6;
+}
+
+static TDB_DATA read_bench_key(char *buf, size_t buflen, int i)
+{
+	TDB_DATA key;
+
+	snprintf(buf, buflen, "record%d", i);
+	key.dptr = (unsigned char *)buf;
+	key.dsize = strlen(buf) + 1;
+	return key;
+}
+
+static int read_bench_child(int i, int seed, double seconds, bool writer,
+			    int start_fd, int result_fd)
+{
+	struct read_bench_result result = { .writer = writer };
+	struct timeval start;
+	char *value;
+	char c;
+
+	if (tdb_reopen(db) != 0) {
+		fatal("tdb_reopen failed");
+		return 1;
+	}
+
+	srandom(seed + i);
+	value = randbuf(DATALEN);
+
+	/* The parent closes the pipe to start everybody at once */
+	read(start_fd, &c, sizeof(c));
+
+	gettimeofday(&start, NULL);
+
+	do {
+		int j;
+
+		for (j = 0; j < 100 && error_count == 0; j++) {
+			char buf[32];
+			TDB_DATA key, data;
+
+			key = read_bench_key(buf, sizeof(buf),
+					     random() % READ_BENCH_RECORDS);
+
+			if (writer) {
+				data.dptr = (unsigned char *)value;
+				data.dsize = 1 + (random() % DATALEN);
+				if (tdb_store(db, key, data, TDB_REPLACE) != 0) {
+					fatal("tdb_store failed");
+				}
+				continue;
+			}
+
+			data = tdb_fetch(db, key);
+			if (data.dptr == NULL) {
+				fatal("tdb_fetch failed");
+			}
+			free(data.dptr);
+		}
+		result.ops += j;
+	} while (error_count == 0 && elapsed_since(&start) < seconds);
+
+	write(result_fd, &result, sizeof(result));
+
+	free(value);
+	return (error_count < 100 ? error_count : 100);
+}
+
+static int read_bench_step(int num_readers, bool with_writer, int seed,
+			   double seconds, double *reads_per_sec,
+			   double *writes_per_sec)
+{
+	int num_procs = num_readers + (with_writer ? 1 : 0);
+	int start_pipe[2], result_pipe[2];
+	uint64_t reads = 0, writes = 0;
+	int i, ret = 0;
+
+	if (pipe(start_pipe) != 0 || pipe(result_pipe) != 0) {
+		perror("Creating pipe");
+		return 1;
+	}
+
+	for (i = 0; i < num_procs; i++) {
+		pid_t pid = fork();
+
+		if (pid == -1) {
+			perror("fork");
+			exit(1);
+		}
+		if (pid == 0) {
+			close(start_pipe[1]);
+			close(result_pipe[0]);
+			exit(read_bench_child(i, seed, seconds,
+					      (i == num_readers),
+					      start_pipe[0], result_pipe[1]));
+		}
+	}
+	close(start_pipe[0]);
+	close(result_pipe[1]);
+
+	/* Go */
+	close(start_pipe[1]);
+
+	for (i = 0; i < num_procs; i++) {
+		struct read_bench_result result;
+
+		if (read(result_pipe[0], &result, sizeof(result)) !=
+		    sizeof(result)) {
+			ret = 1;
+			break;
+		}
+		if (result.writer) {
+			writes += result.ops;
+		} else {
+			reads += result.ops;
+		}
+	}
+	close(result_pipe[0]);
+
+	for (i = 0; i < num_procs; i++) {
+		int status;
+
+		if (wait(&status) == -1) {
+			perror("failed to wait for child");
+			exit(1);
+		}
+		if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+			ret = 1;
+		}
+	}
+
+	*reads_per_sec = reads / seconds;
+	*writes_per_sec = writes / seconds;
+	return ret;
+}
+
+static int run_read_bench(const char *filename, int max_procs,
+			  bool with_writer, int seed, double seconds)
+{
+	int tdb_flags = TDB_DEFAULT|TDB_CLEAR_IF_FIRST|TDB_INCOMPATIBLE_HASH;
+	char *value;
+	int i, n;
+
+	if (mutex) {
+		tdb_flags |= TDB_MUTEX_LOCKING;
+	}
+	if (seqlock) {
+		tdb_flags |= TDB_SEQLOCK_READ;
+	}
+
+	db = tdb_open_ex(filename, hash_size, tdb_flags,
+			 O_RDWR | O_CREAT, 0600, &log_ctx, NULL);
+	if (!db) {
+		fatal("db open failed");
+		return 1;
+	}
+
+	srandom(seed);
+	value = randbuf(DATALEN);
+
+	for (i = 0; i < READ_BENCH_RECORDS; i++) {
+		char buf[32];
+		TDB_DATA key, data;
+
+		key = read_bench_key(buf, sizeof(buf), i);
+		data.dptr = (unsigned char *)value;
+		data.dsize = 1 + (random() % DATALEN);
+
+		if (tdb_store(db, key, data, TDB_INSERT) != 0) {
+			fatal("tdb_store failed");
+			return 1;
+		}
+	}
+	free(value);
+
+	printf("Read scaling with %d records, %d hash_size, %s locking%s\n",
+	       READ_BENCH_RECORDS, hash_size,
+	       seqlock ? "mutex+seqlock" : (mutex ? "mutex" : "fcntl"),
+	       with_writer ? ", one writer" : "");
+	printf("%6s %14s %14s%s\n", "procs", "reads/sec", "per proc",
+	       with_writer ? "     writes/sec" : "");
+
+	for (n = 1; ; n = MIN(n * 2, max_procs)) {
+		double reads_per_sec, writes_per_sec;
+
+		if (read_bench_step(n, with_writer, seed, seconds,
+				    &reads_per_sec, &writes_per_sec) != 0) {
+			printf("step with %d processes failed\n", n);
+			error_count++;
+			break;
+		}
+
+		printf("%6d %14.0f %14.0f", n, reads_per_sec,
+		       reads_per_sec / n);
+		if (with_writer) {
+			printf(" %14.0f", writes_per_sec);
+		}
+		printf("\n");
+		fflush(stdout);
+
+		if (n == max_procs) {
+			break;
+		}
+	}
+
+	if (error_count == 0 && tdb_check(db, NULL, NULL) == -1) {
+		printf("db check failed\n");
+		error_count++;
+	}
+
+	tdb_close(db);
+	return error_count;
+}
+
 static char *test_path(const char *filename)
 {
 	const char *prefix = getenv("TEST_DATA_PREFIX");
@@ -306,19 +549,34 @@ int main(int argc, char * const *argv)
 	int kill_random = 0;
 	int *done;
 	char *test_tdb;
+	double read_seconds = 0;
+	bool num_procs_given = false;
+	bool hash_size_given = false;
+	bool with_writer = false;
 
 	log_ctx.log_fn = tdb_log;
 
-	while ((c = getopt(argc, argv, "n:l:s:H:thkm")) != -1) {
+	while ((c = getopt(argc, argv, "n:l:s:H:R:thkmSW")) != -1) {
 		switch (c) {
 		case 'n':
 			num_procs = strtol(optarg, NULL, 0);
+			num_procs_given = true;
 			break;
 		case 'l':
 			num_loops = strtol(optarg, NULL, 0);
 			break;
 		case 'H':
 			hash_size = strtol(optarg, NULL, 0);
+			hash_size_given = true;
+			break;
+		case 'R':
+			read_seconds = strtod(optarg, NULL);
+			if (read_seconds <= 0) {
+				usage();
+			}
+			break;
+		case 'W':
+			with_writer = true;
 			break;
 		case 's':
 			seed = strtol(optarg, NULL, 0);
@@ -336,6 +594,14 @@ int main(int argc, char * const *argv)
 				exit(1);
 			}
 			break;
+		case 'S':
+			mutex = tdb_runtime_check_for_robust_mutexes();
+			if (!mutex) {
+				printf("tdb_runtime_check_for_robust_mutexes() returned false\n");
+				exit(1);
+			}
+			seqlock = true;
+			break;
 		default:
 			usage();
 		}
@@ -349,6 +615,27 @@ int main(int argc, char * const *argv)
 		seed = (getpid() + time(NULL)) & 0x7FFFFFFF;
 	}
 
+	if (read_seconds > 0) {
+		int ret;
+
+		if (!num_procs_given) {
+			num_procs = 64;
+		}
+		if (!hash_size_given) {
+			hash_size = READ_BENCH_HASH_SIZE;
+		}
+		if (num_procs < 1) {
+			usage();
+		}
+		ret = run_read_bench(test_tdb, num_procs, with_writer, seed,
+				     read_seconds);
+		if (ret == 0) {
+			printf("OK\n");
+		}
+		free(test_tdb);
+		return ret;
+	}
+
 	printf("Testing with %d processes, %d loops, %d hash_size, seed=%d%s\n",
 	       num_procs, num_loops, hash_size, seed,
 	       (always_transaction ? " (all within transactions)" : ""));
@@ -26,6 +26,7 @@
 #include <sys/socket.h>
 #include <errno.h>
 #include <unistd.h>
+#include <sys/time.h>
 #include "tevent.h"
 #include "talloc.h"
 
@@ -595,6 +596,201 @@ static bool echo_server_recv(struct tevent_req *req, int *perr)
 	return true;
 }
 
+/**
+ * @brief Client doing round trips to an echo handler, for benchmarking
+ */
+
+struct echo_client_state {
+	struct tevent_context *ev;
+	int fd;
+	uint8_t *buf;
+	size_t nread;
+	uint64_t *round_trips;
+};
+
+static void echo_client_written(struct tevent_req *subreq);
+static void echo_client_read_done(struct tevent_req *subreq);
+
+static struct tevent_req *echo_client_send(TALLOC_CTX *mem_ctx,
+					   struct tevent_context *ev,
+					   int fd, size_t bufsize,
+					   uint64_t *round_trips)
+{
+	struct tevent_req *req, *subreq;
+	struct echo_client_state *state;
+
+	req = tevent_req_create(mem_ctx, &state, struct echo_client_state);
+	if (req == NULL) {
+		return NULL;
+	}
+	state->ev = ev;
+	state->fd = fd;
+	state->round_trips = round_trips;
+
+	state->buf = talloc_zero_array(state, uint8_t, bufsize);
+	if (tevent_req_nomem(state->buf, req)) {
+		return tevent_req_post(req, ev);
+	}
+
+	subreq = writeall_send(state, state->ev, state->fd,
+			       state->buf, bufsize);
+	if (tevent_req_nomem(subreq, req)) {
+		return tevent_req_post(req, ev);
+	}
+	tevent_req_set_callback(subreq, echo_client_written, req);
+	return req;
+}
+
+static void echo_client_written(struct tevent_req *subreq)
+{
+	struct tevent_req *req = tevent_req_callback_data(
+		subreq, struct tevent_req);
+	struct echo_client_state *state = tevent_req_data(
+		req, struct echo_client_state);
+	ssize_t nwritten;
+	int err;
+
+	nwritten = writeall_recv(subreq, &err);
+	TALLOC_FREE(subreq);
+	if (nwritten == -1) {
+		tevent_req_error(req, err);
+		return;
+	}
+
+	state->nread = 0;
+	subreq = read_send(state, state->ev, state->fd,
+			   state->buf, talloc_get_size(state->buf));
+	if (tevent_req_nomem(subreq, req)) {
+		return;
+	}
+	tevent_req_set_callback(subreq, echo_client_read_done, req);
+}
+
+static void echo_client_read_done(struct tevent_req *subreq)
+{
+	struct tevent_req *req = tevent_req_callback_data(
+		subreq, struct tevent_req);
+	struct echo_client_state *state = tevent_req_data(
+		req, struct echo_client_state);
+	size_t bufsize = talloc_get_size(state->buf);
+	ssize_t nread;
+	int err;
+
+	nread = read_recv(subreq, &err);
+	TALLOC_FREE(subreq);
+	if (nread == -1) {
+		tevent_req_error(req, err);
+		return;
+	}
+	if (nread == 0) {
+		tevent_req_error(req, EPIPE);
+		return;
+	}
+
+	state->nread += nread;
+	if (state->nread < bufsize) {
+		subreq = read_send(state, state->ev, state->fd,
+				   state->buf + state->nread,
+				   bufsize - state->nread);
+		if (tevent_req_nomem(subreq, req)) {
+			return;
+		}
+		tevent_req_set_callback(subreq, echo_client_read_done, req);
+		return;
+	}
+
+	*state->round_trips += 1;
+
+	subreq = writeall_send(state, state->ev, state->fd,
+			       state->buf, bufsize);
+	if (tevent_req_nomem(subreq, req)) {
+		return;
+	}
+	tevent_req_set_callback(subreq, echo_client_written, req);
+}
+
+static void echo_bench_done(struct tevent_context *ev,
+			    struct tevent_timer *te,
+			    struct timeval current_time,
+			    void *private_data)
+{
+	bool *done = (bool *)private_data;
+
+	*done = true;
+}
+
+/**
+ * @brief Run round trips over socketpairs in one process and report
+ * how many events per second the backend dispatched
+ */
+
+static int echo_bench(const char *backend, int num_conns, int seconds)
+{
+	struct tevent_context *ev;
+	struct timeval start, end;
+	uint64_t events = 0;
+	uint64_t round_trips = 0;
+	double elapsed;
+	bool done = false;
+	int i;
+
+	ev = tevent_context_init_byname(NULL, backend);
+	if (ev == NULL) {
+		fprintf(stderr, "backend %s not available\n", backend);
+		return 1;
+	}
+
+	for (i = 0; i < num_conns; i++) {
+		struct tevent_req *req;
+		int sock[2];
+		int ret;
+
+		ret = socketpair(AF_UNIX, SOCK_STREAM, 0, sock);
+		if (ret == -1) {
+			perror("socketpair() failed");
+			return 1;
+		}
+
+		req = echo_send(ev, ev, sock[0], 100);
+		if (req == NULL) {
+			fprintf(stderr, "echo_send failed\n");
+			return 1;
+		}
+		req = echo_client_send(ev, ev, sock[1], 64, &round_trips);
+		if (req == NULL) {
+			fprintf(stderr, "echo_client_send failed\n");
+			return 1;
+		}
+	}
+
+	gettimeofday(&start, NULL);
+
+	if (tevent_add_timer(ev, ev, tevent_timeval_current_ofs(seconds, 0),
+			     echo_bench_done, &done) == NULL) {
+		fprintf(stderr, "tevent_add_timer failed\n");
+		return 1;
+	}
+
+	while (!done) {
+		if (tevent_loop_once(ev) != 0) {
+			perror("tevent_loop_once() failed");
+			return 1;
+		}
+		events++;
+	}
+
+	gettimeofday(&end, NULL);
+	elapsed = (end.tv_sec - start.tv_sec) +
+		(end.tv_usec - start.tv_usec) / 1000000.0;
+
+	printf("%s: %d connections, %.0f events/sec, "
+	       "%.0f round trips/sec\n",
+	       backend, num_conns, events / elapsed, round_trips / elapsed);
+
+	/* don't tear down the connections one by one */
+	return 0;
+}
+
 int main(int argc, const char **argv)
 {
 	int ret, port, listen_sock, err;
@@ -603,8 +799,14 @@ int main(int argc, const char **argv)
 	struct tevent_req *req;
 	bool result;
 
-	if (argc != 2) {
-		fprintf(stderr, "Usage: %s <port>\n", argv[0]);
+	if ((argc == 5) && (strcmp(argv[1], "-b") == 0)) {
+		return echo_bench(argv[2], atoi(argv[3]), atoi(argv[4]));
+	}
+
+	if ((argc != 2) && (argc != 3)) {
+		fprintf(stderr, "Usage: %s <port> [backend]\n"
+			"       %s -b <backend> <connections> <seconds>\n",
+			argv[0], argv[0]);
 		exit(1);
 	}
 
@@ -636,7 +838,11 @@ int main(int argc, const char **argv)
 		exit(1);
 	}
 
-	ev = tevent_context_init(NULL);
+	if (argc == 3) {
+		ev = tevent_context_init_byname(NULL, argv[2]);
+	} else {
+		ev = tevent_context_init(NULL);
+	}
 	if (ev == NULL) {
 		fprintf(stderr, "tevent_context_init failed\n");
 		exit(1);
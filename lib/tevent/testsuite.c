@@ -673,6 +673,253 @@ static bool test_event_fd2(struct torture_context *tctx,
 	return true;
 }
 
+struct test_event_fd3_state {
+	struct torture_context *tctx;
+	const char *backend;
+	struct tevent_context *ev;
+	int sock[2];
+	struct tevent_fd *fde;
+	unsigned num_calls;
+	size_t num_read;
+	bool finished;
+	const char *error;
+};
+
+static void test_event_fd3_fde_handler(struct tevent_context *ev_ctx,
+				       struct tevent_fd *fde,
+				       uint16_t flags,
+				       void *private_data)
+{
+	struct test_event_fd3_state *state =
+		(struct test_event_fd3_state *)private_data;
+	uint8_t buf[16];
+	ssize_t ret;
+
+	state->num_calls++;
+
+	if (flags != TEVENT_FD_READ) {
+		state->finished = true;
+		state->error = __location__;
+		return;
+	}
+
+	/*
+	 * read everything, as the edge triggered
+	 * backends only report new data
+	 */
+	while (true) {
+		ret = read(state->sock[0], buf, sizeof(buf));
+		if (ret <= 0) {
+			break;
+		}
+		state->num_read += ret;
+	}
+	if (ret == 0 || errno != EAGAIN) {
+		state->finished = true;
+		state->error = __location__;
+	}
+}
+
+static void test_event_fd3_finished(struct tevent_context *ev_ctx,
+				    struct tevent_timer *te,
+				    struct timeval tval,
+				    void *private_data)
+{
+	struct test_event_fd3_state *state =
+		(struct test_event_fd3_state *)private_data;
+
+	state->finished = true;
+}
+
+static bool test_event_fd3_loop(struct test_event_fd3_state *state)
+{
+	state->finished = false;
+	tevent_add_timer(state->ev, state->ev,
+			 timeval_current_ofs(0, 10000),
+			 test_event_fd3_finished, state);
+
+	while (!state->finished) {
+		if (tevent_loop_once(state->ev) == -1) {
+			return false;
+		}
+	}
+
+	return state->error == NULL;
+}
+
+static bool test_event_fd3(struct torture_context *tctx,
+			   const void *test_data)
+{
+	struct test_event_fd3_state state;
+	uint8_t buf[3] = { 0, };
+	int flags;
+
+	ZERO_STRUCT(state);
+	state.tctx = tctx;
+	state.backend = (const char *)test_data;
+
+	state.ev = tevent_context_init_byname(tctx, state.backend);
+	if (state.ev == NULL) {
+		torture_skip(tctx, talloc_asprintf(tctx,
+			     "event backend '%s' not supported\n",
+			     state.backend));
+		return true;
+	}
+
+	tevent_set_debug_stderr(state.ev);
+	torture_comment(tctx, "backend '%s' - %s\n",
+			state.backend, __FUNCTION__);
+
+	/*
+	 * This tests the following:
+	 *
+	 * - a handler that reads until EAGAIN is called
+	 *   once for the bytes written before
+	 * - it is not called again without new data
+	 * - it is called again for new data
+	 * - changing the flags does not lose data
+	 *   with the edge triggered backends
+	 */
+	state.sock[0] = -1;
+	state.sock[1] = -1;
+	socketpair(AF_UNIX, SOCK_STREAM, 0, state.sock);
+	flags = fcntl(state.sock[0], F_GETFL);
+	fcntl(state.sock[0], F_SETFL, flags | O_NONBLOCK);
+
+	state.fde = tevent_add_fd(state.ev, state.ev,
+				  state.sock[0], TEVENT_FD_READ,
+				  test_event_fd3_fde_handler, &state);
+	tevent_fd_set_auto_close(state.fde);
+
+	write(state.sock[1], buf, 3);
+	torture_assert(tctx, test_event_fd3_loop(&state),
+		       talloc_asprintf(tctx, "%s", state.error));
+	torture_assert_int_equal(tctx, state.num_calls, 1, "calls");
+	torture_assert_int_equal(tctx, state.num_read, 3, "bytes read");
+
+	torture_assert(tctx, test_event_fd3_loop(&state),
+		       talloc_asprintf(tctx, "%s", state.error));
+	torture_assert_int_equal(tctx, state.num_calls, 1, "calls");
+
+	write(state.sock[1], buf, 2);
+	torture_assert(tctx, test_event_fd3_loop(&state),
+		       talloc_asprintf(tctx, "%s", state.error));
+	torture_assert_int_equal(tctx, state.num_calls, 2, "calls");
+	torture_assert_int_equal(tctx, state.num_read, 5, "bytes read");
+
+	TEVENT_FD_NOT_READABLE(state.fde);
+	write(state.sock[1], buf, 1);
+	torture_assert(tctx, test_event_fd3_loop(&state),
+		       talloc_asprintf(tctx, "%s", state.error));
+	torture_assert_int_equal(tctx, state.num_calls, 2, "calls");
+
+	TEVENT_FD_READABLE(state.fde);
+	torture_assert(tctx, test_event_fd3_loop(&state),
+		       talloc_asprintf(tctx, "%s", state.error));
+	torture_assert_int_equal(tctx, state.num_calls, 3, "calls");
+	torture_assert_int_equal(tctx, state.num_read, 6, "bytes read");
+
+	close(state.sock[1]);
+	talloc_free(state.ev);
+
+	return true;
+}
+
+struct test_event_fd4_state {
+	struct tevent_fd *fde[2];
+	int sock[2][2];
+	unsigned num_calls;
+	bool finished;
+};
+
+static void test_event_fd4_fde_handler(struct tevent_context *ev_ctx,
+				       struct tevent_fd *fde,
+				       uint16_t flags,
+				       void *private_data)
+{
+	struct test_event_fd4_state *state =
+		(struct test_event_fd4_state *)private_data;
+	int i = (fde == state->fde[0]) ? 0 : 1;
+	uint8_t c;
+
+	state->num_calls++;
+	read(state->sock[i][0], &c, 1);
+
+	/* the other one is ready as well */
+	TALLOC_FREE(state->fde[1 - i]);
+}
+
+static void test_event_fd4_finished(struct tevent_context *ev_ctx,
+				    struct tevent_timer *te,
+				    struct timeval tval,
+				    void *private_data)
+{
+	struct test_event_fd4_state *state =
+		(struct test_event_fd4_state *)private_data;
+
+	state->finished = true;
+}
+
+static bool test_event_fd4(struct torture_context *tctx,
+			   const void *test_data)
+{
+	const char *backend = (const char *)test_data;
+	struct tevent_context *ev;
+	struct test_event_fd4_state state;
+	uint8_t c = 0;
+	int i;
+
+	ZERO_STRUCT(state);
+
+	ev = tevent_context_init_byname(tctx, backend);
+	if (ev == NULL) {
+		torture_skip(tctx, talloc_asprintf(tctx,
+			     "event backend '%s' not supported\n",
+			     backend));
+		return true;
+	}
+
+	tevent_set_debug_stderr(ev);
+	torture_comment(tctx, "backend '%s' - %s\n",
+			backend, __FUNCTION__);
+
+	/*
+	 * Two sockets are readable at the same time, the
+	 * handler of the first one frees the fd event of
+	 * the other one, which must not be called anymore.
+	 */
+	for (i = 0; i < 2; i++) {
+		socketpair(AF_UNIX, SOCK_STREAM, 0, state.sock[i]);
+		state.fde[i] = tevent_add_fd(ev, ev, state.sock[i][0],
+					     TEVENT_FD_READ,
+					     test_event_fd4_fde_handler,
+					     &state);
+		tevent_fd_set_auto_close(state.fde[i]);
+		write(state.sock[i][1], &c, 1);
+	}
+
+	tevent_add_timer(ev, ev, timeval_current_ofs(0, 10000),
+			 test_event_fd4_finished, &state);
+
+	while (!state.finished) {
+		if (tevent_loop_once(ev) == -1) {
+			talloc_free(ev);
+			torture_fail(tctx, talloc_asprintf(tctx,
+				     "Failed event loop %s\n",
+				     strerror(errno)));
+		}
+	}
+
+	talloc_free(ev);
+	for (i = 0; i < 2; i++) {
+		close(state.sock[i][1]);
+	}
+
+	torture_assert_int_equal(tctx, state.num_calls, 1, "calls");
+
+	return true;
+}
+
 #ifdef HAVE_PTHREAD
 
 static pthread_mutex_t threaded_mutex = PTHREAD_MUTEX_INITIALIZER;
@@ -926,7 +1173,16 @@ static bool test_multi_tevent_threaded(struct torture_context *test,
 	torture_assert(test, thread_counter == NUM_TEVENT_THREADS,
 		"thread_counter fail\n");
 
+	/*
+	 * Some threads may still be in tevent_thread_proxy_schedule(),
+	 * freeing the proxy has to wait for them.
+	 */
 	talloc_free(master_ev);
+
+	for (i = 0; i < NUM_TEVENT_THREADS; i++) {
+		int ret = pthread_join(thread_map[i], NULL);
+		torture_assert(test, ret == 0, "pthread_join failed");
+	}
 	return true;
 }
 
@@ -1129,6 +1385,215 @@ static bool test_multi_tevent_threaded_1(struct torture_context *test,
 	talloc_free(master_ev);
 	return true;
 }
+
+#define NUM_THREAD_POOL_THREADS 4
+#define NUM_THREAD_POOL_JOBS 200
+
+struct thread_pool_job_data {
+	pthread_t thread;
+	unsigned count;
+};
+
+/* Called in a pool thread */
+static struct tevent_req *thread_pool_job_send(TALLOC_CTX *mem_ctx,
+					       struct tevent_context *ev,
+					       void *private_data)
+{
+	struct thread_pool_job_data *data =
+		talloc_get_type_abort(private_data,
+		struct thread_pool_job_data);
+
+	data->thread = pthread_self();
+	data->count += 1;
+
+	return tevent_wakeup_send(mem_ctx, ev,
+				  tevent_timeval_current_ofs(0, 1000));
+}
+
+static int thread_pool_job_recv(struct tevent_req *req)
+{
+	if (!tevent_wakeup_recv(req)) {
+		return EIO;
+	}
+	return 0;
+}
+
+struct thread_pool_state {
+	unsigned num_done;
+	unsigned num_errors;
+	pthread_t threads[NUM_THREAD_POOL_THREADS];
+	unsigned num_threads;
+};
+
+/* Called in master thread context */
+static void thread_pool_job_done(struct tevent_req *req)
+{
+	struct thread_pool_state *state =
+		(struct thread_pool_state *)tevent_req_callback_data_void(req);
+	struct thread_pool_job_data *data = NULL;
+	unsigned i;
+	int ret;
+
+	ret = tevent_thread_pool_job_recv(req, NULL, &data);
+	TALLOC_FREE(req);
+	state->num_done++;
+
+	if ((ret != 0) || (data == NULL) || (data->count != 1)) {
+		state->num_errors++;
+		TALLOC_FREE(data);
+		return;
+	}
+
+	for (i = 0; i < state->num_threads; i++) {
+		if (pthread_equal(state->threads[i], data->thread)) {
+			break;
+		}
+	}
+	if (i == state->num_threads) {
+		if (i == NUM_THREAD_POOL_THREADS) {
+			state->num_errors++;
+		} else {
+			state->threads[state->num_threads++] = data->thread;
+		}
+	}
+	TALLOC_FREE(data);
+}
+
+static bool test_tevent_thread_pool(struct torture_context *test,
+				    const void *test_data)
+{
+	struct tevent_context *master_ev;
+	struct tevent_thread_pool *pool;
+	struct thread_pool_state state;
+	unsigned i;
+
+	talloc_disable_null_tracking();
+
+	ZERO_STRUCT(state);
+
+	master_ev = tevent_context_init(NULL);
+	if (master_ev == NULL) {
+		return false;
+	}
+	tevent_set_debug_stderr(master_ev);
+
+	pool = tevent_thread_pool_create(master_ev, master_ev, NULL,
+					 NUM_THREAD_POOL_THREADS, 2);
+	if (pool == NULL) {
+		talloc_free(master_ev);
+		torture_fail(test,
+			talloc_asprintf(test,
+				"tevent_thread_pool_create failed: %s\n",
+				strerror(errno)));
+	}
+
+	for (i = 0; i < NUM_THREAD_POOL_JOBS; i++) {
+		struct thread_pool_job_data *data;
+		struct tevent_req *req;
+
+		data = talloc_zero(NULL, struct thread_pool_job_data);
+		torture_assert(test, data != NULL, "talloc failed");
+
+		req = tevent_thread_pool_job_send(master_ev, master_ev, pool,
+						  thread_pool_job_send,
+						  thread_pool_job_recv,
+						  &data);
+		torture_assert(test, req != NULL,
+			       "tevent_thread_pool_job_send failed");
+		torture_assert(test, data == NULL, "data not moved");
+		tevent_req_set_callback(req, thread_pool_job_done, &state);
+	}
+
+	/* Ensure we don't wait more than 10 seconds. */
+	thread_counter = 0;
+	tevent_add_timer(master_ev,
+			master_ev,
+			timeval_current_ofs(10,0),
+			timeout_fn,
+			NULL);
+
+	while ((state.num_done < NUM_THREAD_POOL_JOBS) &&
+	       (thread_counter == 0)) {
+		int ret = tevent_loop_once(master_ev);
+		torture_assert(test, ret == 0, "tevent_loop_once failed");
+	}
+
+	torture_comment(test, "%u jobs done in %u threads\n",
+			state.num_done, state.num_threads);
+
+	talloc_free(pool);
+	talloc_free(master_ev);
+
+	torture_assert_int_equal(test, state.num_done, NUM_THREAD_POOL_JOBS,
+				 "jobs done");
+	torture_assert_int_equal(test, state.num_errors, 0, "job errors");
+
+	return true;
+}
+
+static bool test_tevent_thread_pool_free(struct torture_context *test,
+					 const void *test_data)
+{
+	struct tevent_context *master_ev;
+	struct tevent_thread_pool *pool;
+	struct thread_pool_state state;
+	struct tevent_req *req;
+	unsigned i;
+
+	talloc_disable_null_tracking();
+
+	ZERO_STRUCT(state);
+
+	master_ev = tevent_context_init(NULL);
+	if (master_ev == NULL) {
+		return false;
+	}
+	tevent_set_debug_stderr(master_ev);
+
+	pool = tevent_thread_pool_create(master_ev, master_ev, NULL, 2, 1);
+	if (pool == NULL) {
+		talloc_free(master_ev);
+		torture_fail(test,
+			talloc_asprintf(test,
+				"tevent_thread_pool_create failed: %s\n",
+				strerror(errno)));
+	}
+
+	/*
+	 * Free one request before its job is done and the pool
+	 * with the others still running or queued.
+	 */
+	for (i = 0; i < 10; i++) {
+		struct thread_pool_job_data *data;
+
+		data = talloc_zero(NULL, struct thread_pool_job_data);
+		torture_assert(test, data != NULL, "talloc failed");
+
+		req = tevent_thread_pool_job_send(master_ev, master_ev, pool,
+						  thread_pool_job_send,
+						  thread_pool_job_recv,
+						  &data);
+		torture_assert(test, req != NULL,
+			       "tevent_thread_pool_job_send failed");
+		tevent_req_set_callback(req, thread_pool_job_done, &state);
+		if (i == 0) {
+			TALLOC_FREE(req);
+		}
+	}
+
+	talloc_free(pool);
+
+	while (state.num_done < 9) {
+		int ret = tevent_loop_once(master_ev);
+		torture_assert(test, ret == 0, "tevent_loop_once failed");
+	}
+
+	talloc_free(master_ev);
+
+	torture_assert_int_equal(test, state.num_errors, 9, "cancelled jobs");
+
+	return true;
+}
 #endif
 
 struct torture_suite *torture_local_event(TALLOC_CTX *mem_ctx)
@@ -1142,17 +1607,32 @@ struct torture_suite *torture_local_event(TALLOC_CTX *mem_ctx)
 
 		backend_suite = torture_suite_create(mem_ctx, list[i]);
 
+		/*
+		 * the handlers of these tests only read one
+		 * byte, which an edge triggered backend only
+		 * reports once
+		 */
+		if (strcmp(list[i], "epoll_batch_et") != 0) {
+			torture_suite_add_simple_tcase_const(backend_suite,
+						       "context",
+						       test_event_context,
+						       (const void *)list[i]);
+			torture_suite_add_simple_tcase_const(backend_suite,
+						       "fd1",
+						       test_event_fd1,
+						       (const void *)list[i]);
+		}
 		torture_suite_add_simple_tcase_const(backend_suite,
-					       "context",
-					       test_event_context,
+					       "fd2",
+					       test_event_fd2,
 					       (const void *)list[i]);
 		torture_suite_add_simple_tcase_const(backend_suite,
-					       "fd1",
-					       test_event_fd1,
+					       "fd3",
+					       test_event_fd3,
 					       (const void *)list[i]);
 		torture_suite_add_simple_tcase_const(backend_suite,
-					       "fd2",
-					       test_event_fd2,
+					       "fd4",
+					       test_event_fd4,
 					       (const void *)list[i]);
 
 		torture_suite_add_suite(suite, backend_suite);
@@ -1171,6 +1651,14 @@ struct torture_suite *torture_local_event(TALLOC_CTX *mem_ctx)
 					     test_multi_tevent_threaded_1,
 					     NULL);
 
+	torture_suite_add_simple_tcase_const(suite, "tevent_thread_pool",
+					     test_tevent_thread_pool,
+					     NULL);
+
+	torture_suite_add_simple_tcase_const(suite, "tevent_thread_pool_free",
+					     test_tevent_thread_pool_free,
+					     NULL);
+
 #endif
 
 	return suite;
@@ -40,6 +40,7 @@ struct tevent_timer;
 struct tevent_immediate;
 struct tevent_signal;
 struct tevent_thread_proxy;
+struct tevent_thread_pool;
 
 /**
  * @defgroup tevent The tevent API
@@ -1735,6 +1736,12 @@ struct tevent_thread_proxy *tevent_thread_proxy_create(
  * needed (a pure callback). This is an asynchronous request, caller
  * does not wait for callback to be completed before returning.
  *
+ * Freeing the proxy waits for the threads that are already in this
+ * function. Calls made while it is being freed are ignored, *pp_im
+ * and *pp_private_data then stay with the caller. A thread must not
+ * call this function once the proxy memory is gone, callers have to
+ * make sure their threads stop scheduling before that.
+ *
  * @param[in]  tp               The tevent_thread_proxy to use.
  *
  * @param[in]  pp_im            Pointer to immediate event pointer.
@@ -1750,6 +1757,121 @@ void tevent_thread_proxy_schedule(struct tevent_thread_proxy *tp,
 				  tevent_immediate_handler_t handler,
 				  void *pp_private_data);
 
+/**
+ * @brief Start a job in the event context of a pool thread.
+ *
+ * @param[in]  mem_ctx  The memory context of the request, owned by
+ *                      the pool thread.
+ *
+ * @param[in]  ev       The event context of the pool thread.
+ *
+ * @param[in]  private_data The private data given to
+ *                      tevent_thread_pool_job_send().
+ *
+ * @return              The request for the job, NULL on error.
+ */
+typedef struct tevent_req *(*tevent_thread_pool_job_send_fn)(
+		TALLOC_CTX *mem_ctx,
+		struct tevent_context *ev,
+		void *private_data);
+
+/**
+ * @brief Receive the result of a job, in the pool thread.
+ *
+ * @param[in]  req      The request returned by the send function.
+ *
+ * @return              0 on success, an errno value otherwise.
+ */
+typedef int (*tevent_thread_pool_job_recv_fn)(struct tevent_req *req);
+
+/**
+ * @brief Create a pool of threads each running a tevent_context.
+ *
+ * Each thread runs its own event context of the given backend.
+ * Jobs submitted with tevent_thread_pool_job_send() are started
+ * in one of them and run there until their request is done,
+ * with up to max_jobs of them in flight per thread. Jobs
+ * waiting for a busy thread are taken over by idle ones.
+ *
+ * As for tevent_thread_proxy_create(), talloc_disable_null_tracking()
+ * must have been called.
+ *
+ * @param[in]  mem_ctx      The memory context for the pool.
+ *
+ * @param[in]  ev           The event context receiving the results.
+ *
+ * @param[in]  backend      The backend of the threads' contexts,
+ *                          NULL for the default one.
+ *
+ * @param[in]  num_threads  The number of threads.
+ *
+ * @param[in]  max_jobs     The number of jobs a thread runs at a time.
+ *
+ * @return              The pool, NULL on error with errno set.
+ *                      If tevent was compiled without PTHREAD support
+ *                      NULL is always returned and errno set to ENOSYS.
+ *
+ * @see tevent_thread_pool_job_send()
+ */
+struct tevent_thread_pool *tevent_thread_pool_create(TALLOC_CTX *mem_ctx,
+						     struct tevent_context *ev,
+						     const char *backend,
+						     unsigned num_threads,
+						     unsigned max_jobs);
+
+/**
+ * @brief Run a job in a thread of a pool.
+ *
+ * *pp_private_data must be NULL or a talloced area of memory with no
+ * destructors, its ownership is transferred to the job and
+ * *pp_private_data set to NULL. The job only runs with it, and
+ * tevent_thread_pool_job_recv() hands it back.
+ *
+ * A job can't be cancelled, freeing the request only discards its
+ * result. Freeing the pool fails the outstanding requests with
+ * ECANCELED.
+ *
+ * @param[in]  mem_ctx      The memory context for the request.
+ *
+ * @param[in]  ev           The event context the pool was created with.
+ *
+ * @param[in]  pool         The pool to run the job in.
+ *
+ * @param[in]  send_fn      The function starting the job.
+ *
+ * @param[in]  recv_fn      The function receiving its result.
+ *
+ * @param[in]  pp_private_data Pointer to the talloced data to transfer.
+ *
+ * @return              A tevent_req, NULL on error.
+ *
+ * @see tevent_thread_pool_job_recv()
+ */
+struct tevent_req *tevent_thread_pool_job_send(
+		TALLOC_CTX *mem_ctx,
+		struct tevent_context *ev,
+		struct tevent_thread_pool *pool,
+		tevent_thread_pool_job_send_fn send_fn,
+		tevent_thread_pool_job_recv_fn recv_fn,
+		void *pp_private_data);
+
+/**
+ * @brief Receive the result of a job.
+ *
+ * @param[in]  req      The request of tevent_thread_pool_job_send().
+ *
+ * @param[in]  mem_ctx  The memory context to move the private data to.
+ *
+ * @param[out] pp_private_data Where to store the private data,
+ *                      can be NULL.
+ *
+ * @return              0 on success, the error of the job or the pool
+ *                      otherwise.
+ */
+int tevent_thread_pool_job_recv(struct tevent_req *req,
+				TALLOC_CTX *mem_ctx,
+				void *pp_private_data);
+
 #ifdef TEVENT_DEPRECATED
 #ifndef _DEPRECATED_
 #ifdef HAVE___ATTRIBUTE__
@@ -32,6 +32,12 @@
 #include "tevent_internal.h"
 #include "tevent_util.h"
 
+/*
+  the number of events the epoll_batch backends take from the kernel
+  with one epoll_wait()
+*/
+#define EPOLL_BATCH_MAXEVENTS 64
+
 struct epoll_event_context {
 	/* a pointer back to the generic event_context */
 	struct tevent_context *ev;
@@ -44,12 +50,28 @@ struct epoll_event_context {
 	bool panic_force_replay;
 	bool *panic_state;
 	bool (*panic_fallback)(struct tevent_context *ev, bool replay);
+
+	/*
+	 * The epoll_batch backends keep all the events of one
+	 * epoll_wait() and hand them out one per loop. Changes of the
+	 * fd flags are only passed to the kernel right before the
+	 * next epoll_wait().
+	 */
+	bool batch;
+	/* epoll_batch_et, the handlers have to read/write until EAGAIN */
+	bool edge_triggered;
+	struct epoll_event events[EPOLL_BATCH_MAXEVENTS];
+	int num_events;
+	int next_event;
+	struct tevent_fd **changed_fdes;
+	size_t num_changed_fdes;
 };
 
 #define EPOLL_ADDITIONAL_FD_FLAG_HAS_EVENT	(1<<0)
 #define EPOLL_ADDITIONAL_FD_FLAG_REPORT_ERROR	(1<<1)
 #define EPOLL_ADDITIONAL_FD_FLAG_GOT_ERROR	(1<<2)
 #define EPOLL_ADDITIONAL_FD_FLAG_HAS_MPX	(1<<3)
+#define EPOLL_ADDITIONAL_FD_FLAG_CHANGED	(1<<4)
 
 #ifdef TEST_PANIC_FALLBACK
 
@@ -222,6 +244,7 @@ static void epoll_update_event(struct epoll_event_context *epoll_ev, struct teve
 static void epoll_check_reopen(struct epoll_event_context *epoll_ev)
 {
 	struct tevent_fd *fde;
+	size_t i;
 	bool *caller_panic_state = epoll_ev->panic_state;
 	bool panic_triggered = false;
 
@@ -242,6 +265,21 @@ static void epoll_check_reopen(struct epoll_event_context *epoll_ev)
 	}
 
 	epoll_ev->pid = getpid();
+
+	/*
+	 * The events are from the old epoll handle and all fd events
+	 * are added to the new one below.
+	 */
+	epoll_ev->num_events = 0;
+	epoll_ev->next_event = 0;
+	for (i = 0; i < epoll_ev->num_changed_fdes; i++) {
+		fde = epoll_ev->changed_fdes[i];
+		if (fde != NULL) {
+			fde->additional_flags &= ~EPOLL_ADDITIONAL_FD_FLAG_CHANGED;
+		}
+	}
+	epoll_ev->num_changed_fdes = 0;
+
 	epoll_ev->panic_state = &panic_triggered;
 	for (fde=epoll_ev->ev->fd_events;fde;fde=fde->next) {
 		fde->additional_flags &= ~EPOLL_ADDITIONAL_FD_FLAG_HAS_EVENT;
@@ -315,6 +353,9 @@ static int epoll_add_multiplex_fd(struct epoll_event_context *epoll_ev,
 	ZERO_STRUCT(event);
 	event.events = epoll_map_flags(mpx_fde->flags);
 	event.events |= epoll_map_flags(add_fde->flags);
+	if (epoll_ev->edge_triggered) {
+		event.events |= EPOLLET;
+	}
 	event.data.ptr = mpx_fde;
 	ret = epoll_ctl(epoll_ev->epoll_fd, EPOLL_CTL_MOD, mpx_fde->fd, &event);
 	if (ret != 0 && errno == EBADF) {
@@ -379,6 +420,9 @@ static void epoll_add_event(struct epoll_event_context *epoll_ev, struct tevent_
 	if (mpx_fde != NULL) {
 		event.events |= epoll_map_flags(mpx_fde->flags);
 	}
+	if (epoll_ev->edge_triggered) {
+		event.events |= EPOLLET;
+	}
 	event.data.ptr = fde;
 	ret = epoll_ctl(epoll_ev->epoll_fd, EPOLL_CTL_ADD, fde->fd, &event);
 	if (ret != 0 && errno == EBADF) {
@@ -503,6 +547,9 @@ static void epoll_mod_event(struct epoll_event_context *epoll_ev, struct tevent_
 	if (mpx_fde != NULL) {
 		event.events |= epoll_map_flags(mpx_fde->flags);
 	}
+	if (epoll_ev->edge_triggered) {
+		event.events |= EPOLLET;
+	}
 	event.data.ptr = fde;
 	ret = epoll_ctl(epoll_ev->epoll_fd, EPOLL_CTL_MOD, fde->fd, &event);
 	if (ret != 0 && errno == EBADF) {
@@ -585,6 +632,72 @@ static void epoll_update_event(struct epoll_event_context *epoll_ev, struct teve
 	}
 }
 
+/*
+  the flags of the fde changed. The epoll_batch backends remember the
+  fde and only update the epoll event in epoll_flush_changes(), so
+  several changes before the next epoll_wait() cost a single
+  epoll_ctl().
+*/
+static void epoll_change_event(struct epoll_event_context *epoll_ev,
+			       struct tevent_fd *fde)
+{
+	struct tevent_fd **changed_fdes = epoll_ev->changed_fdes;
+	size_t num = epoll_ev->num_changed_fdes;
+
+	if (!epoll_ev->batch) {
+		epoll_update_event(epoll_ev, fde);
+		return;
+	}
+
+	if (fde->additional_flags & EPOLL_ADDITIONAL_FD_FLAG_CHANGED) {
+		return;
+	}
+
+	if (num == talloc_array_length(changed_fdes)) {
+		changed_fdes = talloc_realloc(epoll_ev, changed_fdes,
+					      struct tevent_fd *,
+					      MAX(num * 2, 16));
+		if (changed_fdes == NULL) {
+			/* then do it right away */
+			epoll_update_event(epoll_ev, fde);
+			return;
+		}
+		epoll_ev->changed_fdes = changed_fdes;
+	}
+
+	changed_fdes[num] = fde;
+	epoll_ev->num_changed_fdes = num + 1;
+	fde->additional_flags |= EPOLL_ADDITIONAL_FD_FLAG_CHANGED;
+}
+
+/*
+  pass the changes remembered by epoll_change_event() to the kernel
+*/
+static void epoll_flush_changes(struct epoll_event_context *epoll_ev,
+				bool *panic_triggered)
+{
+	size_t i;
+
+	for (i = 0; i < epoll_ev->num_changed_fdes; i++) {
+		struct tevent_fd *fde = epoll_ev->changed_fdes[i];
+
+		if (fde == NULL) {
+			/* freed in the meantime */
+			continue;
+		}
+		fde->additional_flags &= ~EPOLL_ADDITIONAL_FD_FLAG_CHANGED;
+		if (fde->event_ctx == NULL) {
+			continue;
+		}
+
+		epoll_update_event(epoll_ev, fde);
+		if (*panic_triggered) {
+			return;
+		}
+	}
+	epoll_ev->num_changed_fdes = 0;
+}
+
 /*
   Cope with epoll returning EPOLLHUP|EPOLLERR on an event.
   Return true if there's nothing else to do, false if
@@ -622,12 +735,16 @@ static bool epoll_handle_hup_or_err(struct epoll_event_context *epoll_ev,
 */
 static int epoll_event_loop(struct epoll_event_context *epoll_ev, struct timeval *tvalp)
 {
-	int ret, i;
-#define MAXEVENTS 1
-	struct epoll_event events[MAXEVENTS];
+	int ret;
+	int maxevents = epoll_ev->batch ? EPOLL_BATCH_MAXEVENTS : 1;
 	int timeout = -1;
 	int wait_errno;
 
+	if (epoll_ev->next_event < epoll_ev->num_events) {
+		/* there are still events from the last epoll_wait() */
+		goto dispatch;
+	}
+
 	if (tvalp) {
 		/* it's better to trigger timed events a bit later than too early */
 		timeout = ((tvalp->tv_usec+999) / 1000) + (tvalp->tv_sec*1000);
@@ -639,7 +756,7 @@ static int epoll_event_loop(struct epoll_event_context *epoll_ev, struct timeval
 	}
 
 	tevent_trace_point_callback(epoll_ev->ev, TEVENT_TRACE_BEFORE_WAIT);
-	ret = epoll_wait(epoll_ev->epoll_fd, events, MAXEVENTS, timeout);
+	ret = epoll_wait(epoll_ev->epoll_fd, epoll_ev->events, maxevents, timeout);
 	wait_errno = errno;
 	tevent_trace_point_callback(epoll_ev->ev, TEVENT_TRACE_AFTER_WAIT);
 
@@ -660,12 +777,23 @@ static int epoll_event_loop(struct epoll_event_context *epoll_ev, struct timeval
 		return 0;
 	}
 
-	for (i=0;i<ret;i++) {
-		struct tevent_fd *fde = talloc_get_type(events[i].data.ptr,
-						       struct tevent_fd);
+	epoll_ev->num_events = MAX(ret, 0);
+	epoll_ev->next_event = 0;
+
+dispatch:
+	while (epoll_ev->next_event < epoll_ev->num_events) {
+		struct epoll_event *event =
+			&epoll_ev->events[epoll_ev->next_event++];
+		struct tevent_fd *fde;
 		uint16_t flags = 0;
 		struct tevent_fd *mpx_fde = NULL;
 
+		if (event->data.ptr == NULL) {
+			/* the fde was freed after epoll_wait() */
+			continue;
+		}
+
+		fde = talloc_get_type(event->data.ptr, struct tevent_fd);
 		if (fde == NULL) {
 			epoll_panic(epoll_ev, "epoll_wait() gave bad data", true);
 			return -1;
@@ -678,12 +806,19 @@ static int epoll_event_loop(struct epoll_event_context *epoll_ev, struct timeval
 			mpx_fde = talloc_get_type_abort(fde->additional_data,
 							struct tevent_fd);
 		}
-		if (events[i].events & (EPOLLHUP|EPOLLERR)) {
+		if (event->events & (EPOLLHUP|EPOLLERR)) {
 			bool handled_fde = epoll_handle_hup_or_err(epoll_ev, fde);
 			bool handled_mpx = epoll_handle_hup_or_err(epoll_ev, mpx_fde);
 
 			if (handled_fde && handled_mpx) {
-				epoll_update_event(epoll_ev, fde);
+				bool panic_triggered = false;
+
+				epoll_ev->panic_state = &panic_triggered;
+				epoll_change_event(epoll_ev, fde);
+				if (panic_triggered) {
+					return 0;
+				}
+				epoll_ev->panic_state = NULL;
 				continue;
 			}
 
@@ -698,8 +833,8 @@ static int epoll_event_loop(struct epoll_event_context *epoll_ev, struct timeval
 			}
 			flags |= TEVENT_FD_READ;
 		}
-		if (events[i].events & EPOLLIN) flags |= TEVENT_FD_READ;
-		if (events[i].events & EPOLLOUT) flags |= TEVENT_FD_WRITE;
+		if (event->events & EPOLLIN) flags |= TEVENT_FD_READ;
+		if (event->events & EPOLLOUT) flags |= TEVENT_FD_WRITE;
 
 		if (flags & TEVENT_FD_WRITE) {
 			if (fde->flags & TEVENT_FD_WRITE) {
@@ -726,7 +861,7 @@ static int epoll_event_loop(struct epoll_event_context *epoll_ev, struct timeval
 		flags &= fde->flags;
 		if (flags) {
 			fde->handler(epoll_ev->ev, fde, flags, fde->private_data);
-			break;
+			return 0;
 		}
 	}
 
@@ -762,6 +897,45 @@ static int epoll_event_context_init(struct tevent_context *ev)
 	return 0;
 }
 
+/*
+  create a epoll_event_context structure for the epoll_batch backend
+*/
+static int epoll_batch_event_context_init(struct tevent_context *ev)
+{
+	struct epoll_event_context *epoll_ev;
+	int ret;
+
+	ret = epoll_event_context_init(ev);
+	if (ret != 0) {
+		return ret;
+	}
+
+	epoll_ev = talloc_get_type_abort(ev->additional_data,
+					 struct epoll_event_context);
+	epoll_ev->batch = true;
+	return 0;
+}
+
+/*
+  create a epoll_event_context structure for the epoll_batch_et
+  backend
+*/
+static int epoll_batch_et_event_context_init(struct tevent_context *ev)
+{
+	struct epoll_event_context *epoll_ev;
+	int ret;
+
+	ret = epoll_batch_event_context_init(ev);
+	if (ret != 0) {
+		return ret;
+	}
+
+	epoll_ev = talloc_get_type_abort(ev->additional_data,
+					 struct epoll_event_context);
+	epoll_ev->edge_triggered = true;
+	return 0;
+}
+
 /*
   destroy an fd_event
 */
@@ -772,6 +946,7 @@ static int epoll_event_fd_destructor(struct tevent_fd *fde)
 	bool panic_triggered = false;
 	struct tevent_fd *mpx_fde = NULL;
 	int flags = fde->flags;
+	size_t i;
 
 	if (ev == NULL) {
 		return tevent_common_fd_destructor(fde);
@@ -800,6 +975,25 @@ static int epoll_event_fd_destructor(struct tevent_fd *fde)
 		fde->additional_flags &= ~EPOLL_ADDITIONAL_FD_FLAG_HAS_EVENT;
 	}
 
+	/*
+	 * forget about the fde in the pending changes and the events
+	 * not handled yet. Events for the multiplexed fde are passed on
+	 * to it.
+	 */
+	if (fde->additional_flags & EPOLL_ADDITIONAL_FD_FLAG_CHANGED) {
+		fde->additional_flags &= ~EPOLL_ADDITIONAL_FD_FLAG_CHANGED;
+		for (i = 0; i < epoll_ev->num_changed_fdes; i++) {
+			if (epoll_ev->changed_fdes[i] == fde) {
+				epoll_ev->changed_fdes[i] = NULL;
+			}
+		}
+	}
+	for (i = epoll_ev->next_event; i < epoll_ev->num_events; i++) {
+		if (epoll_ev->events[i].data.ptr == fde) {
+			epoll_ev->events[i].data.ptr = mpx_fde;
+		}
+	}
+
 	epoll_ev->panic_state = &panic_triggered;
 	epoll_check_reopen(epoll_ev);
 	if (panic_triggered) {
@@ -855,7 +1049,7 @@ static struct tevent_fd *epoll_event_add_fd(struct tevent_context *ev, TALLOC_CT
 	}
 	epoll_ev->panic_state = NULL;
 
-	epoll_update_event(epoll_ev, fde);
+	epoll_change_event(epoll_ev, fde);
 
 	return fde;
 }
@@ -884,7 +1078,7 @@ static void epoll_event_set_fd_flags(struct tevent_fd *fde, uint16_t flags)
 	}
 	epoll_ev->panic_state = NULL;
 
-	epoll_update_event(epoll_ev, fde);
+	epoll_change_event(epoll_ev, fde);
 }
 
 /*
@@ -920,6 +1114,14 @@ static int epoll_event_loop_once(struct tevent_context *ev, const char *location
 		errno = EINVAL;
 		return -1;
 	}
+	if (epoll_ev->next_event >= epoll_ev->num_events) {
+		/* the kernel needs to know before epoll_wait() */
+		epoll_flush_changes(epoll_ev, &panic_triggered);
+		if (panic_triggered) {
+			errno = EINVAL;
+			return -1;
+		}
+	}
 	epoll_ev->panic_force_replay = false;
 	epoll_ev->panic_state = NULL;
 
@@ -939,7 +1141,40 @@ static const struct tevent_ops epoll_event_ops = {
 	.loop_wait		= tevent_common_loop_wait,
 };
 
+static const struct tevent_ops epoll_batch_event_ops = {
+	.context_init		= epoll_batch_event_context_init,
+	.add_fd			= epoll_event_add_fd,
+	.set_fd_close_fn	= tevent_common_fd_set_close_fn,
+	.get_fd_flags		= tevent_common_fd_get_flags,
+	.set_fd_flags		= epoll_event_set_fd_flags,
+	.add_timer		= tevent_common_add_timer_v2,
+	.schedule_immediate	= tevent_common_schedule_immediate,
+	.add_signal		= tevent_common_add_signal,
+	.loop_once		= epoll_event_loop_once,
+	.loop_wait		= tevent_common_loop_wait,
+};
+
+static const struct tevent_ops epoll_batch_et_event_ops = {
+	.context_init		= epoll_batch_et_event_context_init,
+	.add_fd			= epoll_event_add_fd,
+	.set_fd_close_fn	= tevent_common_fd_set_close_fn,
+	.get_fd_flags		= tevent_common_fd_get_flags,
+	.set_fd_flags		= epoll_event_set_fd_flags,
+	.add_timer		= tevent_common_add_timer_v2,
+	.schedule_immediate	= tevent_common_schedule_immediate,
+	.add_signal		= tevent_common_add_signal,
+	.loop_once		= epoll_event_loop_once,
+	.loop_wait		= tevent_common_loop_wait,
+};
+
 _PRIVATE_ bool tevent_epoll_init(void)
 {
-	return tevent_register_backend("epoll", &epoll_event_ops);
+	if (!tevent_register_backend("epoll", &epoll_event_ops)) {
+		return false;
+	}
+	if (!tevent_register_backend("epoll_batch", &epoll_batch_event_ops)) {
+		return false;
+	}
+	return tevent_register_backend("epoll_batch_et",
+				       &epoll_batch_et_event_ops);
 }
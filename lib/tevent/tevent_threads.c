@@ -30,6 +30,7 @@
 
 #if defined(HAVE_PTHREAD)
 #include <pthread.h>
+#include <sched.h>
 
 struct tevent_immediate_list {
 	struct tevent_immediate_list *next, *prev;
@@ -39,12 +40,25 @@ struct tevent_immediate_list {
 };
 
 struct tevent_thread_proxy {
+	/*
+	 * Only protects im_list, num_senders and destroying
+	 * without atomic builtins.
+	 */
 	pthread_mutex_t mutex;
+	/*
+	 * Threads in tevent_thread_proxy_schedule(), the destructor
+	 * waits for them before it closes the pipe.
+	 */
+	unsigned num_senders;
+	bool destroying;
 	struct tevent_context *dest_ev_ctx;
 	int read_fd;
 	int write_fd;
 	struct tevent_fd *pipe_read_fde;
-	/* Pending events list. */
+	/*
+	 * Pending events list, added to by any thread.
+	 * Newest first and only linked by next.
+	 */
 	struct tevent_immediate_list *im_list;
 	/* Completed events list. */
 	struct tevent_immediate_list *tofree_im_list;
@@ -63,12 +77,94 @@ static void free_im_list(struct tevent_immediate_list **pp_list_head)
 	}
 }
 
-static void free_list_handler(struct tevent_context *ev,
-				struct tevent_immediate *im,
-				void *private_ptr)
+/*
+ * Add an entry to the pending list, called by any thread.
+ * Returns true if the list was empty before, only then
+ * dest_ev_ctx needs to be woken up.
+ */
+
+static bool im_list_push(struct tevent_thread_proxy *tp,
+			 struct tevent_immediate_list *im_entry)
 {
-	struct tevent_thread_proxy *tp =
-		talloc_get_type_abort(private_ptr, struct tevent_thread_proxy);
+	struct tevent_immediate_list *head;
+#if defined(HAVE___ATOMIC_COMPARE_EXCHANGE_N)
+	head = __atomic_load_n(&tp->im_list, __ATOMIC_RELAXED);
+	do {
+		im_entry->next = head;
+	} while (!__atomic_compare_exchange_n(&tp->im_list,
+					      &head,
+					      im_entry,
+					      true,
+					      __ATOMIC_RELEASE,
+					      __ATOMIC_RELAXED));
+#else
+	int ret;
+
+	ret = pthread_mutex_lock(&tp->mutex);
+	if (ret != 0) {
+		abort();
+		/* Notreached. */
+		return false;
+	}
+
+	head = tp->im_list;
+	im_entry->next = head;
+	tp->im_list = im_entry;
+
+	ret = pthread_mutex_unlock(&tp->mutex);
+	if (ret != 0) {
+		abort();
+		/* Notreached. */
+		return false;
+	}
+#endif
+	return (head == NULL);
+}
+
+/*
+ * Called by any thread before it touches the pending list or the
+ * pipe. Returns false once the proxy is being destroyed.
+ */
+
+static bool proxy_sender_enter(struct tevent_thread_proxy *tp)
+{
+	bool destroying;
+#if defined(HAVE___ATOMIC_COMPARE_EXCHANGE_N)
+	__atomic_add_fetch(&tp->num_senders, 1, __ATOMIC_SEQ_CST);
+	destroying = __atomic_load_n(&tp->destroying, __ATOMIC_SEQ_CST);
+	if (destroying) {
+		__atomic_sub_fetch(&tp->num_senders, 1, __ATOMIC_SEQ_CST);
+	}
+#else
+	int ret;
+
+	ret = pthread_mutex_lock(&tp->mutex);
+	if (ret != 0) {
+		abort();
+		/* Notreached. */
+		return false;
+	}
+
+	destroying = tp->destroying;
+	if (!destroying) {
+		tp->num_senders += 1;
+	}
+
+	ret = pthread_mutex_unlock(&tp->mutex);
+	if (ret != 0) {
+		abort();
+		/* Notreached. */
+		return false;
+	}
+#endif
+	return !destroying;
+}
+
+static void proxy_sender_leave(struct tevent_thread_proxy *tp)
+{
+#if defined(HAVE___ATOMIC_COMPARE_EXCHANGE_N)
+	__atomic_sub_fetch(&tp->num_senders, 1, __ATOMIC_SEQ_CST);
+#else
 	int ret;
 
 	ret = pthread_mutex_lock(&tp->mutex);
@@ -78,7 +174,7 @@ static void free_list_handler(struct tevent_context *ev,
 		return;
 	}
 
-	free_im_list(&tp->tofree_im_list);
+	tp->num_senders -= 1;
 
 	ret = pthread_mutex_unlock(&tp->mutex);
 	if (ret != 0) {
@@ -86,6 +182,110 @@ static void free_list_handler(struct tevent_context *ev,
 		/* Notreached. */
 		return;
 	}
+#endif
+}
+
+/*
+ * Called by the destructor, new senders ignore the proxy from now
+ * on. Waits for the ones already in tevent_thread_proxy_schedule().
+ */
+
+static void proxy_wait_for_senders(struct tevent_thread_proxy *tp)
+{
+	unsigned num_senders;
+#if defined(HAVE___ATOMIC_COMPARE_EXCHANGE_N)
+	__atomic_store_n(&tp->destroying, true, __ATOMIC_SEQ_CST);
+
+	while ((num_senders = __atomic_load_n(&tp->num_senders,
+					      __ATOMIC_SEQ_CST)) != 0) {
+		sched_yield();
+	}
+#else
+	int ret;
+
+	ret = pthread_mutex_lock(&tp->mutex);
+	if (ret != 0) {
+		abort();
+		/* Notreached. */
+		return;
+	}
+	tp->destroying = true;
+
+	while (true) {
+		num_senders = tp->num_senders;
+
+		ret = pthread_mutex_unlock(&tp->mutex);
+		if (ret != 0) {
+			abort();
+			/* Notreached. */
+			return;
+		}
+		if (num_senders == 0) {
+			break;
+		}
+
+		sched_yield();
+
+		ret = pthread_mutex_lock(&tp->mutex);
+		if (ret != 0) {
+			abort();
+			/* Notreached. */
+			return;
+		}
+	}
+#endif
+}
+
+/*
+ * Take all pending entries, called by the thread of
+ * dest_ev_ctx. They are returned oldest first.
+ */
+
+static struct tevent_immediate_list *im_list_take(
+		struct tevent_thread_proxy *tp)
+{
+	struct tevent_immediate_list *list;
+	struct tevent_immediate_list *fifo = NULL;
+#if defined(HAVE___ATOMIC_COMPARE_EXCHANGE_N)
+	list = __atomic_exchange_n(&tp->im_list, NULL, __ATOMIC_ACQUIRE);
+#else
+	int ret;
+
+	ret = pthread_mutex_lock(&tp->mutex);
+	if (ret != 0) {
+		abort();
+		/* Notreached. */
+		return NULL;
+	}
+
+	list = tp->im_list;
+	tp->im_list = NULL;
+
+	ret = pthread_mutex_unlock(&tp->mutex);
+	if (ret != 0) {
+		abort();
+		/* Notreached. */
+		return NULL;
+	}
+#endif
+	while (list != NULL) {
+		struct tevent_immediate_list *next = list->next;
+
+		list->next = fifo;
+		fifo = list;
+		list = next;
+	}
+	return fifo;
+}
+
+static void free_list_handler(struct tevent_context *ev,
+				struct tevent_immediate *im,
+				void *private_ptr)
+{
+	struct tevent_thread_proxy *tp =
+		talloc_get_type_abort(private_ptr, struct tevent_thread_proxy);
+
+	free_im_list(&tp->tofree_im_list);
 }
 
 static void schedule_immediate_functions(struct tevent_thread_proxy *tp)
@@ -93,9 +293,9 @@ static void schedule_immediate_functions(struct tevent_thread_proxy *tp)
 	struct tevent_immediate_list *im_entry = NULL;
 	struct tevent_immediate_list *im_next = NULL;
 
-	for (im_entry = tp->im_list; im_entry; im_entry = im_next) {
+	for (im_entry = im_list_take(tp); im_entry; im_entry = im_next) {
 		im_next = im_entry->next;
-		DLIST_REMOVE(tp->im_list, im_entry);
+		im_entry->next = NULL;
 
 		tevent_schedule_immediate(im_entry->im,
 					tp->dest_ev_ctx,
@@ -129,18 +329,13 @@ static void pipe_read_handler(struct tevent_context *ev,
 	struct tevent_thread_proxy *tp =
 		talloc_get_type_abort(private_ptr, struct tevent_thread_proxy);
 	ssize_t len = 64;
-	int ret;
-
-	ret = pthread_mutex_lock(&tp->mutex);
-	if (ret != 0) {
-		abort();
-		/* Notreached. */
-		return;
-	}
 
 	/*
 	 * Clear out all data in the pipe. We
 	 * don't really care if this returns -1.
+	 * This has to happen before taking the
+	 * list, a sender finding it empty after
+	 * that writes again.
 	 */
 	while (len == 64) {
 		char buf[64];
@@ -148,25 +343,14 @@ static void pipe_read_handler(struct tevent_context *ev,
 	};
 
 	schedule_immediate_functions(tp);
-
-	ret = pthread_mutex_unlock(&tp->mutex);
-	if (ret != 0) {
-		abort();
-		/* Notreached. */
-		return;
-	}
 }
 
 static int tevent_thread_proxy_destructor(struct tevent_thread_proxy *tp)
 {
+	struct tevent_immediate_list *im_list;
 	int ret;
 
-	ret = pthread_mutex_lock(&tp->mutex);
-	if (ret != 0) {
-		abort();
-		/* Notreached. */
-		return 0;
-	}
+	proxy_wait_for_senders(tp);
 
 	TALLOC_FREE(tp->pipe_read_fde);
 
@@ -182,18 +366,16 @@ static int tevent_thread_proxy_destructor(struct tevent_thread_proxy *tp)
 	/* Hmmm. It's probably an error if we get here with
 	   any non-NULL immediate entries.. */
 
-	free_im_list(&tp->im_list);
+	im_list = im_list_take(tp);
+	while (im_list != NULL) {
+		struct tevent_immediate_list *next = im_list->next;
+		TALLOC_FREE(im_list);
+		im_list = next;
+	}
 	free_im_list(&tp->tofree_im_list);
 
 	TALLOC_FREE(tp->free_im);
 
-	ret = pthread_mutex_unlock(&tp->mutex);
-	if (ret != 0) {
-		abort();
-		/* Notreached. */
-		return 0;
-	}
-
 	ret = pthread_mutex_destroy(&tp->mutex);
 	if (ret != 0) {
 		abort();
@@ -288,6 +470,13 @@ struct tevent_thread_proxy *tevent_thread_proxy_create(
  * *pp_private in the thread context of dest_ev_ctx. Caller doesn't
  * wait for activation to take place, this is simply fire-and-forget.
  *
+ * No lock is taken and the pipe is only written to when
+ * the pending list was empty. Freeing the proxy waits for
+ * the threads already in here, calls after that are ignored.
+ * The memory of the proxy must still be valid for them, so
+ * callers have to stop their senders before the proxy is
+ * freed and reused.
+ *
  * pp_im must be a pointer to an immediate event talloced on
  * a context owned by the calling thread, or the NULL context.
  * Ownership of *pp_im will be transfered to the tevent library.
@@ -308,25 +497,18 @@ void tevent_thread_proxy_schedule(struct tevent_thread_proxy *tp,
 				  void *pp_private_data)
 {
 	struct tevent_immediate_list *im_entry;
-	int ret;
 	char c;
 
-	ret = pthread_mutex_lock(&tp->mutex);
-	if (ret != 0) {
-		abort();
-		/* Notreached. */
-		return;
-	}
-
-	if (tp->write_fd == -1) {
+	if (!proxy_sender_enter(tp)) {
 		/* In the process of being destroyed. Ignore. */
-		goto end;
+		return;
 	}
 
 	/* Create a new immediate_list entry. MUST BE ON THE NULL CONTEXT */
 	im_entry = talloc_zero(NULL, struct tevent_immediate_list);
 	if (im_entry == NULL) {
-		goto end;
+		proxy_sender_leave(tp);
+		return;
 	}
 
 	im_entry->handler = handler;
@@ -337,20 +519,693 @@ void tevent_thread_proxy_schedule(struct tevent_thread_proxy *tp,
 		im_entry->private_ptr = talloc_move(im_entry, pptr);
 	}
 
-	DLIST_ADD(tp->im_list, im_entry);
+	if (im_list_push(tp, im_entry)) {
+		/* And notify the dest_ev_ctx to wake up. */
+		c = '\0';
+		(void)write(tp->write_fd, &c, 1);
+	}
 
-	/* And notify the dest_ev_ctx to wake up. */
-	c = '\0';
-	(void)write(tp->write_fd, &c, 1);
+	proxy_sender_leave(tp);
+}
 
-  end:
+/*
+ * A pool of threads, each running its own tevent context.
+ *
+ * Jobs are tevent_req based: they are started in the event
+ * context of a worker thread and run there until their
+ * request is done, so a thread can have several of them
+ * in flight. Each worker has its own queue of jobs waiting
+ * to be started. A worker takes the oldest job of its own
+ * queue, and if that is empty steals the newest from the
+ * others. The result goes back to the event context that
+ * owns the pool through a tevent_thread_proxy.
+ */
 
-	ret = pthread_mutex_unlock(&tp->mutex);
+struct tevent_thread_pool_job_state;
+
+struct tevent_thread_pool_job {
+	/* Linked into the queue or the running list of a worker. */
+	struct tevent_thread_pool_job *prev, *next;
+	struct tevent_thread_pool *pool;
+	tevent_thread_pool_job_send_fn send_fn;
+	tevent_thread_pool_job_recv_fn recv_fn;
+	/* Owned by the job while it runs. */
+	void *private_data;
+	int ret;
+
+	/* Only used by the worker thread that runs the job. */
+	struct tevent_thread_pool_worker *worker;
+	TALLOC_CTX *mem_ctx;
+	struct tevent_immediate *im;
+
+	/* Only used by the thread of pool->ev. */
+	struct tevent_thread_pool_job_state *state;
+};
+
+struct tevent_thread_pool_worker {
+	struct tevent_thread_pool *pool;
+	pthread_t thread;
+	bool started;
+
+	/* Protects jobs, idle and shutdown. */
+	pthread_mutex_t mutex;
+	struct tevent_thread_pool_job *jobs;
+	/* Waiting for an event, able to start another job. */
+	bool idle;
+	bool shutdown;
+
+	/* Allocated on the NULL context, used by the worker. */
+	struct tevent_context *ev;
+	struct tevent_thread_proxy *proxy;
+	struct tevent_thread_pool_job *running;
+	unsigned num_running;
+};
+
+struct tevent_thread_pool {
+	struct tevent_context *ev;
+	struct tevent_thread_proxy *proxy;
+
+	struct tevent_thread_pool_worker *workers;
+	unsigned num_workers;
+	unsigned max_jobs;
+	unsigned next_worker;
+
+	/*
+	 * Counts the jobs queued, under the mutex. A worker
+	 * looking for work only goes idle if nothing was queued
+	 * since it started to look.
+	 */
+	pthread_mutex_t mutex;
+	uint64_t num_queued;
+
+	/* Requests waiting for their job. */
+	struct tevent_thread_pool_job_state *states;
+};
+
+static void tevent_thread_pool_lock(pthread_mutex_t *mutex)
+{
+	int ret;
+
+	ret = pthread_mutex_lock(mutex);
 	if (ret != 0) {
 		abort();
-		/* Notreached. */
 	}
 }
+
+static void tevent_thread_pool_unlock(pthread_mutex_t *mutex)
+{
+	int ret;
+
+	ret = pthread_mutex_unlock(mutex);
+	if (ret != 0) {
+		abort();
+	}
+}
+
+static uint64_t tevent_thread_pool_num_queued(struct tevent_thread_pool *pool)
+{
+	uint64_t num_queued;
+
+	tevent_thread_pool_lock(&pool->mutex);
+	num_queued = pool->num_queued;
+	tevent_thread_pool_unlock(&pool->mutex);
+
+	return num_queued;
+}
+
+/*
+ * Only there to make tevent_loop_once() of a worker return.
+ */
+
+static void tevent_thread_pool_wakeup_handler(struct tevent_context *ev,
+					      struct tevent_immediate *im,
+					      void *private_ptr)
+{
+	return;
+}
+
+static void tevent_thread_pool_wakeup(struct tevent_thread_pool_worker *w)
+{
+	struct tevent_immediate *im;
+
+	im = tevent_create_immediate(NULL);
+	if (im == NULL) {
+		/* It will find the job once it is woken up otherwise. */
+		return;
+	}
+	tevent_thread_proxy_schedule(w->proxy, &im,
+				     tevent_thread_pool_wakeup_handler,
+				     NULL);
+}
+
+/*
+ * Find a job for worker w: the oldest one of its own queue,
+ * otherwise the newest one of another worker.
+ */
+
+static struct tevent_thread_pool_job *tevent_thread_pool_get_job(
+		struct tevent_thread_pool_worker *w)
+{
+	struct tevent_thread_pool *pool = w->pool;
+	struct tevent_thread_pool_job *job;
+	uint64_t num_queued;
+	unsigned i;
+
+	while (true) {
+		num_queued = tevent_thread_pool_num_queued(pool);
+
+		tevent_thread_pool_lock(&w->mutex);
+		job = w->jobs;
+		if (job != NULL) {
+			DLIST_REMOVE(w->jobs, job);
+		}
+		tevent_thread_pool_unlock(&w->mutex);
+
+		if (job != NULL) {
+			return job;
+		}
+
+		for (i = 1; i < pool->num_workers; i++) {
+			struct tevent_thread_pool_worker *victim;
+
+			victim = &pool->workers[
+				(w - pool->workers + i) % pool->num_workers];
+
+			tevent_thread_pool_lock(&victim->mutex);
+			job = DLIST_TAIL(victim->jobs);
+			if (job != NULL) {
+				DLIST_REMOVE(victim->jobs, job);
+			}
+			tevent_thread_pool_unlock(&victim->mutex);
+
+			if (job != NULL) {
+				return job;
+			}
+		}
+
+		tevent_thread_pool_lock(&w->mutex);
+		if ((w->jobs == NULL) &&
+		    (tevent_thread_pool_num_queued(pool) == num_queued)) {
+			w->idle = true;
+			tevent_thread_pool_unlock(&w->mutex);
+			return NULL;
+		}
+		tevent_thread_pool_unlock(&w->mutex);
+	}
+}
+
+static void tevent_thread_pool_job_done(struct tevent_req *subreq);
+static void tevent_thread_pool_job_finished(
+		struct tevent_thread_pool_job *job);
+static void tevent_thread_pool_job_reply(struct tevent_context *ev,
+					 struct tevent_immediate *im,
+					 void *private_ptr);
+
+/*
+ * Start jobs until the worker runs max_jobs of them
+ * or there are none left.
+ */
+
+static void tevent_thread_pool_start_jobs(struct tevent_thread_pool_worker *w)
+{
+	struct tevent_thread_pool *pool = w->pool;
+
+	while (w->num_running < pool->max_jobs) {
+		struct tevent_thread_pool_job *job;
+		struct tevent_req *subreq;
+
+		job = tevent_thread_pool_get_job(w);
+		if (job == NULL) {
+			return;
+		}
+
+		job->worker = w;
+		DLIST_ADD(w->running, job);
+		w->num_running += 1;
+
+		job->mem_ctx = talloc_new(w->ev);
+		if (job->mem_ctx == NULL) {
+			job->ret = ENOMEM;
+			tevent_thread_pool_job_finished(job);
+			continue;
+		}
+
+		subreq = job->send_fn(job->mem_ctx, w->ev, job->private_data);
+		if (subreq == NULL) {
+			job->ret = ENOMEM;
+			tevent_thread_pool_job_finished(job);
+			continue;
+		}
+		tevent_req_set_callback(subreq, tevent_thread_pool_job_done,
+					job);
+	}
+}
+
+static void tevent_thread_pool_job_done(struct tevent_req *subreq)
+{
+	struct tevent_thread_pool_job *job =
+		tevent_req_callback_data(subreq,
+		struct tevent_thread_pool_job);
+
+	job->ret = job->recv_fn(subreq);
+	tevent_thread_pool_job_finished(job);
+}
+
+/*
+ * Called in the worker thread, hands the job back to the
+ * thread of pool->ev.
+ */
+
+static void tevent_thread_pool_job_finished(struct tevent_thread_pool_job *job)
+{
+	struct tevent_thread_pool_worker *w = job->worker;
+
+	TALLOC_FREE(job->mem_ctx);
+
+	DLIST_REMOVE(w->running, job);
+	w->num_running -= 1;
+
+	tevent_thread_proxy_schedule(job->pool->proxy, &job->im,
+				     tevent_thread_pool_job_reply, &job);
+}
+
+static void *tevent_thread_pool_worker_main(void *private_ptr)
+{
+	struct tevent_thread_pool_worker *w =
+		(struct tevent_thread_pool_worker *)private_ptr;
+	bool shutdown;
+	int ret;
+
+	while (true) {
+		tevent_thread_pool_start_jobs(w);
+
+		tevent_thread_pool_lock(&w->mutex);
+		shutdown = w->shutdown;
+		tevent_thread_pool_unlock(&w->mutex);
+
+		if (shutdown) {
+			break;
+		}
+
+		ret = tevent_loop_once(w->ev);
+		if (ret != 0) {
+			abort();
+		}
+
+		tevent_thread_pool_lock(&w->mutex);
+		w->idle = false;
+		tevent_thread_pool_unlock(&w->mutex);
+	}
+
+	return NULL;
+}
+
+struct tevent_thread_pool_job_state {
+	struct tevent_thread_pool_job_state *prev, *next;
+	struct tevent_req *req;
+	struct tevent_thread_pool *pool;
+	struct tevent_thread_pool_job *job;
+	void *private_data;
+};
+
+static void tevent_thread_pool_free_jobs(struct tevent_thread_pool_job **jobs)
+{
+	struct tevent_thread_pool_job *job = NULL;
+	struct tevent_thread_pool_job *next = NULL;
+
+	for (job = *jobs; job != NULL; job = next) {
+		next = job->next;
+		DLIST_REMOVE(*jobs, job);
+		TALLOC_FREE(job);
+	}
+}
+
+static int tevent_thread_pool_destructor(struct tevent_thread_pool *pool)
+{
+	struct tevent_thread_pool_job_state *state = NULL;
+	struct tevent_thread_pool_job_state *next = NULL;
+	unsigned i;
+	int ret;
+
+	for (i = 0; i < pool->num_workers; i++) {
+		struct tevent_thread_pool_worker *w = &pool->workers[i];
+
+		if (!w->started) {
+			continue;
+		}
+		tevent_thread_pool_lock(&w->mutex);
+		w->shutdown = true;
+		tevent_thread_pool_unlock(&w->mutex);
+		tevent_thread_pool_wakeup(w);
+	}
+
+	for (i = 0; i < pool->num_workers; i++) {
+		struct tevent_thread_pool_worker *w = &pool->workers[i];
+
+		if (!w->started) {
+			continue;
+		}
+		ret = pthread_join(w->thread, NULL);
+		if (ret != 0) {
+			abort();
+		}
+	}
+
+	/* Nobody steals from the others anymore. */
+	for (i = 0; i < pool->num_workers; i++) {
+		struct tevent_thread_pool_worker *w = &pool->workers[i];
+
+		/*
+		 * The event context goes first: the requests of the
+		 * running jobs live below it and have the job as
+		 * their callback data.
+		 */
+		TALLOC_FREE(w->ev);
+		tevent_thread_pool_free_jobs(&w->jobs);
+		tevent_thread_pool_free_jobs(&w->running);
+		pthread_mutex_destroy(&w->mutex);
+	}
+
+	/*
+	 * Jobs waiting in pool->proxy are freed with it, the
+	 * requests waiting for any of them fail.
+	 */
+	TALLOC_FREE(pool->proxy);
+
+	for (state = pool->states; state != NULL; state = next) {
+		next = state->next;
+		DLIST_REMOVE(pool->states, state);
+		state->pool = NULL;
+		state->job = NULL;
+		tevent_req_defer_callback(state->req, pool->ev);
+		tevent_req_error(state->req, ECANCELED);
+	}
+
+	pthread_mutex_destroy(&pool->mutex);
+	return 0;
+}
+
+/*
+ * Create a pool of num_threads threads, each running its own
+ * event context of the given backend. Each one runs up to
+ * max_jobs jobs at a time.
+ */
+
+struct tevent_thread_pool *tevent_thread_pool_create(TALLOC_CTX *mem_ctx,
+						     struct tevent_context *ev,
+						     const char *backend,
+						     unsigned num_threads,
+						     unsigned max_jobs)
+{
+	struct tevent_thread_pool *pool;
+	unsigned i;
+	int ret;
+
+	if ((num_threads == 0) || (max_jobs == 0)) {
+		errno = EINVAL;
+		return NULL;
+	}
+
+	pool = talloc_zero(mem_ctx, struct tevent_thread_pool);
+	if (pool == NULL) {
+		errno = ENOMEM;
+		return NULL;
+	}
+	pool->ev = ev;
+	pool->max_jobs = max_jobs;
+
+	ret = pthread_mutex_init(&pool->mutex, NULL);
+	if (ret != 0) {
+		TALLOC_FREE(pool);
+		errno = ret;
+		return NULL;
+	}
+
+	pool->workers = talloc_zero_array(pool,
+					  struct tevent_thread_pool_worker,
+					  num_threads);
+	if (pool->workers == NULL) {
+		pthread_mutex_destroy(&pool->mutex);
+		TALLOC_FREE(pool);
+		errno = ENOMEM;
+		return NULL;
+	}
+
+	talloc_set_destructor(pool, tevent_thread_pool_destructor);
+
+	pool->proxy = tevent_thread_proxy_create(ev);
+	if (pool->proxy == NULL) {
+		goto fail;
+	}
+
+	for (i = 0; i < num_threads; i++) {
+		struct tevent_thread_pool_worker *w = &pool->workers[i];
+
+		ret = pthread_mutex_init(&w->mutex, NULL);
+		if (ret != 0) {
+			errno = ret;
+			goto fail;
+		}
+		w->pool = pool;
+		pool->num_workers += 1;
+
+		/*
+		 * The worker thread allocates below its event
+		 * context, it must not share a parent with anything
+		 * used by other threads.
+		 */
+		if (backend != NULL) {
+			w->ev = tevent_context_init_byname(NULL, backend);
+		} else {
+			w->ev = tevent_context_init(NULL);
+		}
+		if (w->ev == NULL) {
+			errno = ENOMEM;
+			goto fail;
+		}
+		w->proxy = tevent_thread_proxy_create(w->ev);
+		if (w->proxy == NULL) {
+			goto fail;
+		}
+	}
+
+	for (i = 0; i < num_threads; i++) {
+		struct tevent_thread_pool_worker *w = &pool->workers[i];
+
+		ret = pthread_create(&w->thread, NULL,
+				     tevent_thread_pool_worker_main, w);
+		if (ret != 0) {
+			errno = ret;
+			goto fail;
+		}
+		w->started = true;
+	}
+
+	return pool;
+
+  fail:
+
+	ret = errno;
+	TALLOC_FREE(pool);
+	errno = ret;
+	return NULL;
+}
+
+static int tevent_thread_pool_job_state_destructor(
+		struct tevent_thread_pool_job_state *state)
+{
+	if (state->job != NULL) {
+		/* It runs to the end, but nobody is interested anymore. */
+		state->job->state = NULL;
+		state->job = NULL;
+	}
+	if (state->pool != NULL) {
+		DLIST_REMOVE(state->pool->states, state);
+		state->pool = NULL;
+	}
+	return 0;
+}
+
+/*
+ * Called in the thread of pool->ev with a finished job,
+ * the job is freed by the proxy afterwards.
+ */
+
+static void tevent_thread_pool_job_reply(struct tevent_context *ev,
+					 struct tevent_immediate *im,
+					 void *private_ptr)
+{
+	struct tevent_thread_pool_job *job =
+		talloc_get_type_abort(private_ptr,
+		struct tevent_thread_pool_job);
+	struct tevent_thread_pool_job_state *state = job->state;
+
+	if (state == NULL) {
+		return;
+	}
+
+	DLIST_REMOVE(state->pool->states, state);
+	state->pool = NULL;
+	state->job = NULL;
+	job->state = NULL;
+
+	state->private_data = talloc_move(state, &job->private_data);
+
+	if (job->ret != 0) {
+		tevent_req_error(state->req, job->ret);
+		return;
+	}
+	tevent_req_done(state->req);
+}
+
+struct tevent_req *tevent_thread_pool_job_send(
+		TALLOC_CTX *mem_ctx,
+		struct tevent_context *ev,
+		struct tevent_thread_pool *pool,
+		tevent_thread_pool_job_send_fn send_fn,
+		tevent_thread_pool_job_recv_fn recv_fn,
+		void *pp_private_data)
+{
+	struct tevent_req *req;
+	struct tevent_thread_pool_job_state *state;
+	struct tevent_thread_pool_job *job;
+	struct tevent_thread_pool_worker *w = NULL;
+	struct tevent_thread_pool_worker *thief = NULL;
+	unsigned i;
+
+	req = tevent_req_create(mem_ctx, &state,
+				struct tevent_thread_pool_job_state);
+	if (req == NULL) {
+		return NULL;
+	}
+	state->req = req;
+
+	if (ev != pool->ev) {
+		tevent_req_error(req, EINVAL);
+		return tevent_req_post(req, ev);
+	}
+
+	/* Passed to other threads, MUST BE ON THE NULL CONTEXT */
+	job = talloc_zero(NULL, struct tevent_thread_pool_job);
+	if (tevent_req_nomem(job, req)) {
+		return tevent_req_post(req, ev);
+	}
+	job->pool = pool;
+	job->send_fn = send_fn;
+	job->recv_fn = recv_fn;
+
+	job->im = tevent_create_immediate(job);
+	if (tevent_req_nomem(job->im, req)) {
+		TALLOC_FREE(job);
+		return tevent_req_post(req, ev);
+	}
+
+	if (pp_private_data != NULL) {
+		void **pptr = (void **)pp_private_data;
+		job->private_data = talloc_move(job, pptr);
+	}
+
+	job->state = state;
+	state->job = job;
+	state->pool = pool;
+	DLIST_ADD_END(pool->states, state);
+	talloc_set_destructor(state, tevent_thread_pool_job_state_destructor);
+
+	/*
+	 * Give the job to an idle worker if there is one, otherwise
+	 * queue it round robin for somebody to take or steal.
+	 */
+	for (i = 0; i < pool->num_workers; i++) {
+		struct tevent_thread_pool_worker *cand;
+		bool found;
+
+		cand = &pool->workers[(pool->next_worker + i) %
+				      pool->num_workers];
+
+		tevent_thread_pool_lock(&cand->mutex);
+		found = cand->idle;
+		if (found) {
+			DLIST_ADD_END(cand->jobs, job);
+			cand->idle = false;
+		}
+		tevent_thread_pool_unlock(&cand->mutex);
+
+		if (found) {
+			w = cand;
+			break;
+		}
+	}
+
+	if (w != NULL) {
+		pool->next_worker = (w - pool->workers + 1) % pool->num_workers;
+
+		tevent_thread_pool_lock(&pool->mutex);
+		pool->num_queued += 1;
+		tevent_thread_pool_unlock(&pool->mutex);
+
+		tevent_thread_pool_wakeup(w);
+		return req;
+	}
+
+	w = &pool->workers[pool->next_worker];
+	pool->next_worker = (pool->next_worker + 1) % pool->num_workers;
+
+	tevent_thread_pool_lock(&w->mutex);
+	DLIST_ADD_END(w->jobs, job);
+	tevent_thread_pool_unlock(&w->mutex);
+
+	tevent_thread_pool_lock(&pool->mutex);
+	pool->num_queued += 1;
+	tevent_thread_pool_unlock(&pool->mutex);
+
+	/*
+	 * A worker that went idle since we looked might have
+	 * missed the job, but then we see it idle now. Anybody
+	 * still looking sees the changed num_queued.
+	 */
+	for (i = 0; i < pool->num_workers; i++) {
+		struct tevent_thread_pool_worker *cand = &pool->workers[i];
+
+		tevent_thread_pool_lock(&cand->mutex);
+		if (cand->idle) {
+			cand->idle = false;
+			thief = cand;
+		}
+		tevent_thread_pool_unlock(&cand->mutex);
+
+		if (thief != NULL) {
+			tevent_thread_pool_wakeup(thief);
+			break;
+		}
+	}
+
+	return req;
+}
+
+int tevent_thread_pool_job_recv(struct tevent_req *req,
+				TALLOC_CTX *mem_ctx,
+				void *pp_private_data)
+{
+	struct tevent_thread_pool_job_state *state =
+		tevent_req_data(req, struct tevent_thread_pool_job_state);
+	enum tevent_req_state req_state;
+	uint64_t err;
+
+	if (tevent_req_is_error(req, &req_state, &err)) {
+		tevent_req_received(req);
+		if (req_state == TEVENT_REQ_NO_MEMORY) {
+			return ENOMEM;
+		}
+		return (int)err;
+	}
+
+	if (pp_private_data != NULL) {
+		void **pptr = (void **)pp_private_data;
+		*pptr = talloc_move(mem_ctx, &state->private_data);
+	}
+	tevent_req_received(req);
+	return 0;
+}
 #else
 /* !HAVE_PTHREAD */
 struct tevent_thread_proxy *tevent_thread_proxy_create(
@@ -367,4 +1222,41 @@ void tevent_thread_proxy_schedule(struct tevent_thread_proxy *tp,
 {
 	;
 }
+
+struct tevent_thread_pool *tevent_thread_pool_create(TALLOC_CTX *mem_ctx,
+						     struct tevent_context *ev,
+						     const char *backend,
+						     unsigned num_threads,
+						     unsigned max_jobs)
+{
+	errno = ENOSYS;
+	return NULL;
+}
+
+struct tevent_req *tevent_thread_pool_job_send(
+		TALLOC_CTX *mem_ctx,
+		struct tevent_context *ev,
+		struct tevent_thread_pool *pool,
+		tevent_thread_pool_job_send_fn send_fn,
+		tevent_thread_pool_job_recv_fn recv_fn,
+		void *pp_private_data)
+{
+	struct tevent_req *req;
+	int *state;
+
+	req = tevent_req_create(mem_ctx, &state, int);
+	if (req == NULL) {
+		return NULL;
+	}
+	tevent_req_error(req, ENOSYS);
+	return tevent_req_post(req, ev);
+}
+
+int tevent_thread_pool_job_recv(struct tevent_req *req,
+				TALLOC_CTX *mem_ctx,
+				void *pp_private_data)
+{
+	tevent_req_received(req);
+	return ENOSYS;
+}
 #endif
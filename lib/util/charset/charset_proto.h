@@ -33,4 +33,21 @@ size_t macosxfs_encoding_push(
 	const char **inbuf, size_t *inbytesleft, /* UTF-16-LE string */
 	char **outbuf, size_t *outbytesleft);	/* Script string */
 
+/*
+ * The following functions are in charset_simd.c. They convert the
+ * leading pure ASCII part of a buffer and return the number of
+ * characters they converted, which may be 0. The 8 bit source
+ * versions also stop at a zero byte, so the callers' string
+ * termination logic stays where it is.
+ */
+size_t charset_ascii_run_len(const uint8_t *s, size_t len);
+size_t charset_ascii_to_utf16le(const uint8_t *s, size_t len, uint8_t *d);
+size_t charset_utf16le_to_ascii(const uint8_t *s, size_t num_units,
+				uint8_t *d);
 
+/*
+ * Only meant for tests and benchmarks: switch between the vector and
+ * the scalar implementation, and report which one is in use.
+ */
+void charset_simd_set_enabled(bool enabled);
+const char *charset_simd_impl(void);
@@ -0,0 +1,365 @@
+/*
+   Unix SMB/CIFS implementation.
+
+   Bulk conversion of pure ASCII runs between 8 bit charsets and UTF-16LE
+
+   Copyright (C) Samba Team 2026
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "replace.h"
+#include "charset_proto.h"
+
+/*
+ * All charsets Samba supports as unix or dos charset are supersets of
+ * ASCII, and most file names are pure ASCII. These helpers find and
+ * convert the leading ASCII run of a buffer 16 or 32 characters at a
+ * time, the callers fall back to their per character code for the
+ * rest.
+ *
+ * The SSE2 and AVX2 versions are compiled with target attributes and
+ * selected at runtime, the scalar version works on 64 bit words. The
+ * AVX2 versions clear the upper register halves themselves before
+ * returning, the compiler doesn't always do it for target attribute
+ * functions and the callers are full of SSE code (memcpy, strlen).
+ */
+
+#ifdef HAVE_CHARSET_SIMD_INTRINSICS
+#include <immintrin.h>
+
+#define SSE2_TARGET __attribute__((target("sse2")))
+#define AVX2_TARGET __attribute__((target("avx2")))
+#endif
+
+enum charset_simd_level {
+	CHARSET_SIMD_UNKNOWN = -1,
+	CHARSET_SIMD_NONE = 0,
+	CHARSET_SIMD_SSE2,
+	CHARSET_SIMD_AVX2,
+};
+
+static int simd_cpu = CHARSET_SIMD_UNKNOWN;
+static bool simd_enabled = true;
+
+static enum charset_simd_level charset_simd_level(void)
+{
+	if (unlikely(simd_cpu == CHARSET_SIMD_UNKNOWN)) {
+		int level = CHARSET_SIMD_NONE;
+#ifdef HAVE_CHARSET_SIMD_INTRINSICS
+		__builtin_cpu_init();
+		if (__builtin_cpu_supports("avx2")) {
+			level = CHARSET_SIMD_AVX2;
+		} else if (__builtin_cpu_supports("sse2")) {
+			level = CHARSET_SIMD_SSE2;
+		}
+#endif
+		simd_cpu = level;
+	}
+	if (!simd_enabled) {
+		return CHARSET_SIMD_NONE;
+	}
+	return simd_cpu;
+}
+
+_PUBLIC_ void charset_simd_set_enabled(bool enabled)
+{
+	simd_enabled = enabled;
+}
+
+_PUBLIC_ const char *charset_simd_impl(void)
+{
+	switch (charset_simd_level()) {
+	case CHARSET_SIMD_AVX2:
+		return "avx2";
+	case CHARSET_SIMD_SSE2:
+		return "sse2";
+	default:
+		break;
+	}
+	return "scalar";
+}
+
+#define ONES_64 0x0101010101010101ULL
+#define HIGHS_64 0x8080808080808080ULL
+
+/*
+ * Bytes 0x01-0x7f, a word at a time: a byte is bad if its top bit is
+ * set or if it is zero.
+ */
+static size_t ascii_run_len_scalar(const uint8_t *s, size_t len)
+{
+	size_t i = 0;
+
+	for (; i + 8 <= len; i += 8) {
+		uint64_t v;
+
+		memcpy(&v, s + i, sizeof(v));
+		if (((v | ((v - ONES_64) & ~v)) & HIGHS_64) != 0) {
+			break;
+		}
+	}
+	for (; i < len; i++) {
+		if ((s[i] == 0) || (s[i] & 0x80)) {
+			break;
+		}
+	}
+	return i;
+}
+
+static size_t ascii_to_utf16le_scalar(const uint8_t *s, size_t len,
+				      uint8_t *d)
+{
+	size_t n = ascii_run_len_scalar(s, len);
+	size_t i;
+
+	for (i = 0; i < n; i++) {
+		d[2*i] = s[i];
+		d[2*i+1] = 0;
+	}
+	return n;
+}
+
+static size_t utf16le_to_ascii_scalar(const uint8_t *s, size_t num_units,
+				      uint8_t *d)
+{
+	/*
+	 * Byte wise so it doesn't depend on the host byte order: the
+	 * low byte of each unit must be < 0x80, the high byte zero.
+	 */
+	static const uint8_t nonascii_bytes[8] = {
+		0x80, 0xff, 0x80, 0xff, 0x80, 0xff, 0x80, 0xff
+	};
+	uint64_t nonascii;
+	size_t i = 0;
+
+	memcpy(&nonascii, nonascii_bytes, sizeof(nonascii));
+
+	for (; i + 4 <= num_units; i += 4) {
+		uint64_t v;
+
+		memcpy(&v, s + 2*i, sizeof(v));
+		if ((v & nonascii) != 0) {
+			break;
+		}
+		d[i] = s[2*i];
+		d[i+1] = s[2*i+2];
+		d[i+2] = s[2*i+4];
+		d[i+3] = s[2*i+6];
+	}
+	for (; i < num_units; i++) {
+		if ((s[2*i+1] != 0) || (s[2*i] & 0x80)) {
+			break;
+		}
+		d[i] = s[2*i];
+	}
+	return i;
+}
+
+#ifdef HAVE_CHARSET_SIMD_INTRINSICS
+
+SSE2_TARGET
+static inline int ascii_bad_mask_sse2(__m128i v)
+{
+	__m128i zeros = _mm_cmpeq_epi8(v, _mm_setzero_si128());
+	return _mm_movemask_epi8(_mm_or_si128(v, zeros));
+}
+
+SSE2_TARGET
+static size_t ascii_run_len_sse2(const uint8_t *s, size_t len)
+{
+	size_t i = 0;
+
+	for (; i + 16 <= len; i += 16) {
+		__m128i v = _mm_loadu_si128((const __m128i *)(s + i));
+		int bad = ascii_bad_mask_sse2(v);
+
+		if (bad != 0) {
+			return i + __builtin_ctz(bad);
+		}
+	}
+	return i + ascii_run_len_scalar(s + i, len - i);
+}
+
+SSE2_TARGET
+static size_t ascii_to_utf16le_sse2(const uint8_t *s, size_t len, uint8_t *d)
+{
+	const __m128i zero = _mm_setzero_si128();
+	size_t i = 0;
+
+	for (; i + 16 <= len; i += 16) {
+		__m128i v = _mm_loadu_si128((const __m128i *)(s + i));
+
+		if (ascii_bad_mask_sse2(v) != 0) {
+			break;
+		}
+		_mm_storeu_si128((__m128i *)(d + 2*i),
+				 _mm_unpacklo_epi8(v, zero));
+		_mm_storeu_si128((__m128i *)(d + 2*i + 16),
+				 _mm_unpackhi_epi8(v, zero));
+	}
+	return i + ascii_to_utf16le_scalar(s + i, len - i, d + 2*i);
+}
+
+SSE2_TARGET
+static size_t utf16le_to_ascii_sse2(const uint8_t *s, size_t num_units,
+				    uint8_t *d)
+{
+	const __m128i nonascii = _mm_set1_epi16((short)0xff80);
+	const __m128i zero = _mm_setzero_si128();
+	size_t i = 0;
+
+	for (; i + 16 <= num_units; i += 16) {
+		__m128i a = _mm_loadu_si128((const __m128i *)(s + 2*i));
+		__m128i b = _mm_loadu_si128((const __m128i *)(s + 2*i + 16));
+		__m128i t = _mm_and_si128(_mm_or_si128(a, b), nonascii);
+
+		if (_mm_movemask_epi8(_mm_cmpeq_epi16(t, zero)) != 0xffff) {
+			break;
+		}
+		_mm_storeu_si128((__m128i *)(d + i), _mm_packus_epi16(a, b));
+	}
+	return i + utf16le_to_ascii_scalar(s + 2*i, num_units - i, d + i);
+}
+
+AVX2_TARGET
+static inline uint32_t ascii_bad_mask_avx2(__m256i v)
+{
+	__m256i zeros = _mm256_cmpeq_epi8(v, _mm256_setzero_si256());
+	return (uint32_t)_mm256_movemask_epi8(_mm256_or_si256(v, zeros));
+}
+
+AVX2_TARGET
+static size_t ascii_run_len_avx2(const uint8_t *s, size_t len)
+{
+	size_t i = 0;
+
+	for (; i + 32 <= len; i += 32) {
+		__m256i v = _mm256_loadu_si256((const __m256i *)(s + i));
+		uint32_t bad = ascii_bad_mask_avx2(v);
+
+		if (bad != 0) {
+			_mm256_zeroupper();
+			return i + __builtin_ctz(bad);
+		}
+	}
+	_mm256_zeroupper();
+	return i + ascii_run_len_scalar(s + i, len - i);
+}
+
+AVX2_TARGET
+static size_t ascii_to_utf16le_avx2(const uint8_t *s, size_t len, uint8_t *d)
+{
+	size_t i = 0;
+
+	for (; i + 32 <= len; i += 32) {
+		__m256i v = _mm256_loadu_si256((const __m256i *)(s + i));
+
+		if (ascii_bad_mask_avx2(v) != 0) {
+			break;
+		}
+		_mm256_storeu_si256((__m256i *)(d + 2*i),
+			_mm256_cvtepu8_epi16(_mm256_castsi256_si128(v)));
+		_mm256_storeu_si256((__m256i *)(d + 2*i + 32),
+			_mm256_cvtepu8_epi16(_mm256_extracti128_si256(v, 1)));
+	}
+	_mm256_zeroupper();
+	return i + ascii_to_utf16le_scalar(s + i, len - i, d + 2*i);
+}
+
+AVX2_TARGET
+static size_t utf16le_to_ascii_avx2(const uint8_t *s, size_t num_units,
+				    uint8_t *d)
+{
+	const __m256i nonascii = _mm256_set1_epi16((short)0xff80);
+	size_t i = 0;
+
+	for (; i + 32 <= num_units; i += 32) {
+		__m256i a = _mm256_loadu_si256((const __m256i *)(s + 2*i));
+		__m256i b = _mm256_loadu_si256((const __m256i *)(s + 2*i + 32));
+		__m256i t = _mm256_and_si256(_mm256_or_si256(a, b), nonascii);
+		__m256i packed;
+
+		if (!_mm256_testz_si256(t, t)) {
+			break;
+		}
+		/* packus works per 128 bit lane, put the quads back in order */
+		packed = _mm256_packus_epi16(a, b);
+		packed = _mm256_permute4x64_epi64(packed, 0xd8);
+		_mm256_storeu_si256((__m256i *)(d + i), packed);
+	}
+	_mm256_zeroupper();
+	return i + utf16le_to_ascii_scalar(s + 2*i, num_units - i, d + i);
+}
+
+#endif /* HAVE_CHARSET_SIMD_INTRINSICS */
+
+/*
+ * The vector versions only pay off for longer runs, short names go
+ * straight to the scalar code.
+ */
+#define CHARSET_SIMD_MIN_LEN 16
+
+_PUBLIC_ size_t charset_ascii_run_len(const uint8_t *s, size_t len)
+{
+#ifdef HAVE_CHARSET_SIMD_INTRINSICS
+	if (len >= CHARSET_SIMD_MIN_LEN) {
+		switch (charset_simd_level()) {
+		case CHARSET_SIMD_AVX2:
+			return ascii_run_len_avx2(s, len);
+		case CHARSET_SIMD_SSE2:
+			return ascii_run_len_sse2(s, len);
+		default:
+			break;
+		}
+	}
+#endif
+	return ascii_run_len_scalar(s, len);
+}
+
+_PUBLIC_ size_t charset_ascii_to_utf16le(const uint8_t *s, size_t len,
+					 uint8_t *d)
+{
+#ifdef HAVE_CHARSET_SIMD_INTRINSICS
+	if (len >= CHARSET_SIMD_MIN_LEN) {
+		switch (charset_simd_level()) {
+		case CHARSET_SIMD_AVX2:
+			return ascii_to_utf16le_avx2(s, len, d);
+		case CHARSET_SIMD_SSE2:
+			return ascii_to_utf16le_sse2(s, len, d);
+		default:
+			break;
+		}
+	}
+#endif
+	return ascii_to_utf16le_scalar(s, len, d);
+}
+
+_PUBLIC_ size_t charset_utf16le_to_ascii(const uint8_t *s, size_t num_units,
+					 uint8_t *d)
+{
+#ifdef HAVE_CHARSET_SIMD_INTRINSICS
+	if (num_units >= CHARSET_SIMD_MIN_LEN) {
+		switch (charset_simd_level()) {
+		case CHARSET_SIMD_AVX2:
+			return utf16le_to_ascii_avx2(s, num_units, d);
+		case CHARSET_SIMD_SSE2:
+			return utf16le_to_ascii_sse2(s, num_units, d);
+		default:
+			break;
+		}
+	}
+#endif
+	return utf16le_to_ascii_scalar(s, num_units, d);
+}
@@ -23,6 +23,7 @@
 */
 #include "includes.h"
 #include "system/iconv.h"
+#include "charset_proto.h"
 
 /**
  * @file
@@ -138,6 +139,29 @@ bool convert_string_error_handle(struct smb_iconv_handle *ic,
 		size_t dlen = destlen;
 		unsigned char lastp = '\0';
 		size_t retval = 0;
+		size_t n;
+
+		/*
+		 * Copy the leading ASCII run in bulk. It stops before a
+		 * terminating zero, the loop below handles that.
+		 */
+		if (slen != (size_t)-1) {
+			n = MIN(slen, dlen);
+		} else {
+			n = strnlen((const char *)p, dlen);
+		}
+		n = charset_ascii_run_len(p, n);
+		memmove(q, p, n);
+		if (n > 0) {
+			lastp = p[n - 1];
+		}
+		p += n;
+		q += n;
+		if (slen != (size_t)-1) {
+			slen -= n;
+		}
+		dlen -= n;
+		retval += n;
 
 		/* If all characters are ascii, fast path here. */
 		while (slen && dlen) {
@@ -195,6 +219,15 @@ bool convert_string_error_handle(struct smb_iconv_handle *ic,
 			}
 			if (lastp != 0) goto slow_path;
 		} else {
+			size_t n = charset_utf16le_to_ascii(p,
+						MIN(slen / 2, dlen), q);
+
+			p += 2 * n;
+			q += n;
+			slen -= 2 * n;
+			dlen -= n;
+			retval += n;
+
 			while (slen >= 2 && dlen &&
 			       (*p <= 0x7f) && (p[1] == 0)) {
 				*q++ = *p;
@@ -237,6 +270,25 @@ bool convert_string_error_handle(struct smb_iconv_handle *ic,
 		size_t slen = srclen;
 		size_t dlen = destlen;
 		unsigned char lastp = '\0';
+		size_t n;
+
+		/* Widen the leading ASCII run in bulk, see above */
+		if (slen != (size_t)-1) {
+			n = MIN(slen, dlen / 2);
+		} else {
+			n = strnlen((const char *)p, dlen / 2);
+		}
+		n = charset_ascii_to_utf16le(p, n, q);
+		if (n > 0) {
+			lastp = p[n - 1];
+		}
+		p += n;
+		q += 2 * n;
+		if (slen != (size_t)-1) {
+			slen -= n;
+		}
+		dlen -= 2 * n;
+		retval += 2 * n;
 
 		/* If all characters are ascii, fast path here. */
 		while (slen && (dlen >= 1)) {
@@ -592,6 +592,16 @@ static size_t utf8_pull(void *cd, const char **inbuf, size_t *inbytesleft,
 
 	while (in_left >= 1 && out_left >= 2) {
 		if ((c[0] & 0x80) == 0) {
+			/* an ASCII run, only a zero byte is done singly */
+			size_t n = charset_ascii_to_utf16le(
+				c, MIN(in_left, out_left / 2), uc);
+			if (n > 0) {
+				c  += n;
+				in_left  -= n;
+				out_left -= 2 * n;
+				uc += 2 * n;
+				continue;
+			}
 			uc[0] = c[0];
 			uc[1] = 0;
 			c  += 1;
@@ -715,12 +725,13 @@ static size_t utf8_push(void *cd, const char **inbuf, size_t *inbytesleft,
 		unsigned int codepoint;
 
 		if (uc[1] == 0 && !(uc[0] & 0x80)) {
-			/* simplest case */
-			c[0] = uc[0];
-			in_left  -= 2;
-			out_left -= 1;
-			uc += 2;
-			c  += 1;
+			/* simplest case, take the whole ASCII run at once */
+			size_t n = charset_utf16le_to_ascii(
+				uc, MIN(in_left / 2, out_left), c);
+			in_left  -= 2 * n;
+			out_left -= n;
+			uc += 2 * n;
+			c  += n;
 			continue;
 		}
 
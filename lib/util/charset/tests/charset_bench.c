@@ -0,0 +1,261 @@
+/*
+   Unix SMB/CIFS implementation.
+
+   Throughput of the file name conversions done for directory listings,
+   with and without the vector ASCII fast paths
+
+   Copyright (C) Samba Team 2026
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "replace.h"
+#include "system/time.h"
+#include "lib/util/samba_util.h"
+#include "lib/util/charset/charset.h"
+#include "lib/util/charset/charset_proto.h"
+
+/*
+ * The names look like what a big share directory contains. Every
+ * "nonascii_every"th name gets a non-ASCII character somewhere in the
+ * middle, so the fast path has to hand over to the generic code.
+ */
+struct bench_names {
+	size_t num;
+	char **utf8;
+	DATA_BLOB *utf16;
+	char **upper;
+};
+
+static bool bench_names_create(TALLOC_CTX *mem_ctx,
+			       struct smb_iconv_handle *ic,
+			       size_t num, size_t nonascii_every,
+			       struct bench_names *names)
+{
+	size_t i;
+
+	names->num = num;
+	names->utf8 = talloc_array(mem_ctx, char *, num);
+	names->utf16 = talloc_array(mem_ctx, DATA_BLOB, num);
+	names->upper = talloc_array(mem_ctx, char *, num);
+	if ((names->utf8 == NULL) || (names->utf16 == NULL) ||
+	    (names->upper == NULL)) {
+		return false;
+	}
+
+	for (i = 0; i < num; i++) {
+		bool nonascii = (nonascii_every != 0) &&
+			((i % nonascii_every) == 0);
+		bool ok;
+
+		names->utf8[i] = talloc_asprintf(
+			names->utf8, "Quarterly report %06zu %s draft.docx",
+			i, nonascii ? "\xc3\x9c" "bersicht" : "overview");
+		if (names->utf8[i] == NULL) {
+			return false;
+		}
+		ok = convert_string_talloc_handle(names->utf16, ic,
+						  CH_UTF8, CH_UTF16LE,
+						  names->utf8[i],
+						  strlen(names->utf8[i]),
+						  (void *)&names->utf16[i].data,
+						  &names->utf16[i].length);
+		if (!ok) {
+			return false;
+		}
+		names->upper[i] = strupper_talloc_n_handle(
+			ic, names->upper, names->utf8[i],
+			strlen(names->utf8[i]));
+		if (names->upper[i] == NULL) {
+			return false;
+		}
+	}
+	return true;
+}
+
+/*
+ * What srvstr_push() does for every directory entry: unix name into a
+ * fixed size UTF-16 reply buffer.
+ */
+static uint64_t bench_push(struct smb_iconv_handle *ic,
+			   struct bench_names *names, uint8_t *buf,
+			   size_t buflen)
+{
+	uint64_t sum = 0;
+	size_t i;
+
+	for (i = 0; i < names->num; i++) {
+		size_t converted = 0;
+
+		convert_string_error_handle(ic, CH_UTF8, CH_UTF16LE,
+					    names->utf8[i],
+					    strlen(names->utf8[i]),
+					    buf, buflen, &converted);
+		sum += converted + buf[converted / 2];
+	}
+	return sum;
+}
+
+/*
+ * What srvstr_pull_talloc() does for a name coming from the client.
+ */
+static uint64_t bench_pull(struct smb_iconv_handle *ic,
+			   struct bench_names *names)
+{
+	TALLOC_CTX *frame = talloc_stackframe();
+	uint64_t sum = 0;
+	size_t i;
+
+	for (i = 0; i < names->num; i++) {
+		char *name = NULL;
+		size_t converted = 0;
+
+		convert_string_talloc_handle(frame, ic, CH_UTF16LE, CH_UTF8,
+					     names->utf16[i].data,
+					     names->utf16[i].length,
+					     (void *)&name, &converted);
+		sum += converted + (uint8_t)name[converted / 2];
+		TALLOC_FREE(name);
+	}
+	TALLOC_FREE(frame);
+	return sum;
+}
+
+/*
+ * The case insensitive name comparison done when looking up a name
+ * in a directory.
+ */
+static uint64_t bench_casecmp(struct smb_iconv_handle *ic,
+			      struct bench_names *names)
+{
+	uint64_t sum = 0;
+	size_t i;
+
+	for (i = 0; i < names->num; i++) {
+		sum += strcasecmp_m_handle(ic, names->utf8[i],
+					   names->upper[i]) == 0;
+	}
+	return sum;
+}
+
+enum bench_op { BENCH_PUSH, BENCH_PULL, BENCH_CASECMP };
+
+static const struct {
+	const char *name;
+	enum bench_op op;
+} bench_ops[] = {
+	{ "utf8->utf16le", BENCH_PUSH },
+	{ "utf16le->utf8", BENCH_PULL },
+	{ "strcasecmp_m", BENCH_CASECMP },
+};
+
+static double run_bench(struct smb_iconv_handle *ic,
+			struct bench_names *names, enum bench_op op,
+			uint8_t *buf, size_t buflen, int loops,
+			uint64_t *sum)
+{
+	struct timeval tv = timeval_current();
+	int l;
+
+	*sum = 0;
+
+	for (l = 0; l < loops; l++) {
+		switch (op) {
+		case BENCH_PUSH:
+			*sum += bench_push(ic, names, buf, buflen);
+			break;
+		case BENCH_PULL:
+			*sum += bench_pull(ic, names);
+			break;
+		case BENCH_CASECMP:
+			*sum += bench_casecmp(ic, names);
+			break;
+		}
+	}
+
+	/* nanoseconds per name */
+	return timeval_elapsed(&tv) * 1e9 / ((double)loops * names->num);
+}
+
+int main(int argc, const char *argv[])
+{
+	TALLOC_CTX *frame = talloc_stackframe();
+	struct smb_iconv_handle *ic;
+	struct bench_names names;
+	size_t num = 100000;
+	size_t nonascii_every = 10;
+	int loops = 10;
+	uint8_t buf[1024];
+	size_t i;
+	int ret = 0;
+
+	if (argc > 4) {
+		fprintf(stderr, "charset_bench [<names> [<non-ascii every n> "
+			"[<loops>]]]\n");
+		exit(1);
+	}
+	if (argc > 1) {
+		num = strtoul(argv[1], NULL, 10);
+	}
+	if (argc > 2) {
+		nonascii_every = strtoul(argv[2], NULL, 10);
+	}
+	if (argc > 3) {
+		loops = atoi(argv[3]);
+	}
+	if ((num == 0) || (loops <= 0)) {
+		fprintf(stderr, "need at least one name and one loop\n");
+		exit(1);
+	}
+
+	ic = get_iconv_testing_handle(frame, "CP850", "UTF8", true);
+	if (ic == NULL) {
+		fprintf(stderr, "get_iconv_testing_handle failed\n");
+		exit(1);
+	}
+
+	if (!bench_names_create(frame, ic, num, nonascii_every, &names)) {
+		fprintf(stderr, "creating the names failed\n");
+		exit(1);
+	}
+
+	charset_simd_set_enabled(true);
+	printf("%zu names, every %zuth non-ASCII, vector code: %s\n",
+	       num, nonascii_every, charset_simd_impl());
+	printf("%-14s %12s %12s\n", "operation", "scalar", "vector");
+
+	for (i = 0; i < ARRAY_SIZE(bench_ops); i++) {
+		uint64_t scalar_sum, vector_sum;
+		double scalar_ns, vector_ns;
+
+		charset_simd_set_enabled(false);
+		scalar_ns = run_bench(ic, &names, bench_ops[i].op,
+				      buf, sizeof(buf), loops, &scalar_sum);
+		charset_simd_set_enabled(true);
+		vector_ns = run_bench(ic, &names, bench_ops[i].op,
+				      buf, sizeof(buf), loops, &vector_sum);
+
+		if (scalar_sum != vector_sum) {
+			fprintf(stderr, "%s: result mismatch\n",
+				bench_ops[i].name);
+			ret = 1;
+		}
+
+		printf("%-14s %8.1f ns/name %8.1f ns/name\n",
+		       bench_ops[i].name, scalar_ns, vector_ns);
+	}
+
+	TALLOC_FREE(frame);
+	return ret;
+}
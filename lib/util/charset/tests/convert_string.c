@@ -21,6 +21,7 @@
 #include "includes.h"
 #include "torture/torture.h"
 #include "lib/util/charset/charset.h"
+#include "lib/util/charset/charset_proto.h"
 #include "param/param.h"
 
 struct torture_suite *torture_local_convert_string_handle(TALLOC_CTX *mem_ctx);
@@ -547,6 +548,116 @@ static bool test_gd_ascii_handle(struct torture_context *tctx)
 	return true;
 }
 
+/*
+ * Long ASCII names with a single non-ASCII character at every
+ * position, so the bulk ASCII conversion has to stop and hand over in
+ * every possible place, with the vector code and without it.
+ */
+#define ASCII_RUNS_MAX_LEN 80
+
+static bool test_ascii_runs_handle(struct torture_context *tctx)
+{
+	struct smb_iconv_handle *iconv_handle;
+	size_t len, pos, i;
+	int simd;
+
+	iconv_handle = get_iconv_testing_handle(tctx, "ASCII", "UTF8",
+						lpcfg_parm_bool(tctx->lp_ctx, NULL, "iconv", "use_builtin_handlers", true));
+	torture_assert(tctx, iconv_handle, "getting iconv handle");
+
+	for (simd = 0; simd < 2; simd++) {
+		charset_simd_set_enabled(simd);
+		torture_comment(tctx, "testing with %s implementation\n",
+				charset_simd_impl());
+
+		for (len = 1; len <= ASCII_RUNS_MAX_LEN; len++) {
+		for (pos = 0; pos <= len; pos++) {
+			uint8_t utf8[ASCII_RUNS_MAX_LEN + 1];
+			uint8_t utf16[2 * ASCII_RUNS_MAX_LEN];
+			uint8_t out[2 * ASCII_RUNS_MAX_LEN];
+			size_t utf8_len = 0, utf16_len = 0;
+			size_t out_len;
+			DATA_BLOB out_talloc;
+			bool ok;
+
+			/* pos == len means no non-ASCII character at all */
+			for (i = 0; i < len; i++) {
+				if (i == pos) {
+					/* U+00FC */
+					utf8[utf8_len++] = 0xc3;
+					utf8[utf8_len++] = 0xbc;
+					utf16[utf16_len++] = 0xfc;
+					utf16[utf16_len++] = 0x00;
+					continue;
+				}
+				utf8[utf8_len++] = 'a' + (i % 26);
+				utf16[utf16_len++] = 'a' + (i % 26);
+				utf16[utf16_len++] = 0x00;
+			}
+
+			ok = convert_string_error_handle(iconv_handle,
+							 CH_UTF8, CH_UTF16LE,
+							 utf8, utf8_len,
+							 out, sizeof(out),
+							 &out_len);
+			torture_assert(tctx, ok, "UTF8 to UTF16LE");
+			torture_assert_mem_equal(tctx, out, utf16, utf16_len,
+						 "UTF8 to UTF16LE incorrect");
+			torture_assert_int_equal(tctx, out_len, utf16_len,
+						 "UTF8 to UTF16LE length");
+
+			ok = convert_string_talloc_handle(tctx, iconv_handle,
+							  CH_UTF8, CH_UTF16LE,
+							  utf8, utf8_len,
+							  (void *)&out_talloc.data,
+							  &out_talloc.length);
+			torture_assert(tctx, ok, "UTF8 to UTF16LE talloc");
+			torture_assert_data_blob_equal(tctx, out_talloc,
+				data_blob_const(utf16, utf16_len),
+				"UTF8 to UTF16LE talloc incorrect");
+			TALLOC_FREE(out_talloc.data);
+
+			ok = convert_string_error_handle(iconv_handle,
+							 CH_UTF16LE, CH_UTF8,
+							 utf16, utf16_len,
+							 out, sizeof(out),
+							 &out_len);
+			torture_assert(tctx, ok, "UTF16LE to UTF8");
+			torture_assert_mem_equal(tctx, out, utf8, utf8_len,
+						 "UTF16LE to UTF8 incorrect");
+			torture_assert_int_equal(tctx, out_len, utf8_len,
+						 "UTF16LE to UTF8 length");
+
+			ok = convert_string_talloc_handle(tctx, iconv_handle,
+							  CH_UTF16LE, CH_UTF8,
+							  utf16, utf16_len,
+							  (void *)&out_talloc.data,
+							  &out_talloc.length);
+			torture_assert(tctx, ok, "UTF16LE to UTF8 talloc");
+			torture_assert_data_blob_equal(tctx, out_talloc,
+				data_blob_const(utf8, utf8_len),
+				"UTF16LE to UTF8 talloc incorrect");
+			TALLOC_FREE(out_talloc.data);
+
+			/* the output must not be longer than allowed */
+			ok = convert_string_error_handle(iconv_handle,
+							 CH_UTF8, CH_UTF16LE,
+							 utf8, utf8_len,
+							 out, utf16_len - 2,
+							 &out_len);
+			torture_assert(tctx, !ok, "UTF8 to short UTF16LE");
+			torture_assert_errno_equal(tctx, E2BIG,
+						   "UTF8 to short UTF16LE");
+			torture_assert(tctx, out_len <= utf16_len - 2,
+				       "UTF8 to short UTF16LE overflow");
+		}
+		}
+	}
+
+	charset_simd_set_enabled(true);
+	return true;
+}
+
 static bool test_plato_english_iso8859_cp850_handle(struct torture_context *tctx)
 {
 	struct smb_iconv_handle *iconv_handle;
@@ -1707,6 +1818,7 @@ struct torture_suite *torture_local_convert_string_handle(TALLOC_CTX *mem_ctx)
 	torture_suite_add_simple_test(suite, "gd_ascii", test_gd_ascii_handle);
 	torture_suite_add_simple_test(suite, "gd_minus_1", test_gd_minus_1_handle);
 	torture_suite_add_simple_test(suite, "gd_iso8859_cp850", test_gd_iso8859_cp850_handle);
+	torture_suite_add_simple_test(suite, "ascii_runs", test_ascii_runs_handle);
 	torture_suite_add_simple_test(suite, "plato_english_iso8859_cp850", test_plato_english_iso8859_cp850_handle);
 	torture_suite_add_simple_test(suite, "plato_english_minus_1", test_plato_english_minus_1_handle);
 	torture_suite_add_simple_test(suite, "plato_cp850_utf8", test_plato_cp850_utf8_handle);
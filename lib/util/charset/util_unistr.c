@@ -60,7 +60,15 @@ _PUBLIC_ char *strlower_talloc_handle(struct smb_iconv_handle *iconv_handle,
 
 	while (*src) {
 		size_t c_size;
-		codepoint_t c = next_codepoint_handle(iconv_handle, src, &c_size);
+		codepoint_t c;
+
+		if ((*src & 0x80) == 0) {
+			/* ASCII is the same in all supported charsets */
+			c = (unsigned char)*src;
+			c_size = 1;
+		} else {
+			c = next_codepoint_handle(iconv_handle, src, &c_size);
+		}
 		src += c_size;
 
 		c = tolower_m(c);
@@ -112,8 +120,16 @@ _PUBLIC_ char *strupper_talloc_n_handle(struct smb_iconv_handle *iconv_handle,
 
 	while (n && *src) {
 		size_t c_size;
-		codepoint_t c = next_codepoint_handle_ext(iconv_handle, src, n,
-							  CH_UNIX, &c_size);
+		codepoint_t c;
+
+		if ((*src & 0x80) == 0) {
+			/* ASCII is the same in all supported charsets */
+			c = (unsigned char)*src;
+			c_size = 1;
+		} else {
+			c = next_codepoint_handle_ext(iconv_handle, src, n,
+						      CH_UNIX, &c_size);
+		}
 		src += c_size;
 		n -= c_size;
 
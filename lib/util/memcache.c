@@ -54,6 +54,7 @@ static bool memcache_is_talloc(enum memcache_number n)
 	case PDB_GETPWSID_CACHE:
 	case SINGLETON_CACHE_TALLOC:
 	case SHARE_MODE_LOCK_CACHE:
+	case NTACL_CACHE:
 		result = true;
 		break;
 	default:
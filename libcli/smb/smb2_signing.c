@@ -280,12 +280,9 @@ NTSTATUS smb2_signing_encrypt_pdu(DATA_BLOB encryption_key,
 		       16 - AES_GCM_128_IV_SIZE);
 		aes_gcm_128_updateA(&c.gcm, tf + SMB2_TF_NONCE, a_total);
 		for (i=1; i < count; i++) {
-			aes_gcm_128_crypt(&c.gcm,
+			aes_gcm_128_encrypt(&c.gcm,
 					(uint8_t *)vector[i].iov_base,
 					vector[i].iov_len);
-			aes_gcm_128_updateC(&c.gcm,
-					(const uint8_t *)vector[i].iov_base,
-					vector[i].iov_len);
 		}
 		aes_gcm_128_digest(&c.gcm, sig);
 		break;
@@ -381,10 +378,7 @@ NTSTATUS smb2_signing_decrypt_pdu(DATA_BLOB decryption_key,
 		aes_gcm_128_init(&c.gcm, key, tf + SMB2_TF_NONCE);
 		aes_gcm_128_updateA(&c.gcm, tf + SMB2_TF_NONCE, a_total);
 		for (i=1; i < count; i++) {
-			aes_gcm_128_updateC(&c.gcm,
-					(const uint8_t *)vector[i].iov_base,
-					vector[i].iov_len);
-			aes_gcm_128_crypt(&c.gcm,
+			aes_gcm_128_decrypt(&c.gcm,
 					(uint8_t *)vector[i].iov_base,
 					vector[i].iov_len);
 		}
@@ -16,7 +16,7 @@
 # along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #
 
-import ldb, sys
+import ldb, sys, os
 import samba.getopt as options
 from samba.auth import system_session
 from samba.samdb import SamDB
@@ -55,6 +55,7 @@ class cmd_dbcheck(Command):
             help="don't print details of checking"),
         Option("--attrs", dest="attrs", default=None, help="list of attributes to check (space separated)"),
         Option("--reindex", dest="reindex", default=False, action="store_true", help="force database re-index"),
+        Option("--reindex-threads", dest="reindex_threads", type=int, default=None, help="number of threads unpacking records for the re-index"),
         Option("--force-modules", dest="force_modules", default=False, action="store_true", help="force loading of Samba modules and ignore the @MODULES record (for very old databases)"),
         Option("--reset-well-known-acls", dest="reset_well_known_acls", default=False, action="store_true", help="reset ACLs on objects with well known default ACL values to the default"),
         Option("-H", "--URL", help="LDB URL for database or target server (defaults to local SAM database)",
@@ -65,10 +66,16 @@ class cmd_dbcheck(Command):
             cross_ncs=False, quiet=False,
             scope="SUB", credopts=None, sambaopts=None, versionopts=None,
             attrs=None, reindex=False, force_modules=False,
-            reset_well_known_acls=False):
+            reset_well_known_acls=False, reindex_threads=None):
 
         lp = sambaopts.get_loadparm()
 
+        if reindex:
+            # the tdb backends pick these up when they are opened
+            os.environ["LDB_WARN_REINDEX"] = "1"
+            if reindex_threads is not None:
+                os.environ["LDB_REINDEX_THREADS"] = str(reindex_threads)
+
         over_ldap = H is not None and H.startswith('ldap')
 
         if over_ldap:
@@ -122,6 +129,12 @@ class cmd_dbcheck(Command):
             if reindex:
                 self.outf.write("Re-indexing...\n")
                 error_count = 0
+
+                def reindex_progress(level, text):
+                    # fatal, error and warning messages
+                    if level <= 2:
+                        self.outf.write("%s\n" % text)
+                samdb.set_debug(reindex_progress)
                 if chk.reindex_database():
                     self.outf.write("completed re-index OK\n")
 
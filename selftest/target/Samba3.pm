@@ -548,6 +548,7 @@ sub setup_simpleserver($$)
 	vfs objects = xattr_tdb streams_depot
 	change notify = no
 	smb encrypt = off
+	smbd:credit latency target = 0
 
 [vfs_aio_fork]
 	path = $prefix_abs/share
@@ -555,6 +556,32 @@ sub setup_simpleserver($$)
         read only = no
         vfs_aio_fork:erratic_testing_mode=yes
 
+[vfs_io_uring]
+	path = $prefix_abs/share
+	vfs objects = io_uring
+	read only = no
+
+[vfs_aio_pthread]
+	path = $prefix_abs/share
+	vfs objects = aio_pthread
+	read only = no
+
+[readdir_prefetch]
+	path = $prefix_abs/share
+	vfs objects = readdir_prefetch
+	read only = no
+
+[readdir_prefetch_small]
+	copy = readdir_prefetch
+	readdir_prefetch:batch size = 5
+
+[qdir_chunk]
+	path = $prefix_abs/share
+	vfs objects =
+	read only = no
+	smbd:query directory chunk size = 3
+	smbd:async dir stat = yes
+
 [dosmode]
 	path = $prefix_abs/share
 	vfs objects =
@@ -1720,6 +1747,9 @@ sub provision($$$$$$$$)
 	copy = tmp
 	acl_xattr:ignore system acls = yes
 	acl_xattr:default acl style = windows
+[acl_xattr_cache]
+	copy = tmp
+	acl_xattr:security descriptor cache = yes
 [nosymlinks]
 	copy = tmp
 	path = $nosymlinks_shrdir
@@ -108,6 +108,11 @@ struct tevent_context;
 	SMBPROFILE_STATS_BASIC(fchmod_acl) \
 	SMBPROFILE_STATS_SECTION_END \
 	\
+	SMBPROFILE_STATS_SECTION_START(ntaclcache, "NT ACL Cache") \
+	SMBPROFILE_STATS_COUNT(ntaclcache_hits) \
+	SMBPROFILE_STATS_COUNT(ntaclcache_misses) \
+	SMBPROFILE_STATS_SECTION_END \
+	\
 	SMBPROFILE_STATS_SECTION_START(statcache, "Stat Cache") \
 	SMBPROFILE_STATS_COUNT(statcache_lookups) \
 	SMBPROFILE_STATS_COUNT(statcache_misses) \
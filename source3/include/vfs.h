@@ -170,6 +170,7 @@
 /* Bump to version 34 - Samba 4.4 will ship with that */
 /* Version 34 - Remove bool posix_open, add uint64_t posix_flags */
 /* Version 34 - Added bool posix_pathnames to struct smb_request */
+/* Version 34 - Add query_directory_queue to files_struct */
 
 #define SMB_VFS_INTERFACE_VERSION 34
 
@@ -300,6 +301,12 @@ typedef struct files_struct {
 	 * possibly the simplest approach. Thanks, Jeremy for the idea.
 	 */
 	struct tevent_req *deferred_close;
+
+	/*
+	 * SMB2 QUERY_DIRECTORY requests on this directory handle are
+	 * processed one after the other, they share fsp->dptr.
+	 */
+	struct tevent_queue *query_directory_queue;
 } files_struct;
 
 #define FSP_POSIX_FLAGS_OPEN		0x01
@@ -75,7 +75,7 @@ static bool gencache_init(void)
 	DEBUG(5, ("Opening cache file at %s\n", cache_fname));
 
 	cache = tdb_wrap_open(NULL, cache_fname, 0,
-			      TDB_DEFAULT|TDB_INCOMPATIBLE_HASH,
+			      TDB_DEFAULT|TDB_MURMUR_HASH,
 			      open_flags, 0644);
 	if (cache) {
 		int ret;
@@ -95,7 +95,7 @@ static bool gencache_init(void)
 			 */
 			cache = tdb_wrap_open(NULL, cache_fname, 0,
 					      TDB_DEFAULT|
-					      TDB_INCOMPATIBLE_HASH|
+					      TDB_MURMUR_HASH|
 					      TDB_CLEAR_IF_FIRST,
 					      open_flags, 0644);
 		}
@@ -104,7 +104,7 @@ static bool gencache_init(void)
 	if (!cache && (errno == EACCES)) {
 		open_flags = O_RDONLY;
 		cache = tdb_wrap_open(NULL, cache_fname, 0,
-				      TDB_DEFAULT|TDB_INCOMPATIBLE_HASH,
+				      TDB_DEFAULT|TDB_MURMUR_HASH,
 				      open_flags, 0644);
 		if (cache) {
 			DEBUG(5, ("gencache_init: Opening cache file %s read-only.\n", cache_fname));
@@ -130,7 +130,8 @@ static bool gencache_init(void)
 				      TDB_INCOMPATIBLE_HASH|
 				      TDB_SEQNUM|
 				      TDB_NOSYNC|
-				      TDB_MUTEX_LOCKING,
+				      TDB_MUTEX_LOCKING|
+				      TDB_FREELIST_CLASSES,
 				      open_flags, 0644);
 	if (cache_notrans == NULL) {
 		DEBUG(5, ("Opening %s failed: %s\n", cache_fname,
@@ -718,6 +719,16 @@ bool gencache_stabilize(void)
 		return false;
 	}
 
+	/*
+	 * gencache.tdb is created with the default hash size and can
+	 * grow large, grow the hash table once the chains get long.
+	 */
+	res = tdb_rehash(cache->tdb, 0);
+	if (res != 0) {
+		DEBUG(10, ("tdb_rehash on gencache.tdb failed: %s\n",
+			   tdb_errorstr(cache->tdb)));
+	}
+
 	now = talloc_asprintf(talloc_tos(), "%d", (int)time(NULL));
 	if (now != NULL) {
 		tdb_store(cache_notrans->tdb, last_stabilize_key(),
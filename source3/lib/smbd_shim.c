@@ -43,10 +43,10 @@ void cancel_pending_lock_requests_by_fid(files_struct *fsp,
 }
 
 void send_stat_cache_delete_message(struct messaging_context *msg_ctx,
-				    const char *name)
+				    files_struct *fsp)
 {
 	if (shim.send_stat_cache_delete_message) {
-		shim.send_stat_cache_delete_message(msg_ctx, name);
+		shim.send_stat_cache_delete_message(msg_ctx, fsp);
 	}
 }
 
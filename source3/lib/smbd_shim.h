@@ -33,7 +33,7 @@ struct smbd_shim
 						    struct byte_range_lock *br_lck,
 						    enum file_close_type close_type);
 	void (*send_stat_cache_delete_message)(struct messaging_context *msg_ctx,
-					       const char *name);
+					       files_struct *fsp);
 
 	bool (*change_to_root_user)(void);
 	bool (*become_authenticated_pipe_user)(struct auth_session_info *session_info);
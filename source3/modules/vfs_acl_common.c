@@ -25,6 +25,8 @@
 #include "../librpc/gen_ndr/ndr_security.h"
 #include "../lib/util/bitmap.h"
 #include "passdb/lookup_sid.h"
+#include "../lib/util/memcache.h"
+#include "smbprofile.h"
 
 static NTSTATUS create_acl_blob(const struct security_descriptor *psd,
 			DATA_BLOB *pblob,
@@ -41,6 +43,8 @@ static NTSTATUS store_acl_blob_fsp(vfs_handle_struct *handle,
 			files_struct *fsp,
 			DATA_BLOB *pblob);
 
+static uint64_t acl_blob_generation(vfs_handle_struct *handle);
+
 #define HASH_SECURITY_INFO (SECINFO_OWNER | \
 				SECINFO_GROUP | \
 				SECINFO_DACL | \
@@ -56,6 +60,7 @@ static const struct enum_list default_acl_style[] = {
 struct acl_common_config {
 	bool ignore_system_acls;
 	enum default_acl_style default_acl_style;
+	bool sd_cache;
 };
 
 static bool init_acl_common_config(vfs_handle_struct *handle)
@@ -78,6 +83,10 @@ static bool init_acl_common_config(vfs_handle_struct *handle)
 						 "default acl style",
 						 default_acl_style,
 						 DEFAULT_ACL_POSIX);
+	config->sd_cache = lp_parm_bool(SNUM(handle->conn),
+					ACL_MODULE_NAME,
+					"security descriptor cache",
+					false);
 
 	SMB_VFS_HANDLE_SET_DATA(handle, config, NULL,
 				struct acl_common_config,
@@ -845,6 +854,151 @@ static NTSTATUS stat_fsp_or_name(vfs_handle_struct *handle,
 	return NT_STATUS_OK;
 }
 
+/*
+ * Per-process cache of the security descriptors get_nt_acl_internal()
+ * came up with, so that repeated access checks on a file don't read,
+ * parse and verify the blob again.
+ *
+ * An entry is only used as long as the file has the ctime it had
+ * when the entry was added and the module reports the same blob
+ * generation. Storing an ACL via the xattr or a POSIX ACL changes the
+ * ctime, for vfs_acl_tdb the generation is the sequence number of the
+ * database. SET_NT_ACL in this process removes the entry directly.
+ *
+ * The ctime only changes when the clock has moved on by at least the
+ * timestamp granularity of the file system, which can be as coarse
+ * as a second (two on FAT). Another process changing the ACL within
+ * that window leaves the ctime as it was, so a descriptor is only
+ * cached once its ctime is older than ACL_SD_CACHE_CTIME_GRANULARITY.
+ * Any later change then shows up as a different ctime.
+ */
+
+#define ACL_SD_CACHE_CTIME_GRANULARITY 2.0
+
+struct acl_sd_cache_entry {
+	struct timespec ctime;
+	uint64_t generation;
+	struct security_descriptor *psd;
+};
+
+static DATA_BLOB acl_sd_cache_key(vfs_handle_struct *handle,
+				  const struct file_id *id,
+				  uint8_t buf[28])
+{
+	SIVAL(buf, 0, SNUM(handle->conn));
+	push_file_id_24((char *)buf + 4, id);
+	return data_blob_const(buf, 28);
+}
+
+static struct security_descriptor *acl_sd_cache_lookup(
+	TALLOC_CTX *mem_ctx,
+	vfs_handle_struct *handle,
+	const SMB_STRUCT_STAT *psbuf,
+	uint64_t generation)
+{
+	struct acl_sd_cache_entry *entry;
+	struct file_id id;
+	uint8_t buf[28];
+	DATA_BLOB key;
+
+	id = vfs_file_id_from_sbuf(handle->conn, psbuf);
+	key = acl_sd_cache_key(handle, &id, buf);
+
+	entry = (struct acl_sd_cache_entry *)memcache_lookup_talloc(
+		NULL, NTACL_CACHE, key);
+	if (entry == NULL) {
+		DO_PROFILE_INC(ntaclcache_misses);
+		return NULL;
+	}
+
+	if ((timespec_compare(&entry->ctime, &psbuf->st_ex_ctime) != 0) ||
+	    (entry->generation != generation)) {
+		memcache_delete(NULL, NTACL_CACHE, key);
+		DO_PROFILE_INC(ntaclcache_misses);
+		return NULL;
+	}
+
+	DO_PROFILE_INC(ntaclcache_hits);
+
+	return security_descriptor_copy(mem_ctx, entry->psd);
+}
+
+static void acl_sd_cache_add(vfs_handle_struct *handle,
+			     const SMB_STRUCT_STAT *psbuf,
+			     uint64_t generation,
+			     const struct security_descriptor *psd)
+{
+	struct acl_sd_cache_entry *entry;
+	struct timespec now;
+	struct file_id id;
+	uint8_t buf[28];
+	DATA_BLOB key;
+
+	now = timespec_current();
+	if (timespec_elapsed2(&psbuf->st_ex_ctime, &now) <
+	    ACL_SD_CACHE_CTIME_GRANULARITY) {
+		/*
+		 * Too recent, a change right now would not move the
+		 * ctime.
+		 */
+		DBG_DEBUG("ctime too recent, not caching\n");
+		return;
+	}
+
+	entry = talloc(talloc_tos(), struct acl_sd_cache_entry);
+	if (entry == NULL) {
+		return;
+	}
+	entry->ctime = psbuf->st_ex_ctime;
+	entry->generation = generation;
+	entry->psd = security_descriptor_copy(entry, psd);
+	if (entry->psd == NULL) {
+		TALLOC_FREE(entry);
+		return;
+	}
+
+	id = vfs_file_id_from_sbuf(handle->conn, psbuf);
+	key = acl_sd_cache_key(handle, &id, buf);
+
+	memcache_add_talloc(NULL, NTACL_CACHE, key, &entry);
+
+	/* Still ours if there is no cache */
+	TALLOC_FREE(entry);
+}
+
+static void acl_sd_cache_delete(vfs_handle_struct *handle,
+				files_struct *fsp)
+{
+	uint8_t buf[28];
+	DATA_BLOB key;
+
+	key = acl_sd_cache_key(handle, &fsp->file_id, buf);
+	memcache_delete(NULL, NTACL_CACHE, key);
+}
+
+/*******************************************************************
+ Remove the parts of a security descriptor not asked for.
+*******************************************************************/
+
+static void filter_security_info(struct security_descriptor *psd,
+				 uint32_t security_info)
+{
+	if (!(security_info & SECINFO_OWNER)) {
+		psd->owner_sid = NULL;
+	}
+	if (!(security_info & SECINFO_GROUP)) {
+		psd->group_sid = NULL;
+	}
+	if (!(security_info & SECINFO_DACL)) {
+		psd->type &= ~SEC_DESC_DACL_PRESENT;
+		psd->dacl = NULL;
+	}
+	if (!(security_info & SECINFO_SACL)) {
+		psd->type &= ~SEC_DESC_SACL_PRESENT;
+		psd->sacl = NULL;
+	}
+}
+
 /*******************************************************************
  Pull a DATA_BLOB from an xattr given a pathname.
  If the hash doesn't match, or doesn't exist - return the underlying
@@ -863,6 +1017,10 @@ static NTSTATUS get_nt_acl_internal(vfs_handle_struct *handle,
 	struct security_descriptor *psd = NULL;
 	bool psd_is_from_fs = false;
 	struct acl_common_config *config = NULL;
+	SMB_STRUCT_STAT cache_sbuf;
+	SMB_STRUCT_STAT *cache_psbuf = NULL;
+	uint64_t generation = 0;
+	bool cacheable = true;
 
 	SMB_VFS_HANDLE_GET_DATA(handle, config,
 				struct acl_common_config,
@@ -874,6 +1032,32 @@ static NTSTATUS get_nt_acl_internal(vfs_handle_struct *handle,
 
 	DBG_DEBUG("name=%s\n", name);
 
+	if (config->sd_cache) {
+		/*
+		 * Take the generation and the ctime before reading
+		 * the blob, a change in between makes us miss next
+		 * time.
+		 */
+		generation = acl_blob_generation(handle);
+		cache_psbuf = &cache_sbuf;
+		status = stat_fsp_or_name(handle, fsp, name,
+					  &cache_sbuf, &cache_psbuf);
+		if (NT_STATUS_IS_OK(status)) {
+			cache_sbuf = *cache_psbuf;
+			cache_psbuf = &cache_sbuf;
+			psd = acl_sd_cache_lookup(mem_ctx, handle,
+						  cache_psbuf, generation);
+		} else {
+			cache_psbuf = NULL;
+		}
+		if (psd != NULL) {
+			DBG_DEBUG("cached acl for %s\n", name);
+			filter_security_info(psd, security_info);
+			*ppdesc = psd;
+			return NT_STATUS_OK;
+		}
+	}
+
 	status = get_acl_blob(mem_ctx, handle, fsp, name, &blob);
 	if (NT_STATUS_IS_OK(status)) {
 		status = validate_nt_acl_blob(mem_ctx,
@@ -938,6 +1122,8 @@ static NTSTATUS get_nt_acl_internal(vfs_handle_struct *handle,
 			}
 
 			psd_is_from_fs = true;
+			cacheable = ((security_info & HASH_SECURITY_INFO) ==
+				     HASH_SECURITY_INFO);
 		}
 	}
 
@@ -979,21 +1165,12 @@ static NTSTATUS get_nt_acl_internal(vfs_handle_struct *handle,
 		psd->type &= ~SEC_DESC_DACL_PROTECTED;
 	}
 
-	if (!(security_info & SECINFO_OWNER)) {
-		psd->owner_sid = NULL;
-	}
-	if (!(security_info & SECINFO_GROUP)) {
-		psd->group_sid = NULL;
-	}
-	if (!(security_info & SECINFO_DACL)) {
-		psd->type &= ~SEC_DESC_DACL_PRESENT;
-		psd->dacl = NULL;
-	}
-	if (!(security_info & SECINFO_SACL)) {
-		psd->type &= ~SEC_DESC_SACL_PRESENT;
-		psd->sacl = NULL;
+	if ((cache_psbuf != NULL) && cacheable) {
+		acl_sd_cache_add(handle, cache_psbuf, generation, psd);
 	}
 
+	filter_security_info(psd, security_info);
+
 	if (DEBUGLEVEL >= 10) {
 		DBG_DEBUG("returning acl for %s is:\n", name);
 		NDR_PRINT_DEBUG(security_descriptor, psd);
@@ -1112,8 +1289,10 @@ static NTSTATUS store_v3_blob(vfs_handle_struct *handle, files_struct *fsp,
  Store a security descriptor given an fsp.
 *********************************************************************/
 
-static NTSTATUS fset_nt_acl_common(vfs_handle_struct *handle, files_struct *fsp,
-        uint32_t security_info_sent, const struct security_descriptor *orig_psd)
+static NTSTATUS fset_nt_acl_internal(vfs_handle_struct *handle,
+				     files_struct *fsp,
+				     uint32_t security_info_sent,
+				     const struct security_descriptor *orig_psd)
 {
 	NTSTATUS status;
 	int ret;
@@ -1275,6 +1454,23 @@ static NTSTATUS fset_nt_acl_common(vfs_handle_struct *handle, files_struct *fsp,
 	return status;
 }
 
+static NTSTATUS fset_nt_acl_common(vfs_handle_struct *handle, files_struct *fsp,
+        uint32_t security_info_sent, const struct security_descriptor *orig_psd)
+{
+	NTSTATUS status;
+
+	status = fset_nt_acl_internal(handle, fsp, security_info_sent,
+				      orig_psd);
+
+	/*
+	 * Even a failed attempt might have changed part of it, don't
+	 * rely on the ctime to tell.
+	 */
+	acl_sd_cache_delete(handle, fsp);
+
+	return status;
+}
+
 static int acl_common_remove_object(vfs_handle_struct *handle,
 					const char *path,
 					bool is_directory)
@@ -59,7 +59,9 @@ static bool acl_tdb_init(void)
 	}
 
 	become_root();
-	acl_db = db_open(NULL, dbname, 0, TDB_DEFAULT, O_RDWR|O_CREAT, 0600,
+	/* TDB_SEQNUM for acl_blob_generation() */
+	acl_db = db_open(NULL, dbname, 0, TDB_DEFAULT|TDB_SEQNUM,
+			 O_RDWR|O_CREAT, 0600,
 			 DBWRAP_LOCK_ORDER_1, DBWRAP_FLAG_NONE);
 	unbecome_root();
 
@@ -194,6 +196,16 @@ static NTSTATUS get_acl_blob(TALLOC_CTX *ctx,
 	return NT_STATUS_OK;
 }
 
+/*******************************************************************
+ Changes with every store to the tdb. Storing a blob does not touch
+ the file, so the ctime doesn't tell the cache about it.
+*******************************************************************/
+
+static uint64_t acl_blob_generation(vfs_handle_struct *handle)
+{
+	return (uint64_t)dbwrap_get_seqnum(acl_db);
+}
+
 /*******************************************************************
  Store a DATA_BLOB into a tdb record given an fsp pointer.
 *******************************************************************/
@@ -91,6 +91,16 @@ static NTSTATUS get_acl_blob(TALLOC_CTX *ctx,
 	return NT_STATUS_OK;
 }
 
+/*******************************************************************
+ Storing the xattr changes the ctime of the file, that is all the
+ cache needs to look at.
+*******************************************************************/
+
+static uint64_t acl_blob_generation(vfs_handle_struct *handle)
+{
+	return 0;
+}
+
 /*******************************************************************
  Store a DATA_BLOB into an xattr given an fsp pointer.
 *******************************************************************/
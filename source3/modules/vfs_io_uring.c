@@ -0,0 +1,633 @@
+/*
+ * Use the io_uring of Linux (>= 5.1) for async pread/pwrite/fsync
+ *
+ * Copyright (C) Samba Team 2026
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "includes.h"
+#include "system/filesys.h"
+#include "smbd/smbd.h"
+#include "smbd/globals.h"
+#include "lib/util/tevent_unix.h"
+#include "smbprofile.h"
+#include <liburing.h>
+
+/*
+ * One ring exists per tevent_context the module is asked to do I/O
+ * on. Completions are reaped directly from the tevent loop: the ring
+ * fd becomes readable as soon as there are entries in the completion
+ * queue, so there is no helper thread and no eventfd round trip.
+ *
+ * Submissions are batched: a _send function only prepares a
+ * submission queue entry, the actual io_uring_submit() happens in a
+ * tevent immediate. All requests created while processing one
+ * incoming SMB2 compound or one batch of socket reads end up in a
+ * single io_uring_enter() system call.
+ */
+
+struct vfs_io_uring_request;
+
+struct vfs_io_uring_config {
+	struct vfs_io_uring_ring *rings;
+	unsigned num_entries;
+};
+
+struct vfs_io_uring_ring {
+	struct vfs_io_uring_ring *prev, *next;
+	struct vfs_io_uring_config *config;
+	struct tevent_context *ev;
+	struct io_uring uring;
+	struct tevent_fd *fde;
+	struct tevent_immediate *submit_im;
+	bool submit_scheduled;
+
+	/*
+	 * Retries io_uring_submit() if the kernel refused it while
+	 * nothing was in flight, see vfs_io_uring_queue_run().
+	 */
+	struct tevent_timer *retry_te;
+
+	/*
+	 * Requests waiting for a free submission queue entry
+	 */
+	struct vfs_io_uring_request *queue;
+
+	/*
+	 * Requests handed to the kernel, waiting for completion
+	 */
+	struct vfs_io_uring_request *pending;
+	unsigned num_pending;
+
+	/*
+	 * Of those, the ones still in the submission queue
+	 */
+	unsigned num_unsubmitted;
+};
+
+struct vfs_io_uring_request {
+	struct vfs_io_uring_request *prev, *next;
+	struct vfs_io_uring_request **list_head;
+	struct vfs_io_uring_ring *ring;
+	struct tevent_req *req;
+	struct io_uring_sqe sqe;
+	struct iovec iov;
+};
+
+struct vfs_io_uring_state {
+	struct vfs_io_uring_request *ur;
+	ssize_t ret;
+	int err;
+	SMBPROFILE_BASIC_ASYNC_STATE(profile_basic);
+	SMBPROFILE_BYTES_ASYNC_STATE(profile_bytes);
+};
+
+static void vfs_io_uring_fd_handler(struct tevent_context *ev,
+				    struct tevent_fd *fde,
+				    uint16_t flags,
+				    void *private_data);
+static void vfs_io_uring_submit_handler(struct tevent_context *ev,
+					struct tevent_immediate *im,
+					void *private_data);
+static void vfs_io_uring_retry_handler(struct tevent_context *ev,
+				       struct tevent_timer *te,
+				       struct timeval current_time,
+				       void *private_data);
+
+/*
+ * Free the state of a request whose caller tried to free it while
+ * the kernel owned it, see vfs_io_uring_state_destructor().
+ */
+static void vfs_io_uring_free_orphan(struct vfs_io_uring_request *cur)
+{
+	struct vfs_io_uring_state *state = talloc_get_type_abort(
+		talloc_parent(cur), struct vfs_io_uring_state);
+
+	talloc_set_destructor(state, NULL);
+	TALLOC_FREE(state);
+}
+
+/*
+ * Called from the ring destructor. The callbacks run from the event
+ * loop later, not from within the talloc destructor.
+ */
+static void vfs_io_uring_fail_list(struct vfs_io_uring_request **list,
+				   struct tevent_context *ev,
+				   int err)
+{
+	while (*list != NULL) {
+		struct vfs_io_uring_request *cur = *list;
+
+		DLIST_REMOVE(*list, cur);
+		cur->list_head = NULL;
+
+		if (cur->req == NULL) {
+			vfs_io_uring_free_orphan(cur);
+			continue;
+		}
+		tevent_req_defer_callback(cur->req, ev);
+		tevent_req_error(cur->req, err);
+	}
+}
+
+static int vfs_io_uring_ring_destructor(struct vfs_io_uring_ring *ring)
+{
+	DLIST_REMOVE(ring->config->rings, ring);
+	TALLOC_FREE(ring->fde);
+
+	/*
+	 * io_uring_queue_exit() makes the kernel wait for or cancel
+	 * everything still in flight, so after this no buffer handed
+	 * to the ring is referenced anymore.
+	 */
+	io_uring_queue_exit(&ring->uring);
+
+	vfs_io_uring_fail_list(&ring->queue, ring->ev, ESHUTDOWN);
+	vfs_io_uring_fail_list(&ring->pending, ring->ev, ESHUTDOWN);
+
+	return 0;
+}
+
+static struct vfs_io_uring_ring *vfs_io_uring_get_ring(
+	struct vfs_io_uring_config *config, struct tevent_context *ev)
+{
+	struct vfs_io_uring_ring *ring;
+	int ret;
+
+	for (ring = config->rings; ring != NULL; ring = ring->next) {
+		if (ring->ev == ev) {
+			return ring;
+		}
+	}
+
+	ring = talloc_zero(config, struct vfs_io_uring_ring);
+	if (ring == NULL) {
+		return NULL;
+	}
+	ring->config = config;
+	ring->ev = ev;
+
+	ring->submit_im = tevent_create_immediate(ring);
+	if (ring->submit_im == NULL) {
+		TALLOC_FREE(ring);
+		return NULL;
+	}
+
+	ret = io_uring_queue_init(config->num_entries, &ring->uring, 0);
+	if (ret < 0) {
+		DBG_WARNING("io_uring_queue_init(%u) failed: %s\n",
+			    config->num_entries, strerror(-ret));
+		TALLOC_FREE(ring);
+		return NULL;
+	}
+
+	DLIST_ADD(config->rings, ring);
+	talloc_set_destructor(ring, vfs_io_uring_ring_destructor);
+
+	ring->fde = tevent_add_fd(ev, ring, ring->uring.ring_fd,
+				  TEVENT_FD_READ, vfs_io_uring_fd_handler,
+				  ring);
+	if (ring->fde == NULL) {
+		TALLOC_FREE(ring);
+		return NULL;
+	}
+
+	DBG_DEBUG("initialized ring with %u entries\n", config->num_entries);
+
+	return ring;
+}
+
+/*
+ * Move queued requests into the submission queue and tell the kernel
+ * about them with a single io_uring_submit().
+ */
+static void vfs_io_uring_queue_run(struct vfs_io_uring_ring *ring)
+{
+	struct vfs_io_uring_request *cur, *next;
+	int ret;
+
+	for (cur = ring->queue; cur != NULL; cur = next) {
+		struct io_uring_sqe *sqe;
+
+		next = cur->next;
+
+		if (ring->num_pending >= ring->config->num_entries) {
+			/*
+			 * Never have more requests in flight than the
+			 * completion queue can hold, older kernels
+			 * drop completions on overflow.
+			 */
+			break;
+		}
+
+		sqe = io_uring_get_sqe(&ring->uring);
+		if (sqe == NULL) {
+			/*
+			 * The submission queue is full, the remaining
+			 * requests get their turn once completions
+			 * come in.
+			 */
+			break;
+		}
+		*sqe = cur->sqe;
+
+		DLIST_REMOVE(ring->queue, cur);
+		DLIST_ADD_END(ring->pending, cur);
+		cur->list_head = &ring->pending;
+		ring->num_pending += 1;
+		ring->num_unsubmitted += 1;
+	}
+
+	if (ring->num_unsubmitted == 0) {
+		return;
+	}
+
+	ret = io_uring_submit(&ring->uring);
+	if ((ret < 0) && (ret != -EAGAIN) && (ret != -EBUSY)) {
+		/*
+		 * Something is badly wrong with the ring. Tear it
+		 * down, this fails all requests, the next one will
+		 * set up a fresh ring.
+		 */
+		DBG_ERR("io_uring_submit failed: %s\n", strerror(-ret));
+		TALLOC_FREE(ring);
+		return;
+	}
+
+	if (ret > 0) {
+		ring->num_unsubmitted -= MIN((unsigned)ret,
+					     ring->num_unsubmitted);
+	}
+	if (ring->num_unsubmitted == 0) {
+		return;
+	}
+
+	/*
+	 * The kernel is short on resources or the completion queue
+	 * would overflow. The entries stay in the submission queue.
+	 * If there are requests in flight, the next completion
+	 * submits them. Otherwise nothing would ever wake us up, so
+	 * try again a bit later.
+	 */
+	if ((ring->num_pending > ring->num_unsubmitted) ||
+	    (ring->retry_te != NULL)) {
+		return;
+	}
+
+	DBG_DEBUG("io_uring_submit: %s, retrying\n",
+		  ret < 0 ? strerror(-ret) : "short submit");
+
+	ring->retry_te = tevent_add_timer(ring->ev, ring,
+					  timeval_current_ofs_msec(1),
+					  vfs_io_uring_retry_handler, ring);
+	if (ring->retry_te == NULL) {
+		DBG_ERR("tevent_add_timer failed\n");
+		TALLOC_FREE(ring);
+		return;
+	}
+}
+
+static void vfs_io_uring_retry_handler(struct tevent_context *ev,
+				       struct tevent_timer *te,
+				       struct timeval current_time,
+				       void *private_data)
+{
+	struct vfs_io_uring_ring *ring = talloc_get_type_abort(
+		private_data, struct vfs_io_uring_ring);
+
+	ring->retry_te = NULL;
+	vfs_io_uring_queue_run(ring);
+}
+
+static void vfs_io_uring_submit_handler(struct tevent_context *ev,
+					struct tevent_immediate *im,
+					void *private_data)
+{
+	struct vfs_io_uring_ring *ring = talloc_get_type_abort(
+		private_data, struct vfs_io_uring_ring);
+
+	ring->submit_scheduled = false;
+	vfs_io_uring_queue_run(ring);
+}
+
+static void vfs_io_uring_finish_req(struct vfs_io_uring_request *cur,
+				    const struct io_uring_cqe *cqe)
+{
+	struct vfs_io_uring_ring *ring = cur->ring;
+	struct tevent_req *req = cur->req;
+	struct vfs_io_uring_state *state;
+
+	DLIST_REMOVE(ring->pending, cur);
+	cur->list_head = NULL;
+	ring->num_pending -= 1;
+
+	if (req == NULL) {
+		/*
+		 * The caller tried to go away while the kernel was
+		 * still working on the buffer, see
+		 * vfs_io_uring_state_destructor().
+		 */
+		vfs_io_uring_free_orphan(cur);
+		return;
+	}
+
+	state = tevent_req_data(req, struct vfs_io_uring_state);
+
+	SMBPROFILE_BASIC_ASYNC_END(state->profile_basic);
+	SMBPROFILE_BYTES_ASYNC_END(state->profile_bytes);
+
+	if (cqe->res < 0) {
+		state->ret = -1;
+		state->err = -cqe->res;
+	} else {
+		state->ret = cqe->res;
+		state->err = 0;
+	}
+
+	tevent_req_defer_callback(req, ring->ev);
+	tevent_req_done(req);
+}
+
+static void vfs_io_uring_fd_handler(struct tevent_context *ev,
+				    struct tevent_fd *fde,
+				    uint16_t flags,
+				    void *private_data)
+{
+	struct vfs_io_uring_ring *ring = talloc_get_type_abort(
+		private_data, struct vfs_io_uring_ring);
+	struct io_uring_cqe *cqe = NULL;
+	unsigned head;
+	unsigned num_cqes = 0;
+
+	if ((flags & TEVENT_FD_READ) == 0) {
+		return;
+	}
+
+	io_uring_for_each_cqe(&ring->uring, head, cqe) {
+		struct vfs_io_uring_request *cur = talloc_get_type_abort(
+			io_uring_cqe_get_data(cqe),
+			struct vfs_io_uring_request);
+
+		vfs_io_uring_finish_req(cur, cqe);
+		num_cqes += 1;
+	}
+
+	io_uring_cq_advance(&ring->uring, num_cqes);
+
+	/*
+	 * We freed up slots, push out whatever was waiting for them.
+	 */
+	vfs_io_uring_queue_run(ring);
+}
+
+static int vfs_io_uring_state_destructor(struct vfs_io_uring_state *state)
+{
+	struct vfs_io_uring_request *cur = state->ur;
+
+	if (cur->list_head == NULL) {
+		return 0;
+	}
+
+	if (cur->list_head == &cur->ring->queue) {
+		/*
+		 * Not yet seen by the kernel, just forget it.
+		 */
+		DLIST_REMOVE(cur->ring->queue, cur);
+		cur->list_head = NULL;
+		return 0;
+	}
+
+	/*
+	 * The kernel still reads from or writes into the buffer and
+	 * the iovec below us. Refuse to be freed, talloc moves us to
+	 * our grandparent. The completion handler frees us once the
+	 * kernel is done. Callers must keep the buffer itself alive
+	 * until then, smbd does so by waiting for all aio on a file
+	 * before closing it.
+	 */
+	cur->req = NULL;
+	return -1;
+}
+
+static struct tevent_req *vfs_io_uring_request_create(
+	struct vfs_handle_struct *handle,
+	TALLOC_CTX *mem_ctx,
+	struct tevent_context *ev,
+	struct vfs_io_uring_state **pstate)
+{
+	struct vfs_io_uring_config *config = NULL;
+	struct vfs_io_uring_ring *ring = NULL;
+	struct vfs_io_uring_state *state = NULL;
+	struct tevent_req *req = NULL;
+
+	SMB_VFS_HANDLE_GET_DATA(handle, config,
+				struct vfs_io_uring_config,
+				return NULL);
+
+	ring = vfs_io_uring_get_ring(config, ev);
+	if (ring == NULL) {
+		return NULL;
+	}
+
+	req = tevent_req_create(mem_ctx, &state, struct vfs_io_uring_state);
+	if (req == NULL) {
+		return NULL;
+	}
+
+	state->ur = talloc_zero(state, struct vfs_io_uring_request);
+	if (tevent_req_nomem(state->ur, req)) {
+		return tevent_req_post(req, ev);
+	}
+	state->ur->ring = ring;
+	state->ur->req = req;
+
+	*pstate = state;
+	return req;
+}
+
+static void vfs_io_uring_request_submit(struct vfs_io_uring_state *state)
+{
+	struct vfs_io_uring_request *cur = state->ur;
+	struct vfs_io_uring_ring *ring = cur->ring;
+
+	io_uring_sqe_set_data(&cur->sqe, cur);
+
+	DLIST_ADD_END(ring->queue, cur);
+	cur->list_head = &ring->queue;
+	talloc_set_destructor(state, vfs_io_uring_state_destructor);
+
+	if (!ring->submit_scheduled) {
+		tevent_schedule_immediate(ring->submit_im, ring->ev,
+					  vfs_io_uring_submit_handler, ring);
+		ring->submit_scheduled = true;
+	}
+}
+
+static struct tevent_req *vfs_io_uring_pread_send(
+	struct vfs_handle_struct *handle, TALLOC_CTX *mem_ctx,
+	struct tevent_context *ev, struct files_struct *fsp,
+	void *data, size_t n, off_t offset)
+{
+	struct tevent_req *req;
+	struct vfs_io_uring_state *state = NULL;
+
+	req = vfs_io_uring_request_create(handle, mem_ctx, ev, &state);
+	if (req == NULL) {
+		return SMB_VFS_NEXT_PREAD_SEND(mem_ctx, ev, handle, fsp,
+					       data, n, offset);
+	}
+	if (!tevent_req_is_in_progress(req)) {
+		return req;
+	}
+
+	SMBPROFILE_BYTES_ASYNC_START(syscall_asys_pread, profile_p,
+				     state->profile_bytes, n);
+
+	state->ur->iov = (struct iovec) {
+		.iov_base = data,
+		.iov_len = n,
+	};
+	io_uring_prep_readv(&state->ur->sqe, fsp->fh->fd,
+			    &state->ur->iov, 1, offset);
+	vfs_io_uring_request_submit(state);
+
+	return req;
+}
+
+static struct tevent_req *vfs_io_uring_pwrite_send(
+	struct vfs_handle_struct *handle, TALLOC_CTX *mem_ctx,
+	struct tevent_context *ev, struct files_struct *fsp,
+	const void *data, size_t n, off_t offset)
+{
+	struct tevent_req *req;
+	struct vfs_io_uring_state *state = NULL;
+
+	req = vfs_io_uring_request_create(handle, mem_ctx, ev, &state);
+	if (req == NULL) {
+		return SMB_VFS_NEXT_PWRITE_SEND(mem_ctx, ev, handle, fsp,
+						data, n, offset);
+	}
+	if (!tevent_req_is_in_progress(req)) {
+		return req;
+	}
+
+	SMBPROFILE_BYTES_ASYNC_START(syscall_asys_pwrite, profile_p,
+				     state->profile_bytes, n);
+
+	state->ur->iov = (struct iovec) {
+		.iov_base = discard_const(data),
+		.iov_len = n,
+	};
+	io_uring_prep_writev(&state->ur->sqe, fsp->fh->fd,
+			     &state->ur->iov, 1, offset);
+	vfs_io_uring_request_submit(state);
+
+	return req;
+}
+
+static struct tevent_req *vfs_io_uring_fsync_send(
+	struct vfs_handle_struct *handle, TALLOC_CTX *mem_ctx,
+	struct tevent_context *ev, struct files_struct *fsp)
+{
+	struct tevent_req *req;
+	struct vfs_io_uring_state *state = NULL;
+
+	req = vfs_io_uring_request_create(handle, mem_ctx, ev, &state);
+	if (req == NULL) {
+		return SMB_VFS_NEXT_FSYNC_SEND(mem_ctx, ev, handle, fsp);
+	}
+	if (!tevent_req_is_in_progress(req)) {
+		return req;
+	}
+
+	SMBPROFILE_BASIC_ASYNC_START(syscall_asys_fsync, profile_p,
+				     state->profile_basic);
+
+	io_uring_prep_fsync(&state->ur->sqe, fsp->fh->fd, 0);
+	vfs_io_uring_request_submit(state);
+
+	return req;
+}
+
+static ssize_t vfs_io_uring_recv(struct tevent_req *req, int *err)
+{
+	struct vfs_io_uring_state *state = tevent_req_data(
+		req, struct vfs_io_uring_state);
+
+	if (tevent_req_is_unix_error(req, err)) {
+		return -1;
+	}
+	if (state->ret == -1) {
+		*err = state->err;
+	}
+	return state->ret;
+}
+
+static int vfs_io_uring_int_recv(struct tevent_req *req, int *err)
+{
+	/*
+	 * Use implicit conversion ssize_t->int
+	 */
+	return vfs_io_uring_recv(req, err);
+}
+
+static int vfs_io_uring_connect(vfs_handle_struct *handle,
+				const char *service,
+				const char *user)
+{
+	struct vfs_io_uring_config *config;
+	int ret;
+
+	ret = SMB_VFS_NEXT_CONNECT(handle, service, user);
+	if (ret < 0) {
+		return ret;
+	}
+
+	config = talloc_zero(handle, struct vfs_io_uring_config);
+	if (config == NULL) {
+		SMB_VFS_NEXT_DISCONNECT(handle);
+		errno = ENOMEM;
+		return -1;
+	}
+
+	config->num_entries = lp_parm_ulong(SNUM(handle->conn),
+					    "io_uring",
+					    "num_entries",
+					    128);
+	config->num_entries = MAX(config->num_entries, 1);
+
+	SMB_VFS_HANDLE_SET_DATA(handle, config,
+				NULL, struct vfs_io_uring_config,
+				return -1);
+
+	return 0;
+}
+
+static struct vfs_fn_pointers vfs_io_uring_fns = {
+	.connect_fn = vfs_io_uring_connect,
+	.pread_send_fn = vfs_io_uring_pread_send,
+	.pread_recv_fn = vfs_io_uring_recv,
+	.pwrite_send_fn = vfs_io_uring_pwrite_send,
+	.pwrite_recv_fn = vfs_io_uring_recv,
+	.fsync_send_fn = vfs_io_uring_fsync_send,
+	.fsync_recv_fn = vfs_io_uring_int_recv,
+};
+
+static_decl_vfs;
+NTSTATUS vfs_io_uring_init(void)
+{
+	return smb_register_vfs(SMB_VFS_INTERFACE_VERSION,
+				"io_uring", &vfs_io_uring_fns);
+}
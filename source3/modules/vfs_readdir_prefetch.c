@@ -0,0 +1,602 @@
+/*
+ * VFS module to stat directory entries in parallel.
+ *
+ * Copyright (C) Samba Team 2026
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * A directory listing stats every entry and reads its DOS attribute
+ * xattr, one entry after the other. On file systems where each of these
+ * is a network round trip that makes listing a large directory latency
+ * bound.
+ *
+ * This module reads the directory ahead in batches and has the stat
+ * and the getxattr of all entries of a batch done by a thread pool,
+ * with the credentials of the current user. readdir then hands out the
+ * stat results and the following getxattr of the DOS attribute of the
+ * entry just returned is answered from the prefetched value.
+ *
+ * The threads do the system calls themselves, so this module has to
+ * be the last one before the default VFS module.
+ */
+
+#include "includes.h"
+#include "system/filesys.h"
+#include "smbd/smbd.h"
+#include "smbd/globals.h"
+#include "lib/pthreadpool/pthreadpool.h"
+
+#if defined(HAVE_DIRFD) && defined(HAVE_FSTATAT) && \
+	defined(USE_LINUX_THREAD_CREDENTIALS)
+
+/*
+ * NB. This threadpool is shared over all
+ * instances of this VFS module in this
+ * process.
+ */
+
+static struct pthreadpool *prefetch_pool;
+
+struct readdir_prefetch_dir;
+
+struct readdir_prefetch_entry {
+	struct readdir_prefetch_dir *dir;
+	struct dirent dirent;
+	/* SMB_VFS_NEXT_TELLDIR after reading this entry */
+	long offset;
+	/* Name as smbd builds it for getxattr, NULL if not prefetched */
+	char *path;
+
+	/* Returns. */
+	SMB_STRUCT_STAT st;
+	bool xattr_valid;
+	ssize_t xattr_len;
+	int xattr_errno;
+	char xattr[sizeof(fstring)];
+};
+
+struct readdir_prefetch_dir {
+	struct readdir_prefetch_dir *prev, *next;
+	DIR *dirp;
+	/* Directory path as passed to opendir, NULL if unknown */
+	char *path;
+
+	/* The current batch */
+	struct readdir_prefetch_entry *entries;
+	unsigned num_entries;
+	unsigned pos;
+	long start_offset;
+	struct readdir_prefetch_entry *last;
+
+	/* Inputs for the workers. */
+	int dir_fd;
+	int stat_flags;
+	bool fake_dir_create_times;
+	const struct security_unix_token *ux_tok;
+};
+
+struct readdir_prefetch_config {
+	int batch_size;
+	bool store_dos_attributes;
+	bool fake_dir_create_times;
+	struct readdir_prefetch_dir *dirs;
+};
+
+/************************************************************************
+ Ensure thread pool is initialized.
+***********************************************************************/
+
+static bool init_prefetch_pool(void)
+{
+	int ret;
+
+	if (prefetch_pool != NULL) {
+		return true;
+	}
+
+	ret = pthreadpool_init(lp_aio_max_threads(), &prefetch_pool);
+	if (ret != 0) {
+		errno = ret;
+		return false;
+	}
+
+	DEBUG(10,("init_prefetch_pool: initialized with up to %d threads\n",
+		  (int)lp_aio_max_threads()));
+
+	return true;
+}
+
+static struct readdir_prefetch_dir *find_prefetch_dir(
+	struct readdir_prefetch_config *config, DIR *dirp)
+{
+	struct readdir_prefetch_dir *d;
+
+	for (d = config->dirs; d != NULL; d = d->next) {
+		if (d->dirp == dirp) {
+			return d;
+		}
+	}
+	return NULL;
+}
+
+static void drop_prefetch_batch(struct readdir_prefetch_dir *d)
+{
+	TALLOC_FREE(d->entries);
+	d->num_entries = 0;
+	d->pos = 0;
+	d->last = NULL;
+}
+
+/*****************************************************************
+ The worker function, fills in the returns of one entry. Entries
+ that can't be done are left invalid for smbd to do them itself.
+*****************************************************************/
+
+static void readdir_prefetch_worker(void *private_data)
+{
+	struct readdir_prefetch_entry *e =
+		(struct readdir_prefetch_entry *)private_data;
+	struct readdir_prefetch_dir *d = e->dir;
+	struct stat st;
+	int ret;
+
+	/* Become the correct credential on this thread. */
+	if (set_thread_credentials(d->ux_tok->uid,
+				d->ux_tok->gid,
+				(size_t)d->ux_tok->ngroups,
+				d->ux_tok->groups) != 0) {
+		return;
+	}
+
+	ret = fstatat(d->dir_fd, e->dirent.d_name, &st, d->stat_flags);
+	if (ret != 0) {
+		return;
+	}
+	init_stat_ex_from_stat(&e->st, &st, d->fake_dir_create_times);
+
+	if (e->path == NULL) {
+		return;
+	}
+
+	e->xattr_len = getxattr(e->path, SAMBA_XATTR_DOS_ATTRIB,
+				e->xattr, sizeof(e->xattr));
+	e->xattr_errno = (e->xattr_len == -1) ? errno : 0;
+	e->xattr_valid = true;
+}
+
+/************************************************************************
+ Have the entries of the current batch done by the thread pool and
+ wait for them.
+***********************************************************************/
+
+static void readdir_prefetch_stat(vfs_handle_struct *handle,
+				  struct readdir_prefetch_config *config,
+				  struct readdir_prefetch_dir *d)
+{
+	unsigned i, num_jobs, num_done;
+	bool get_xattr;
+
+	d->ux_tok = copy_unix_token(d->entries,
+				    get_current_utok(handle->conn));
+	if (d->ux_tok == NULL) {
+		return;
+	}
+	d->dir_fd = dirfd(d->dirp);
+	if (d->dir_fd == -1) {
+		return;
+	}
+	d->stat_flags = lp_posix_pathnames() ? AT_SYMLINK_NOFOLLOW : 0;
+	d->fake_dir_create_times = config->fake_dir_create_times;
+
+	get_xattr = config->store_dos_attributes && (d->path != NULL);
+
+	num_jobs = 0;
+
+	for (i = 0; i < d->num_entries; i++) {
+		struct readdir_prefetch_entry *e = &d->entries[i];
+		const char *name = e->dirent.d_name;
+		int ret;
+
+		if (ISDOT(name) || ISDOTDOT(name)) {
+			/* smbd doesn't use them */
+			continue;
+		}
+
+		if (get_xattr) {
+			/*
+			 * Don't pass ./xxx, see smbd_dirptr_get_entry()
+			 */
+			if (ISDOT(d->path)) {
+				e->path = talloc_strdup(d->entries, name);
+			} else {
+				e->path = talloc_asprintf(d->entries, "%s/%s",
+							  d->path, name);
+			}
+			if (e->path == NULL) {
+				break;
+			}
+		}
+
+		ret = pthreadpool_add_job(prefetch_pool, i,
+					  readdir_prefetch_worker, e);
+		if (ret != 0) {
+			DEBUG(5, ("readdir_prefetch_stat: pthreadpool_add_job "
+				  "failed: %s\n", strerror(ret)));
+			e->path = NULL;
+			break;
+		}
+		num_jobs += 1;
+	}
+
+	num_done = 0;
+
+	while (num_done < num_jobs) {
+		int jobids[64];
+		int ret;
+
+		ret = pthreadpool_finished_jobs(
+			prefetch_pool, jobids,
+			MIN(num_jobs - num_done, ARRAY_SIZE(jobids)));
+		if (ret < 0) {
+			/*
+			 * The workers still use the entries, we can't
+			 * free them.
+			 */
+			smb_panic("readdir_prefetch_stat");
+			/* notreached. */
+			return;
+		}
+		num_done += ret;
+	}
+
+	DEBUG(10, ("readdir_prefetch_stat: prefetched %u entries of %s\n",
+		   num_jobs, d->path ? d->path : "(unknown)"));
+}
+
+/************************************************************************
+ Read the next batch of entries from the directory.
+***********************************************************************/
+
+static bool readdir_prefetch_fill(vfs_handle_struct *handle,
+				  struct readdir_prefetch_config *config,
+				  struct readdir_prefetch_dir *d,
+				  bool want_stat)
+{
+	int i;
+
+	drop_prefetch_batch(d);
+
+	d->entries = talloc_array(d, struct readdir_prefetch_entry,
+				  config->batch_size);
+	if (d->entries == NULL) {
+		return false;
+	}
+
+	d->start_offset = SMB_VFS_NEXT_TELLDIR(handle, d->dirp);
+
+	for (i = 0; i < config->batch_size; i++) {
+		struct readdir_prefetch_entry *e = &d->entries[i];
+		struct dirent *dp;
+
+		dp = SMB_VFS_NEXT_READDIR(handle, d->dirp, NULL);
+		if (dp == NULL) {
+			break;
+		}
+
+		*e = (struct readdir_prefetch_entry) {
+			.dir = d,
+			.dirent = *dp,
+			.offset = SMB_VFS_NEXT_TELLDIR(handle, d->dirp),
+		};
+		SET_STAT_INVALID(e->st);
+
+		d->num_entries += 1;
+	}
+
+	if (want_stat && (d->num_entries != 0)) {
+		readdir_prefetch_stat(handle, config, d);
+	}
+
+	return true;
+}
+
+static void readdir_prefetch_add_dir(vfs_handle_struct *handle,
+				     DIR *dirp, const char *path)
+{
+	struct readdir_prefetch_config *config;
+	struct readdir_prefetch_dir *d;
+
+	SMB_VFS_HANDLE_GET_DATA(handle, config,
+				struct readdir_prefetch_config, return);
+
+	d = talloc_zero(config, struct readdir_prefetch_dir);
+	if (d == NULL) {
+		/* Just not prefetched. */
+		return;
+	}
+	d->dirp = dirp;
+	d->dir_fd = -1;
+
+	if (path != NULL) {
+		d->path = talloc_strdup(d, path);
+		if (d->path == NULL) {
+			TALLOC_FREE(d);
+			return;
+		}
+	}
+
+	DLIST_ADD(config->dirs, d);
+}
+
+static int readdir_prefetch_connect(vfs_handle_struct *handle,
+				    const char *service,
+				    const char *user)
+{
+	struct readdir_prefetch_config *config;
+	int snum = SNUM(handle->conn);
+	int ret;
+
+	ret = SMB_VFS_NEXT_CONNECT(handle, service, user);
+	if (ret < 0) {
+		return ret;
+	}
+
+	config = talloc_zero(handle->conn, struct readdir_prefetch_config);
+	if (config == NULL) {
+		SMB_VFS_NEXT_DISCONNECT(handle);
+		errno = ENOMEM;
+		return -1;
+	}
+
+	config->batch_size = lp_parm_int(snum, "readdir_prefetch",
+					 "batch size", 128);
+	config->store_dos_attributes = lp_store_dos_attributes(snum);
+	config->fake_dir_create_times = lp_fake_directory_create_times(snum);
+
+	if (!init_prefetch_pool()) {
+		DEBUG(1, ("readdir_prefetch_connect: could not create the "
+			  "thread pool: %s\n", strerror(errno)));
+		config->batch_size = 0;
+	}
+
+	SMB_VFS_HANDLE_SET_DATA(handle, config, NULL,
+				struct readdir_prefetch_config, return -1);
+
+	return 0;
+}
+
+static DIR *readdir_prefetch_opendir(vfs_handle_struct *handle,
+				     const char *fname, const char *mask,
+				     uint32_t attr)
+{
+	DIR *dirp;
+
+	dirp = SMB_VFS_NEXT_OPENDIR(handle, fname, mask, attr);
+	if (dirp != NULL) {
+		readdir_prefetch_add_dir(handle, dirp, fname);
+	}
+	return dirp;
+}
+
+static DIR *readdir_prefetch_fdopendir(vfs_handle_struct *handle,
+				       files_struct *fsp,
+				       const char *mask,
+				       uint32_t attr)
+{
+	DIR *dirp;
+
+	dirp = SMB_VFS_NEXT_FDOPENDIR(handle, fsp, mask, attr);
+	if (dirp != NULL) {
+		readdir_prefetch_add_dir(handle, dirp,
+					 fsp->fsp_name->base_name);
+	}
+	return dirp;
+}
+
+static struct dirent *readdir_prefetch_readdir(vfs_handle_struct *handle,
+					       DIR *dirp,
+					       SMB_STRUCT_STAT *sbuf)
+{
+	struct readdir_prefetch_config *config;
+	struct readdir_prefetch_dir *d;
+	struct readdir_prefetch_entry *e;
+
+	SMB_VFS_HANDLE_GET_DATA(handle, config,
+				struct readdir_prefetch_config, return NULL);
+
+	d = find_prefetch_dir(config, dirp);
+	if ((d == NULL) || (config->batch_size <= 0)) {
+		return SMB_VFS_NEXT_READDIR(handle, dirp, sbuf);
+	}
+
+	if (d->pos == d->num_entries) {
+		if (!readdir_prefetch_fill(handle, config, d, sbuf != NULL)) {
+			return SMB_VFS_NEXT_READDIR(handle, dirp, sbuf);
+		}
+		if (d->num_entries == 0) {
+			return NULL;
+		}
+	}
+
+	e = &d->entries[d->pos++];
+	d->last = e;
+
+	if (sbuf != NULL) {
+		*sbuf = e->st;
+	}
+	return &e->dirent;
+}
+
+static void readdir_prefetch_seekdir(vfs_handle_struct *handle, DIR *dirp,
+				     long offset)
+{
+	struct readdir_prefetch_config *config;
+	struct readdir_prefetch_dir *d;
+	unsigned i;
+
+	SMB_VFS_HANDLE_GET_DATA(handle, config,
+				struct readdir_prefetch_config, return);
+
+	d = find_prefetch_dir(config, dirp);
+	if ((d != NULL) && (d->entries != NULL)) {
+		/*
+		 * smbd seeks back to the entry that did not fit into the
+		 * last response, that one is still in our batch.
+		 */
+		if (offset == d->start_offset) {
+			d->pos = 0;
+			d->last = NULL;
+			return;
+		}
+		for (i = 0; i < d->num_entries; i++) {
+			if (d->entries[i].offset == offset) {
+				d->pos = i + 1;
+				d->last = NULL;
+				return;
+			}
+		}
+		drop_prefetch_batch(d);
+	}
+
+	SMB_VFS_NEXT_SEEKDIR(handle, dirp, offset);
+}
+
+static long readdir_prefetch_telldir(vfs_handle_struct *handle, DIR *dirp)
+{
+	struct readdir_prefetch_config *config;
+	struct readdir_prefetch_dir *d;
+
+	SMB_VFS_HANDLE_GET_DATA(handle, config,
+				struct readdir_prefetch_config, return -1);
+
+	d = find_prefetch_dir(config, dirp);
+	if ((d == NULL) || (d->entries == NULL)) {
+		return SMB_VFS_NEXT_TELLDIR(handle, dirp);
+	}
+	if (d->pos == 0) {
+		return d->start_offset;
+	}
+	return d->entries[d->pos - 1].offset;
+}
+
+static void readdir_prefetch_rewinddir(vfs_handle_struct *handle, DIR *dirp)
+{
+	struct readdir_prefetch_config *config;
+	struct readdir_prefetch_dir *d;
+
+	SMB_VFS_HANDLE_GET_DATA(handle, config,
+				struct readdir_prefetch_config, return);
+
+	d = find_prefetch_dir(config, dirp);
+	if (d != NULL) {
+		drop_prefetch_batch(d);
+	}
+
+	SMB_VFS_NEXT_REWINDDIR(handle, dirp);
+}
+
+static int readdir_prefetch_closedir(vfs_handle_struct *handle, DIR *dirp)
+{
+	struct readdir_prefetch_config *config;
+	struct readdir_prefetch_dir *d;
+
+	SMB_VFS_HANDLE_GET_DATA(handle, config,
+				struct readdir_prefetch_config, return -1);
+
+	d = find_prefetch_dir(config, dirp);
+	if (d != NULL) {
+		DLIST_REMOVE(config->dirs, d);
+		TALLOC_FREE(d);
+	}
+
+	return SMB_VFS_NEXT_CLOSEDIR(handle, dirp);
+}
+
+/*****************************************************************
+ Answer the getxattr of the DOS attribute smbd does right after
+ readdir returned an entry, each prefetched value is used once.
+*****************************************************************/
+
+static ssize_t readdir_prefetch_getxattr(vfs_handle_struct *handle,
+					 const char *path,
+					 const char *name,
+					 void *value,
+					 size_t size)
+{
+	struct readdir_prefetch_config *config;
+	struct readdir_prefetch_dir *d;
+
+	SMB_VFS_HANDLE_GET_DATA(handle, config,
+				struct readdir_prefetch_config, return -1);
+
+	if (strcmp(name, SAMBA_XATTR_DOS_ATTRIB) != 0) {
+		return SMB_VFS_NEXT_GETXATTR(handle, path, name, value, size);
+	}
+
+	for (d = config->dirs; d != NULL; d = d->next) {
+		struct readdir_prefetch_entry *e = d->last;
+
+		if ((e == NULL) || !e->xattr_valid ||
+		    (strcmp(e->path, path) != 0)) {
+			continue;
+		}
+		e->xattr_valid = false;
+
+		if (e->xattr_len == -1) {
+			if ((e->xattr_errno == ERANGE) &&
+			    (size > sizeof(e->xattr))) {
+				/* Our buffer was too small */
+				break;
+			}
+			errno = e->xattr_errno;
+			return -1;
+		}
+		if (size == 0) {
+			return e->xattr_len;
+		}
+		if ((size_t)e->xattr_len > size) {
+			break;
+		}
+		memcpy(value, e->xattr, e->xattr_len);
+		return e->xattr_len;
+	}
+
+	return SMB_VFS_NEXT_GETXATTR(handle, path, name, value, size);
+}
+
+#endif
+
+static struct vfs_fn_pointers vfs_readdir_prefetch_fns = {
+#if defined(HAVE_DIRFD) && defined(HAVE_FSTATAT) && \
+	defined(USE_LINUX_THREAD_CREDENTIALS)
+	.connect_fn = readdir_prefetch_connect,
+	.opendir_fn = readdir_prefetch_opendir,
+	.fdopendir_fn = readdir_prefetch_fdopendir,
+	.readdir_fn = readdir_prefetch_readdir,
+	.seekdir_fn = readdir_prefetch_seekdir,
+	.telldir_fn = readdir_prefetch_telldir,
+	.rewind_dir_fn = readdir_prefetch_rewinddir,
+	.closedir_fn = readdir_prefetch_closedir,
+	.getxattr_fn = readdir_prefetch_getxattr,
+#endif
+};
+
+NTSTATUS vfs_readdir_prefetch_init(void);
+NTSTATUS vfs_readdir_prefetch_init(void)
+{
+	return smb_register_vfs(SMB_VFS_INTERFACE_VERSION,
+				"readdir_prefetch", &vfs_readdir_prefetch_fns);
+}
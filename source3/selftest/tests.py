@@ -56,6 +56,7 @@ finally:
 
 have_libarchive = ("HAVE_LIBARCHIVE" in config_hash)
 have_linux_kernel_oplocks = ("HAVE_KERNEL_OPLOCKS_LINUX" in config_hash)
+have_liburing = ("HAVE_LIBURING" in config_hash)
 
 plantestsuite("samba3.blackbox.success", "nt4_dc:local", [os.path.join(samba3srcdir, "script/tests/test_success.sh")])
 plantestsuite("samba3.blackbox.failure", "nt4_dc:local", [os.path.join(samba3srcdir, "script/tests/test_failure.sh")])
@@ -97,6 +98,8 @@ for t in tests:
 tests = ["RW1", "RW2", "RW3"]
 for t in tests:
     plantestsuite("samba3.smbtorture_s3.vfs_aio_fork(simpleserver).%s" % t, "simpleserver", [os.path.join(samba3srcdir, "script/tests/test_smbtorture_s3.sh"), t, '//$SERVER_IP/vfs_aio_fork', '$USERNAME', '$PASSWORD', smbtorture3, "", "-l $LOCAL_PATH"])
+    if have_liburing:
+        plantestsuite("samba3.smbtorture_s3.vfs_io_uring(simpleserver).%s" % t, "simpleserver", [os.path.join(samba3srcdir, "script/tests/test_smbtorture_s3.sh"), t, '//$SERVER_IP/vfs_io_uring', '$USERNAME', '$PASSWORD', smbtorture3, "", "-l $LOCAL_PATH"])
 
 posix_tests = ["POSIX", "POSIX-APPEND", "POSIX-SYMLINK-ACL", "POSIX-SYMLINK-EA"]
 
@@ -399,6 +402,9 @@ for t in tests:
         plansmbtorture4testsuite(t, "ad_dc", '//$SERVER/tmp -U$USERNAME%$PASSWORD')
     elif t == "raw.search":
         plansmbtorture4testsuite(t, "nt4_dc", '//$SERVER_IP/tmp -U$USERNAME%$PASSWORD')
+        # resume keys and seeks into the prefetched batch
+        plansmbtorture4testsuite(t, "simpleserver", '//$SERVER/readdir_prefetch -U$USERNAME%$PASSWORD', description="readdir_prefetch")
+        plansmbtorture4testsuite(t, "simpleserver", '//$SERVER/readdir_prefetch_small -U$USERNAME%$PASSWORD', description="readdir_prefetch small batch")
 # test the dirsort module.
         plansmbtorture4testsuite(t, "nt4_dc", '//$SERVER_IP/tmpsort -U$USERNAME%$PASSWORD')
         plansmbtorture4testsuite(t, "ad_dc", '//$SERVER/tmp -U$USERNAME%$PASSWORD')
@@ -417,13 +423,42 @@ for t in tests:
     elif t == "smb2.notify":
         plansmbtorture4testsuite(t, "nt4_dc", '//$SERVER_IP/tmp -U$USERNAME%$PASSWORD --signing=required')
         plansmbtorture4testsuite(t, "ad_dc", '//$SERVER/tmp -U$USERNAME%$PASSWORD --signing=required')
+    elif t == "smb2.read":
+        plansmbtorture4testsuite(t, "nt4_dc", '//$SERVER_IP/tmp -U$USERNAME%$PASSWORD')
+        plansmbtorture4testsuite(t, "ad_dc", '//$SERVER/tmp -U$USERNAME%$PASSWORD')
+        # shrinks the credit window with every read
+        plansmbtorture4testsuite(t, "simpleserver", '//$SERVER/tmp -U$USERNAME%$PASSWORD', description="credit window")
     elif t == "smb2.dosmode":
         plansmbtorture4testsuite(t, "simpleserver", '//$SERVER/dosmode -U$USERNAME%$PASSWORD')
     elif t == "smb2.kernel-oplocks":
         if have_linux_kernel_oplocks:
             plansmbtorture4testsuite(t, "nt4_dc", '//$SERVER/kernel_oplocks -U$USERNAME%$PASSWORD')
+    elif t == "smb2.bench":
+        # skipped by default, run with --include to compare aio backends
+        # and directory listing with and without readdir_prefetch
+        plansmbtorture4testsuite(t, "simpleserver", '//$SERVER/vfs_aio_pthread -U$USERNAME%$PASSWORD', description="vfs_aio_pthread")
+        if have_liburing:
+            plansmbtorture4testsuite(t, "simpleserver", '//$SERVER/vfs_io_uring -U$USERNAME%$PASSWORD', description="vfs_io_uring")
+        plansmbtorture4testsuite(t, "simpleserver", '//$SERVER/readdir_prefetch -U$USERNAME%$PASSWORD', description="readdir_prefetch")
+    elif t == "smb2.dir":
+        plansmbtorture4testsuite(t, "nt4_dc", '//$SERVER_IP/tmp -U$USERNAME%$PASSWORD')
+        plansmbtorture4testsuite(t, "ad_dc", '//$SERVER/tmp -U$USERNAME%$PASSWORD')
+        # list large directories in chunks of a few entries
+        plansmbtorture4testsuite(t, "simpleserver", '//$SERVER/qdir_chunk -U$USERNAME%$PASSWORD', description="chunked")
+        plansmbtorture4testsuite(t, "simpleserver", '//$SERVER/readdir_prefetch -U$USERNAME%$PASSWORD', description="readdir_prefetch")
+        plansmbtorture4testsuite(t, "simpleserver", '//$SERVER/readdir_prefetch_small -U$USERNAME%$PASSWORD', description="readdir_prefetch small batch")
+    elif t == "base.dir1" or t == "base.dir2":
+        plansmbtorture4testsuite(t, "nt4_dc", '//$SERVER_IP/tmp -U$USERNAME%$PASSWORD')
+        plansmbtorture4testsuite(t, "ad_dc", '//$SERVER/tmp -U$USERNAME%$PASSWORD')
+        plansmbtorture4testsuite(t, "simpleserver", '//$SERVER/readdir_prefetch -U$USERNAME%$PASSWORD', description="readdir_prefetch")
+        plansmbtorture4testsuite(t, "simpleserver", '//$SERVER/readdir_prefetch_small -U$USERNAME%$PASSWORD', description="readdir_prefetch small batch")
     elif t == "vfs.acl_xattr":
         plansmbtorture4testsuite(t, "nt4_dc", '//$SERVER_IP/tmp -U$USERNAME%$PASSWORD')
+        plansmbtorture4testsuite(t, "nt4_dc", '//$SERVER_IP/acl_xattr_cache -U$USERNAME%$PASSWORD', description="sd cache")
+    elif t == "smb2.acls":
+        plansmbtorture4testsuite(t, "nt4_dc", '//$SERVER_IP/tmp -U$USERNAME%$PASSWORD')
+        plansmbtorture4testsuite(t, "ad_dc", '//$SERVER/tmp -U$USERNAME%$PASSWORD')
+        plansmbtorture4testsuite(t, "nt4_dc", '//$SERVER_IP/acl_xattr_cache -U$USERNAME%$PASSWORD', description="sd cache")
     else:
         plansmbtorture4testsuite(t, "nt4_dc", '//$SERVER_IP/tmp -U$USERNAME%$PASSWORD')
         plansmbtorture4testsuite(t, "ad_dc", '//$SERVER/tmp -U$USERNAME%$PASSWORD')
@@ -706,11 +706,16 @@ NTSTATUS schedule_smb2_aio_read(connection_struct *conn,
 		return NT_STATUS_RETRY;
 	}
 
-	/* Create the out buffer. */
-	*preadbuf = data_blob_talloc(ctx, NULL, smb_maxcnt);
+	/*
+	 * Create the out buffer, with room for the
+	 * compound padding behind the data.
+	 */
+	*preadbuf = data_blob_talloc(ctx, NULL,
+				     smb_maxcnt + SMBD_SMB2_OUT_DYN_TAILROOM);
 	if (preadbuf->data == NULL) {
 		return NT_STATUS_NO_MEMORY;
 	}
+	preadbuf->length = smb_maxcnt;
 
 	if (!(aio_ex = create_aio_extra(smbreq->smb2req, fsp, 0))) {
 		return NT_STATUS_NO_MEMORY;
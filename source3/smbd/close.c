@@ -1072,6 +1072,31 @@ static NTSTATUS close_directory(struct smb_request *req, files_struct *fsp,
 		notify_status = NT_STATUS_OK;
 	}
 
+	if (fsp->num_aio_requests != 0) {
+
+		if (close_type != SHUTDOWN_CLOSE) {
+			/*
+			 * The smb2 close must have waited for
+			 * outstanding directory queries, they use
+			 * fsp->dptr.
+			 */
+			DEBUG(0, ("fsp->num_aio_requests=%u\n",
+				  fsp->num_aio_requests));
+			smb_panic("can not close directory with outstanding "
+				  "requests");
+		}
+
+		/*
+		 * See close_normal_file(), drop the close request
+		 * first.
+		 */
+		TALLOC_FREE(fsp->deferred_close);
+
+		while (fsp->num_aio_requests != 0) {
+			talloc_free(fsp->aio_requests[0]);
+		}
+	}
+
 	/*
 	 * NT can set delete_on_close of the last open
 	 * reference to a directory also.
@@ -1095,8 +1120,7 @@ static NTSTATUS close_directory(struct smb_request *req, files_struct *fsp,
 			become_user(fsp->conn, fsp->vuid);
 			became_user = True;
 		}
-		send_stat_cache_delete_message(fsp->conn->sconn->msg_ctx,
-					       fsp->fsp_name->base_name);
+		send_stat_cache_delete_message(fsp->conn->sconn->msg_ctx, fsp);
 		set_delete_on_close_lck(fsp, lck,
 				get_current_nttok(fsp->conn),
 				get_current_utok(fsp->conn));
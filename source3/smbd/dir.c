@@ -76,6 +76,15 @@ struct dptr_struct {
 	bool priv;     /* Directory handle opened with privilege. */
 	uint32_t counter;
 	struct memcache *dptr_cache;
+	/* Stat information looked up ahead, see dptr_set_prefetched_stat() */
+	struct dptr_stat_prefetch *stat_prefetch;
+};
+
+struct dptr_stat_prefetch {
+	unsigned num_names;
+	unsigned next;
+	char **names;
+	SMB_STRUCT_STAT *st;
 };
 
 static struct smb_Dir *OpenDir_fsp(TALLOC_CTX *mem_ctx, connection_struct *conn,
@@ -653,6 +662,9 @@ void dptr_CloseDir(files_struct *fsp)
 
 void dptr_SeekDir(struct dptr_struct *dptr, long offset)
 {
+	if (offset != dptr->dir_hnd->offset) {
+		TALLOC_FREE(dptr->stat_prefetch);
+	}
 	SeekDir(dptr->dir_hnd, offset);
 }
 
@@ -681,6 +693,77 @@ void dptr_set_priv(struct dptr_struct *dptr)
 	dptr->priv = true;
 }
 
+/****************************************************************************
+ Where a directory stream of its own has to start reading to see the
+ entries this search returns next. Returns false at the end of the
+ directory, sets *pseek to false if the search is at its start.
+****************************************************************************/
+
+bool dptr_readahead_offset(struct dptr_struct *dptr, long *poffset,
+			   bool *pseek)
+{
+	long offset = dptr->dir_hnd->offset;
+
+	if (offset == END_OF_DIRECTORY_OFFSET) {
+		return false;
+	}
+
+	/*
+	 * "." and ".." are returned by ReadDirName() itself before
+	 * the first real entry.
+	 */
+	*pseek = ((offset != START_OF_DIRECTORY_OFFSET) &&
+		  (offset != DOT_DOT_DIRECTORY_OFFSET));
+	*poffset = offset;
+	return true;
+}
+
+/****************************************************************************
+ Hand over stat information for the next num_names entries of a search,
+ looked up by the caller. Entries with an invalid stat are left to the
+ search, as is everything once the search does not read the names in
+ this order.
+****************************************************************************/
+
+void dptr_set_prefetched_stat(struct dptr_struct *dptr, char ***pnames,
+			      SMB_STRUCT_STAT **pst, unsigned num_names)
+{
+	struct dptr_stat_prefetch *p;
+
+	TALLOC_FREE(dptr->stat_prefetch);
+
+	if (num_names == 0) {
+		return;
+	}
+
+	p = talloc_zero(dptr, struct dptr_stat_prefetch);
+	if (p == NULL) {
+		return;
+	}
+	p->num_names = num_names;
+	p->names = talloc_move(p, pnames);
+	p->st = talloc_move(p, pst);
+
+	dptr->stat_prefetch = p;
+}
+
+static void dptr_prefetched_stat(struct dptr_struct *dptr, const char *name,
+				 SMB_STRUCT_STAT *pst)
+{
+	struct dptr_stat_prefetch *p = dptr->stat_prefetch;
+
+	while (p->next < p->num_names) {
+		unsigned i = p->next++;
+
+		if (strcmp(p->names[i], name) == 0) {
+			*pst = p->st[i];
+			return;
+		}
+	}
+
+	TALLOC_FREE(dptr->stat_prefetch);
+}
+
 /****************************************************************************
  Return the next visible file name, skipping veto'd and invisible files.
 ****************************************************************************/
@@ -693,6 +776,29 @@ static const char *dptr_normal_ReadDirName(struct dptr_struct *dptr,
 	const char *name;
 	char *talloced = NULL;
 
+	while (dptr->stat_prefetch != NULL) {
+		/*
+		 * Don't have the VFS stat the entries, we have that
+		 * already.
+		 */
+		name = ReadDirName(dptr->dir_hnd, poffset, NULL, &talloced);
+		if (name == NULL) {
+			TALLOC_FREE(dptr->stat_prefetch);
+			return NULL;
+		}
+		if (pst != NULL) {
+			SET_STAT_INVALID(*pst);
+			if (!ISDOT(name) && !ISDOTDOT(name)) {
+				dptr_prefetched_stat(dptr, name, pst);
+			}
+		}
+		if (is_visible_file(dptr->conn, dptr->path, name, pst, True)) {
+			*ptalloced = talloced;
+			return name;
+		}
+		TALLOC_FREE(talloced);
+	}
+
 	while ((name = ReadDirName(dptr->dir_hnd, poffset, pst, &talloced))
 	       != NULL) {
 		if (is_visible_file(dptr->conn, dptr->path, name, pst, True)) {
@@ -0,0 +1,413 @@
+/*
+   Unix SMB/CIFS implementation.
+   Per-directory case insensitive name index
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+ * When a name is not found by stat on a case sensitive file system,
+ * get_real_filename() has to look for a case variant of it in the
+ * directory. Doing that by reading the whole directory each time makes
+ * creating files in a large directory O(n) per create, a bulk copy into
+ * it is O(n^2).
+ *
+ * Instead we keep an index of the upper cased names of the most recently
+ * scanned directories. An index is only trusted as long as the directory
+ * has the file id and the mtime it had when the index was built, so
+ * changes made by anyone else invalidate it. Changes made by this smbd
+ * are reported by notify_fname() and applied to the index directly.
+ *
+ * Taking over the new mtime of the directory after such a change is
+ * only safe if the change was the only one since the index was last
+ * found to be current. So the index only follows a change of ours that
+ * comes right after a lookup checked the mtime, which is what a create
+ * of a new name does: get_real_filename() first, then the create.
+ * Other changes drop the index, the next lookup rebuilds it.
+ *
+ * Like the stat cache this is per process. A change by someone else
+ * between the lookup and our own change is not seen until the next
+ * change of the directory.
+ */
+
+#include "includes.h"
+#include "smbd/smbd.h"
+#include "dbwrap/dbwrap.h"
+#include "dbwrap/dbwrap_rbt.h"
+#include "util_tdb.h"
+
+struct dir_name_index {
+	struct dir_name_index *prev, *next;
+	int snum;
+	char *path;
+	struct file_id id;
+	struct timespec mtime;
+	/*
+	 * A lookup just found the directory to still have mtime,
+	 * the next change of ours may take over its new mtime.
+	 */
+	bool checked;
+	/* upper cased name -> name as found in the directory */
+	struct db_context *names;
+	/*
+	 * Two names in the directory map to the same upper cased
+	 * name. Removing one of them can't be done in the index then.
+	 */
+	bool collisions;
+};
+
+static struct dir_name_index *dir_name_indexes;
+static int num_dir_name_indexes;
+
+static int dir_name_index_destructor(struct dir_name_index *idx)
+{
+	DLIST_REMOVE(dir_name_indexes, idx);
+	num_dir_name_indexes -= 1;
+	return 0;
+}
+
+static char *dir_name_index_path(TALLOC_CTX *mem_ctx,
+				 connection_struct *conn,
+				 const char *path)
+{
+	if ((path == NULL) || (path[0] == '\0') || ISDOT(path)) {
+		return talloc_strdup(mem_ctx, conn->connectpath);
+	}
+	if (path[0] == '.' && path[1] == '/') {
+		path += 2;
+	}
+	if (path[0] == '/') {
+		return talloc_strdup(mem_ctx, path);
+	}
+	return talloc_asprintf(mem_ctx, "%s/%s", conn->connectpath, path);
+}
+
+static struct dir_name_index *dir_name_index_find(connection_struct *conn,
+						  const char *abspath)
+{
+	struct dir_name_index *idx;
+
+	for (idx = dir_name_indexes; idx != NULL; idx = idx->next) {
+		if ((idx->snum == SNUM(conn)) &&
+		    (strcmp(idx->path, abspath) == 0)) {
+			return idx;
+		}
+	}
+	return NULL;
+}
+
+static bool dir_name_index_add_name(struct dir_name_index *idx,
+				    const char *name)
+{
+	TDB_DATA value;
+	NTSTATUS status;
+
+	status = dbwrap_fetch_bystring_upper(idx->names, talloc_tos(), name,
+					     &value);
+	if (NT_STATUS_IS_OK(status)) {
+		/*
+		 * Keep the first one, that is the one a scan of the
+		 * directory would have found.
+		 */
+		if (strcmp((const char *)value.dptr, name) != 0) {
+			idx->collisions = true;
+		}
+		TALLOC_FREE(value.dptr);
+		return true;
+	}
+
+	status = dbwrap_store_bystring_upper(idx->names, name,
+					     string_term_tdb_data(name),
+					     TDB_REPLACE);
+	return NT_STATUS_IS_OK(status);
+}
+
+static struct dir_name_index *dir_name_index_build(connection_struct *conn,
+						   const char *path,
+						   const char *abspath,
+						   const SMB_STRUCT_STAT *st)
+{
+	struct dir_name_index *idx;
+	struct smb_Dir *cur_dir;
+	const char *dname = NULL;
+	char *talloced = NULL;
+	long curpos;
+	int max_indexes;
+
+	max_indexes = lp_parm_int(-1, "smbd", "dir name index", 16);
+
+	if (max_indexes <= 0) {
+		errno = EOPNOTSUPP;
+		return NULL;
+	}
+
+	cur_dir = OpenDir(talloc_tos(), conn, path, NULL, 0);
+	if (cur_dir == NULL) {
+		DEBUG(3,("dir_name_index_build: didn't open dir [%s]\n",
+			 path));
+		return NULL;
+	}
+
+	idx = talloc_zero(NULL, struct dir_name_index);
+	if (idx == NULL) {
+		goto nomem;
+	}
+	idx->snum = SNUM(conn);
+	idx->id = vfs_file_id_from_sbuf(conn, st);
+	idx->mtime = st->st_ex_mtime;
+	idx->path = talloc_strdup(idx, abspath);
+	idx->names = db_open_rbt(idx);
+	if ((idx->path == NULL) || (idx->names == NULL)) {
+		goto nomem;
+	}
+
+	curpos = 0;
+	while ((dname = ReadDirName(cur_dir, &curpos, NULL, &talloced))) {
+		bool ok = true;
+
+		if (!ISDOT(dname) && !ISDOTDOT(dname)) {
+			ok = dir_name_index_add_name(idx, dname);
+		}
+		TALLOC_FREE(talloced);
+		if (!ok) {
+			goto nomem;
+		}
+	}
+	TALLOC_FREE(cur_dir);
+
+	while (num_dir_name_indexes >= max_indexes) {
+		struct dir_name_index *last = DLIST_TAIL(dir_name_indexes);
+		TALLOC_FREE(last);
+	}
+
+	DLIST_ADD(dir_name_indexes, idx);
+	num_dir_name_indexes += 1;
+	talloc_set_destructor(idx, dir_name_index_destructor);
+
+	DEBUG(10,("dir_name_index_build: indexed [%s]\n", abspath));
+
+	return idx;
+
+nomem:
+	TALLOC_FREE(idx);
+	TALLOC_FREE(cur_dir);
+	errno = ENOMEM;
+	return NULL;
+}
+
+/****************************************************************************
+ Look up a name case insensitively in the directory path, the index
+ equivalent of get_real_filename_full_scan() for names that are not
+ mangled. Returns -1 with errno set to EOPNOTSUPP if the caller has to
+ scan the directory itself.
+****************************************************************************/
+
+int dir_name_index_lookup(connection_struct *conn, const char *path,
+			  const char *name, TALLOC_CTX *mem_ctx,
+			  char **found_name)
+{
+	struct smb_filename *smb_dname;
+	struct dir_name_index *idx;
+	struct file_id id;
+	char *abspath;
+	TDB_DATA value;
+	NTSTATUS status;
+	int ret;
+
+	abspath = dir_name_index_path(talloc_tos(), conn, path);
+	if (abspath == NULL) {
+		errno = ENOMEM;
+		return -1;
+	}
+
+	smb_dname = synthetic_smb_fname(talloc_tos(), path, NULL, NULL);
+	if (smb_dname == NULL) {
+		TALLOC_FREE(abspath);
+		errno = ENOMEM;
+		return -1;
+	}
+
+	ret = SMB_VFS_STAT(conn, smb_dname);
+	if (ret == -1) {
+		/* Let the directory scan report the error */
+		TALLOC_FREE(smb_dname);
+		TALLOC_FREE(abspath);
+		errno = EOPNOTSUPP;
+		return -1;
+	}
+	id = vfs_file_id_from_sbuf(conn, &smb_dname->st);
+
+	idx = dir_name_index_find(conn, abspath);
+	if ((idx != NULL) &&
+	    (!file_id_equal(&idx->id, &id) ||
+	     (timespec_compare(&idx->mtime,
+			       &smb_dname->st.st_ex_mtime) != 0))) {
+		DEBUG(10,("dir_name_index_lookup: [%s] changed\n", abspath));
+		TALLOC_FREE(idx);
+	}
+
+	if (idx == NULL) {
+		idx = dir_name_index_build(conn, path, abspath,
+					   &smb_dname->st);
+		if (idx == NULL) {
+			int saved_errno = errno;
+			TALLOC_FREE(smb_dname);
+			TALLOC_FREE(abspath);
+			errno = saved_errno;
+			return -1;
+		}
+	} else {
+		DLIST_PROMOTE(dir_name_indexes, idx);
+	}
+	idx->checked = false;
+	TALLOC_FREE(smb_dname);
+	TALLOC_FREE(abspath);
+
+	status = dbwrap_fetch_bystring_upper(idx->names, mem_ctx, name,
+					     &value);
+	if (!NT_STATUS_IS_OK(status)) {
+		/* Most likely the caller is about to create it */
+		idx->checked = true;
+		errno = ENOENT;
+		return -1;
+	}
+
+	*found_name = (char *)value.dptr;
+	return 0;
+}
+
+/****************************************************************************
+ Apply a change made by ourselves to the index of the parent directory,
+ called with the path relative to the share as given to notify_fname().
+****************************************************************************/
+
+void dir_name_index_update(connection_struct *conn, uint32_t action,
+			   const char *path)
+{
+	struct smb_filename *smb_dname = NULL;
+	struct dir_name_index *idx;
+	struct file_id id;
+	char *parent = NULL;
+	char *abspath = NULL;
+	const char *name;
+	TDB_DATA value;
+	NTSTATUS status;
+	int ret;
+
+	if (dir_name_indexes == NULL) {
+		return;
+	}
+	if ((action != NOTIFY_ACTION_ADDED) &&
+	    (action != NOTIFY_ACTION_REMOVED) &&
+	    (action != NOTIFY_ACTION_OLD_NAME) &&
+	    (action != NOTIFY_ACTION_NEW_NAME)) {
+		return;
+	}
+
+	if (!parent_dirname(talloc_tos(), path, &parent, &name)) {
+		return;
+	}
+	abspath = dir_name_index_path(talloc_tos(), conn, parent);
+	if (abspath == NULL) {
+		goto done;
+	}
+	idx = dir_name_index_find(conn, abspath);
+	if (idx == NULL) {
+		goto done;
+	}
+	if (!idx->checked) {
+		/*
+		 * Someone else might have changed the directory since
+		 * the index was last found to be current, we can't tell
+		 * from the mtime after our change.
+		 */
+		DEBUG(10,("dir_name_index_update: [%s] not checked\n",
+			  abspath));
+		TALLOC_FREE(idx);
+		goto done;
+	}
+
+	smb_dname = synthetic_smb_fname(talloc_tos(), parent, NULL, NULL);
+	if (smb_dname == NULL) {
+		TALLOC_FREE(idx);
+		goto done;
+	}
+	ret = SMB_VFS_STAT(conn, smb_dname);
+	if (ret == -1) {
+		TALLOC_FREE(idx);
+		goto done;
+	}
+	id = vfs_file_id_from_sbuf(conn, &smb_dname->st);
+	if (!file_id_equal(&idx->id, &id) ||
+	    (timespec_compare(&smb_dname->st.st_ex_mtime, &idx->mtime) < 0)) {
+		TALLOC_FREE(idx);
+		goto done;
+	}
+
+	if ((action == NOTIFY_ACTION_ADDED) ||
+	    (action == NOTIFY_ACTION_NEW_NAME)) {
+		if (!dir_name_index_add_name(idx, name)) {
+			TALLOC_FREE(idx);
+			goto done;
+		}
+	} else {
+		status = dbwrap_fetch_bystring_upper(idx->names, talloc_tos(),
+						     name, &value);
+		if (NT_STATUS_IS_OK(status)) {
+			bool same = (strcmp((const char *)value.dptr,
+					    name) == 0);
+			TALLOC_FREE(value.dptr);
+
+			if (idx->collisions) {
+				/*
+				 * We can't tell whether another case
+				 * variant is left.
+				 */
+				TALLOC_FREE(idx);
+				goto done;
+			}
+			if (same) {
+				dbwrap_delete_bystring_upper(idx->names,
+							     name);
+			}
+		}
+	}
+
+	idx->mtime = smb_dname->st.st_ex_mtime;
+
+	/*
+	 * A rename within the directory is reported as two changes,
+	 * they belong to the same lookup.
+	 */
+	if (action != NOTIFY_ACTION_OLD_NAME) {
+		idx->checked = false;
+	}
+
+done:
+	TALLOC_FREE(smb_dname);
+	TALLOC_FREE(abspath);
+	TALLOC_FREE(parent);
+}
+
+/****************************************************************************
+ Forget all directory indexes.
+****************************************************************************/
+
+void dir_name_index_flush(void)
+{
+	while (dir_name_indexes != NULL) {
+		struct dir_name_index *idx = dir_name_indexes;
+		TALLOC_FREE(idx);
+	}
+}
@@ -659,8 +659,7 @@ NTSTATUS unix_convert(TALLOC_CTX *ctx,
 				goto fail;
 			}
 			/* Add the path (not including the stream) to the cache. */
-			stat_cache_add(orig_path, smb_fname->base_name,
-				       conn->case_sensitive);
+			stat_cache_add(conn, orig_path, smb_fname->base_name);
 			DEBUG(5,("conversion of base_name finished %s -> %s\n",
 				 orig_path, smb_fname->base_name));
 			goto done;
@@ -1142,8 +1141,7 @@ NTSTATUS unix_convert(TALLOC_CTX *ctx,
 		 * or wildcard components as this can change the size.
 		 */
 		if(!component_was_mangled && !name_has_wildcard) {
-			stat_cache_add(orig_path, dirpath,
-					conn->case_sensitive);
+			stat_cache_add(conn, orig_path, dirpath);
 		}
 
 		/*
@@ -1160,8 +1158,7 @@ NTSTATUS unix_convert(TALLOC_CTX *ctx,
 	 */
 
 	if(!component_was_mangled && !name_has_wildcard) {
-		stat_cache_add(orig_path, smb_fname->base_name,
-			       conn->case_sensitive);
+		stat_cache_add(conn, orig_path, smb_fname->base_name);
 	}
 
 	/*
@@ -1341,6 +1338,23 @@ static int get_real_filename_full_scan(connection_struct *conn,
 		}
 	}
 
+	if (!mangled && !conn->case_sensitive) {
+		int ret;
+
+		/*
+		 * Look the name up in the index of the directory, which
+		 * only needs a scan if the directory was changed.
+		 */
+		ret = dir_name_index_lookup(conn, path, name, mem_ctx,
+					    found_name);
+		if (ret == 0 || errno != EOPNOTSUPP) {
+			int saved_errno = errno;
+			TALLOC_FREE(unmangled_name);
+			errno = saved_errno;
+			return ret;
+		}
+	}
+
 	/* open the directory */
 	if (!(cur_dir = OpenDir(talloc_tos(), conn, path, NULL, 0))) {
 		DEBUG(3,("scan dir didn't open dir [%s]\n",path));
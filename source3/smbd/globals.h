@@ -497,6 +497,15 @@ struct smbXsrv_connection {
 			 * This is the "server max credits" parameter.
 			 */
 			uint16_t max;
+			/*
+			 * The number of credits the client may
+			 * currently hold, between 1/16th of max and max.
+			 *
+			 * It grows while the client uses up what we
+			 * granted and the backend replies fast, and it
+			 * shrinks when the replies get slow.
+			 */
+			uint16_t window;
 			/*
 			 * a bitmap of size max_credits
 			 */
@@ -504,6 +513,24 @@ struct smbXsrv_connection {
 			bool multicredit;
 		} credits;
 
+		/*
+		 * Statistics of the credit window and the
+		 * send queue, see "smbstatus --smb2-credits".
+		 */
+		struct {
+			/* average time from request to reply */
+			uint64_t avg_latency_usec;
+			uint64_t latency_target_usec;
+			uint64_t num_latency_samples;
+			uint32_t num_since_adjust;
+			uint64_t num_requests;
+			uint64_t num_credits_granted;
+			uint64_t num_window_grow;
+			uint64_t num_window_shrink;
+			uint64_t num_reordered;
+			size_t max_send_queue_len;
+		} stats;
+
 		bool allow_2ff;
 		struct {
 			uint32_t capabilities;
@@ -739,6 +766,14 @@ struct smbd_smb2_request {
 	 */
 	struct tevent_req *subreq;
 
+	/*
+	 * Number of bytes allocated behind the dynamic
+	 * response buffer passed to smbd_smb2_request_done(),
+	 * they can take the compound padding without
+	 * copying the buffer.
+	 */
+	size_t out_dyn_tailroom;
+
 #define SMBD_SMB2_TF_IOV_OFS 0
 #define SMBD_SMB2_HDR_IOV_OFS 1
 #define SMBD_SMB2_BODY_IOV_OFS 2
@@ -782,6 +817,9 @@ struct smbd_smb2_request {
 
 #define SMBD_SMB2_SHORT_RECEIVEFILE_WRITE_LEN (SMB2_HDR_BODY + 0x30)
 
+/* enough for the padding of a compound response to 8 bytes */
+#define SMBD_SMB2_OUT_DYN_TAILROOM 8
+
 	struct {
 		/*
 		 * vector[0] TRANSPORT HEADER (empty)
@@ -500,6 +500,8 @@ void notify_fname(connection_struct *conn, uint32_t action, uint32_t filter,
 		path += 2;
 	}
 
+	dir_name_index_update(conn, action, path);
+
 	notify_trigger(notify_ctx, action, filter, conn->connectpath, path);
 }
 
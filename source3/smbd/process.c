@@ -2823,6 +2823,78 @@ static void msg_kill_client_ip(struct messaging_context *msg_ctx,
 	TALLOC_FREE(client_ip);
 }
 
+/*
+ * Reply to "smbstatus --smb2-credits" with one line per connection
+ */
+static void msg_smb2_connection_stats(struct messaging_context *msg_ctx,
+				      void *private_data, uint32_t msg_type,
+				      struct server_id server_id,
+				      DATA_BLOB *data)
+{
+	struct smbd_server_connection *sconn = talloc_get_type_abort(
+		private_data, struct smbd_server_connection);
+	struct smbXsrv_connection *xconn = NULL;
+	struct server_id self = messaging_server_id(msg_ctx);
+	struct server_id_buf tmp;
+	char *report = talloc_strdup(talloc_tos(), "");
+
+	/*
+	 * smbstatus waits for a reply from everyone it asked, so
+	 * also send one if there's nothing to report.
+	 */
+	if (sconn->client != NULL) {
+		xconn = sconn->client->connections;
+	}
+
+	for (;
+	     xconn != NULL && report != NULL;
+	     xconn = xconn->next)
+	{
+		struct smbd_smb2_request *req = NULL;
+		unsigned num_pending = 0;
+		char *remote = NULL;
+
+		if (xconn->protocol < PROTOCOL_SMB2_02) {
+			continue;
+		}
+
+		for (req = xconn->smb2.requests; req != NULL; req = req->next) {
+			num_pending += 1;
+		}
+
+		remote = tsocket_address_string(xconn->remote_address,
+						report);
+
+		report = talloc_asprintf_append_buffer(report,
+			"%-7s %-25s %5u/%-5u %7u %7u %5u/%-5u %8llu "
+			"%8llu %8llu %8llu/%-8llu %8llu\n",
+			server_id_str_buf(self, &tmp),
+			remote != NULL ? remote : "",
+			(unsigned)xconn->smb2.credits.window,
+			(unsigned)xconn->smb2.credits.max,
+			(unsigned)xconn->smb2.credits.granted,
+			num_pending,
+			(unsigned)xconn->smb2.send_queue_len,
+			(unsigned)xconn->smb2.stats.max_send_queue_len,
+			(unsigned long long)xconn->smb2.stats.avg_latency_usec,
+			(unsigned long long)xconn->smb2.stats.num_requests,
+			(unsigned long long)xconn->smb2.stats.num_credits_granted,
+			(unsigned long long)xconn->smb2.stats.num_window_grow,
+			(unsigned long long)xconn->smb2.stats.num_window_shrink,
+			(unsigned long long)xconn->smb2.stats.num_reordered);
+		TALLOC_FREE(remote);
+	}
+
+	if (report == NULL) {
+		return;
+	}
+
+	messaging_send_buf(msg_ctx, server_id,
+			   MSG_SMBXSRV_CONNECTION_STATS,
+			   (uint8_t *)report, talloc_get_size(report));
+	TALLOC_FREE(report);
+}
+
 /*
  * Send keepalive packets to our client
  */
@@ -4071,6 +4143,10 @@ void smbd_process(struct tevent_context *ev_ctx,
 
 	messaging_deregister(sconn->msg_ctx, MSG_SMB_TELL_NUM_CHILDREN, NULL);
 
+	messaging_register(sconn->msg_ctx, sconn,
+			   MSG_SMBXSRV_REQ_CONNECTION_STATS,
+			   msg_smb2_connection_stats);
+
 	/*
 	 * Use the default MSG_DEBUG handler to avoid rebroadcasting
 	 * MSGs to all child processes
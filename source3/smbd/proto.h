@@ -199,6 +199,10 @@ bool dptr_has_wild(struct dptr_struct *dptr);
 int dptr_dnum(struct dptr_struct *dptr);
 bool dptr_get_priv(struct dptr_struct *dptr);
 void dptr_set_priv(struct dptr_struct *dptr);
+bool dptr_readahead_offset(struct dptr_struct *dptr, long *poffset,
+			   bool *pseek);
+void dptr_set_prefetched_stat(struct dptr_struct *dptr, char ***pnames,
+			      SMB_STRUCT_STAT **pst, unsigned num_names);
 bool dptr_SearchDir(struct dptr_struct *dptr, const char *name, long *poffset, SMB_STRUCT_STAT *pst);
 void dptr_init_search_op(struct dptr_struct *dptr);
 bool dptr_fill(struct smbd_server_connection *sconn,
@@ -231,6 +235,15 @@ NTSTATUS can_delete_directory(struct connection_struct *conn,
 bool have_file_open_below(connection_struct *conn,
 			const struct smb_filename *name);
 
+/* The following definitions come from smbd/dir_name_index.c  */
+
+int dir_name_index_lookup(connection_struct *conn, const char *path,
+			  const char *name, TALLOC_CTX *mem_ctx,
+			  char **found_name);
+void dir_name_index_update(connection_struct *conn, uint32_t action,
+			   const char *path);
+void dir_name_index_flush(void);
+
 /* The following definitions come from smbd/dmapi.c  */
 
 const void *dmapi_get_current_session(void);
@@ -1076,9 +1089,12 @@ ssize_t message_push_string(uint8_t **outbuf, const char *str, int flags);
 
 /* The following definitions come from smbd/statcache.c  */
 
-void stat_cache_add( const char *full_orig_name,
-		char *translated_path,
-		bool case_sensitive);
+struct stat_cache_shared_stats;
+bool stat_cache_shared_init(bool read_only);
+bool stat_cache_shared_statistics(struct stat_cache_shared_stats *stats);
+void stat_cache_add(connection_struct *conn,
+		    const char *full_orig_name,
+		    char *translated_path);
 bool stat_cache_lookup(connection_struct *conn,
 			bool posix_paths,
 			char **pp_name,
@@ -1086,9 +1102,9 @@ bool stat_cache_lookup(connection_struct *conn,
 			char **pp_start,
 			SMB_STRUCT_STAT *pst);
 void smbd_send_stat_cache_delete_message(struct messaging_context *msg_ctx,
-				    const char *name);
+				    files_struct *fsp);
 void send_stat_cache_delete_message(struct messaging_context *msg_ctx,
-				    const char *name);
+				    files_struct *fsp);
 void stat_cache_delete(const char *name);
 struct TDB_DATA;
 unsigned int fast_string_hash(struct TDB_DATA *key);
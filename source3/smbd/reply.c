@@ -6875,6 +6875,12 @@ NTSTATUS rename_internals_fsp(connection_struct *conn,
 		notify_rename(conn, fsp->is_directory, fsp->fsp_name,
 			      smb_fname_dst);
 
+		if (fsp->is_directory) {
+			/* Names below the old one are gone */
+			send_stat_cache_delete_message(conn->sconn->msg_ctx,
+						       fsp);
+		}
+
 		rename_open_files(conn, lck, fsp->file_id, fsp->name_hash,
 				  smb_fname_dst);
 
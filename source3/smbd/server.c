@@ -1593,6 +1593,12 @@ extern void build_options(bool screen);
 		exit_daemon("Samba cannot init leases", EACCES);
 	}
 
+	if (lp_parm_bool(-1, "smbd", "shared stat cache", false) &&
+	    !stat_cache_shared_init(false)) {
+		DEBUG(0, ("Samba cannot init the shared stat cache, "
+			  "using one per process\n"));
+	}
+
 	if (!smbd_notifyd_init(msg_ctx, interactive)) {
 		exit_daemon("Samba cannot init notification", EACCES);
 	}
@@ -164,6 +164,7 @@ bool reload_services(struct smbd_server_connection *sconn,
 
 	mangle_reset_cache();
 	reset_stat_cache();
+	dir_name_index_flush();
 
 	/* this forces service parameters to be flushed */
 	set_current_service(NULL,0,True);
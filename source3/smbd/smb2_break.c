@@ -444,20 +444,34 @@ void send_break_message_smb2(files_struct *fsp,
 	NTTIME now = timeval_to_nttime(&tv);
 
 	/*
-	 * TODO: in future we should have a better algorithm
-	 * to find the correct connection for a break message.
-	 * Then we also need some retries if a channel gets disconnected.
+	 * With multi-channel the first connection is not
+	 * necessarily bound to the session of the handle
+	 * and it might already be disconnected.
+	 * So we use the first working channel of the session.
 	 */
-	xconn = fsp->conn->sconn->client->connections;
-
-	status = smb2srv_session_lookup_conn(xconn,
-					     fsp->vuid,
-					     now,
-					     &session);
-	if (NT_STATUS_EQUAL(status, NT_STATUS_USER_SESSION_DELETED) ||
-	    (session == NULL))
+	for (xconn = fsp->conn->sconn->client->connections;
+	     xconn != NULL;
+	     xconn = xconn->next)
 	{
+		if (!NT_STATUS_IS_OK(xconn->transport.status)) {
+			continue;
+		}
+
+		session = NULL;
+		status = smb2srv_session_lookup_conn(xconn,
+						     fsp->vuid,
+						     now,
+						     &session);
+		if (NT_STATUS_EQUAL(status, NT_STATUS_USER_SESSION_DELETED) ||
+		    (session == NULL))
+		{
+			continue;
+		}
+
+		break;
+	}
 
+	if (xconn == NULL) {
 		DEBUG(10,("send_break_message_smb2: skip oplock break "
 			"for file %s, %s, smb2 level %u session %llu not found\n",
 			fsp_str_dbg(fsp),
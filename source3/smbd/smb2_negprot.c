@@ -654,24 +654,15 @@ NTSTATUS smbd_smb2_request_process_negprot(struct smbd_smb2_request *req)
 			return smbd_smb2_request_done(req, outbody, &outdyn);
 		}
 
+		/*
+		 * This either finds the process already serving
+		 * the client guid, or stores the new client
+		 * information in smbXsrv_client_global.tdb
+		 */
 		status = smb2srv_client_lookup_global(xconn->client,
 						xconn->smb2.client.guid,
 						req, &global0);
-		/*
-		 * TODO: check for races...
-		 */
 		if (NT_STATUS_EQUAL(status, NT_STATUS_OBJECTID_NOT_FOUND)) {
-			/*
-			 * This stores the new client information in
-			 * smbXsrv_client_global.tdb
-			 */
-			xconn->client->global->client_guid =
-						xconn->smb2.client.guid;
-			status = smbXsrv_client_update(xconn->client);
-			if (!NT_STATUS_IS_OK(status)) {
-				return status;
-			}
-
 			xconn->smb2.client.guid_verified = true;
 		} else if (NT_STATUS_IS_OK(status)) {
 			status = smb2srv_client_connection_pass(req,
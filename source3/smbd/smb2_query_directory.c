@@ -25,6 +25,7 @@
 #include "trans2.h"
 #include "../lib/util/tevent_ntstatus.h"
 #include "system/filesys.h"
+#include "lib/pthreadpool/pthreadpool.h"
 
 static struct tevent_req *smbd_smb2_query_directory_send(TALLOC_CTX *mem_ctx,
 					      struct tevent_context *ev,
@@ -193,11 +194,413 @@ static void smbd_smb2_request_find_done(struct tevent_req *subreq)
 	}
 }
 
+/*
+ * Before each chunk of a listing, a helper thread reads the next
+ * entries of the directory with its own directory stream and stats
+ * them, with the credentials of the user. That moves the cold I/O
+ * off the main thread: the VFS calls smbd makes for the chunk
+ * afterwards find the directory blocks and inodes in the caches.
+ *
+ * The helper calls opendir, seekdir, readdir and stat directly,
+ * bypassing the VFS, and seeks to an offset telldir returned on
+ * smbd's own directory stream. So it only does I/O on shares without
+ * "vfs objects", where smbd's calls end up in the same system calls.
+ * With "smbd:async dir stat = yes" smbd also takes the stat
+ * information from it instead of asking the VFS.
+ *
+ * The job completes through the signal fd of the pthreadpool, so
+ * the event loop polls the client sockets before the next chunk.
+ * Without per thread credentials the helper does no I/O, the job
+ * only serves to yield.
+ */
+
+/*
+ * NB. This threadpool is shared over all
+ * directory listings in this process,
+ * as is the current jobid.
+ */
+
+static struct pthreadpool *query_dir_pool;
+static int query_dir_jobid;
+
+struct query_dir_readahead_job {
+	struct query_dir_readahead_job *prev, *next;
+	int jobid;
+	/* NULL once the request is gone */
+	struct tevent_req *req;
+	/* Inputs. */
+	bool do_io;
+	const struct security_unix_token *ux_tok;
+	char *dir_path;
+	bool seek;
+	long offset;
+	unsigned max_names;
+	bool use_lstat;
+	bool fake_dir_create_times;
+	/* Returns, allocated before the job is started. */
+	char **names;
+	SMB_STRUCT_STAT *st;
+	unsigned num_names;
+};
+
+/* List of outstanding jobs we have. */
+static struct query_dir_readahead_job *query_dir_readahead_jobs;
+
+struct query_dir_readahead_state {
+	struct query_dir_readahead_job *job;
+};
+
+static void query_dir_readahead_handle_completion(struct tevent_context *ev,
+						  struct tevent_fd *fde,
+						  uint16_t flags,
+						  void *p)
+{
+	struct query_dir_readahead_job *job;
+	struct query_dir_readahead_state *state;
+	struct tevent_req *req;
+	int jobid = 0;
+	int ret;
+
+	if ((flags & TEVENT_FD_READ) == 0) {
+		return;
+	}
+
+	ret = pthreadpool_finished_jobs(query_dir_pool, &jobid, 1);
+	if (ret != 1) {
+		smb_panic("query_dir_readahead_handle_completion");
+		/* notreached. */
+		return;
+	}
+
+	for (job = query_dir_readahead_jobs; job != NULL; job = job->next) {
+		if (job->jobid == jobid) {
+			break;
+		}
+	}
+	if (job == NULL) {
+		DEBUG(0, ("query_dir_readahead_handle_completion cannot find "
+			  "jobid %d\n", jobid));
+		smb_panic("query_dir_readahead_handle_completion - no jobid");
+		/* notreached. */
+		return;
+	}
+	DLIST_REMOVE(query_dir_readahead_jobs, job);
+
+	req = job->req;
+	if (req == NULL) {
+		/* Nobody is interested anymore. */
+		TALLOC_FREE(job);
+		return;
+	}
+	job->req = NULL;
+
+	state = tevent_req_data(req, struct query_dir_readahead_state);
+	talloc_steal(state, job);
+	tevent_req_done(req);
+}
+
+static bool init_query_dir_pool(struct tevent_context *ev)
+{
+	struct tevent_fd *fde;
+	int ret;
+
+	if (query_dir_pool != NULL) {
+		return true;
+	}
+
+	ret = pthreadpool_init(lp_aio_max_threads(), &query_dir_pool);
+	if (ret != 0) {
+		errno = ret;
+		return false;
+	}
+	fde = tevent_add_fd(ev,
+			    NULL,
+			    pthreadpool_signal_fd(query_dir_pool),
+			    TEVENT_FD_READ,
+			    query_dir_readahead_handle_completion,
+			    NULL);
+	if (fde == NULL) {
+		pthreadpool_destroy(query_dir_pool);
+		query_dir_pool = NULL;
+		errno = ENOMEM;
+		return false;
+	}
+	return true;
+}
+
+/*****************************************************************
+ The worker function. It must not allocate memory with talloc, the
+ buffers for the names and the stat information are provided.
+ Entries that can't be looked at stay invalid, smbd will stat them
+ itself.
+*****************************************************************/
+
+static void query_dir_readahead_worker(void *private_data)
+{
+#if defined(USE_LINUX_THREAD_CREDENTIALS)
+	struct query_dir_readahead_job *job =
+		(struct query_dir_readahead_job *)private_data;
+	struct dirent *de;
+	DIR *dir;
+	unsigned i;
+
+	if (!job->do_io) {
+		return;
+	}
+
+	/* Become the correct credential on this thread. */
+	if (set_thread_credentials(job->ux_tok->uid,
+				job->ux_tok->gid,
+				(size_t)job->ux_tok->ngroups,
+				job->ux_tok->groups) != 0) {
+		return;
+	}
+
+	dir = opendir(job->dir_path);
+	if (dir == NULL) {
+		return;
+	}
+
+	/* The offset is what telldir returned on smbd's own stream */
+	if (job->seek) {
+		seekdir(dir, job->offset);
+	}
+
+	while ((job->num_names < job->max_names) &&
+	       ((de = readdir(dir)) != NULL)) {
+		if (ISDOT(de->d_name) || ISDOTDOT(de->d_name)) {
+			continue;
+		}
+		strlcpy(job->names[job->num_names], de->d_name,
+			NAME_MAX + 1);
+		job->num_names += 1;
+	}
+
+	closedir(dir);
+
+	for (i = 0; i < job->num_names; i++) {
+		char path[PATH_MAX];
+		int ret;
+
+		ret = snprintf(path, sizeof(path), "%s/%s",
+			       job->dir_path, job->names[i]);
+		if ((ret < 0) || ((size_t)ret >= sizeof(path))) {
+			continue;
+		}
+
+		if (job->use_lstat) {
+			ret = sys_lstat(path, &job->st[i],
+					job->fake_dir_create_times);
+		} else {
+			ret = sys_stat(path, &job->st[i],
+				       job->fake_dir_create_times);
+		}
+		if (ret != 0) {
+			SET_STAT_INVALID(job->st[i]);
+		}
+	}
+#endif
+}
+
+static int query_dir_readahead_state_destructor(
+	struct query_dir_readahead_state *state)
+{
+	if (state->job == NULL) {
+		return 0;
+	}
+	if (state->job->req != NULL) {
+		/*
+		 * The job is still running, the completion
+		 * handler throws it away.
+		 */
+		state->job->req = NULL;
+		return 0;
+	}
+	/* Never handed to the pool, or done and ours */
+	TALLOC_FREE(state->job);
+	return 0;
+}
+
+#if defined(USE_LINUX_THREAD_CREDENTIALS)
+/*
+ * The helper bypasses the VFS, only use it where smbd only has the
+ * default VFS module.
+ */
+static bool query_dir_readahead_default_vfs(connection_struct *conn)
+{
+	const char **vfs_objects = lp_vfs_objects(SNUM(conn));
+
+	return ((vfs_objects == NULL) || (vfs_objects[0] == NULL));
+}
+#endif
+
+static struct tevent_req *query_dir_readahead_send(TALLOC_CTX *mem_ctx,
+						   struct tevent_context *ev,
+						   files_struct *fsp,
+						   unsigned max_entries)
+{
+	connection_struct *conn = fsp->conn;
+	struct tevent_req *req;
+	struct query_dir_readahead_state *state;
+	struct query_dir_readahead_job *job;
+	char *buf;
+	unsigned i;
+	int ret;
+
+	req = tevent_req_create(mem_ctx, &state,
+				struct query_dir_readahead_state);
+	if (req == NULL) {
+		return NULL;
+	}
+
+	if (!init_query_dir_pool(ev)) {
+		tevent_req_error(req, errno);
+		return tevent_req_post(req, ev);
+	}
+
+	/*
+	 * Not below the request, the job might outlive it. And not
+	 * in a talloc pool, the helper thread writes into it.
+	 */
+	job = talloc_zero(NULL, struct query_dir_readahead_job);
+	if (tevent_req_nomem(job, req)) {
+		return tevent_req_post(req, ev);
+	}
+	state->job = job;
+	talloc_set_destructor(state, query_dir_readahead_state_destructor);
+
+#if defined(USE_LINUX_THREAD_CREDENTIALS)
+	if (query_dir_readahead_default_vfs(conn)) {
+		job->do_io = dptr_readahead_offset(fsp->dptr, &job->offset,
+						   &job->seek);
+	}
+#endif
+
+	if (job->do_io) {
+		job->max_names = max_entries;
+
+		job->names = talloc_array(job, char *, max_entries);
+		if (tevent_req_nomem(job->names, req)) {
+			return tevent_req_post(req, ev);
+		}
+		buf = talloc_array(job->names, char,
+				   max_entries * (NAME_MAX + 1));
+		if (tevent_req_nomem(buf, req)) {
+			return tevent_req_post(req, ev);
+		}
+		for (i = 0; i < max_entries; i++) {
+			job->names[i] = buf + i * (NAME_MAX + 1);
+		}
+
+		job->st = talloc_array(job, SMB_STRUCT_STAT, max_entries);
+		if (tevent_req_nomem(job->st, req)) {
+			return tevent_req_post(req, ev);
+		}
+		for (i = 0; i < max_entries; i++) {
+			SET_STAT_INVALID(job->st[i]);
+		}
+
+		if (ISDOT(fsp->fsp_name->base_name)) {
+			job->dir_path = talloc_strdup(job, conn->connectpath);
+		} else {
+			job->dir_path = talloc_asprintf(
+				job, "%s/%s", conn->connectpath,
+				fsp->fsp_name->base_name);
+		}
+		if (tevent_req_nomem(job->dir_path, req)) {
+			return tevent_req_post(req, ev);
+		}
+
+		/* Copy our current credentials. */
+		job->ux_tok = copy_unix_token(job, get_current_utok(conn));
+		if (tevent_req_nomem(job->ux_tok, req)) {
+			return tevent_req_post(req, ev);
+		}
+
+		/* The same as the default VFS readdir does */
+		job->use_lstat = lp_posix_pathnames();
+		job->fake_dir_create_times = lp_fake_directory_create_times(
+			SNUM(conn));
+	}
+
+	job->jobid = query_dir_jobid++;
+
+	ret = pthreadpool_add_job(query_dir_pool, job->jobid,
+				  query_dir_readahead_worker, job);
+	if (ret != 0) {
+		tevent_req_error(req, ret);
+		return tevent_req_post(req, ev);
+	}
+
+	/*
+	 * The job belongs to the list until it's done, the request
+	 * might go away before.
+	 */
+	job->req = req;
+	DLIST_ADD(query_dir_readahead_jobs, job);
+
+	return req;
+}
+
+static int query_dir_readahead_recv(struct tevent_req *req,
+				    struct dptr_struct *dptr,
+				    bool use_stat)
+{
+	struct query_dir_readahead_state *state = tevent_req_data(
+		req, struct query_dir_readahead_state);
+	struct query_dir_readahead_job *job = state->job;
+	int err;
+
+	if (tevent_req_is_unix_error(req, &err)) {
+		return err;
+	}
+	if (use_stat && (job->num_names != 0)) {
+		dptr_set_prefetched_stat(dptr, &job->names, &job->st,
+					 job->num_names);
+	}
+	return 0;
+}
+
 struct smbd_smb2_query_directory_state {
+	struct tevent_context *ev;
 	struct smbd_smb2_request *smb2req;
+	struct smb_request *smbreq;
+	connection_struct *conn;
+	struct files_struct *fsp;
+	uint8_t in_flags;
+	uint32_t in_output_buffer_length;
+	const char *in_file_name;
+	uint32_t info_level;
+	uint32_t dirtype;
+	uint32_t max_count;
+	bool dont_descend;
+	bool ask_sharemode;
+	NTSTATUS empty_status;
+
+	char *pdata;
+	char *base_data;
+	char *end_data;
+	int last_entry_off;
+	uint32_t num;
+
+	/*
+	 * Entries done per turn of the event loop, 0 means all of
+	 * them at once.
+	 */
+	unsigned chunk_size;
+	bool async_stat;
+	bool started;
+	long start_offset;
+	struct tevent_req *readahead_subreq;
+
 	DATA_BLOB out_output_buffer;
 };
 
+static void smbd_smb2_query_directory_trigger(struct tevent_req *req,
+					      void *private_data);
+static void smbd_smb2_query_directory_start(struct tevent_req *req);
+static bool smbd_smb2_query_directory_cancel(struct tevent_req *req);
+
 static struct tevent_req *smbd_smb2_query_directory_send(TALLOC_CTX *mem_ctx,
 					      struct tevent_context *ev,
 					      struct smbd_smb2_request *smb2req,
@@ -211,22 +614,11 @@ static struct tevent_req *smbd_smb2_query_directory_send(TALLOC_CTX *mem_ctx,
 	struct smbXsrv_connection *xconn = smb2req->xconn;
 	struct tevent_req *req;
 	struct smbd_smb2_query_directory_state *state;
-	struct smb_request *smbreq;
 	connection_struct *conn = smb2req->tcon->compat;
+	struct tevent_queue_entry *qe;
 	NTSTATUS status;
-	NTSTATUS empty_status;
-	uint32_t info_level;
-	uint32_t max_count;
-	char *pdata;
-	char *base_data;
-	char *end_data;
-	int last_entry_off = 0;
-	int off = 0;
-	uint32_t num = 0;
-	uint32_t dirtype = FILE_ATTRIBUTE_HIDDEN | FILE_ATTRIBUTE_SYSTEM | FILE_ATTRIBUTE_DIRECTORY;
-	bool dont_descend = false;
-	bool ask_sharemode = true;
-	bool wcard_has_wild = false;
+	int chunk_size;
+	bool ok;
 	struct tm tm;
 	char *p;
 
@@ -235,14 +627,22 @@ static struct tevent_req *smbd_smb2_query_directory_send(TALLOC_CTX *mem_ctx,
 	if (req == NULL) {
 		return NULL;
 	}
+	state->ev = ev;
 	state->smb2req = smb2req;
+	state->conn = conn;
+	state->fsp = fsp;
+	state->in_flags = in_flags;
+	state->in_output_buffer_length = in_output_buffer_length;
+	state->in_file_name = in_file_name;
+	state->dirtype = FILE_ATTRIBUTE_HIDDEN | FILE_ATTRIBUTE_SYSTEM |
+			 FILE_ATTRIBUTE_DIRECTORY;
 	state->out_output_buffer = data_blob_null;
 
 	DEBUG(10,("smbd_smb2_query_directory_send: %s - %s\n",
 		  fsp_str_dbg(fsp), fsp_fnum_dbg(fsp)));
 
-	smbreq = smbd_smb2_fake_smb_request(smb2req);
-	if (tevent_req_nomem(smbreq, req)) {
+	state->smbreq = smbd_smb2_fake_smb_request(smb2req);
+	if (tevent_req_nomem(state->smbreq, req)) {
 		return tevent_req_post(req, ev);
 	}
 
@@ -294,27 +694,27 @@ static struct tevent_req *smbd_smb2_query_directory_send(TALLOC_CTX *mem_ctx,
 
 	switch (in_file_info_class) {
 	case SMB2_FIND_DIRECTORY_INFO:
-		info_level = SMB_FIND_FILE_DIRECTORY_INFO;
+		state->info_level = SMB_FIND_FILE_DIRECTORY_INFO;
 		break;
 
 	case SMB2_FIND_FULL_DIRECTORY_INFO:
-		info_level = SMB_FIND_FILE_FULL_DIRECTORY_INFO;
+		state->info_level = SMB_FIND_FILE_FULL_DIRECTORY_INFO;
 		break;
 
 	case SMB2_FIND_BOTH_DIRECTORY_INFO:
-		info_level = SMB_FIND_FILE_BOTH_DIRECTORY_INFO;
+		state->info_level = SMB_FIND_FILE_BOTH_DIRECTORY_INFO;
 		break;
 
 	case SMB2_FIND_NAME_INFO:
-		info_level = SMB_FIND_FILE_NAMES_INFO;
+		state->info_level = SMB_FIND_FILE_NAMES_INFO;
 		break;
 
 	case SMB2_FIND_ID_BOTH_DIRECTORY_INFO:
-		info_level = SMB_FIND_ID_BOTH_DIRECTORY_INFO;
+		state->info_level = SMB_FIND_ID_BOTH_DIRECTORY_INFO;
 		break;
 
 	case SMB2_FIND_ID_FULL_DIRECTORY_INFO:
-		info_level = SMB_FIND_ID_FULL_DIRECTORY_INFO;
+		state->info_level = SMB_FIND_ID_FULL_DIRECTORY_INFO;
 		break;
 
 	default:
@@ -322,7 +722,124 @@ static struct tevent_req *smbd_smb2_query_directory_send(TALLOC_CTX *mem_ctx,
 		return tevent_req_post(req, ev);
 	}
 
-	if (in_flags & SMB2_CONTINUE_FLAG_REOPEN) {
+	chunk_size = lp_parm_int(SNUM(conn), "smbd",
+				 "query directory chunk size", 128);
+
+	/*
+	 * We're not allowed to go async in a compound chain unless
+	 * we're the last request, see smbd_smb2_request_pending_queue().
+	 */
+	if ((chunk_size <= 0) ||
+	    (smb2req->in.vector_count >
+	     smb2req->current_idx + SMBD_SMB2_NUM_IOV_PER_REQ)) {
+		/*
+		 * List all entries at once, in the smbd main loop.
+		 */
+		smbd_smb2_query_directory_start(req);
+		if (tevent_req_is_in_progress(req)) {
+			tevent_req_nterror(req, NT_STATUS_INTERNAL_ERROR);
+		}
+		return tevent_req_post(req, ev);
+	}
+
+	/*
+	 * Otherwise every chunk_size entries are read ahead by a
+	 * helper thread, and the event loop gets a turn before each
+	 * chunk, so that other requests on the connection and oplock
+	 * breaks are not held up by a large directory on slow
+	 * storage.
+	 */
+	state->chunk_size = chunk_size;
+	state->async_stat = lp_parm_bool(SNUM(conn), "smbd",
+					 "async dir stat", false);
+
+	/* Hold back a close of the directory until we're done */
+	ok = aio_add_req_to_fsp(fsp, req);
+	if (!ok) {
+		tevent_req_nterror(req, NT_STATUS_NO_MEMORY);
+		return tevent_req_post(req, ev);
+	}
+
+	/* allow this request to be canceled */
+	tevent_req_set_cancel_fn(req, smbd_smb2_query_directory_cancel);
+
+	if (fsp->query_directory_queue == NULL) {
+		fsp->query_directory_queue = tevent_queue_create(
+			fsp, "query_directory_queue");
+		if (tevent_req_nomem(fsp->query_directory_queue, req)) {
+			return tevent_req_post(req, ev);
+		}
+	}
+
+	/*
+	 * Requests on the same handle share fsp->dptr, wait for
+	 * the ones before us.
+	 */
+	qe = tevent_queue_add_optimize_empty(fsp->query_directory_queue, ev,
+					     req,
+					     smbd_smb2_query_directory_trigger,
+					     NULL);
+	if (tevent_req_nomem(qe, req)) {
+		return tevent_req_post(req, ev);
+	}
+	if (!tevent_req_is_in_progress(req)) {
+		return tevent_req_post(req, ev);
+	}
+
+	return req;
+}
+
+/*
+ * Run as the user of the request again after the event loop had a
+ * turn, other requests might have changed that.
+ */
+static bool smbd_smb2_query_directory_become_user(struct tevent_req *req)
+{
+	struct smbd_smb2_query_directory_state *state = tevent_req_data(
+		req, struct smbd_smb2_query_directory_state);
+	bool ok;
+
+	ok = change_to_user(state->conn,
+			    state->smb2req->session->compat->vuid);
+	if (!ok) {
+		tevent_req_nterror(req, NT_STATUS_ACCESS_DENIED);
+		return false;
+	}
+
+	ok = set_current_service(state->conn, 0, true);
+	if (!ok) {
+		tevent_req_nterror(req, NT_STATUS_ACCESS_DENIED);
+		return false;
+	}
+
+	return true;
+}
+
+static void smbd_smb2_query_directory_trigger(struct tevent_req *req,
+					      void *private_data)
+{
+	if (!smbd_smb2_query_directory_become_user(req)) {
+		return;
+	}
+	smbd_smb2_query_directory_start(req);
+}
+
+static void smbd_smb2_query_directory_chunk(struct tevent_req *req);
+static void smbd_smb2_query_directory_next(struct tevent_req *req);
+
+static void smbd_smb2_query_directory_start(struct tevent_req *req)
+{
+	struct smbd_smb2_query_directory_state *state = tevent_req_data(
+		req, struct smbd_smb2_query_directory_state);
+	struct smb_request *smbreq = state->smbreq;
+	connection_struct *conn = state->conn;
+	struct files_struct *fsp = state->fsp;
+	bool wcard_has_wild = false;
+	NTSTATUS status;
+
+	state->started = true;
+
+	if (state->in_flags & SMB2_CONTINUE_FLAG_REOPEN) {
 		int flags;
 
 		dptr_CloseDir(fsp);
@@ -338,12 +855,12 @@ static struct tevent_req *smbd_smb2_query_directory_send(TALLOC_CTX *mem_ctx,
 #endif
 		status = fd_open(conn, fsp, flags, 0);
 		if (tevent_req_nterror(req, status)) {
-			return tevent_req_post(req, ev);
+			return;
 		}
 	}
 
 	if (!smbreq->posix_pathnames) {
-		wcard_has_wild = ms_has_wild(in_file_name);
+		wcard_has_wild = ms_has_wild(state->in_file_name);
 	}
 
 	/* Ensure we've canonicalized any search path if not a wildcard. */
@@ -358,17 +875,17 @@ static struct tevent_req *smbd_smb2_query_directory_send(TALLOC_CTX *mem_ctx,
 					UCF_POSIX_PATHNAMES : 0);
 
 		if (ISDOT(fsp->fsp_name->base_name)) {
-			fullpath = in_file_name;
+			fullpath = state->in_file_name;
 		} else {
 			size_t len;
 			char *tmp;
 
 			len = full_path_tos(
-				fsp->fsp_name->base_name, in_file_name,
+				fsp->fsp_name->base_name, state->in_file_name,
 				tmpbuf, sizeof(tmpbuf), &tmp, &to_free);
 			if (len == -1) {
 				tevent_req_oom(req);
-				return tevent_req_post(req, ev);
+				return;
 			}
 			fullpath = tmp;
 		}
@@ -383,10 +900,10 @@ static struct tevent_req *smbd_smb2_query_directory_send(TALLOC_CTX *mem_ctx,
 		TALLOC_FREE(to_free);
 
 		if (tevent_req_nterror(req, status)) {
-			return tevent_req_post(req, ev);
+			return;
 		}
 
-		in_file_name = smb_fname->original_lcomp;
+		state->in_file_name = smb_fname->original_lcomp;
 	}
 
 	if (fsp->dptr == NULL) {
@@ -397,90 +914,114 @@ static struct tevent_req *smbd_smb2_query_directory_send(TALLOC_CTX *mem_ctx,
 				     false, /* old_handle */
 				     false, /* expect_close */
 				     0, /* spid */
-				     in_file_name, /* wcard */
+				     state->in_file_name, /* wcard */
 				     wcard_has_wild,
-				     dirtype,
+				     state->dirtype,
 				     &fsp->dptr);
 		if (!NT_STATUS_IS_OK(status)) {
 			tevent_req_nterror(req, status);
-			return tevent_req_post(req, ev);
+			return;
 		}
 
-		empty_status = NT_STATUS_NO_SUCH_FILE;
+		state->empty_status = NT_STATUS_NO_SUCH_FILE;
 	} else {
-		empty_status = STATUS_NO_MORE_FILES;
+		state->empty_status = STATUS_NO_MORE_FILES;
 	}
 
-	if (in_flags & SMB2_CONTINUE_FLAG_RESTART) {
+	if (state->in_flags & SMB2_CONTINUE_FLAG_RESTART) {
 		dptr_SeekDir(fsp->dptr, 0);
 	}
 
-	if (in_flags & SMB2_CONTINUE_FLAG_SINGLE) {
-		max_count = 1;
+	if (state->in_flags & SMB2_CONTINUE_FLAG_SINGLE) {
+		state->max_count = 1;
 	} else {
-		max_count = UINT16_MAX;
+		state->max_count = UINT16_MAX;
 	}
 
 #define DIR_ENTRY_SAFETY_MARGIN 4096
 
 	state->out_output_buffer = data_blob_talloc(state, NULL,
-			in_output_buffer_length + DIR_ENTRY_SAFETY_MARGIN);
+			state->in_output_buffer_length +
+			DIR_ENTRY_SAFETY_MARGIN);
 	if (tevent_req_nomem(state->out_output_buffer.data, req)) {
-		return tevent_req_post(req, ev);
+		return;
 	}
 
 	state->out_output_buffer.length = 0;
-	pdata = (char *)state->out_output_buffer.data;
-	base_data = pdata;
+	state->pdata = (char *)state->out_output_buffer.data;
+	state->base_data = state->pdata;
 	/*
 	 * end_data must include the safety margin as it's what is
 	 * used to determine if pushed strings have been truncated.
 	 */
-	end_data = pdata + in_output_buffer_length + DIR_ENTRY_SAFETY_MARGIN - 1;
-	last_entry_off = 0;
-	off = 0;
-	num = 0;
+	state->end_data = state->pdata + state->in_output_buffer_length +
+			  DIR_ENTRY_SAFETY_MARGIN - 1;
+	state->last_entry_off = 0;
+	state->num = 0;
 
 	DEBUG(8,("smbd_smb2_query_directory_send: dirpath=<%s> dontdescend=<%s>, "
 		"in_output_buffer_length = %u\n",
 		fsp->fsp_name->base_name, lp_dont_descend(talloc_tos(), SNUM(conn)),
-		(unsigned int)in_output_buffer_length ));
+		(unsigned int)state->in_output_buffer_length ));
 	if (in_list(fsp->fsp_name->base_name,lp_dont_descend(talloc_tos(), SNUM(conn)),
 			conn->case_sensitive)) {
-		dont_descend = true;
+		state->dont_descend = true;
+	}
+
+	state->ask_sharemode = lp_parm_bool(SNUM(conn),
+					    "smbd", "search ask sharemode",
+					    true);
+
+	/* Where to go back to if we're cancelled */
+	state->start_offset = dptr_TellDir(fsp->dptr);
+
+	if (state->chunk_size == 0) {
+		smbd_smb2_query_directory_chunk(req);
+		return;
 	}
 
-	ask_sharemode = lp_parm_bool(SNUM(conn),
-				     "smbd", "search ask sharemode",
-				     true);
+	smbd_smb2_query_directory_next(req);
+}
+
+/*
+ * Put up to chunk_size entries into the output buffer
+ */
+static void smbd_smb2_query_directory_chunk(struct tevent_req *req)
+{
+	struct smbd_smb2_query_directory_state *state = tevent_req_data(
+		req, struct smbd_smb2_query_directory_state);
+	struct files_struct *fsp = state->fsp;
+	unsigned i;
 
-	while (true) {
+	for (i = 0; (state->chunk_size == 0) || (i < state->chunk_size); i++) {
 		bool got_exact_match = false;
-		int space_remaining = in_output_buffer_length - off;
+		int off = (int)PTR_DIFF(state->pdata, state->base_data);
+		int space_remaining = state->in_output_buffer_length - off;
+		NTSTATUS status;
 
 		SMB_ASSERT(space_remaining >= 0);
 
 		status = smbd_dirptr_lanman2_entry(state,
-					       conn,
+					       state->conn,
 					       fsp->dptr,
-					       smbreq->flags2,
-					       in_file_name,
-					       dirtype,
-					       info_level,
+					       state->smbreq->flags2,
+					       state->in_file_name,
+					       state->dirtype,
+					       state->info_level,
 					       false, /* requires_resume_key */
-					       dont_descend,
-					       ask_sharemode,
+					       state->dont_descend,
+					       state->ask_sharemode,
 					       8, /* align to 8 bytes */
 					       false, /* no padding */
-					       &pdata,
-					       base_data,
-					       end_data,
+					       &state->pdata,
+					       state->base_data,
+					       state->end_data,
 					       space_remaining,
 					       &got_exact_match,
-					       &last_entry_off,
+					       &state->last_entry_off,
 					       NULL);
 
-		off = (int)PTR_DIFF(pdata, base_data);
+		off = (int)PTR_DIFF(state->pdata, state->base_data);
 
 		if (!NT_STATUS_IS_OK(status)) {
 			if (NT_STATUS_EQUAL(status, NT_STATUS_ILLEGAL_CHARACTER)) {
@@ -489,33 +1030,111 @@ static struct tevent_req *smbd_smb2_query_directory_send(TALLOC_CTX *mem_ctx,
 				 * entry.
 				 */
 				continue;
-			} else if (num > 0) {
-				SIVAL(state->out_output_buffer.data, last_entry_off, 0);
+			} else if (state->num > 0) {
+				SIVAL(state->out_output_buffer.data,
+				      state->last_entry_off, 0);
 				tevent_req_done(req);
-				return tevent_req_post(req, ev);
+				return;
 			} else if (NT_STATUS_EQUAL(status, STATUS_MORE_ENTRIES)) {
 				tevent_req_nterror(req, NT_STATUS_INFO_LENGTH_MISMATCH);
-				return tevent_req_post(req, ev);
+				return;
 			} else {
-				tevent_req_nterror(req, empty_status);
-				return tevent_req_post(req, ev);
+				tevent_req_nterror(req, state->empty_status);
+				return;
 			}
 		}
 
-		num++;
+		state->num++;
 		state->out_output_buffer.length = off;
 
-		if (num < max_count) {
+		if (state->num < state->max_count) {
 			continue;
 		}
 
-		SIVAL(state->out_output_buffer.data, last_entry_off, 0);
+		SIVAL(state->out_output_buffer.data, state->last_entry_off, 0);
 		tevent_req_done(req);
-		return tevent_req_post(req, ev);
+		return;
+	}
+
+	smbd_smb2_query_directory_next(req);
+}
+
+static void smbd_smb2_query_directory_readahead_done(struct tevent_req *subreq);
+
+/*
+ * Have the next chunk read ahead by a helper thread. Its completion
+ * arrives through an fd, so the event loop polls the sockets before
+ * we go on.
+ */
+static void smbd_smb2_query_directory_next(struct tevent_req *req)
+{
+	struct smbd_smb2_query_directory_state *state = tevent_req_data(
+		req, struct smbd_smb2_query_directory_state);
+
+	state->readahead_subreq = query_dir_readahead_send(state, state->ev,
+							   state->fsp,
+							   state->chunk_size);
+	if (state->readahead_subreq == NULL) {
+		tevent_req_oom(req);
+		return;
+	}
+	tevent_req_set_callback(state->readahead_subreq,
+				smbd_smb2_query_directory_readahead_done,
+				req);
+}
+
+static void smbd_smb2_query_directory_readahead_done(struct tevent_req *subreq)
+{
+	struct tevent_req *req = tevent_req_callback_data(
+		subreq, struct tevent_req);
+	struct smbd_smb2_query_directory_state *state = tevent_req_data(
+		req, struct smbd_smb2_query_directory_state);
+	int ret;
+
+	ret = query_dir_readahead_recv(subreq, state->fsp->dptr,
+				       state->async_stat);
+	TALLOC_FREE(subreq);
+	state->readahead_subreq = NULL;
+
+	if (!smbd_smb2_query_directory_become_user(req)) {
+		return;
+	}
+
+	if (ret != 0) {
+		/*
+		 * Not fatal, but without the helper we can't yield
+		 * properly, so do the rest at once.
+		 */
+		DEBUG(5, ("query_dir_readahead_recv failed: %s\n",
+			  strerror(ret)));
+		state->chunk_size = 0;
+	}
+
+	smbd_smb2_query_directory_chunk(req);
+}
+
+static bool smbd_smb2_query_directory_cancel(struct tevent_req *req)
+{
+	struct smbd_smb2_query_directory_state *state = tevent_req_data(
+		req, struct smbd_smb2_query_directory_state);
+
+	/*
+	 * We're waiting for the queue or the readahead helper, never
+	 * in the middle of an entry. A running helper job is
+	 * detached and thrown away when it's done.
+	 */
+	TALLOC_FREE(state->readahead_subreq);
+
+	if (state->started && (state->fsp->dptr != NULL)) {
+		/*
+		 * Give the client the entries we have read so far
+		 * again with its next request.
+		 */
+		dptr_SeekDir(state->fsp->dptr, state->start_offset);
 	}
 
-	tevent_req_nterror(req, NT_STATUS_INTERNAL_ERROR);
-	return tevent_req_post(req, ev);
+	tevent_req_nterror(req, NT_STATUS_CANCELLED);
+	return true;
 }
 
 static NTSTATUS smbd_smb2_query_directory_recv(struct tevent_req *req,
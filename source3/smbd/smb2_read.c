@@ -161,6 +161,14 @@ static void smbd_smb2_request_read_done(struct tevent_req *subreq)
 
 	outdyn = out_data_buffer;
 
+	if (outdyn.data != NULL) {
+		/*
+		 * All our read buffers are allocated with
+		 * SMBD_SMB2_OUT_DYN_TAILROOM extra bytes.
+		 */
+		req->out_dyn_tailroom = SMBD_SMB2_OUT_DYN_TAILROOM;
+	}
+
 	error = smbd_smb2_request_done(req, outbody, &outdyn);
 	if (!NT_STATUS_IS_OK(error)) {
 		smbd_server_connection_terminate(req->xconn,
@@ -478,10 +486,12 @@ static struct tevent_req *smbd_smb2_read_send(TALLOC_CTX *mem_ctx,
 	if (IS_IPC(smbreq->conn)) {
 		struct tevent_req *subreq = NULL;
 
-		state->out_data = data_blob_talloc(state, NULL, in_length);
-		if (in_length > 0 && tevent_req_nomem(state->out_data.data, req)) {
+		state->out_data = data_blob_talloc(state, NULL,
+				in_length + SMBD_SMB2_OUT_DYN_TAILROOM);
+		if (tevent_req_nomem(state->out_data.data, req)) {
 			return tevent_req_post(req, ev);
 		}
+		state->out_data.length = in_length;
 
 		if (!fsp_is_np(fsp)) {
 			tevent_req_nterror(req, NT_STATUS_FILE_CLOSED);
@@ -557,11 +567,13 @@ static struct tevent_req *smbd_smb2_read_send(TALLOC_CTX *mem_ctx,
 	}
 
 	/* Ok, read into memory. Allocate the out buffer. */
-	state->out_data = data_blob_talloc(state, NULL, in_length);
-	if (in_length > 0 && tevent_req_nomem(state->out_data.data, req)) {
+	state->out_data = data_blob_talloc(state, NULL,
+			in_length + SMBD_SMB2_OUT_DYN_TAILROOM);
+	if (tevent_req_nomem(state->out_data.data, req)) {
 		SMB_VFS_STRICT_UNLOCK(conn, fsp, &lock);
 		return tevent_req_post(req, ev);
 	}
+	state->out_data.length = in_length;
 
 	nread = read_file(fsp,
 			  (char *)state->out_data.data,
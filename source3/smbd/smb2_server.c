@@ -37,6 +37,8 @@ static void smbd_smb2_connection_handler(struct tevent_context *ev,
 					 uint16_t flags,
 					 void *private_data);
 static NTSTATUS smbd_smb2_flush_send_queue(struct smbXsrv_connection *xconn);
+static void smbd_smb2_send_queue_add(struct smbXsrv_connection *xconn,
+				     struct smbd_smb2_send_queue *e);
 
 static const struct smbd_smb2_dispatch_table {
 	uint16_t opcode;
@@ -213,6 +215,9 @@ static NTSTATUS smbd_initialize_smb2(struct smbXsrv_connection *xconn,
 	xconn->smb2.credits.seq_range = 1;
 	xconn->smb2.credits.granted = 1;
 	xconn->smb2.credits.max = lp_smb2_max_credits();
+	xconn->smb2.credits.window = MAX(xconn->smb2.credits.max / 16, 1);
+	xconn->smb2.stats.latency_target_usec = 1000 * lp_parm_int(-1,
+		"smbd", "credit latency target", 20);
 	xconn->smb2.credits.bitmap = bitmap_talloc(xconn,
 						   xconn->smb2.credits.max);
 	if (xconn->smb2.credits.bitmap == NULL) {
@@ -799,15 +804,11 @@ static void smb2_set_operation_credit(struct smbXsrv_connection *xconn,
 	 * more later. I was only able to trigger higher
 	 * values, when using a very high credit charge.
 	 *
-	 * TODO: scale up depending on load, free memory
-	 *       or other stuff.
-	 *       Maybe also on the relationship between number
-	 *       of requests and the used sequence number.
-	 *       Which means we would grant more credits
-	 *       for client which use multi credit requests.
+	 * smb2_credit_window_update() scales the window up
+	 * to max and down again, depending on how many
+	 * credits the client uses and how fast we reply.
 	 */
-	current_max_credits = xconn->smb2.credits.max / 16;
-	current_max_credits = MAX(current_max_credits, 1);
+	current_max_credits = xconn->smb2.credits.window;
 
 	if (xconn->smb2.credits.multicredit) {
 		credit_charge = SVAL(inhdr, SMB2_HDR_CREDIT_CHARGE);
@@ -883,6 +884,9 @@ static void smb2_set_operation_credit(struct smbXsrv_connection *xconn,
 	 * 3. remove the range we'll already granted to the client
 	 *    this makes sure the client consumes the lowest sequence
 	 *    number, before we can grant additional credits.
+	 *    smb2_credit_window_update() may have shrunk the window
+	 *    below that range, then there's nothing to grant until
+	 *    the client used enough of its credits.
 	 */
 	credits_possible = UINT64_MAX - xconn->smb2.credits.seq_low;
 	if (credits_possible > 0) {
@@ -890,13 +894,18 @@ static void smb2_set_operation_credit(struct smbXsrv_connection *xconn,
 		credits_possible -= 1;
 	}
 	credits_possible = MIN(credits_possible, current_max_credits);
-	credits_possible -= xconn->smb2.credits.seq_range;
+	if (credits_possible > xconn->smb2.credits.seq_range) {
+		credits_possible -= xconn->smb2.credits.seq_range;
+	} else {
+		credits_possible = 0;
+	}
 
 	credits_granted = MIN(credits_granted, credits_possible);
 
 	SSVAL(outhdr, SMB2_HDR_CREDIT, credits_granted);
 	xconn->smb2.credits.granted += credits_granted;
 	xconn->smb2.credits.seq_range += credits_granted;
+	xconn->smb2.stats.num_credits_granted += credits_granted;
 
 	DEBUG(10,("smb2_set_operation_credit: requested %u, charge %u, "
 		"granted %u, current possible/max %u/%u, "
@@ -912,6 +921,76 @@ static void smb2_set_operation_credit(struct smbXsrv_connection *xconn,
 		(unsigned int)xconn->smb2.credits.seq_range));
 }
 
+/*
+ * Adapt the credit window to the backend latency, like TCP
+ * congestion control: grow additively in chunks of 32 while the
+ * client uses most of its credits and we reply faster than
+ * the latency target, shrink by a quarter when replies are
+ * slower. This way a client flooding us with large reads
+ * gets backpressure instead of a longer queue in front of
+ * everyone else.
+ */
+static void smb2_credit_window_update(struct smbd_smb2_request *req)
+{
+	struct smbXsrv_connection *xconn = req->xconn;
+	uint16_t min_window = MAX(xconn->smb2.credits.max / 16, 1);
+	uint16_t window = xconn->smb2.credits.window;
+	uint16_t opcode = SVAL(SMBD_SMB2_IN_HDR_PTR(req), SMB2_HDR_OPCODE);
+
+	xconn->smb2.stats.num_requests += 1;
+
+	/*
+	 * Only reads and writes tell us how fast the backend is.
+	 * Others, like notify, blocking locks or opens waiting for
+	 * an oplock break, wait for the client and would make the
+	 * window collapse.
+	 */
+	if ((opcode == SMB2_OP_READ) || (opcode == SMB2_OP_WRITE)) {
+		struct timeval now = timeval_current();
+		int64_t diff;
+		uint64_t latency;
+
+		diff = usec_time_diff(&now, &req->request_time);
+		latency = MAX(diff, 0);
+
+		if (xconn->smb2.stats.num_latency_samples == 0) {
+			xconn->smb2.stats.avg_latency_usec = latency;
+		} else {
+			xconn->smb2.stats.avg_latency_usec -=
+				xconn->smb2.stats.avg_latency_usec / 8;
+			xconn->smb2.stats.avg_latency_usec += latency / 8;
+		}
+		xconn->smb2.stats.num_latency_samples += 1;
+	}
+
+	/*
+	 * Only adjust once per chunk, the average needs some
+	 * replies to follow a change.
+	 */
+	xconn->smb2.stats.num_since_adjust += 1;
+	if (xconn->smb2.stats.num_since_adjust < 32) {
+		return;
+	}
+
+	if (xconn->smb2.stats.avg_latency_usec >
+	    xconn->smb2.stats.latency_target_usec)
+	{
+		window -= window / 4;
+		window = MAX(window, min_window);
+		if (window != xconn->smb2.credits.window) {
+			xconn->smb2.stats.num_window_shrink += 1;
+		}
+	} else if (xconn->smb2.credits.granted < window / 4) {
+		window = MIN(window + 32, xconn->smb2.credits.max);
+		if (window != xconn->smb2.credits.window) {
+			xconn->smb2.stats.num_window_grow += 1;
+		}
+	}
+
+	xconn->smb2.stats.num_since_adjust = 0;
+	xconn->smb2.credits.window = window;
+}
+
 static void smb2_calculate_credits(const struct smbd_smb2_request *inreq,
 				struct smbd_smb2_request *outreq)
 {
@@ -1308,8 +1387,7 @@ static NTSTATUS smb2_send_async_interim_response(const struct smbd_smb2_request
 	nreq->queue_entry.mem_ctx = nreq;
 	nreq->queue_entry.vector = nreq->out.vector;
 	nreq->queue_entry.count = nreq->out.vector_count;
-	DLIST_ADD_END(xconn->smb2.send_queue, &nreq->queue_entry);
-	xconn->smb2.send_queue_len++;
+	smbd_smb2_send_queue_add(xconn, &nreq->queue_entry);
 
 	status = smbd_smb2_flush_send_queue(xconn);
 	if (!NT_STATUS_IS_OK(status)) {
@@ -1695,8 +1773,7 @@ static void smbd_smb2_request_pending_timer(struct tevent_context *ev,
 	state->queue_entry.mem_ctx = state;
 	state->queue_entry.vector = state->vector;
 	state->queue_entry.count = ARRAY_SIZE(state->vector);
-	DLIST_ADD_END(xconn->smb2.send_queue, &state->queue_entry);
-	xconn->smb2.send_queue_len++;
+	smbd_smb2_send_queue_add(xconn, &state->queue_entry);
 
 	status = smbd_smb2_flush_send_queue(xconn);
 	if (!NT_STATUS_IS_OK(status)) {
@@ -2728,6 +2805,8 @@ static NTSTATUS smbd_smb2_request_reply(struct smbd_smb2_request *req)
 	/* MS-SMB2: 3.3.4.1 Sending Any Outgoing Message */
 	smbd_smb2_request_reply_update_counts(req);
 
+	smb2_credit_window_update(req);
+
 	if (req->do_encryption &&
 	    (firsttf->iov_len == 0) &&
 	    (req->first_key.length == 0) &&
@@ -2928,8 +3007,7 @@ static NTSTATUS smbd_smb2_request_reply(struct smbd_smb2_request *req)
 	req->queue_entry.mem_ctx = req;
 	req->queue_entry.vector = req->out.vector;
 	req->queue_entry.count = req->out.vector_count;
-	DLIST_ADD_END(xconn->smb2.send_queue, &req->queue_entry);
-	xconn->smb2.send_queue_len++;
+	smbd_smb2_send_queue_add(xconn, &req->queue_entry);
 
 	status = smbd_smb2_flush_send_queue(xconn);
 	if (!NT_STATUS_IS_OK(status)) {
@@ -2980,6 +3058,13 @@ NTSTATUS smbd_smb2_request_done_ex(struct smbd_smb2_request *req,
 	struct iovec *outbody_v;
 	struct iovec *outdyn_v;
 	uint32_t next_command_ofs;
+	size_t dyn_tailroom = req->out_dyn_tailroom;
+
+	/*
+	 * Only valid for the dyn buffer passed in here,
+	 * not for error responses we may generate below.
+	 */
+	req->out_dyn_tailroom = 0;
 
 	DEBUG(10,("smbd_smb2_request_done_ex: "
 		  "idx[%d] status[%s] body[%u] dyn[%s:%u] at %s\n",
@@ -3044,6 +3129,20 @@ NTSTATUS smbd_smb2_request_done_ex(struct smbd_smb2_request *req,
 
 			outdyn_v->iov_base = (void *)pad;
 			outdyn_v->iov_len = pad_size;
+		} else if (dyn_tailroom >= pad_size) {
+			/*
+			 * The caller allocated some bytes
+			 * behind the dynamic buffer, so we
+			 * can pad in place, this avoids
+			 * copying large read responses.
+			 */
+			uint8_t *dyn_end;
+
+			dyn_end = SMBD_SMB2_OUT_DYN_PTR(req);
+			dyn_end += SMBD_SMB2_OUT_DYN_LEN(req);
+
+			memset(dyn_end, 0, pad_size);
+			outdyn_v->iov_len += pad_size;
 		} else {
 			/*
 			 * For now we copy the dynamic buffer
@@ -3270,8 +3369,7 @@ static NTSTATUS smbd_smb2_send_break(struct smbXsrv_connection *xconn,
 	state->queue_entry.mem_ctx = state;
 	state->queue_entry.vector = state->vector;
 	state->queue_entry.count = ARRAY_SIZE(state->vector);
-	DLIST_ADD_END(xconn->smb2.send_queue, &state->queue_entry);
-	xconn->smb2.send_queue_len++;
+	smbd_smb2_send_queue_add(xconn, &state->queue_entry);
 
 	status = smbd_smb2_flush_send_queue(xconn);
 	if (!NT_STATUS_IS_OK(status)) {
@@ -3562,6 +3660,67 @@ static int socket_error_from_errno(int ret,
 	return sys_errno;
 }
 
+/*
+ * Responses larger than this are considered bulk data
+ */
+#define SMBD_SMB2_SMALL_RESPONSE_SIZE 4096
+
+static bool smbd_smb2_send_queue_is_bulk(const struct smbd_smb2_send_queue *e)
+{
+	ssize_t len;
+
+	if (e->sendfile_header != NULL) {
+		return true;
+	}
+
+	len = iov_buflen(e->vector, e->count);
+	if (len == -1) {
+		return true;
+	}
+
+	return (len > SMBD_SMB2_SMALL_RESPONSE_SIZE);
+}
+
+/*
+ * SMB2 does not require responses to be sent in any particular
+ * order. A burst of large READ responses would put every small
+ * (metadata) response behind megabytes of data, so small
+ * responses overtake the bulk responses which are still waiting
+ * in the queue.
+ *
+ * The head of the queue may already be partially written, it
+ * always stays first. Small responses stay in order between each
+ * other, so an interim response is always sent before the final
+ * response.
+ */
+static void smbd_smb2_send_queue_add(struct smbXsrv_connection *xconn,
+				     struct smbd_smb2_send_queue *e)
+{
+	struct smbd_smb2_send_queue *q = NULL;
+
+	if (xconn->smb2.send_queue != NULL &&
+	    !smbd_smb2_send_queue_is_bulk(e))
+	{
+		for (q = xconn->smb2.send_queue->next; q != NULL; q = q->next) {
+			if (smbd_smb2_send_queue_is_bulk(q)) {
+				break;
+			}
+		}
+	}
+
+	if (q != NULL) {
+		DLIST_ADD_AFTER(xconn->smb2.send_queue, e, q->prev);
+		xconn->smb2.stats.num_reordered += 1;
+	} else {
+		DLIST_ADD_END(xconn->smb2.send_queue, e);
+	}
+
+	xconn->smb2.send_queue_len++;
+	xconn->smb2.stats.max_send_queue_len = MAX(
+		xconn->smb2.stats.max_send_queue_len,
+		xconn->smb2.send_queue_len);
+}
+
 static NTSTATUS smbd_smb2_flush_send_queue(struct smbXsrv_connection *xconn)
 {
 	int ret;
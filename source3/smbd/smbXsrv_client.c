@@ -266,6 +266,17 @@ static void smbXsrv_client_global_verify_record(struct db_record *db_rec,
 	TALLOC_FREE(frame);
 }
 
+static NTSTATUS smbXsrv_client_global_store(struct smbXsrv_client_global0 *global);
+
+/*
+ * Find the smbd process owning client_guid.
+ *
+ * If there is none, client becomes the owner: the record is
+ * stored while we still hold the lock we used for the lookup,
+ * so two connections of the same client racing in here end up
+ * in the same process. NT_STATUS_OBJECTID_NOT_FOUND is returned
+ * in that case.
+ */
 NTSTATUS smb2srv_client_lookup_global(struct smbXsrv_client *client,
 				      struct GUID client_guid,
 				      TALLOC_CTX *mem_ctx,
@@ -275,10 +286,17 @@ NTSTATUS smb2srv_client_lookup_global(struct smbXsrv_client *client,
 	struct smbXsrv_client_global0 *global = NULL;
 	bool is_free = false;
 	struct db_record *db_rec;
+	NTSTATUS status;
+
+	if (client->global->db_rec != NULL) {
+		DBG_ERR("guid [%s]: Called with db_rec != NULL'\n",
+			GUID_string(talloc_tos(), &client_guid));
+		return NT_STATUS_INTERNAL_ERROR;
+	}
 
 	db_rec = smbXsrv_client_global_fetch_locked(table->global.db_ctx,
 						    &client_guid,
-						    talloc_tos());
+						    client->global);
 	if (db_rec == NULL) {
 		return NT_STATUS_INTERNAL_DB_ERROR;
 	}
@@ -288,14 +306,29 @@ NTSTATUS smb2srv_client_lookup_global(struct smbXsrv_client *client,
 					    NULL,
 					    mem_ctx,
 					    &global);
-	TALLOC_FREE(db_rec);
+	if (!is_free) {
+		TALLOC_FREE(db_rec);
+		*_global = global;
+		return NT_STATUS_OK;
+	}
 
-	if (is_free) {
-		return NT_STATUS_OBJECTID_NOT_FOUND;
+	/*
+	 * smbXsrv_client_global_store() releases the lock
+	 */
+	client->global->client_guid = client_guid;
+	client->global->db_rec = db_rec;
+	status = smbXsrv_client_global_store(client->global);
+	if (!NT_STATUS_IS_OK(status)) {
+		DBG_ERR("client_guid[%s] store failed - %s\n",
+			GUID_string(talloc_tos(), &client_guid),
+			nt_errstr(status));
+		return status;
 	}
 
-	*_global = global;
-	return NT_STATUS_OK;
+	DBG_DEBUG("client_guid[%s] stored\n",
+		  GUID_string(talloc_tos(), &client_guid));
+
+	return NT_STATUS_OBJECTID_NOT_FOUND;
 }
 
 NTSTATUS smb2srv_client_connection_pass(struct smbd_smb2_request *smb2req,
@@ -605,7 +638,7 @@ static void smbXsrv_client_connection_pass_loop(struct tevent_req *subreq)
 		goto next;
 	}
 
-	DBG_DEBUG("MSG_SMBXSRV_CLIENT_CLOSE\n");
+	DBG_DEBUG("MSG_SMBXSRV_CONNECTION_PASS\n");
 	if (DEBUGLVL(DBGLVL_DEBUG)) {
 		NDR_PRINT_DEBUG(smbXsrv_connection_passB, &pass_blob);
 	}
@@ -654,8 +687,7 @@ static void smbXsrv_client_connection_pass_loop(struct tevent_req *subreq)
 	SMB_ASSERT(rec->num_fds == 1);
 	sock_fd = rec->fds[0];
 
-	DBG_ERR("got connection sockfd[%d]\n", sock_fd);
-	NDR_PRINT_DEBUG(smbXsrv_connection_passB, &pass_blob);
+	DBG_DEBUG("got connection sockfd[%d]\n", sock_fd);
 	status = smbd_add_connection(client, sock_fd, &xconn);
 	if (!NT_STATUS_IS_OK(status)) {
 		close(sock_fd);
@@ -65,6 +65,19 @@ struct trans_state {
 	char *data;
 };
 
+/*
+ * Counters of the shared stat cache, summed up over all smbds
+ */
+struct stat_cache_shared_stats {
+	uint64_t lookups;
+	uint64_t hits;
+	uint64_t misses;
+	uint64_t adds;
+	uint64_t invalidations;
+	uint64_t purges;
+	uint64_t bytes;		/* added since the last purge */
+};
+
 /*
  * unix_convert_flags
  */
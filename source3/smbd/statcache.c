@@ -22,18 +22,356 @@
 
 #include "includes.h"
 #include "../lib/util/memcache.h"
+#include "system/filesys.h"
 #include "smbd/smbd.h"
 #include "messages.h"
 #include "smbprofile.h"
 #include <tdb.h>
+#include "dbwrap/dbwrap.h"
+#include "dbwrap/dbwrap_open.h"
+#include "util_tdb.h"
 
 /****************************************************************************
  Stat cache code used in unix_convert.
 *****************************************************************************/
 
+/****************************************************************************
+ Shared stat cache.
+
+ With "smbd:shared stat cache = yes" all smbds use one CLEAR_IF_FIRST tdb
+ instead of their own memcache, so a new client does not have to learn
+ the case corrections of the hot paths again. With mutex locking the tdb
+ is opened with TDB_SEQLOCK_READ, lookups then read the mmap'ed hash
+ chains without taking a lock.
+
+ Entries are keyed by the share path and the client name, the value is
+ the translated name. Instead of telling all smbds to delete an entry,
+ the entry is deleted from the tdb, for a directory together with all
+ entries below it.
+*****************************************************************************/
+
+#define STAT_CACHE_SHARED_STATS_KEY "STAT_CACHE/STATISTICS"
+#define STAT_CACHE_SHARED_STATS_LEN (7 * sizeof(uint64_t))
+
+/* our counters are added to the shared ones every that many operations */
+#define STAT_CACHE_SHARED_FLUSH_INTERVAL 256
+
+static struct db_context *stat_cache_shared_db;
+static struct stat_cache_shared_stats stat_cache_shared_pending;
+
+bool stat_cache_shared_init(bool read_only)
+{
+	char *db_path;
+	int tdb_flags = TDB_DEFAULT|TDB_VOLATILE|TDB_CLEAR_IF_FIRST|
+		TDB_INCOMPATIBLE_HASH;
+
+	if (stat_cache_shared_db != NULL) {
+		return true;
+	}
+
+	db_path = lock_path("statcache.tdb");
+	if (db_path == NULL) {
+		return false;
+	}
+
+	if (tdb_runtime_check_for_robust_mutexes()) {
+		tdb_flags |= TDB_MUTEX_LOCKING|TDB_SEQLOCK_READ;
+	}
+
+	stat_cache_shared_db = db_open(NULL, db_path, 0, tdb_flags,
+				       read_only ? O_RDONLY : O_RDWR|O_CREAT,
+				       0644, DBWRAP_LOCK_ORDER_3,
+				       DBWRAP_FLAG_NONE);
+	TALLOC_FREE(db_path);
+	if (stat_cache_shared_db == NULL) {
+		DEBUG(1, ("ERROR: Failed to initialise the shared stat "
+			  "cache\n"));
+		return false;
+	}
+
+	return true;
+}
+
+static TDB_DATA stat_cache_shared_key(TALLOC_CTX *mem_ctx,
+				      connection_struct *conn,
+				      const char *name, size_t namelen)
+{
+	char *key;
+
+	key = talloc_asprintf(mem_ctx, "%s/%.*s", conn->connectpath,
+			      (int)namelen, name);
+	if (key == NULL) {
+		return tdb_null;
+	}
+	return string_tdb_data(key);
+}
+
+struct stat_cache_shared_fetch_state {
+	TALLOC_CTX *mem_ctx;
+	DATA_BLOB value;
+};
+
+static void stat_cache_shared_fetch_parser(TDB_DATA key, TDB_DATA data,
+					   void *private_data)
+{
+	struct stat_cache_shared_fetch_state *state =
+		(struct stat_cache_shared_fetch_state *)private_data;
+
+	if ((data.dsize == 0) || (data.dptr[data.dsize-1] != '\0')) {
+		return;
+	}
+	state->value = data_blob_talloc(state->mem_ctx, data.dptr,
+					data.dsize);
+}
+
+/*
+ * Fetch the translated name including the terminating 0 into value,
+ * talloc'ed off mem_ctx.
+ */
+static bool stat_cache_shared_fetch(TALLOC_CTX *mem_ctx,
+				    connection_struct *conn,
+				    const char *name, size_t namelen,
+				    DATA_BLOB *value)
+{
+	struct stat_cache_shared_fetch_state state = {
+		.mem_ctx = mem_ctx,
+	};
+	TDB_DATA key;
+
+	key = stat_cache_shared_key(talloc_tos(), conn, name, namelen);
+	if (key.dptr == NULL) {
+		return false;
+	}
+	dbwrap_parse_record(stat_cache_shared_db, key,
+			    stat_cache_shared_fetch_parser, &state);
+	TALLOC_FREE(key.dptr);
+
+	if (state.value.data == NULL) {
+		return false;
+	}
+	*value = state.value;
+	return true;
+}
+
+static void stat_cache_shared_store(connection_struct *conn,
+				    const char *name, size_t namelen,
+				    const char *translated_path,
+				    size_t translated_path_length)
+{
+	DATA_BLOB old;
+	TDB_DATA key, value;
+	bool exists;
+
+	exists = stat_cache_shared_fetch(talloc_tos(), conn, name, namelen,
+					 &old);
+	if (exists) {
+		exists = ((old.length == translated_path_length + 1) &&
+			  (memcmp(old.data, translated_path,
+				  translated_path_length) == 0));
+		data_blob_free(&old);
+		if (exists) {
+			/* Don't write what's there already */
+			return;
+		}
+	}
+
+	key = stat_cache_shared_key(talloc_tos(), conn, name, namelen);
+	if (key.dptr == NULL) {
+		return;
+	}
+	/* translated_path is 0-terminated at translated_path_length */
+	value = make_tdb_data((const uint8_t *)translated_path,
+			      translated_path_length + 1);
+
+	dbwrap_store(stat_cache_shared_db, key, value, TDB_REPLACE);
+
+	stat_cache_shared_pending.adds += 1;
+	stat_cache_shared_pending.bytes += key.dsize + value.dsize;
+
+	TALLOC_FREE(key.dptr);
+}
+
+static void stat_cache_shared_delete(connection_struct *conn,
+				     const char *name)
+{
+	TDB_DATA key;
+
+	key = stat_cache_shared_key(talloc_tos(), conn, name, strlen(name));
+	if (key.dptr == NULL) {
+		return;
+	}
+	dbwrap_delete(stat_cache_shared_db, key);
+	TALLOC_FREE(key.dptr);
+}
+
+static int stat_cache_shared_purge_fn(struct db_record *rec,
+				      void *private_data)
+{
+	TDB_DATA key = dbwrap_record_get_key(rec);
+
+	/* Only the entries, they are keyed by an absolute path */
+	if ((key.dsize > 0) && (key.dptr[0] == '/')) {
+		dbwrap_record_delete(rec);
+	}
+	return 0;
+}
+
+/*
+ * Add our counters to the shared ones. If the entries added since the
+ * last purge exceed "max stat cache size", all entries are thrown away.
+ */
+static void stat_cache_shared_flush_stats(bool force)
+{
+	struct stat_cache_shared_stats *p = &stat_cache_shared_pending;
+	uint64_t max_size = (uint64_t)lp_max_stat_cache_size() * 1024;
+	uint64_t counters[7] = { 0, };
+	uint8_t buf[STAT_CACHE_SHARED_STATS_LEN];
+	struct db_record *rec;
+	TDB_DATA value;
+	bool purge = false;
+	size_t i;
+
+	if (!force &&
+	    (p->lookups + p->adds < STAT_CACHE_SHARED_FLUSH_INTERVAL)) {
+		return;
+	}
+
+	rec = dbwrap_fetch_locked(stat_cache_shared_db, talloc_tos(),
+				  string_tdb_data(STAT_CACHE_SHARED_STATS_KEY));
+	if (rec == NULL) {
+		return;
+	}
+
+	value = dbwrap_record_get_value(rec);
+	if (value.dsize == STAT_CACHE_SHARED_STATS_LEN) {
+		for (i = 0; i < ARRAY_SIZE(counters); i++) {
+			counters[i] = BVAL(value.dptr, i * sizeof(uint64_t));
+		}
+	}
+
+	counters[0] += p->lookups;
+	counters[1] += p->hits;
+	counters[2] += p->misses;
+	counters[3] += p->adds;
+	counters[4] += p->invalidations;
+	counters[6] += p->bytes;
+
+	if ((max_size != 0) && (counters[6] > max_size)) {
+		counters[5] += 1;
+		counters[6] = 0;
+		purge = true;
+	}
+
+	for (i = 0; i < ARRAY_SIZE(counters); i++) {
+		SBVAL(buf, i * sizeof(uint64_t), counters[i]);
+	}
+	dbwrap_record_store(rec, make_tdb_data(buf, sizeof(buf)), 0);
+	TALLOC_FREE(rec);
+
+	ZERO_STRUCTP(p);
+
+	if (purge) {
+		DEBUG(10, ("stat_cache_shared_flush_stats: purging\n"));
+		dbwrap_traverse(stat_cache_shared_db,
+				stat_cache_shared_purge_fn, NULL, NULL);
+	}
+}
+
+static int stat_cache_shared_delete_prefix_fn(struct db_record *rec,
+					      void *private_data)
+{
+	TDB_DATA *prefix = (TDB_DATA *)private_data;
+	TDB_DATA key = dbwrap_record_get_key(rec);
+
+	if ((key.dsize > prefix->dsize) &&
+	    (memcmp(key.dptr, prefix->dptr, prefix->dsize) == 0)) {
+		dbwrap_record_delete(rec);
+	}
+	return 0;
+}
+
+/*
+ * Invalidate the entry of a deleted or renamed name. A directory also
+ * takes all entries below it with it, the other entries stay valid.
+ */
+static void stat_cache_shared_invalidate(connection_struct *conn,
+					 const char *name,
+					 bool is_directory)
+{
+	char *lname;
+	TDB_DATA prefix;
+
+	if (conn->case_sensitive) {
+		lname = talloc_strdup(talloc_tos(), name);
+	} else {
+		lname = talloc_strdup_upper(talloc_tos(), name);
+	}
+	if (lname == NULL) {
+		return;
+	}
+
+	stat_cache_shared_delete(conn, lname);
+
+	if (is_directory) {
+		prefix = string_tdb_data(talloc_asprintf(
+			lname, "%s/%s/", conn->connectpath, lname));
+		if (prefix.dptr != NULL) {
+			dbwrap_traverse(stat_cache_shared_db,
+					stat_cache_shared_delete_prefix_fn,
+					&prefix, NULL);
+		}
+	}
+	TALLOC_FREE(lname);
+
+	stat_cache_shared_pending.invalidations += 1;
+	stat_cache_shared_flush_stats(false);
+}
+
+/****************************************************************************
+ Get the counters of the shared stat cache for smbstatus.
+*****************************************************************************/
+
+bool stat_cache_shared_statistics(struct stat_cache_shared_stats *stats)
+{
+	uint64_t counters[7] = { 0, };
+	TDB_DATA value;
+	NTSTATUS status;
+	size_t i;
+
+	if (stat_cache_shared_db == NULL) {
+		return false;
+	}
+
+	status = dbwrap_fetch(stat_cache_shared_db, talloc_tos(),
+			      string_tdb_data(STAT_CACHE_SHARED_STATS_KEY),
+			      &value);
+	if (NT_STATUS_IS_OK(status)) {
+		if (value.dsize == STAT_CACHE_SHARED_STATS_LEN) {
+			for (i = 0; i < ARRAY_SIZE(counters); i++) {
+				counters[i] = BVAL(value.dptr,
+						   i * sizeof(uint64_t));
+			}
+		}
+		TALLOC_FREE(value.dptr);
+	}
+
+	*stats = (struct stat_cache_shared_stats) {
+		.lookups = counters[0],
+		.hits = counters[1],
+		.misses = counters[2],
+		.adds = counters[3],
+		.invalidations = counters[4],
+		.purges = counters[5],
+		.bytes = counters[6],
+	};
+
+	return true;
+}
+
 /**
  * Add an entry into the stat cache.
  *
+ * @param conn                 The connection the name was looked up in
  * @param full_orig_name       The original name as specified by the client
  * @param orig_translated_path The name on our filesystem.
  *
@@ -43,10 +381,11 @@
  *
  */
 
-void stat_cache_add( const char *full_orig_name,
-		char *translated_path,
-		bool case_sensitive)
+void stat_cache_add(connection_struct *conn,
+		    const char *full_orig_name,
+		    char *translated_path)
 {
+	bool case_sensitive = conn->case_sensitive;
 	size_t translated_path_length;
 	char *original_path;
 	size_t original_path_length;
@@ -131,10 +470,19 @@ void stat_cache_add( const char *full_orig_name,
 	 * New entry or replace old entry.
 	 */
 
-	memcache_add(
-		smbd_memcache(), STAT_CACHE,
-		data_blob_const(original_path, original_path_length),
-		data_blob_const(translated_path, translated_path_length + 1));
+	if (stat_cache_shared_db != NULL) {
+		stat_cache_shared_store(conn, original_path,
+					original_path_length,
+					translated_path,
+					translated_path_length);
+		stat_cache_shared_flush_stats(false);
+	} else {
+		memcache_add(
+			smbd_memcache(), STAT_CACHE,
+			data_blob_const(original_path, original_path_length),
+			data_blob_const(translated_path,
+					translated_path_length + 1));
+	}
 
 	DEBUG(5,("stat_cache_add: Added entry (%lx:size %x) %s -> %s\n",
 		 (unsigned long)translated_path,
@@ -197,6 +545,11 @@ bool stat_cache_lookup(connection_struct *conn,
 
 	DO_PROFILE_INC(statcache_lookups);
 
+	if (stat_cache_shared_db != NULL) {
+		stat_cache_shared_pending.lookups += 1;
+		stat_cache_shared_flush_stats(false);
+	}
+
 	/*
 	 * Don't lookup trivial valid directory entries.
 	 */
@@ -233,10 +586,16 @@ bool stat_cache_lookup(connection_struct *conn,
 
 		data_val = data_blob_null;
 
-		if (memcache_lookup(
-			    smbd_memcache(), STAT_CACHE,
-			    data_blob_const(chk_name, strlen(chk_name)),
-			    &data_val)) {
+		if (stat_cache_shared_db != NULL) {
+			if (stat_cache_shared_fetch(ctx, conn, chk_name,
+						    strlen(chk_name),
+						    &data_val)) {
+				break;
+			}
+		} else if (memcache_lookup(
+				   smbd_memcache(), STAT_CACHE,
+				   data_blob_const(chk_name, strlen(chk_name)),
+				   &data_val)) {
 			break;
 		}
 
@@ -250,6 +609,7 @@ bool stat_cache_lookup(connection_struct *conn,
 			 * We reached the end of the name - no match.
 			 */
 			DO_PROFILE_INC(statcache_misses);
+			stat_cache_shared_pending.misses += 1;
 			TALLOC_FREE(chk_name);
 			return False;
 		}
@@ -268,6 +628,7 @@ bool stat_cache_lookup(connection_struct *conn,
 		if ((*chk_name == '\0')
 		    || ISDOT(chk_name) || ISDOTDOT(chk_name)) {
 			DO_PROFILE_INC(statcache_misses);
+			stat_cache_shared_pending.misses += 1;
 			TALLOC_FREE(chk_name);
 			return False;
 		}
@@ -278,10 +639,14 @@ bool stat_cache_lookup(connection_struct *conn,
 		smb_panic("talloc failed");
 	}
 	translated_path_length = data_val.length - 1;
+	if (stat_cache_shared_db != NULL) {
+		data_blob_free(&data_val);
+	}
 
 	DEBUG(10,("stat_cache_lookup: lookup succeeded for name [%s] "
 		  "-> [%s]\n", chk_name, translated_path ));
 	DO_PROFILE_INC(statcache_hits);
+	stat_cache_shared_pending.hits += 1;
 
 	ZERO_STRUCT(smb_fname);
 	smb_fname.base_name = translated_path;
@@ -294,8 +659,13 @@ bool stat_cache_lookup(connection_struct *conn,
 
 	if (ret != 0) {
 		/* Discard this entry - it doesn't exist in the filesystem. */
-		memcache_delete(smbd_memcache(), STAT_CACHE,
-				data_blob_const(chk_name, strlen(chk_name)));
+		if (stat_cache_shared_db != NULL) {
+			stat_cache_shared_delete(conn, chk_name);
+		} else {
+			memcache_delete(smbd_memcache(), STAT_CACHE,
+					data_blob_const(chk_name,
+							strlen(chk_name)));
+		}
 		TALLOC_FREE(chk_name);
 		TALLOC_FREE(translated_path);
 		return False;
@@ -346,12 +716,20 @@ bool stat_cache_lookup(connection_struct *conn,
 }
 
 /***************************************************************************
- Tell all smbd's to delete an entry.
+ Tell all smbd's to delete the entry of fsp. The shared stat cache
+ deletes it right away.
 **************************************************************************/
 
 void smbd_send_stat_cache_delete_message(struct messaging_context *msg_ctx,
-					 const char *name)
+					 files_struct *fsp)
 {
+	const char *name = fsp->fsp_name->base_name;
+
+	if (stat_cache_shared_db != NULL) {
+		stat_cache_shared_invalidate(fsp->conn, name,
+					     fsp->is_directory);
+		return;
+	}
 #ifdef DEVELOPER
 	message_send_all(msg_ctx,
 			MSG_SMB_STAT_CACHE_DELETE,
@@ -483,12 +483,162 @@ static bool print_notify_rec(const char *path, struct server_id server,
 	return true;
 }
 
+struct smb2_credits_state {
+	struct server_id *pids;
+	size_t num_pids;
+	size_t num_replies;
+};
+
+static int collect_smb2_pids(const char *key, struct sessionid *session,
+			     void *private_data)
+{
+	struct smb2_credits_state *state =
+		(struct smb2_credits_state *)private_data;
+	struct server_id *tmp;
+	size_t i;
+
+	if (session->connection_dialect < SMB2_DIALECT_REVISION_202) {
+		return 0;
+	}
+
+	for (i = 0; i < state->num_pids; i++) {
+		if (server_id_equal(&state->pids[i], &session->pid)) {
+			return 0;
+		}
+	}
+
+	tmp = talloc_realloc(NULL, state->pids, struct server_id,
+			     state->num_pids + 1);
+	if (tmp == NULL) {
+		return -1;
+	}
+	state->pids = tmp;
+	state->pids[state->num_pids] = session->pid;
+	state->num_pids += 1;
+
+	return 0;
+}
+
+static void print_smb2_credits(struct messaging_context *msg_ctx,
+			       void *private_data,
+			       uint32_t msg_type,
+			       struct server_id pid,
+			       DATA_BLOB *data)
+{
+	struct smb2_credits_state *state =
+		(struct smb2_credits_state *)private_data;
+
+	if (data->length > 0) {
+		d_printf("%.*s", (int)strnlen((const char *)data->data,
+					      data->length),
+			 (const char *)data->data);
+	}
+	state->num_replies += 1;
+}
+
+static void show_smb2_credits_timeout(struct tevent_context *ev,
+				      struct tevent_timer *te,
+				      struct timeval current_time,
+				      void *private_data)
+{
+	bool *timed_out = (bool *)private_data;
+
+	*timed_out = true;
+}
+
+static bool show_smb2_credits(struct messaging_context *msg_ctx)
+{
+	struct tevent_context *ev = messaging_tevent_context(msg_ctx);
+	struct smb2_credits_state state = { .num_pids = 0, };
+	struct tevent_timer *te = NULL;
+	bool timed_out = false;
+	size_t i, num_sent = 0;
+	NTSTATUS status;
+
+	status = sessionid_traverse_read(collect_smb2_pids, &state);
+	if (!NT_STATUS_IS_OK(status)) {
+		TALLOC_FREE(state.pids);
+		return false;
+	}
+
+	messaging_register(msg_ctx, &state, MSG_SMBXSRV_CONNECTION_STATS,
+			   print_smb2_credits);
+
+	d_printf("\n%-7s %-25s %11s %7s %7s %11s %8s %8s %8s %17s %8s\n",
+		 "PID", "Client", "Window/Max", "Granted", "Pending",
+		 "Queue/Max", "Lat(us)", "Requests", "Credits", "Grow/Shrink",
+		 "Reorder");
+	d_printf("----------------------------------------------------------"
+		 "----------------------------------------------------------"
+		 "---------------\n");
+
+	for (i = 0; i < state.num_pids; i++) {
+		status = messaging_send(msg_ctx, state.pids[i],
+					MSG_SMBXSRV_REQ_CONNECTION_STATS,
+					&data_blob_null);
+		if (NT_STATUS_IS_OK(status)) {
+			num_sent += 1;
+		}
+	}
+
+	te = tevent_add_timer(ev, NULL, timeval_current_ofs(5, 0),
+			      show_smb2_credits_timeout, &timed_out);
+	if (te == NULL) {
+		num_sent = 0;
+	}
+
+	while ((state.num_replies < num_sent) && !timed_out) {
+		if (tevent_loop_once(ev) != 0) {
+			break;
+		}
+	}
+	TALLOC_FREE(te);
+
+	messaging_deregister(msg_ctx, MSG_SMBXSRV_CONNECTION_STATS, &state);
+	TALLOC_FREE(state.pids);
+
+	return true;
+}
+
+static bool show_stat_cache(void)
+{
+	struct stat_cache_shared_stats stats;
+	double hit_rate = 0.0;
+
+	if (!stat_cache_shared_init(true) ||
+	    !stat_cache_shared_statistics(&stats)) {
+		d_printf("The shared stat cache is not in use\n");
+		return false;
+	}
+
+	if (stats.lookups != 0) {
+		hit_rate = 100.0 * stats.hits / stats.lookups;
+	}
+
+	d_printf("\nShared stat cache\n");
+	d_printf("-----------------\n");
+	d_printf("Lookups:       %llu\n", (unsigned long long)stats.lookups);
+	d_printf("Hits:          %llu (%.1f%%)\n",
+		 (unsigned long long)stats.hits, hit_rate);
+	d_printf("Misses:        %llu\n", (unsigned long long)stats.misses);
+	d_printf("Adds:          %llu\n", (unsigned long long)stats.adds);
+	d_printf("Invalidations: %llu\n",
+		 (unsigned long long)stats.invalidations);
+	d_printf("Purges:        %llu\n", (unsigned long long)stats.purges);
+	d_printf("Size:          %llu bytes\n",
+		 (unsigned long long)stats.bytes);
+
+	return true;
+}
+
 int main(int argc, const char *argv[])
 {
 	int c;
 	int profile_only = 0;
 	bool show_processes, show_locks, show_shares;
 	bool show_notify = false;
+	bool show_credits = false;
+	bool show_statcache = false;
 	poptContext pc;
 	struct poptOption long_options[] = {
 		POPT_AUTOHELP
@@ -504,6 +654,8 @@ int main(int argc, const char *argv[])
 		{"byterange",	'B', POPT_ARG_NONE,	NULL, 'B', "Include byte range locks"},
 		{"numeric",	'n', POPT_ARG_NONE,	NULL, 'n', "Numeric uid/gid"},
 		{"fast",	'f', POPT_ARG_NONE,	NULL, 'f', "Skip checks if processes still exist"},
+		{"smb2-credits", 'C', POPT_ARG_NONE,	NULL, 'C', "Show SMB2 credit and queue statistics"},
+		{"stat-cache",	'c', POPT_ARG_NONE,	NULL, 'c', "Show shared stat cache statistics"},
 		POPT_COMMON_SAMBA
 		POPT_TABLEEND
 	};
@@ -571,6 +723,12 @@ int main(int argc, const char *argv[])
 		case 'f':
 			do_checks = false;
 			break;
+		case 'C':
+			show_credits = true;
+			break;
+		case 'c':
+			show_statcache = true;
+			break;
 		}
 	}
 
@@ -613,6 +771,18 @@ int main(int argc, const char *argv[])
 		goto done;
 	}
 
+	if (show_credits) {
+		ok = show_smb2_credits(msg_ctx);
+		ret = ok ? 0 : 1;
+		goto done;
+	}
+
+	if (show_statcache) {
+		ok = show_stat_cache();
+		ret = ok ? 0 : 1;
+		goto done;
+	}
+
 	switch (profile_only) {
 		case 'P':
 			/* Dump profile data */
@@ -1244,6 +1244,171 @@ static bool torture_ldb_unpack_only_attr_list(struct torture_context *torture)
 	return true;
 }
 
+static bool torture_ldb_unpack_no_data_alloc(struct torture_context *torture)
+{
+	TALLOC_CTX *mem_ctx = talloc_new(torture);
+	struct ldb_context *ldb;
+	struct ldb_val data = data_blob_const(dda1d01d_bin, sizeof(dda1d01d_bin));
+	struct ldb_message *msg = ldb_msg_new(mem_ctx);
+	struct ldb_message *msg2 = ldb_msg_new(mem_ctx);
+	const char *lookup_names[] = {"instanceType", "name"};
+	unsigned int i, j;
+
+	torture_assert(torture,
+		       ldb=samba_ldb_init(mem_ctx, torture->ev, NULL, NULL, NULL),
+		       "Failed to init samba");
+
+	torture_assert_int_equal(torture, ldb_unpack_data(ldb, &data, msg), 0,
+				 "ldb_unpack_data failed");
+	torture_assert_int_equal(torture,
+				 ldb_unpack_data_only_attr_list_flags(ldb, &data, msg2,
+							NULL, 0,
+							LDB_UNPACK_DATA_FLAG_NO_DATA_ALLOC,
+							NULL), 0,
+				 "ldb_unpack_data_only_attr_list_flags failed");
+
+	torture_assert(torture,
+		       helper_ldb_message_compare(torture, msg, msg2),
+		       "Unpacked messages differ");
+
+	/* Everything points into the packed data */
+	for (i = 0; i < msg2->num_elements; i++) {
+		struct ldb_message_element *el = &msg2->elements[i];
+
+		torture_assert(torture,
+			       (const uint8_t *)el->name > data.data &&
+			       (const uint8_t *)el->name < data.data + data.length,
+			       "Element name was copied");
+		for (j = 0; j < el->num_values; j++) {
+			torture_assert(torture,
+				       el->values[j].data > data.data &&
+				       el->values[j].data + el->values[j].length <
+				       data.data + data.length,
+				       "Value was copied");
+			torture_assert_int_equal(torture,
+						 el->values[j].data[el->values[j].length],
+						 0, "Value is not terminated");
+		}
+	}
+
+	/* Also with a list of attributes */
+	talloc_free(msg2);
+	msg2 = ldb_msg_new(mem_ctx);
+	torture_assert_int_equal(torture,
+				 ldb_unpack_data_only_attr_list_flags(ldb, &data, msg2,
+							lookup_names,
+							ARRAY_SIZE(lookup_names),
+							LDB_UNPACK_DATA_FLAG_NO_DATA_ALLOC,
+							NULL), 0,
+				 "ldb_unpack_data_only_attr_list_flags failed");
+	torture_assert_int_equal(torture, msg2->num_elements, 2,
+				 "Got wrong number of parsed elements");
+	torture_assert_str_equal(torture, msg2->elements[0].name, "instanceType",
+				 "First element has wrong name");
+	torture_assert_mem_equal(torture, msg2->elements[0].values[0].data,
+				 "4", 1,
+				 "First element's value is incorrect");
+	torture_assert_str_equal(torture, msg2->elements[1].name, "name",
+				 "Second element has wrong name");
+
+	return true;
+}
+
+static bool torture_ldb_match_compiled(struct torture_context *torture)
+{
+	TALLOC_CTX *mem_ctx = talloc_new(torture);
+	const char *ldif_text = dda1d01d_ldif;
+	struct ldb_context *ldb;
+	struct ldb_ldif *ldif;
+	struct ldb_dn *base;
+	unsigned int i;
+	struct {
+		const char *filter;
+		bool matched;
+	} tests[] = {
+		{ "(objectClass=container)", true },
+		{ "(objectClass=CONTAINER)", true },
+		{ "(cn=dda1d01d-*)", true },
+		{ "(cn=*4bd7*a184*)", true },
+		{ "(cn=*4bd7*4bd7*)", false },
+		{ "(instanceType>=4)", true },
+		{ "(instanceType<=3)", false },
+		{ "(uSNChanged=*)", true },
+		{ "(!(description=*))", true },
+		{ "(!(name=*))", false },
+		{ "(&(objectClass=top)(|(instanceType=5)(showInAdvancedViewOnly=TRUE)))", true },
+		{ "(&(objectClass=top)(!(cn=dda1d01d*)))", false },
+		{ "(managedBy=cn=admin,dc=addc,dc=samba,dc=example,dc=com)", true },
+		{ "(managedBy=CN=Other,DC=addc,DC=samba,DC=example,DC=com)", false },
+		{ "(managedBy=not a dn)", false },
+		{ "(managedBy<=not a dn)", true },
+		{ "(dn=CN=dda1d01d-4bd7-4c49-a184-46f9241b560e,CN=Operations,CN=DomainUpdates,CN=System,DC=addc,DC=samba,DC=example,DC=com)", true },
+		{ "(uSNCreated:1.2.840.113556.1.4.803:=3)", true },
+		{ "(uSNCreated:1.2.840.113556.1.4.803:=4)", false },
+	};
+
+	torture_assert(torture,
+		       ldb=samba_ldb_init(mem_ctx, torture->ev, NULL, NULL, NULL),
+		       "Failed to init ldb");
+	torture_assert_int_equal(torture,
+				 ldb_schema_attribute_add(ldb, "managedBy", 0,
+							  LDB_SYNTAX_DN),
+				 LDB_SUCCESS,
+				 "ldb_schema_attribute_add failed");
+
+	torture_assert(torture,
+		       ldif = ldb_ldif_read_string(ldb, &ldif_text),
+		       "ldb_ldif_read_string failed");
+	torture_assert_int_equal(torture,
+				 ldb_msg_add_string(ldif->msg, "managedBy",
+					"CN=Admin,DC=addc,DC=samba,DC=example,DC=com"),
+				 LDB_SUCCESS, "ldb_msg_add_string failed");
+	base = ldb_dn_new(mem_ctx, ldb, "DC=addc,DC=samba,DC=example,DC=com");
+
+	for (i = 0; i < ARRAY_SIZE(tests); i++) {
+		struct ldb_parse_tree *tree;
+		struct ldb_match_program *program;
+		bool matched, matched2;
+		unsigned int j;
+
+		tree = ldb_parse_tree(mem_ctx, tests[i].filter);
+		torture_assert(torture, tree != NULL, tests[i].filter);
+
+		torture_assert_int_equal(torture,
+					 ldb_match_compile(ldb, mem_ctx, tree,
+							   &program),
+					 LDB_SUCCESS, tests[i].filter);
+
+		/* a program is good for many records */
+		for (j = 0; j < 2; j++) {
+			torture_assert_int_equal(torture,
+				ldb_match_msg_compiled(program, ldif->msg,
+						       base,
+						       LDB_SCOPE_SUBTREE,
+						       &matched),
+				LDB_SUCCESS, tests[i].filter);
+			torture_assert(torture, matched == tests[i].matched,
+				       tests[i].filter);
+		}
+
+		torture_assert_int_equal(torture,
+			ldb_match_msg_error(ldb, ldif->msg, tree, base,
+					    LDB_SCOPE_SUBTREE, &matched2),
+			LDB_SUCCESS, tests[i].filter);
+		torture_assert(torture, matched2 == matched, tests[i].filter);
+
+		/* not in scope */
+		torture_assert_int_equal(torture,
+			ldb_match_msg_compiled(program, ldif->msg,
+					       base, LDB_SCOPE_ONELEVEL,
+					       &matched),
+			LDB_SUCCESS, tests[i].filter);
+		torture_assert(torture, !matched, tests[i].filter);
+	}
+
+	return true;
+}
+
 struct torture_suite *torture_ldb(TALLOC_CTX *mem_ctx)
 {
 	struct torture_suite *suite = torture_suite_create(mem_ctx, "ldb");
@@ -1265,6 +1430,10 @@ struct torture_suite *torture_ldb(TALLOC_CTX *mem_ctx)
 				      torture_ldb_parse_ldif);
 	torture_suite_add_simple_test(suite, "unpack-data-only-attr-list",
 				      torture_ldb_unpack_only_attr_list);
+	torture_suite_add_simple_test(suite, "unpack-data-no-data-alloc",
+				      torture_ldb_unpack_no_data_alloc);
+	torture_suite_add_simple_test(suite, "match-compiled",
+				      torture_ldb_match_compiled);
 
 	suite->description = talloc_strdup(suite, "LDB (samba-specific behaviour) tests");
 
@@ -0,0 +1,361 @@
+/*
+   Unix SMB/CIFS implementation.
+
+   SMB2 throughput benchmarks
+
+   Copyright (C) Samba Team 2026
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "includes.h"
+#include "libcli/smb2/smb2.h"
+#include "libcli/smb2/smb2_calls.h"
+
+#include "torture/torture.h"
+#include "torture/smb2/proto.h"
+
+#define FNAME "smb2_bench_rw.dat"
+#define DNAME "smb2_bench_querydir"
+
+/*
+  keep "qdepth" reads or writes of "iosize" bytes in flight on one
+  handle for "timelimit" seconds, wrapping around within the first
+  "filesize" bytes of the file. This is meant to compare async I/O
+  backends of the server (vfs_aio_pthread, vfs_io_uring, ...)
+*/
+struct bench_rw_state {
+	struct torture_context *tctx;
+	struct smb2_tree *tree;
+	struct smb2_handle h;
+	bool do_write;
+	DATA_BLOB buf;
+	uint64_t file_size;
+	uint64_t next_offset;
+	uint64_t data_end;
+	unsigned num_outstanding;
+	uint64_t num_bytes;
+	uint64_t num_ops;
+	bool stop;
+	NTSTATUS status;
+};
+
+static void bench_rw_done(struct smb2_request *req);
+
+static bool bench_rw_submit(struct bench_rw_state *state)
+{
+	struct smb2_request *req;
+
+	if (state->next_offset + state->buf.length > state->file_size) {
+		state->next_offset = 0;
+	}
+
+	if (state->do_write) {
+		struct smb2_write wr;
+
+		ZERO_STRUCT(wr);
+		wr.in.file.handle = state->h;
+		wr.in.offset = state->next_offset;
+		wr.in.data = state->buf;
+		req = smb2_write_send(state->tree, &wr);
+		state->data_end = MAX(state->data_end,
+				      state->next_offset + state->buf.length);
+	} else {
+		struct smb2_read rd;
+
+		ZERO_STRUCT(rd);
+		rd.in.file.handle = state->h;
+		rd.in.length = state->buf.length;
+		rd.in.offset = state->next_offset;
+		req = smb2_read_send(state->tree, &rd);
+	}
+	if (req == NULL) {
+		state->status = NT_STATUS_NO_MEMORY;
+		state->stop = true;
+		return false;
+	}
+	req->async.fn = bench_rw_done;
+	req->async.private_data = state;
+
+	state->next_offset += state->buf.length;
+	state->num_outstanding += 1;
+	return true;
+}
+
+static void bench_rw_done(struct smb2_request *req)
+{
+	struct bench_rw_state *state = talloc_get_type_abort(
+		req->async.private_data, struct bench_rw_state);
+	NTSTATUS status;
+
+	state->num_outstanding -= 1;
+
+	if (state->do_write) {
+		struct smb2_write wr;
+
+		ZERO_STRUCT(wr);
+		status = smb2_write_recv(req, &wr);
+		if (NT_STATUS_IS_OK(status)) {
+			state->num_bytes += wr.out.nwritten;
+		}
+	} else {
+		struct smb2_read rd;
+
+		ZERO_STRUCT(rd);
+		status = smb2_read_recv(req, state, &rd);
+		if (NT_STATUS_IS_OK(status)) {
+			state->num_bytes += rd.out.data.length;
+			data_blob_free(&rd.out.data);
+		}
+	}
+	if (!NT_STATUS_IS_OK(status)) {
+		state->status = status;
+		state->stop = true;
+		return;
+	}
+	state->num_ops += 1;
+
+	if (!state->stop) {
+		bench_rw_submit(state);
+	}
+}
+
+static bool bench_rw_run(struct bench_rw_state *state, int qdepth,
+			 int timelimit)
+{
+	struct torture_context *tctx = state->tctx;
+	struct timeval tv;
+	double secs;
+	int i;
+
+	state->num_bytes = 0;
+	state->num_ops = 0;
+	state->next_offset = 0;
+	state->stop = false;
+	state->status = NT_STATUS_OK;
+
+	tv = timeval_current();
+
+	for (i=0; i<qdepth; i++) {
+		if (!bench_rw_submit(state)) {
+			break;
+		}
+	}
+
+	while (state->num_outstanding > 0) {
+		if (tevent_loop_once(tctx->ev) != 0) {
+			torture_comment(tctx, "tevent_loop_once failed\n");
+			return false;
+		}
+		if (timeval_elapsed(&tv) >= timelimit) {
+			state->stop = true;
+		}
+	}
+
+	torture_assert_ntstatus_ok(tctx, state->status,
+				   state->do_write ? "write failed" :
+				   "read failed");
+
+	secs = timeval_elapsed(&tv);
+	torture_comment(tctx, "%s: %.2f MB/s, %.0f ops/second "
+			"(qdepth %d, iosize %u)\n",
+			state->do_write ? "write" : "read",
+			state->num_bytes / secs / (1024 * 1024),
+			state->num_ops / secs, qdepth,
+			(unsigned)state->buf.length);
+
+	return true;
+}
+
+static bool test_bench_rw(struct torture_context *tctx,
+			  struct smb2_tree *tree)
+{
+	bool ret = true;
+	NTSTATUS status;
+	struct bench_rw_state *state;
+	int qdepth = torture_setting_int(tctx, "qdepth", 16);
+	int timelimit = torture_setting_int(tctx, "timelimit", 10);
+	unsigned long iosize = torture_setting_ulong(tctx, "iosize", 65536);
+	unsigned long filesize = torture_setting_ulong(tctx, "filesize",
+						       256 * 1024 * 1024);
+
+	torture_assert(tctx, qdepth > 0, "qdepth must be positive");
+	torture_assert(tctx, iosize > 0 && iosize <= filesize,
+		       "iosize must be between 1 and filesize");
+
+	state = talloc_zero(tctx, struct bench_rw_state);
+	torture_assert(tctx, state != NULL, "talloc failed");
+	state->tctx = tctx;
+	state->tree = tree;
+	state->file_size = filesize;
+
+	state->buf = data_blob_talloc(state, NULL, iosize);
+	torture_assert(tctx, state->buf.data != NULL, "talloc failed");
+	memset(state->buf.data, 0x42, state->buf.length);
+
+	smb2_util_unlink(tree, FNAME);
+
+	status = torture_smb2_testfile(tree, FNAME, &state->h);
+	torture_assert_ntstatus_ok(tctx, status, "create failed");
+
+	torture_comment(tctx, "Running for %d seconds per direction\n",
+			timelimit);
+
+	/*
+	 * The write phase also makes sure there's data to read back.
+	 */
+	state->do_write = true;
+	if (!bench_rw_run(state, qdepth, timelimit)) {
+		ret = false;
+		goto done;
+	}
+
+	/*
+	 * Only read back what the write phase produced, a short write
+	 * phase must not make us read beyond EOF.
+	 */
+	state->file_size = state->data_end;
+	state->do_write = false;
+	if (!bench_rw_run(state, qdepth, timelimit)) {
+		ret = false;
+		goto done;
+	}
+
+done:
+	smb2_util_close(tree, state->h);
+	smb2_util_unlink(tree, FNAME);
+	talloc_free(state);
+	return ret;
+}
+
+/*
+  list a directory of "numfiles" files again and again for "timelimit"
+  seconds, the way a client lists a folder. This is meant to compare
+  the cost of the server's per entry work (stat, DOS attributes) with
+  and without vfs_readdir_prefetch.
+*/
+static bool bench_querydir_list(struct torture_context *tctx,
+				struct smb2_tree *tree,
+				uint64_t *num_entries)
+{
+	TALLOC_CTX *frame = talloc_stackframe();
+	struct smb2_handle h;
+	struct smb2_find f;
+	NTSTATUS status;
+	bool ret = true;
+
+	status = torture_smb2_testdir(tree, DNAME, &h);
+	torture_assert_ntstatus_ok_goto(tctx, status, ret, done,
+					"open dir failed");
+
+	ZERO_STRUCT(f);
+	f.in.file.handle = h;
+	f.in.pattern = "*";
+	f.in.continue_flags = SMB2_CONTINUE_FLAG_RESTART;
+	f.in.max_response_size = 0x10000;
+	f.in.level = SMB2_FIND_ID_BOTH_DIRECTORY_INFO;
+
+	while (true) {
+		union smb_search_data *d;
+		unsigned int count;
+
+		status = smb2_find_level(tree, frame, &f, &count, &d);
+		if (NT_STATUS_EQUAL(status, STATUS_NO_MORE_FILES)) {
+			break;
+		}
+		torture_assert_ntstatus_ok_goto(tctx, status, ret, close_dir,
+						"find failed");
+		*num_entries += count;
+		f.in.continue_flags = 0;
+		TALLOC_FREE(d);
+	}
+
+close_dir:
+	smb2_util_close(tree, h);
+done:
+	TALLOC_FREE(frame);
+	return ret;
+}
+
+static bool test_bench_querydir(struct torture_context *tctx,
+				struct smb2_tree *tree)
+{
+	bool ret = true;
+	NTSTATUS status;
+	int numfiles = torture_setting_int(tctx, "numfiles", 100000);
+	int timelimit = torture_setting_int(tctx, "timelimit", 10);
+	uint64_t num_entries = 0;
+	unsigned num_listings = 0;
+	struct timeval tv;
+	double secs;
+	int i;
+
+	torture_assert(tctx, numfiles > 0, "numfiles must be positive");
+
+	smb2_deltree(tree, DNAME);
+
+	status = smb2_util_mkdir(tree, DNAME);
+	torture_assert_ntstatus_ok(tctx, status, "mkdir failed");
+
+	torture_comment(tctx, "Creating %d files\n", numfiles);
+
+	for (i = 0; i < numfiles; i++) {
+		struct smb2_handle h;
+		char *fname;
+
+		fname = talloc_asprintf(tctx, DNAME "\\file%d.dat", i);
+		torture_assert_goto(tctx, fname != NULL, ret, done,
+				    "talloc failed");
+
+		status = torture_smb2_testfile(tree, fname, &h);
+		TALLOC_FREE(fname);
+		torture_assert_ntstatus_ok_goto(tctx, status, ret, done,
+						"create failed");
+		smb2_util_close(tree, h);
+	}
+
+	torture_comment(tctx, "Listing for %d seconds\n", timelimit);
+
+	tv = timeval_current();
+
+	do {
+		if (!bench_querydir_list(tctx, tree, &num_entries)) {
+			ret = false;
+			goto done;
+		}
+		num_listings += 1;
+	} while (timeval_elapsed(&tv) < timelimit);
+
+	secs = timeval_elapsed(&tv);
+	torture_comment(tctx, "querydir: %.0f entries/second, "
+			"%.2f seconds per listing of %d files\n",
+			num_entries / secs, secs / num_listings, numfiles);
+
+done:
+	smb2_deltree(tree, DNAME);
+	return ret;
+}
+
+struct torture_suite *torture_smb2_bench_init(void)
+{
+	struct torture_suite *suite = torture_suite_create(
+		talloc_autofree_context(), "bench");
+
+	torture_suite_add_1smb2_test(suite, "rw", test_bench_rw);
+	torture_suite_add_1smb2_test(suite, "querydir", test_bench_querydir);
+
+	suite->description = talloc_strdup(suite, "SMB2 throughput benchmarks");
+
+	return suite;
+}
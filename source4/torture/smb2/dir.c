@@ -1379,6 +1379,117 @@ done:
 	return ret;
 }
 
+/*
+  test that a search cancelled in the middle doesn't lose entries
+*/
+
+static bool test_cancel(struct torture_context *tctx,
+			struct smb2_tree *tree)
+{
+	TALLOC_CTX *mem_ctx = talloc_new(tctx);
+	const int num_files = 1000;
+	bool found[1000] = {};
+	bool ret = true;
+	NTSTATUS status;
+	struct smb2_create create;
+	struct smb2_find f;
+	struct smb2_handle h;
+	struct smb2_request *req;
+	union smb_search_data *d;
+	int i, file_count = 0;
+	unsigned count;
+
+	torture_comment(tctx,
+	    "Testing cancel of a directory enumeration in progress\n");
+
+	smb2_deltree(tree, DNAME);
+
+	ZERO_STRUCT(create);
+	create.in.desired_access = SEC_RIGHTS_DIR_ALL;
+	create.in.create_options = NTCREATEX_OPTIONS_DIRECTORY;
+	create.in.file_attributes = FILE_ATTRIBUTE_DIRECTORY;
+	create.in.share_access = NTCREATEX_SHARE_ACCESS_READ |
+				 NTCREATEX_SHARE_ACCESS_WRITE |
+				 NTCREATEX_SHARE_ACCESS_DELETE;
+	create.in.create_disposition = NTCREATEX_DISP_CREATE;
+	create.in.fname = DNAME;
+
+	status = smb2_create(tree, mem_ctx, &create);
+	torture_assert_ntstatus_ok_goto(tctx, status, ret, done, "");
+	h = create.out.file.handle;
+
+	ZERO_STRUCT(create);
+	create.in.desired_access = SEC_RIGHTS_FILE_ALL;
+	create.in.file_attributes = FILE_ATTRIBUTE_NORMAL;
+	create.in.create_disposition = NTCREATEX_DISP_CREATE;
+
+	for (i = 0; i < num_files; i++) {
+		create.in.fname = talloc_asprintf(mem_ctx, "%s\\t%04d",
+						  DNAME, i);
+		status = smb2_create(tree, mem_ctx, &create);
+		torture_assert_ntstatus_ok_goto(tctx, status, ret, done, "");
+		smb2_util_close(tree, create.out.file.handle);
+	}
+
+	ZERO_STRUCT(f);
+	f.in.file.handle        = h;
+	f.in.pattern            = "*";
+	f.in.max_response_size  = 0x10000;
+	f.in.level              = SMB2_FIND_BOTH_DIRECTORY_INFO;
+
+	/*
+	 * The server may or may not have answered the search before
+	 * the cancel arrives, both is fine as long as the entries
+	 * are not lost.
+	 */
+	req = smb2_find_send(tree, &f);
+	torture_assert_goto(tctx, req != NULL, ret, done,
+			    "smb2_find_send failed\n");
+	smb2_cancel(req);
+
+	status = smb2_find_level_recv(req, mem_ctx, f.in.level, &count, &d);
+	if (NT_STATUS_EQUAL(status, NT_STATUS_CANCELLED)) {
+		count = 0;
+	} else {
+		torture_assert_ntstatus_ok_goto(tctx, status, ret, done, "");
+	}
+
+	f.in.continue_flags = 0;
+
+	while (true) {
+		for (i = 0; i < count; i++) {
+			const char *name = d[i].both_directory_info.name.s;
+			int n;
+
+			if (!strcmp(name, ".") || !strcmp(name, ".."))
+				continue;
+
+			torture_assert_goto(tctx,
+			    (sscanf(name, "t%04d", &n) == 1) &&
+			    (n >= 0) && (n < num_files) && !found[n],
+			    ret, done,
+			    talloc_asprintf(tctx, "unexpected or duplicate "
+					    "entry %s\n", name));
+			found[n] = true;
+			file_count++;
+		}
+
+		status = smb2_find_level(tree, tree, &f, &count, &d);
+		if (NT_STATUS_EQUAL(status, STATUS_NO_MORE_FILES))
+			break;
+		torture_assert_ntstatus_ok_goto(tctx, status, ret, done, "");
+	}
+
+	torture_assert_int_equal_goto(tctx, file_count, num_files, ret,
+				      done, "");
+done:
+	smb2_util_close(tree, h);
+	smb2_deltree(tree, DNAME);
+	talloc_free(mem_ctx);
+
+	return ret;
+}
+
 struct torture_suite *torture_smb2_dir_init(void)
 {
 	struct torture_suite *suite =
@@ -1392,6 +1503,7 @@ struct torture_suite *torture_smb2_dir_init(void)
 	torture_suite_add_1smb2_test(suite, "sorted", test_sorted);
 	torture_suite_add_1smb2_test(suite, "file-index", test_file_index);
 	torture_suite_add_1smb2_test(suite, "large-files", test_large_files);
+	torture_suite_add_1smb2_test(suite, "cancel", test_cancel);
 	suite->description = talloc_strdup(suite, "SMB2-DIR tests");
 
 	return suite;
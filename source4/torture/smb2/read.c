@@ -300,6 +300,71 @@ done:
 	return ret;
 }
 
+/*
+  Keep a lot of credits outstanding while the server shrinks its
+  credit window. Against smbd with "smbd:credit latency target = 0"
+  the window first grows while we only send keepalives, which don't
+  count for the latency, and then shrinks below the credits we hold
+  as soon as reads are answered. The server must not grant more than
+  its maximum then.
+*/
+static bool test_read_credit_window(struct torture_context *torture,
+				    struct smb2_tree *tree)
+{
+	bool ret = true;
+	NTSTATUS status;
+	struct smb2_transport *transport = tree->session->transport;
+	struct smb2_handle h;
+	uint8_t buf[64];
+	struct smb2_read rd;
+	TALLOC_CTX *tmp_ctx = talloc_new(tree);
+	int i;
+
+	ZERO_STRUCT(buf);
+
+	/* use few credits, the window grows */
+	smb2_transport_credits_ask_num(transport, 1);
+	for (i = 0; i < 2048; i++) {
+		status = smb2_keepalive(transport);
+		CHECK_STATUS(status, NT_STATUS_OK);
+	}
+
+	/* take as many credits as we get and keep them */
+	smb2_transport_credits_ask_num(transport, 8192);
+	for (i = 0; i < 128; i++) {
+		status = smb2_keepalive(transport);
+		CHECK_STATUS(status, NT_STATUS_OK);
+	}
+
+	smb2_util_unlink(tree, FNAME);
+
+	status = torture_smb2_testfile(tree, FNAME, &h);
+	CHECK_STATUS(status, NT_STATUS_OK);
+
+	status = smb2_util_write(tree, h, buf, 0, ARRAY_SIZE(buf));
+	CHECK_STATUS(status, NT_STATUS_OK);
+
+	/* the replies to the reads shrink the window */
+	for (i = 0; i < 1024; i++) {
+		ZERO_STRUCT(rd);
+		rd.in.file.handle = h;
+		rd.in.length = 1;
+		rd.in.offset = i % ARRAY_SIZE(buf);
+		status = smb2_read(tree, tmp_ctx, &rd);
+		CHECK_STATUS(status, NT_STATUS_OK);
+		CHECK_VALUE(rd.out.data.length, 1);
+		talloc_free(rd.out.data.data);
+	}
+
+	status = smb2_util_close(tree, h);
+	CHECK_STATUS(status, NT_STATUS_OK);
+
+done:
+	smb2_util_unlink(tree, FNAME);
+	talloc_free(tmp_ctx);
+	return ret;
+}
+
 /* 
    basic testing of SMB2 read
 */
@@ -311,6 +376,8 @@ struct torture_suite *torture_smb2_read_init(void)
 	torture_suite_add_1smb2_test(suite, "position", test_read_position);
 	torture_suite_add_1smb2_test(suite, "dir", test_read_dir);
 	torture_suite_add_1smb2_test(suite, "access", test_read_access);
+	torture_suite_add_1smb2_test(suite, "credit-window",
+				     test_read_credit_window);
 
 	suite->description = talloc_strdup(suite, "SMB2-READ tests");
 